@@ -0,0 +1,267 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <cmath>
+
+#include "aggregates.hpp"
+#include "dnsmessage.hpp"
+
+namespace {
+    /**
+     * \brief Names of the transports, in Transport order.
+     */
+    const char* const TRANSPORT_NAMES[] = {
+        "udp4",
+        "tcp4",
+        "udp6",
+        "tcp6",
+    };
+
+    /**
+     * \brief Write Space-Saving counters.
+     *
+     * Each counter is written as an array of the key, count and error.
+     *
+     * \param enc      the encoder.
+     * \param counters the counters.
+     * \param key      function writing a key.
+     */
+    template<typename Counters, typename WriteKey>
+    void write_counters(CborBaseEncoder& enc, const Counters& counters, WriteKey key)
+    {
+        enc.writeArrayHeader(counters.size());
+        for ( const auto& c : counters )
+        {
+            enc.writeArrayHeader(3);
+            key(c.key);
+            enc.write(c.count);
+            enc.write(c.error);
+        }
+    }
+
+    /**
+     * \brief Write an exact histogram as a map of value to count.
+     *
+     * \param enc  the encoder.
+     * \param hist the histogram.
+     */
+    void write_histogram(CborBaseEncoder& enc, const Aggregates::Histogram& hist)
+    {
+        enc.writeMapHeader(hist.size());
+        for ( const auto& h : hist )
+        {
+            enc.write(h.first);
+            enc.write(h.second);
+        }
+    }
+}
+
+const std::size_t HyperLogLog::REGISTERS;
+
+void HyperLogLog::merge(const HyperLogLog& other)
+{
+    for ( std::size_t i = 0; i < REGISTERS; ++i )
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+}
+
+uint64_t HyperLogLog::estimate() const
+{
+    const double m = REGISTERS;
+    double sum = 0;
+    unsigned zeros = 0;
+    for ( auto r : registers_ )
+    {
+        sum += std::ldexp(1.0, -r);
+        if ( r == 0 )
+            ++zeros;
+    }
+
+    double res = 0.7213 / ( 1 + 1.079 / m ) * m * m / sum;
+
+    // Small cardinalities are better estimated by linear counting.
+    if ( res <= 2.5 * m && zeros > 0 )
+        res = m * std::log(m / zeros);
+
+    return static_cast<uint64_t>(res + 0.5);
+}
+
+Aggregates::Aggregates(std::size_t top,
+                       const std::chrono::system_clock::time_point& start,
+                       const std::chrono::seconds& period,
+                       const PseudoAnonymise* pseudo_anon)
+    : top_(top), start_(start), period_(period), pseudo_anon_(pseudo_anon),
+      count_(0), unanswered_(0),
+      qnames_(top * COUNTERS_PER_TOP), clients_(top * COUNTERS_PER_TOP),
+      latency_sum_(0)
+{
+    transports_.fill(0);
+    latency_.fill(0);
+}
+
+void Aggregates::add(const QueryResponse& qr)
+{
+    const DNSMessage& d(qr.has_query() ? qr.query() : qr.response());
+
+    ++count_;
+#if ENABLE_PSEUDOANONYMISATION
+    if ( pseudo_anon_ )
+    {
+        IPAddress client(pseudo_anon_->address(d.clientIP));
+        clients_.add(client);
+        client_hll_.add(hash_value(client));
+    }
+    else
+#endif
+    {
+        clients_.add(d.clientIP);
+        client_hll_.add(hash_value(d.clientIP));
+    }
+    if ( d.clientIP.is_ipv6() )
+        ++transports_[d.tcp ? TCP_IPV6 : UDP_IPV6];
+    else
+        ++transports_[d.tcp ? TCP_IPV4 : UDP_IPV4];
+
+    for ( const auto& query : d.dns.queries() )
+    {
+        qnames_.add(fold_case(query.dname()));
+        ++qtypes_[query.query_type()];
+        break;
+    }
+
+    if ( !qr.has_response() )
+    {
+        ++unanswered_;
+        return;
+    }
+
+    const DNSMessage& r(qr.response());
+    unsigned rcode = r.dns.rcode();
+    auto edns0 = r.dns.edns0();
+    if ( edns0 )
+        rcode += edns0->extended_rcode() << 4;
+    ++rcodes_[rcode];
+
+    if ( qr.has_query() )
+    {
+        std::chrono::nanoseconds latency = r.timestamp - qr.query().timestamp;
+        uint64_t ns = ( latency.count() > 0 ) ? static_cast<uint64_t>(latency.count()) : 0;
+        ++latency_[LatencyHistogram::bucket_index(ns)];
+        latency_sum_ += ns;
+    }
+}
+
+void Aggregates::merge(const Aggregates& other)
+{
+    start_ = std::min(start_, other.start_);
+    count_ += other.count_;
+    unanswered_ += other.unanswered_;
+    qnames_.merge(other.qnames_);
+    clients_.merge(other.clients_);
+    client_hll_.merge(other.client_hll_);
+    for ( const auto& r : other.rcodes_ )
+        rcodes_[r.first] += r.second;
+    for ( const auto& q : other.qtypes_ )
+        qtypes_[q.first] += q.second;
+    for ( std::size_t i = 0; i < TRANSPORT_COUNT; ++i )
+        transports_[i] += other.transports_[i];
+    for ( std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i )
+        latency_[i] += other.latency_[i];
+    latency_sum_ += other.latency_sum_;
+}
+
+const char* Aggregates::transport_name(Transport t)
+{
+    return TRANSPORT_NAMES[t];
+}
+
+uint64_t Aggregates::latency_count() const
+{
+    uint64_t res = 0;
+    for ( auto c : latency_ )
+        res += c;
+    return res;
+}
+
+void Aggregates::write(CborBaseEncoder& enc) const
+{
+    enc.writeMapHeader(13);
+
+    enc.write(std::string("period-start"));
+    enc.write(start_);
+    enc.write(std::string("period-length"));
+    enc.write(period_.count());
+    enc.write(std::string("query-responses"));
+    enc.write(count_);
+    enc.write(std::string("unanswered-queries"));
+    enc.write(unanswered_);
+    enc.write(std::string("distinct-clients"));
+    enc.write(client_hll_.estimate());
+    enc.write(std::string("client-hll"));
+    enc.write(client_hll_.registers().data(), client_hll_.registers().size());
+
+    // Write all the counters, not just the top, so written
+    // summaries can be merged.
+    enc.write(std::string("qnames"));
+    write_counters(enc, qnames_.top(qnames_.size()),
+                   [&](const DNSName& name) { enc.write(name.data(), name.size()); });
+    enc.write(std::string("clients"));
+    write_counters(enc, clients_.top(clients_.size()),
+                   [&](const IPAddress& addr) { enc.write(addr.asNetworkBinary()); });
+
+    enc.write(std::string("rcodes"));
+    write_histogram(enc, rcodes_);
+    enc.write(std::string("qtypes"));
+    write_histogram(enc, qtypes_);
+
+    enc.write(std::string("transports"));
+    enc.writeMapHeader(TRANSPORT_COUNT);
+    for ( std::size_t i = 0; i < TRANSPORT_COUNT; ++i )
+    {
+        enc.write(std::string(transport_name(static_cast<Transport>(i))));
+        enc.write(transports_[i]);
+    }
+
+    // Latency buckets are written as [upper bound ns, count],
+    // omitting empty buckets.
+    enc.write(std::string("response-latency"));
+    unsigned buckets = 0;
+    for ( auto c : latency_ )
+        if ( c > 0 )
+            ++buckets;
+    enc.writeArrayHeader(buckets);
+    for ( std::size_t i = 0; i < LatencyHistogram::BUCKETS; ++i )
+        if ( latency_[i] > 0 )
+        {
+            enc.writeArrayHeader(2);
+            enc.write(LatencyHistogram::bucket_upper_bound(i));
+            enc.write(latency_[i]);
+        }
+    enc.write(std::string("response-latency-sum"));
+    enc.write(latency_sum_);
+}
+
+DNSName Aggregates::fold_case(const DNSName& name)
+{
+    byte_string res = name.as_byte_string();
+    std::size_t i = 0;
+    while ( i < res.size() )
+    {
+        std::size_t len = res[i];
+        if ( len == 0 || len > 63 )
+            break;
+        for ( std::size_t j = i + 1; j <= i + len && j < res.size(); ++j )
+            if ( res[j] >= 'A' && res[j] <= 'Z' )
+                res[j] += 'a' - 'A';
+        i += len + 1;
+    }
+    return DNSName(res);
+}
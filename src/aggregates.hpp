@@ -0,0 +1,637 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef AGGREGATES_HPP
+#define AGGREGATES_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "cborencoder.hpp"
+#include "dnsname.hpp"
+#include "ipaddress.hpp"
+#include "metrics.hpp"
+#include "pseudoanonymise.hpp"
+#include "queryresponse.hpp"
+
+/**
+ * \class SpaceSaving
+ * \brief Estimate the most frequent keys in a stream.
+ *
+ * This is the Space-Saving algorithm of Metwally, Agrawal and
+ * El Abbadi. A fixed number of counters is kept. A key without a
+ * counter takes over the counter with the lowest count, inheriting
+ * that count as its possible overestimate. Any key occurring more
+ * than 1/capacity of the time is guaranteed a counter.
+ *
+ * The counters are held in a binary min-heap, so the lowest count
+ * is always at the root.
+ *
+ * Two summaries may be merged, giving a summary of the combined
+ * streams with the same error bounds.
+ *
+ * \tparam Key the key type. It must have a `hash_value()`.
+ */
+template<typename Key>
+class SpaceSaving
+{
+public:
+    /**
+     * \struct Counter
+     * \brief A key and its estimated count.
+     */
+    struct Counter
+    {
+        /**
+         * \brief the key.
+         */
+        Key key;
+
+        /**
+         * \brief the estimated count. It may overestimate by up to `error`.
+         */
+        uint64_t count;
+
+        /**
+         * \brief the most the count may overestimate.
+         */
+        uint64_t error;
+    };
+
+    /**
+     * \brief Constructor.
+     *
+     * \param capacity the number of counters.
+     */
+    explicit SpaceSaving(std::size_t capacity)
+        : capacity_(std::max<std::size_t>(capacity, 1))
+    {
+        heap_.reserve(capacity_);
+        index_.reserve(capacity_);
+    }
+
+    /**
+     * \brief Count an occurrence of a key.
+     *
+     * \param key the key.
+     * \param n   the number of occurrences.
+     */
+    void add(const Key& key, uint64_t n = 1)
+    {
+        auto it = index_.find(key);
+        if ( it != index_.end() )
+        {
+            heap_[it->second].count += n;
+            sift_down(it->second);
+        }
+        else if ( heap_.size() < capacity_ )
+        {
+            heap_.push_back({ key, n, 0 });
+            index_[key] = heap_.size() - 1;
+            sift_up(heap_.size() - 1);
+        }
+        else
+        {
+            Counter& min = heap_.front();
+            index_.erase(min.key);
+            min.key = key;
+            min.error = min.count;
+            min.count += n;
+            index_[key] = 0;
+            sift_down(0);
+        }
+    }
+
+    /**
+     * \brief Merge another summary into this one.
+     *
+     * A key counted in only one summary may have occurred in the
+     * other up to that summary's lowest count, so that is added to
+     * its count and error.
+     *
+     * \param other the summary to merge.
+     */
+    void merge(const SpaceSaving& other)
+    {
+        uint64_t min_this = min_count();
+        uint64_t min_other = other.min_count();
+
+        std::unordered_map<Key, Counter, boost::hash<Key>> all;
+        for ( const auto& c : heap_ )
+            all.emplace(c.key, Counter{ c.key, c.count + min_other, c.error + min_other });
+        for ( const auto& c : other.heap_ )
+        {
+            auto it = all.find(c.key);
+            if ( it != all.end() )
+            {
+                it->second.count += c.count - min_other;
+                it->second.error += c.error - min_other;
+            }
+            else
+                all.emplace(c.key, Counter{ c.key, c.count + min_this, c.error + min_this });
+        }
+
+        std::vector<Counter> counters;
+        counters.reserve(all.size());
+        for ( auto& c : all )
+            counters.push_back(std::move(c.second));
+        if ( counters.size() > capacity_ )
+        {
+            std::nth_element(counters.begin(), counters.begin() + capacity_, counters.end(),
+                             [](const Counter& a, const Counter& b) { return a.count > b.count; });
+            counters.resize(capacity_);
+        }
+
+        heap_ = std::move(counters);
+        index_.clear();
+        for ( std::size_t i = 0; i < heap_.size(); ++i )
+            index_[heap_[i].key] = i;
+        for ( std::size_t i = heap_.size() / 2; i > 0; --i )
+            sift_down(i - 1);
+    }
+
+    /**
+     * \brief Return the most frequent keys.
+     *
+     * \param n the most keys to return.
+     * \returns the counters, highest count first.
+     */
+    std::vector<Counter> top(std::size_t n) const
+    {
+        std::vector<Counter> res(heap_);
+        std::sort(res.begin(), res.end(),
+                  [](const Counter& a, const Counter& b)
+                  {
+                      return a.count > b.count ||
+                          ( a.count == b.count && a.error < b.error );
+                  });
+        if ( res.size() > n )
+            res.resize(n);
+        return res;
+    }
+
+    /**
+     * \brief Return the lowest count, or 0 if any counter is unused.
+     */
+    uint64_t min_count() const
+    {
+        return ( heap_.size() < capacity_ ) ? 0 : heap_.front().count;
+    }
+
+    /**
+     * \brief Return the number of counters in use.
+     */
+    std::size_t size() const
+    {
+        return heap_.size();
+    }
+
+    /**
+     * \brief Return the number of counters.
+     */
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    /**
+     * \brief Move a counter towards the root until its parent is lower.
+     *
+     * \param i the counter heap index.
+     */
+    void sift_up(std::size_t i)
+    {
+        while ( i > 0 )
+        {
+            std::size_t parent = ( i - 1 ) / 2;
+            if ( heap_[parent].count <= heap_[i].count )
+                break;
+            swap_counters(i, parent);
+            i = parent;
+        }
+    }
+
+    /**
+     * \brief Move a counter away from the root until its children are higher.
+     *
+     * \param i the counter heap index.
+     */
+    void sift_down(std::size_t i)
+    {
+        for (;;)
+        {
+            std::size_t least = i;
+            std::size_t left = 2 * i + 1;
+            std::size_t right = left + 1;
+            if ( left < heap_.size() && heap_[left].count < heap_[least].count )
+                least = left;
+            if ( right < heap_.size() && heap_[right].count < heap_[least].count )
+                least = right;
+            if ( least == i )
+                break;
+            swap_counters(i, least);
+            i = least;
+        }
+    }
+
+    /**
+     * \brief Swap two counters in the heap, updating the index.
+     *
+     * \param a the first counter heap index.
+     * \param b the second counter heap index.
+     */
+    void swap_counters(std::size_t a, std::size_t b)
+    {
+        std::swap(heap_[a], heap_[b]);
+        index_[heap_[a].key] = a;
+        index_[heap_[b].key] = b;
+    }
+
+    /**
+     * \brief the number of counters.
+     */
+    std::size_t capacity_;
+
+    /**
+     * \brief the counters, as a min-heap on count.
+     */
+    std::vector<Counter> heap_;
+
+    /**
+     * \brief the heap index of each counted key.
+     */
+    std::unordered_map<Key, std::size_t, boost::hash<Key>> index_;
+};
+
+/**
+ * \class HyperLogLog
+ * \brief Estimate the number of distinct items in a stream.
+ *
+ * Each item is hashed. The top PRECISION bits of the hash choose
+ * a register, which records the most leading zeros seen in the
+ * remaining bits. The standard error of the estimate is about
+ * 1.04/sqrt(REGISTERS), 1.6% for the default precision.
+ *
+ * Two estimators are merged by taking the larger of each register.
+ */
+class HyperLogLog
+{
+public:
+    /**
+     * \brief number of hash bits used to choose a register.
+     */
+    static const unsigned PRECISION = 12;
+
+    /**
+     * \brief number of registers.
+     */
+    static const std::size_t REGISTERS = std::size_t(1) << PRECISION;
+
+    /**
+     * \brief Constructor.
+     */
+    HyperLogLog()
+    {
+        registers_.fill(0);
+    }
+
+    /**
+     * \brief Add an item.
+     *
+     * \param hash a 64 bit hash of the item.
+     */
+    void add(uint64_t hash)
+    {
+        std::size_t index = hash >> ( 64 - PRECISION );
+        uint64_t rest = ( hash << PRECISION ) | ( uint64_t(1) << ( PRECISION - 1 ) );
+        uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+        if ( rank > registers_[index] )
+            registers_[index] = rank;
+    }
+
+    /**
+     * \brief Merge another estimator into this one.
+     *
+     * \param other the estimator to merge.
+     */
+    void merge(const HyperLogLog& other);
+
+    /**
+     * \brief Return the estimated number of distinct items.
+     */
+    uint64_t estimate() const;
+
+    /**
+     * \brief Return the registers.
+     */
+    const std::array<uint8_t, REGISTERS>& registers() const
+    {
+        return registers_;
+    }
+
+private:
+    /**
+     * \brief the registers.
+     */
+    std::array<uint8_t, REGISTERS> registers_;
+};
+
+/**
+ * \class Aggregates
+ * \brief Summary statistics of query/response traffic over a period.
+ *
+ * The summary holds:
+ *
+ * - the most frequent query names and clients, estimated with Space-Saving,
+ * - the number of distinct clients, estimated with HyperLogLog,
+ * - exact histograms of response RCODE, query type and transport,
+ * - a histogram of response latency, with the bucket resolution
+ *   of a `LatencyHistogram`.
+ *
+ * Query names are case folded. If pseudo-anonymisation is given,
+ * clients are counted by their pseudo-anonymised address, so no
+ * client address is reported. Summaries may be merged, so
+ * summaries from several periods or servers may be combined.
+ */
+class Aggregates
+{
+public:
+    /**
+     * \brief counters kept for each reported most frequent key.
+     *
+     * Space-Saving is more accurate for the top keys the more
+     * counters are kept beyond those reported.
+     */
+    static const unsigned COUNTERS_PER_TOP = 8;
+
+    /**
+     * \enum Transport
+     * \brief Transport histogram indexes.
+     */
+    enum Transport
+    {
+        UDP_IPV4,
+        TCP_IPV4,
+        UDP_IPV6,
+        TCP_IPV6,
+        TRANSPORT_COUNT
+    };
+
+    /**
+     * \typedef Histogram
+     * \brief An exact histogram of counts by value.
+     */
+    using Histogram = std::map<unsigned, uint64_t>;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param top         the number of most frequent names and clients reported.
+     * \param start       the start of the period.
+     * \param period      the period length.
+     * \param pseudo_anon pseudo-anonymisation, if to use. It must
+     *                    outlive the summary.
+     */
+    Aggregates(std::size_t top,
+               const std::chrono::system_clock::time_point& start,
+               const std::chrono::seconds& period,
+               const PseudoAnonymise* pseudo_anon = nullptr);
+
+    /**
+     * \brief Add a query/response to the summary.
+     *
+     * \param qr the query/response.
+     */
+    void add(const QueryResponse& qr);
+
+    /**
+     * \brief Merge another summary into this one.
+     *
+     * The merged summary starts at the earlier of the two starts.
+     *
+     * \param other the summary to merge.
+     */
+    void merge(const Aggregates& other);
+
+    /**
+     * \brief Return the start of the period.
+     */
+    const std::chrono::system_clock::time_point& start() const
+    {
+        return start_;
+    }
+
+    /**
+     * \brief Return the period length.
+     */
+    const std::chrono::seconds& period() const
+    {
+        return period_;
+    }
+
+    /**
+     * \brief Return the number of query/responses summarised.
+     */
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    /**
+     * \brief Return the number of queries without a response.
+     */
+    uint64_t unanswered() const
+    {
+        return unanswered_;
+    }
+
+    /**
+     * \brief Return the estimated number of distinct clients.
+     */
+    uint64_t distinct_clients() const
+    {
+        return client_hll_.estimate();
+    }
+
+    /**
+     * \brief Return the most frequent query names.
+     */
+    std::vector<SpaceSaving<DNSName>::Counter> top_qnames() const
+    {
+        return qnames_.top(top_);
+    }
+
+    /**
+     * \brief Return the most frequent clients.
+     */
+    std::vector<SpaceSaving<IPAddress>::Counter> top_clients() const
+    {
+        return clients_.top(top_);
+    }
+
+    /**
+     * \brief Return the histogram of response RCODEs.
+     */
+    const Histogram& rcodes() const
+    {
+        return rcodes_;
+    }
+
+    /**
+     * \brief Return the histogram of query types.
+     */
+    const Histogram& qtypes() const
+    {
+        return qtypes_;
+    }
+
+    /**
+     * \brief Return the count for a transport.
+     *
+     * \param t the transport.
+     */
+    uint64_t transport(Transport t) const
+    {
+        return transports_[t];
+    }
+
+    /**
+     * \brief Return the number of latencies recorded.
+     */
+    uint64_t latency_count() const;
+
+    /**
+     * \brief Return the response latency bucket counts.
+     */
+    const LatencyHistogram::Counts& latencies() const
+    {
+        return latency_;
+    }
+
+    /**
+     * \brief Return the sum of response latencies, in nanoseconds.
+     */
+    uint64_t latency_sum() const
+    {
+        return latency_sum_;
+    }
+
+    /**
+     * \brief Write the summary to a CBOR encoder.
+     *
+     * The summary is written as a map, with the HyperLogLog registers
+     * and the Space-Saving counters so that written summaries can
+     * themselves be merged.
+     *
+     * \param enc the encoder.
+     */
+    void write(CborBaseEncoder& enc) const;
+
+    /**
+     * \brief Return the name of a transport.
+     *
+     * \param t the transport.
+     * \returns the name, e.g. `udp4`.
+     */
+    static const char* transport_name(Transport t);
+
+    /**
+     * \brief Return a case folded copy of a name.
+     *
+     * \param name the name, in uncompressed wire format.
+     * \returns the name with ASCII upper case letters in lower case.
+     */
+    static DNSName fold_case(const DNSName& name);
+
+private:
+    /**
+     * \brief the number of most frequent names and clients reported.
+     */
+    std::size_t top_;
+
+    /**
+     * \brief the start of the period.
+     */
+    std::chrono::system_clock::time_point start_;
+
+    /**
+     * \brief the period length.
+     */
+    std::chrono::seconds period_;
+
+    /**
+     * \brief pseudo-anonymisation for client addresses, if to use.
+     */
+    const PseudoAnonymise* pseudo_anon_;
+
+    /**
+     * \brief the number of query/responses.
+     */
+    uint64_t count_;
+
+    /**
+     * \brief the number of queries without a response.
+     */
+    uint64_t unanswered_;
+
+    /**
+     * \brief the most frequent query names.
+     */
+    SpaceSaving<DNSName> qnames_;
+
+    /**
+     * \brief the most frequent clients.
+     */
+    SpaceSaving<IPAddress> clients_;
+
+    /**
+     * \brief the distinct clients.
+     */
+    HyperLogLog client_hll_;
+
+    /**
+     * \brief the response RCODEs, including any extended RCODE.
+     */
+    Histogram rcodes_;
+
+    /**
+     * \brief the query types.
+     */
+    Histogram qtypes_;
+
+    /**
+     * \brief the transports.
+     */
+    std::array<uint64_t, TRANSPORT_COUNT> transports_;
+
+    /**
+     * \brief the response latencies, in `LatencyHistogram` buckets.
+     */
+    LatencyHistogram::Counts latency_;
+
+    /**
+     * \brief the sum of response latencies, in nanoseconds.
+     */
+    uint64_t latency_sum_;
+};
+
+#endif
@@ -20,20 +20,21 @@ BaseOutputWriter::BaseOutputWriter(const Configuration& config)
 }
 
 void BaseOutputWriter::writeQR(const std::shared_ptr<QueryResponse>& qr,
-                               const PacketStatistics& stats)
+                               const PacketStatistics& stats,
+                               bool sections)
 {
     checkForRotation(qr->timestamp());
     startRecord(qr);
 
     writeBasic(qr, stats);
 
-    if ( qr->has_query() && config_.output_options_queries != 0 )
+    if ( sections && qr->has_query() && config_.output_options_queries != 0 )
     {
         startExtendedQueryGroup();
         writeSections(qr->query(), config_.output_options_queries);
         endExtendedGroup();
     }
-    if ( qr->has_response() && config_.output_options_responses != 0 )
+    if ( sections && qr->has_response() && config_.output_options_responses != 0 )
     {
         startExtendedResponseGroup();
         writeSections(qr->response(), config_.output_options_responses);
@@ -83,9 +83,12 @@ public:
      *
      * \param qr        Query/Response record to write.
      * \param stats     statistics at time of record.
+     * \param sections  `false` to omit the configured extended
+     *                  sections, for example to shed load.
      */
     void writeQR(const std::shared_ptr<QueryResponse>& qr,
-                 const PacketStatistics& stats);
+                 const PacketStatistics& stats,
+                 bool sections = true);
 
     /**
      * \brief Write out a single address event.
@@ -114,6 +114,7 @@ namespace block_cbor {
     FileVersionFields::FileVersionFields()
         : configuration_(current_configuration, current_configuration + countof(current_configuration)),
           block_(current_block, current_block + countof(current_block)),
+          block_filters_(current_block_filters, current_block_filters + countof(current_block_filters)),
           block_preamble_(current_block_preamble, current_block_preamble + countof(current_block_preamble)),
           block_statistics_(current_block_statistics, current_block_statistics + countof(current_block_statistics)),
           block_tables_(current_block_tables, current_block_tables + countof(current_block_tables)),
@@ -163,6 +164,14 @@ namespace block_cbor {
             return BlockField::unknown;
     }
 
+    BlockFiltersField FileVersionFields::block_filters_field(unsigned index) const
+    {
+        if ( index < block_filters_.size() )
+            return block_filters_[index];
+        else
+            return BlockFiltersField::unknown;
+    }
+
     BlockPreambleField FileVersionFields::block_preamble_field(unsigned index) const
     {
         if ( index < block_preamble_.size() )
@@ -146,6 +146,9 @@ namespace block_cbor {
         accept_rr_types,
         ignore_rr_types,
         max_block_qr_items,
+        compactor_client_sample,
+        compactor_client_sample_ipv4_prefix_length,
+        compactor_client_sample_ipv6_prefix_length,
 
         unknown = -1
     };
@@ -161,6 +164,19 @@ namespace block_cbor {
         tables,
         queries,
         address_event_counts,
+        compactor_filters,
+
+        unknown = -1
+    };
+
+    /**
+     * \enum BlockFiltersField
+     * \brief Fields in block filters map.
+     */
+    enum class BlockFiltersField
+    {
+        address_filter,
+        name_filter,
 
         unknown = -1
     };
@@ -193,6 +209,10 @@ namespace block_cbor {
         compactor_missing_pairs,
         compactor_missing_packets,
         compactor_missing_non_dns,
+        compactor_shed_sections_pairs,
+        compactor_shed_address_events,
+        compactor_sampled_pairs,
+        compactor_sampled_out_pairs,
 
         unknown = -1
     };
@@ -430,6 +450,10 @@ namespace block_cbor {
         ConfigurationField::ignore_rr_types,
         ConfigurationField::server_addresses,
         ConfigurationField::max_block_qr_items,
+        ConfigurationField::unknown,
+        ConfigurationField::compactor_client_sample,
+        ConfigurationField::compactor_client_sample_ipv4_prefix_length,
+        ConfigurationField::compactor_client_sample_ipv6_prefix_length,
     };
 
     /**
@@ -455,6 +479,12 @@ namespace block_cbor {
         BlockField::tables,
         BlockField::queries,
         BlockField::address_event_counts,
+        BlockField::unknown,
+        BlockField::unknown,
+        BlockField::unknown,
+        BlockField::unknown,
+        BlockField::unknown,
+        BlockField::compactor_filters,
     };
 
     /**
@@ -469,6 +499,28 @@ namespace block_cbor {
         return find_index(current_block, index);
     }
 
+    /**
+     * \brief Map of current block filters indexes.
+     *
+     * The index of a entry in the array is the file map value of that entry.
+     */
+    constexpr BlockFiltersField current_block_filters[] = {
+        BlockFiltersField::address_filter,
+        BlockFiltersField::name_filter,
+    };
+
+    /**
+     * \brief find map index of block filters fields for current format.
+     *
+     * \param index the field identifier.
+     * \return the field index.
+     * \throws std::logic_error if the item is specified in the format.
+     */
+    constexpr unsigned find_block_filters_index(BlockFiltersField index)
+    {
+        return find_index(current_block_filters, index);
+    }
+
     /**
      * \brief Map of current block preamble indexes.
      *
@@ -512,6 +564,10 @@ namespace block_cbor {
         BlockStatisticsField::compactor_missing_pairs,
         BlockStatisticsField::compactor_missing_packets,
         BlockStatisticsField::compactor_missing_non_dns,
+        BlockStatisticsField::compactor_shed_sections_pairs,
+        BlockStatisticsField::compactor_shed_address_events,
+        BlockStatisticsField::compactor_sampled_pairs,
+        BlockStatisticsField::compactor_sampled_out_pairs,
     };
 
     /**
@@ -784,6 +840,14 @@ namespace block_cbor {
          */
         BlockField block_field(unsigned index) const;
 
+        /**
+         * \brief Return block filters field for given map index.
+         *
+         * \param index the map index read from file.
+         * \returns field identifier.
+         */
+        BlockFiltersField block_filters_field(unsigned index) const;
+
         /**
          * \brief Return block preamble field for given map index.
          *
@@ -876,6 +940,11 @@ namespace block_cbor {
          */
         std::vector<BlockField> block_;
 
+        /**
+         * \brief block filters index map.
+         */
+        std::vector<BlockFiltersField> block_filters_;
+
         /**
          * \brief block preamble index map.
          */
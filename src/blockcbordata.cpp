@@ -50,7 +50,7 @@ namespace block_cbor {
     {
         try
         {
-            str = dec.read_binary();
+            str = DNSName(dec.read_binary());
         }
         catch (const std::logic_error& e)
         {
@@ -60,7 +60,7 @@ namespace block_cbor {
 
     void ByteStringItem::writeCbor(CborBaseEncoder& enc)
     {
-        enc.write(str);
+        enc.write(str.data(), str.size());
     }
 
     void IPAddressItem::readCbor(CborBaseDecoder& dec, const FileVersionFields&)
@@ -556,7 +556,8 @@ namespace block_cbor {
 
     void QueryResponseItem::readCbor(CborBaseDecoder& dec,
                                      const std::chrono::system_clock::time_point& earliest_time,
-                                     const FileVersionFields& fields)
+                                     const FileVersionFields& fields,
+                                     unsigned parts)
     {
         try
         {
@@ -620,11 +621,17 @@ namespace block_cbor {
                     break;
 
                 case QueryResponseField::query_extended:
-                    query_extra_info = readExtraInfo(dec, fields);
+                    if ( parts & READ_QUERY_EXTRA_INFO )
+                        query_extra_info = readExtraInfo(dec, fields);
+                    else
+                        dec.skip();
                     break;
 
                 case QueryResponseField::response_extended:
-                    response_extra_info = readExtraInfo(dec, fields);
+                    if ( parts & READ_RESPONSE_EXTRA_INFO )
+                        response_extra_info = readExtraInfo(dec, fields);
+                    else
+                        dec.skip();
                     break;
 
                 default:
@@ -709,10 +716,7 @@ namespace block_cbor {
 
     std::size_t hash_value(const AddressEventItem& aei)
     {
-        std::size_t seed = boost::hash_value(aei.type);
-        boost::hash_combine(seed, aei.code);
-        boost::hash_combine(seed, aei.address);
-        return seed;
+        return fast_hash((uint64_t(aei.type) << 32) | aei.code, aei.address);
     }
 
     void AddressEventCount::readCbor(CborBaseDecoder& dec, const FileVersionFields& fields)
@@ -785,8 +789,43 @@ namespace block_cbor {
         enc.writeBreak();
     }
 
-    void BlockData::readCbor(CborBaseDecoder& dec, const FileVersionFields& fields)
+    byte_string name_filter_key(const byte_string& name)
+    {
+        byte_string res(name);
+        for ( auto& c : res )
+            if ( c >= 'A' && c <= 'Z' )
+                c += 'a' - 'A';
+        return res;
+    }
+
+    bool BlockSearch::may_match(const BloomFilter& address_filter,
+                                const BloomFilter& name_filter) const
+    {
+        // An absent filter could contain anything.
+        if ( client_address && !address_filter.empty() &&
+             !address_filter.may_contain(client_address->asNetworkBinary()) )
+            return false;
+        if ( qname && !name_filter.empty() &&
+             !name_filter.may_contain(name_filter_key(*qname)) )
+            return false;
+        return true;
+    }
+
+    void BlockData::build_filters(unsigned bits_per_item)
     {
+        address_filter = BloomFilter(ip_addresses.size(), bits_per_item);
+        for ( auto& a : ip_addresses )
+            address_filter.add(a.addr.asNetworkBinary());
+
+        name_filter = BloomFilter(names_rdatas.size(), bits_per_item);
+        for ( auto& n : names_rdatas )
+            name_filter.add(name_filter_key(n.str.as_byte_string()));
+    }
+
+    bool BlockData::readCbor(CborBaseDecoder& dec, const FileVersionFields& fields,
+                             unsigned parts, const BlockSearch* search)
+    {
+        bool match = true;
         bool indef;
         uint64_t n_elems = dec.readMapHeader(indef);
         while ( indef || n_elems-- > 0 )
@@ -803,20 +842,73 @@ namespace block_cbor {
                 readBlockPreamble(dec, fields);
                 break;
 
+            case BlockField::compactor_filters:
+                readFilters(dec, fields);
+                if ( search && !search->may_match(address_filter, name_filter) )
+                {
+                    // Statistics are independent of the block contents.
+                    match = false;
+                    parts &= READ_STATISTICS;
+                }
+                break;
+
             case BlockField::tables:
-                readHeaders(dec, fields);
+                readHeaders(dec, fields, parts);
                 break;
 
             case BlockField::statistics:
-                readStats(dec, fields);
+                if ( parts & READ_STATISTICS )
+                    readStats(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockField::queries:
-                readItems(dec, fields);
+                if ( parts & READ_ITEMS )
+                    readItems(dec, fields, parts);
+                else
+                    dec.skip();
                 break;
 
             case BlockField::address_event_counts:
-                readAddressEventCounts(dec, fields);
+                if ( parts & READ_ADDRESS_EVENT_COUNTS )
+                    readAddressEventCounts(dec, fields);
+                else
+                    dec.skip();
+                break;
+
+            default:
+                dec.skip();
+                break;
+            }
+        }
+
+        // In case the filters came after the items.
+        if ( !match )
+            query_response_items.clear();
+        return match;
+    }
+
+    void BlockData::readFilters(CborBaseDecoder& dec, const FileVersionFields& fields)
+    {
+        bool indef;
+        uint64_t n_elems = dec.readMapHeader(indef);
+        while ( indef || n_elems-- > 0 )
+        {
+            if ( indef && dec.type() == CborBaseDecoder::TYPE_BREAK )
+            {
+                dec.readBreak();
+                break;
+            }
+
+            switch(fields.block_filters_field(dec.read_unsigned()))
+            {
+            case BlockFiltersField::address_filter:
+                address_filter.readCbor(dec);
+                break;
+
+            case BlockFiltersField::name_filter:
+                name_filter.readCbor(dec);
                 break;
 
             default:
@@ -851,7 +943,8 @@ namespace block_cbor {
         }
     }
 
-    void BlockData::readHeaders(CborBaseDecoder& dec, const FileVersionFields& fields)
+    void BlockData::readHeaders(CborBaseDecoder& dec, const FileVersionFields& fields,
+                                unsigned parts)
     {
         bool indef;
         uint64_t n_elems = dec.readMapHeader(indef);
@@ -866,35 +959,59 @@ namespace block_cbor {
             switch(fields.block_tables_field(dec.read_unsigned()))
             {
             case BlockTablesField::ip_address:
-                ip_addresses.readCbor(dec, fields);
+                if ( parts & READ_IP_ADDRESSES )
+                    ip_addresses.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::classtype:
-                class_types.readCbor(dec, fields);
+                if ( parts & READ_CLASS_TYPES )
+                    class_types.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::name_rdata:
-                names_rdatas.readCbor(dec, fields);
+                if ( parts & READ_NAMES_RDATAS )
+                    names_rdatas.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::query_signature:
-                query_signatures.readCbor(dec, fields);
+                if ( parts & READ_QUERY_SIGNATURES )
+                    query_signatures.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::question_list:
-                questions_lists.readCbor(dec, fields);
+                if ( parts & READ_QUESTIONS_LISTS )
+                    questions_lists.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::question_rr:
-                questions.readCbor(dec, fields);
+                if ( parts & READ_QUESTIONS )
+                    questions.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::rr_list:
-                rrs_lists.readCbor(dec, fields);
+                if ( parts & READ_RRS_LISTS )
+                    rrs_lists.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             case BlockTablesField::rr:
-                resource_records.readCbor(dec, fields);
+                if ( parts & READ_RESOURCE_RECORDS )
+                    resource_records.readCbor(dec, fields);
+                else
+                    dec.skip();
                 break;
 
             default:
@@ -904,7 +1021,8 @@ namespace block_cbor {
         }
     }
 
-    void BlockData::readItems(CborBaseDecoder& dec, const FileVersionFields& fields)
+    void BlockData::readItems(CborBaseDecoder& dec, const FileVersionFields& fields,
+                              unsigned parts)
     {
         bool indef;
         uint64_t n_elems = dec.readArrayHeader(indef);
@@ -919,7 +1037,7 @@ namespace block_cbor {
             }
 
             QueryResponseItem qri;
-            qri.readCbor(dec, earliest_time, fields);
+            qri.readCbor(dec, earliest_time, fields, parts);
             query_response_items.push_back(std::move(qri));
         }
     }
@@ -980,6 +1098,22 @@ namespace block_cbor {
                 last_packet_statistics.output_ignored_pcap_drop_count += dec.read_unsigned();
                 break;
 
+            case BlockStatisticsField::compactor_shed_sections_pairs:
+                last_packet_statistics.shed_sections_qr_count += dec.read_unsigned();
+                break;
+
+            case BlockStatisticsField::compactor_shed_address_events:
+                last_packet_statistics.shed_address_event_count += dec.read_unsigned();
+                break;
+
+            case BlockStatisticsField::compactor_sampled_pairs:
+                last_packet_statistics.sampled_qr_count += dec.read_unsigned();
+                break;
+
+            case BlockStatisticsField::compactor_sampled_out_pairs:
+                last_packet_statistics.sampled_out_qr_count += dec.read_unsigned();
+                break;
+
             default:
                 dec.skip();
                 break;
@@ -1012,6 +1146,7 @@ namespace block_cbor {
         constexpr unsigned tables_index = find_block_index(BlockField::tables);
         constexpr unsigned queries_index = find_block_index(BlockField::queries);
         constexpr unsigned aec_index = find_block_index(BlockField::address_event_counts);
+        constexpr unsigned filters_index = find_block_index(BlockField::compactor_filters);
         constexpr unsigned earliest_time_index = find_block_preamble_index(BlockPreambleField::earliest_time);
 
         // Block header.
@@ -1023,6 +1158,14 @@ namespace block_cbor {
         enc.write(earliest_time_index);
         enc.write(earliest_time);
 
+        // Filters, if present. These go before the tables and items,
+        // so a reader can skip those if the filters show no match.
+        if ( !address_filter.empty() || !name_filter.empty() )
+        {
+            enc.write(filters_index);
+            writeFilters(enc);
+        }
+
         // Statistics.
         enc.write(statistics_index);
         writeStats(enc);
@@ -1043,6 +1186,25 @@ namespace block_cbor {
         enc.writeBreak();
     }
 
+    void BlockData::writeFilters(CborBaseEncoder& enc)
+    {
+        constexpr unsigned address_filter_index = find_block_filters_index(BlockFiltersField::address_filter);
+        constexpr unsigned name_filter_index = find_block_filters_index(BlockFiltersField::name_filter);
+
+        enc.writeMapHeader();
+        if ( !address_filter.empty() )
+        {
+            enc.write(address_filter_index);
+            address_filter.writeCbor(enc);
+        }
+        if ( !name_filter.empty() )
+        {
+            enc.write(name_filter_index);
+            name_filter.writeCbor(enc);
+        }
+        enc.writeBreak();
+    }
+
     void BlockData::writeHeaders(CborBaseEncoder& enc)
     {
         constexpr unsigned ipaddress_index = find_block_tables_index(BlockTablesField::ip_address);
@@ -1093,6 +1255,10 @@ namespace block_cbor {
         constexpr unsigned missing_pairs_index = find_block_statistics_index(BlockStatisticsField::compactor_missing_pairs);
         constexpr unsigned missing_packets_index = find_block_statistics_index(BlockStatisticsField::compactor_missing_packets);
         constexpr unsigned missing_non_dns_index = find_block_statistics_index(BlockStatisticsField::compactor_missing_non_dns);
+        constexpr unsigned shed_sections_pairs_index = find_block_statistics_index(BlockStatisticsField::compactor_shed_sections_pairs);
+        constexpr unsigned shed_address_events_index = find_block_statistics_index(BlockStatisticsField::compactor_shed_address_events);
+        constexpr unsigned sampled_pairs_index = find_block_statistics_index(BlockStatisticsField::compactor_sampled_pairs);
+        constexpr unsigned sampled_out_pairs_index = find_block_statistics_index(BlockStatisticsField::compactor_sampled_out_pairs);
 
         enc.writeMapHeader();
         enc.write(total_packets_index);
@@ -1115,6 +1281,20 @@ namespace block_cbor {
         enc.write(last_packet_statistics.output_raw_pcap_drop_count - start_packet_statistics.output_raw_pcap_drop_count);
         enc.write(missing_non_dns_index);
         enc.write(last_packet_statistics.output_ignored_pcap_drop_count - start_packet_statistics.output_ignored_pcap_drop_count);
+
+        // Only write load shedding statistics when shedding happened.
+        const std::pair<unsigned, uint64_t> shed_stats[] = {
+            { shed_sections_pairs_index, last_packet_statistics.shed_sections_qr_count - start_packet_statistics.shed_sections_qr_count },
+            { shed_address_events_index, last_packet_statistics.shed_address_event_count - start_packet_statistics.shed_address_event_count },
+            { sampled_pairs_index, last_packet_statistics.sampled_qr_count - start_packet_statistics.sampled_qr_count },
+            { sampled_out_pairs_index, last_packet_statistics.sampled_out_qr_count - start_packet_statistics.sampled_out_qr_count },
+        };
+        for ( const auto& s : shed_stats )
+            if ( s.second != 0 )
+            {
+                enc.write(s.first);
+                enc.write(s.second);
+            }
         enc.writeBreak();
     }
 
@@ -19,13 +19,16 @@
 #include <vector>
 
 #include <boost/functional/hash.hpp>
+#include <boost/optional.hpp>
 
 #include "addressevent.hpp"
+#include "bloomfilter.hpp"
 #include "bytestring.hpp"
 #include "blockcbor.hpp"
 #include "cbordecoder.hpp"
 #include "cborencoder.hpp"
 #include "capturedns.hpp"
+#include "dnsname.hpp"
 #include "ipaddress.hpp"
 #include "makeunique.hpp"
 #include "packetstatistics.hpp"
@@ -52,6 +55,30 @@ namespace block_cbor {
         RESPONSE_HAS_NO_QUESTION = (1 << 5),
     };
 
+    /**
+     * \brief Block parts to decode when reading.
+     *
+     * Parts not selected are skipped over in the CBOR input without
+     * being decoded, and are left empty in the block.
+     */
+    enum BlockParts
+    {
+        READ_IP_ADDRESSES = (1 << 0),
+        READ_CLASS_TYPES = (1 << 1),
+        READ_NAMES_RDATAS = (1 << 2),
+        READ_QUERY_SIGNATURES = (1 << 3),
+        READ_QUESTIONS_LISTS = (1 << 4),
+        READ_QUESTIONS = (1 << 5),
+        READ_RRS_LISTS = (1 << 6),
+        READ_RESOURCE_RECORDS = (1 << 7),
+        READ_ITEMS = (1 << 8),
+        READ_QUERY_EXTRA_INFO = (1 << 9),
+        READ_RESPONSE_EXTRA_INFO = (1 << 10),
+        READ_STATISTICS = (1 << 11),
+        READ_ADDRESS_EVENT_COUNTS = (1 << 12),
+        READ_ALL = (1 << 13) - 1,
+    };
+
     /**
      * \brief type for the index into a header.
      *
@@ -107,12 +134,12 @@ namespace block_cbor {
         /**
          * \brief the string data.
          */
-        byte_string str;
+        DNSName str;
 
         /**
          * \brief return the key to be used for storing values.
          */
-        const byte_string& key() const
+        const DNSName& key() const
         {
             return str;
         }
@@ -714,13 +741,16 @@ namespace block_cbor {
          * \param dec           CBOR stream to read from.
          * \param earliest_time earliest time in block.
          * \param fields        translate map keys to internal values.
+         * \param parts         the block parts to decode. Extra info not
+         *                      selected is skipped.
          * \throws cbor_file_format_error on unexpected CBOR content.
          * \throws cbor_decode_error on malformed CBOR items.
          * \throws cbor_end_of_input on end of CBOR file.
          */
         void readCbor(CborBaseDecoder& dec,
                       const std::chrono::system_clock::time_point& earliest_time,
-                      const FileVersionFields& fields);
+                      const FileVersionFields& fields,
+                      unsigned parts = READ_ALL);
 
         /**
          * \brief Write the object contents to CBOR.
@@ -1086,6 +1116,60 @@ namespace block_cbor {
         std::unordered_map<KeyRef<K>, index_t, boost::hash<KeyRef<K>>> map_;
     };
 
+    /**
+     * \brief Make the key used for a NAME in the block name filter.
+     *
+     * Names are compared case-insensitively, so ASCII upper case
+     * letters are converted to lower case. Label lengths are never
+     * in the upper case letter range, so are unaffected.
+     *
+     * \param name the NAME, in label format.
+     * \returns the filter key.
+     */
+    byte_string name_filter_key(const byte_string& name);
+
+    /**
+     * \struct BlockSearch
+     * \brief Criteria for a search of blocks.
+     *
+     * All criteria given must match.
+     */
+    struct BlockSearch
+    {
+        /**
+         * \brief client address to search for.
+         */
+        boost::optional<IPAddress> client_address;
+
+        /**
+         * \brief QNAME to search for, in label format.
+         */
+        boost::optional<byte_string> qname;
+
+        /**
+         * \brief Determine if there are no search criteria.
+         *
+         * \returns `true` if there are no criteria.
+         */
+        bool empty() const
+        {
+            return !client_address && !qname;
+        }
+
+        /**
+         * \brief Determine if a block with the given filters may
+         * contain matches.
+         *
+         * An empty filter is treated as absent, and may match anything.
+         *
+         * \param address_filter the block address filter.
+         * \param name_filter    the block name filter.
+         * \returns `false` if the block definitely contains no matches.
+         */
+        bool may_match(const BloomFilter& address_filter,
+                       const BloomFilter& name_filter) const;
+    };
+
     /**
      * \struct BlockData
      * \brief The output blocks.
@@ -1152,7 +1236,7 @@ namespace block_cbor {
         /**
          * \brief the header list of NAMEs or RDATA.
          */
-        HeaderList<ByteStringItem, byte_string> names_rdatas;
+        HeaderList<ByteStringItem, DNSName> names_rdatas;
 
         /**
          * \brief the header list of query signatures.
@@ -1179,6 +1263,16 @@ namespace block_cbor {
          */
         std::unordered_map<AddressEventItem, unsigned, boost::hash<AddressEventItem>> address_event_counts;
 
+        /**
+         * \brief filter of the IP addresses in the block, if present.
+         */
+        BloomFilter address_filter;
+
+        /**
+         * \brief filter of the NAMEs and RDATA in the block, if present.
+         */
+        BloomFilter name_filter;
+
         /**
          * \brief Clear all block data.
          */
@@ -1194,6 +1288,8 @@ namespace block_cbor {
             questions_lists.clear();
             rrs_lists.clear();
             address_event_counts.clear();
+            address_filter.clear();
+            name_filter.clear();
         }
 
         /**
@@ -1291,7 +1387,7 @@ namespace block_cbor {
          * \param rd the NAME or RDATA to add.
          * \returns the index of the NAME or RDATA.
          */
-        index_t add_name_rdata(const byte_string& rd)
+        index_t add_name_rdata(const DNSName& rd)
         {
             index_t res = names_rdatas.find(rd);
             if ( res == 0 )
@@ -1303,6 +1399,17 @@ namespace block_cbor {
             return res;
         }
 
+        /**
+         * brief Add a new NAME or RDATA to the block headers.
+         *
+         * \param rd the NAME or RDATA to add.
+         * \returns the index of the NAME or RDATA.
+         */
+        index_t add_name_rdata(const byte_string& rd)
+        {
+            return add_name_rdata(DNSName(rd));
+        }
+
         /**
          * brief Add a new RR to the block headers.
          *
@@ -1352,16 +1459,40 @@ namespace block_cbor {
                 address_event_counts[aei] = 1;
         }
 
+        /**
+         * \brief Build the block filters from the block header tables.
+         *
+         * \param bits_per_item the filter bits per table entry.
+         */
+        void build_filters(unsigned bits_per_item);
+
         /**
          * \brief Read the object contents from CBOR.
          *
+         * If a search is given and the block filters show the block
+         * has no matches, the block tables and items that follow
+         * the filters are skipped, and the block has no items.
+         *
          * \param dec    CBOR stream to read from.
          * \param fields translate map keys to internal values.
+         * \param parts  the block parts to decode. Other parts are skipped.
+         * \param search the search to apply, if any.
+         * \returns `false` if the block filters show no search matches.
          * \throws cbor_file_format_error on unexpected CBOR content.
          * \throws cbor_decode_error on malformed CBOR items.
          * \throws cbor_end_of_input on end of CBOR file.
          */
-        void readCbor(CborBaseDecoder& dec, const FileVersionFields& fields);
+        bool readCbor(CborBaseDecoder& dec, const FileVersionFields& fields,
+                      unsigned parts = READ_ALL,
+                      const BlockSearch* search = nullptr);
+
+        /**
+         * \brief Read the block filters.
+         *
+         * \param dec    CBOR stream to read from.
+         * \param fields translate map keys to internal values.
+         */
+        void readFilters(CborBaseDecoder& dec, const FileVersionFields& fields);
 
         /**
          * \brief Read the block preamble.
@@ -1376,16 +1507,20 @@ namespace block_cbor {
          *
          * \param dec    CBOR stream to read from.
          * \param fields translate map keys to internal values.
+         * \param parts  the tables to decode. Other tables are skipped.
          */
-        void readHeaders(CborBaseDecoder& dec, const FileVersionFields& fields);
+        void readHeaders(CborBaseDecoder& dec, const FileVersionFields& fields,
+                         unsigned parts = READ_ALL);
 
         /**
          * \brief Read block query/response items from CBOR.
          *
          * \param dec    CBOR decoder.
          * \param fields translate map keys to internal values.
+         * \param parts  the item extra info to decode.
          */
-        void readItems(CborBaseDecoder& dec, const FileVersionFields& fields);
+        void readItems(CborBaseDecoder& dec, const FileVersionFields& fields,
+                       unsigned parts = READ_ALL);
 
         /**
          * \brief Read block statistics from CBOR. Accumulate the stats over
@@ -1411,6 +1546,13 @@ namespace block_cbor {
          */
         void writeCbor(CborBaseEncoder& enc);
 
+        /**
+         * \brief Write block filters.
+         *
+         * \param enc the CBOR encoder to use for the write.
+         */
+        void writeFilters(CborBaseEncoder& enc);
+
         /**
          * \brief Write block headers.
          *
@@ -18,6 +18,7 @@
 #include "baseoutputwriter.hpp"
 #include "blockcbor.hpp"
 #include "bytestring.hpp"
+#include "clientsampler.hpp"
 #include "makeunique.hpp"
 #include "dnsmessage.hpp"
 
@@ -27,11 +28,43 @@ BlockCborReader::BlockCborReader(CborBaseDecoder& dec, Configuration &config,
                                  boost::optional<PseudoAnonymise> pseudo_anon)
     : dec_(dec), next_item_(0), need_block_(true),
       block_(config.max_block_qr_items), current_block_num_(0),
-      pseudo_anon_(pseudo_anon)
+      pseudo_anon_(pseudo_anon), projection_(ALL), parts_(block_cbor::READ_ALL),
+      blocks_skipped_(0)
 {
     readFileHeader(config);
 }
 
+void BlockCborReader::set_projection(unsigned projection)
+{
+    projection_ = projection;
+
+    // Items and signatures are always needed to produce Query/Response pairs.
+    parts_ = block_cbor::READ_ITEMS | block_cbor::READ_QUERY_SIGNATURES;
+    if ( projection & ( ADDRESSES | ADDRESS_EVENTS ) )
+        parts_ |= block_cbor::READ_IP_ADDRESSES;
+    if ( projection & ( QUESTION | QUERY_SECTIONS | RESPONSE_SECTIONS ) )
+        parts_ |= block_cbor::READ_CLASS_TYPES | block_cbor::READ_NAMES_RDATAS;
+    if ( projection & ( QUERY_SECTIONS | RESPONSE_SECTIONS ) )
+        parts_ |= block_cbor::READ_QUESTIONS_LISTS | block_cbor::READ_QUESTIONS |
+            block_cbor::READ_RRS_LISTS | block_cbor::READ_RESOURCE_RECORDS;
+    if ( projection & QUERY_SECTIONS )
+        parts_ |= block_cbor::READ_QUERY_EXTRA_INFO;
+    if ( projection & RESPONSE_SECTIONS )
+        parts_ |= block_cbor::READ_RESPONSE_EXTRA_INFO;
+    if ( projection & STATISTICS )
+        parts_ |= block_cbor::READ_STATISTICS;
+    if ( projection & ADDRESS_EVENTS )
+        parts_ |= block_cbor::READ_ADDRESS_EVENT_COUNTS;
+}
+
+void BlockCborReader::set_search(const block_cbor::BlockSearch& search)
+{
+    if ( search.empty() )
+        search_ = boost::none;
+    else
+        search_ = search;
+}
+
 void BlockCborReader::readFileHeader(Configuration& config)
 {
     try
@@ -277,6 +310,18 @@ void BlockCborReader::readConfiguration(Configuration& config)
             config.max_block_qr_items = dec_.read_unsigned();
             break;
 
+        case block_cbor::ConfigurationField::compactor_client_sample:
+            config.client_sample = static_cast<double>(dec_.read_unsigned()) / ClientSampler::PARTS;
+            break;
+
+        case block_cbor::ConfigurationField::compactor_client_sample_ipv4_prefix_length:
+            config.client_sample_ipv4_prefix_length = dec_.read_unsigned();
+            break;
+
+        case block_cbor::ConfigurationField::compactor_client_sample_ipv6_prefix_length:
+            config.client_sample_ipv6_prefix_length = dec_.read_unsigned();
+            break;
+
         default:
             // Unknown item, skip.
             dec_.skip();
@@ -299,12 +344,34 @@ bool BlockCborReader::readBlock()
         return false;
 
     block_.clear();
-    block_.readCbor(dec_, *fields_);
+    if ( search_ )
+    {
+        // Matching needs the searched tables.
+        unsigned parts = parts_;
+        if ( search_->client_address )
+            parts |= block_cbor::READ_IP_ADDRESSES;
+        if ( search_->qname )
+            parts |= block_cbor::READ_NAMES_RDATAS;
+        if ( block_.readCbor(dec_, *fields_, parts, search_.get_ptr()) )
+            findSearchMatches();
+        else
+            ++blocks_skipped_;
+    }
+    else
+        block_.readCbor(dec_, *fields_, parts_);
 
 #if ENABLE_PSEUDOANONYMISATION
     if ( pseudo_anon_ )
+    {
+        std::vector<IPAddress> addrs;
+        addrs.reserve(block_.ip_addresses.size());
+        for ( auto& a : block_.ip_addresses )
+            addrs.push_back(a.addr);
+        pseudo_anon_->addresses(addrs);
+        auto addr = addrs.begin();
         for ( auto& a : block_.ip_addresses )
-            a.addr = pseudo_anon_->address(a.addr);
+            a.addr = *addr++;
+    }
 #endif
 
     // Accumulate address events counts.
@@ -325,25 +392,76 @@ bool BlockCborReader::readBlock()
     return true;
 }
 
+void BlockCborReader::findSearchMatches()
+{
+    search_addresses_.clear();
+    search_names_.clear();
+
+    // Note the matching table entries now, before any
+    // pseudo-anonymisation, so items need only compare indexes.
+    if ( search_->client_address )
+        for ( block_cbor::index_t i = 1; i <= block_.ip_addresses.size(); ++i )
+            if ( block_.ip_addresses[i].addr == *search_->client_address )
+                search_addresses_.push_back(i);
+
+    if ( search_->qname )
+    {
+        byte_string key = block_cbor::name_filter_key(*search_->qname);
+        for ( block_cbor::index_t i = 1; i <= block_.names_rdatas.size(); ++i )
+            if ( block_cbor::name_filter_key(block_.names_rdatas[i].str.as_byte_string()) == key )
+                search_names_.push_back(i);
+    }
+
+    if ( ( search_->client_address && search_addresses_.empty() ) ||
+         ( search_->qname && search_names_.empty() ) )
+        block_.query_response_items.clear();
+}
+
+bool BlockCborReader::searchMatches(const block_cbor::QueryResponseItem& qri) const
+{
+    if ( search_->client_address &&
+         std::find(search_addresses_.begin(), search_addresses_.end(), qri.client_address) == search_addresses_.end() )
+        return false;
+
+    if ( search_->qname )
+    {
+        const block_cbor::QuerySignature& sig = block_.query_signatures[qri.signature];
+        if ( !( sig.qr_flags & block_cbor::QR_HAS_QUESTION ) ||
+             std::find(search_names_.begin(), search_names_.end(), qri.qname) == search_names_.end() )
+            return false;
+    }
+
+    return true;
+}
+
 std::shared_ptr<QueryResponse> BlockCborReader::readQR()
 {
     std::shared_ptr<QueryResponse> res;
     std::unique_ptr<DNSMessage> query, response;
+    const block_cbor::QueryResponseItem* item;
 
-    while ( need_block_ )
-        if ( !readBlock() )
-            return res;
+    do
+    {
+        while ( need_block_ )
+            if ( !readBlock() )
+                return res;
 
-    const block_cbor::QueryResponseItem& qri = block_.query_response_items[next_item_];
-    need_block_ = (block_.query_response_items.size() == ++next_item_);
+        item = &block_.query_response_items[next_item_];
+        need_block_ = (block_.query_response_items.size() == ++next_item_);
+    } while ( search_ && !searchMatches(*item) );
+
+    const block_cbor::QueryResponseItem& qri = *item;
 
     const block_cbor::QuerySignature& sig = block_.query_signatures[qri.signature];
     if ( sig.qr_flags & block_cbor::QUERY_ONLY )
     {
         query = make_unique<DNSMessage>();
         query->timestamp = qri.tstamp;
-        query->clientIP = block_.ip_addresses[qri.client_address].addr;
-        query->serverIP = block_.ip_addresses[sig.server_address].addr;
+        if ( projection_ & ADDRESSES )
+        {
+            query->clientIP = block_.ip_addresses[qri.client_address].addr;
+            query->serverIP = block_.ip_addresses[sig.server_address].addr;
+        }
         query->clientPort = qri.client_port;
         query->serverPort = sig.server_port;
         query->hoplimit = qri.hoplimit;
@@ -358,9 +476,10 @@ std::shared_ptr<QueryResponse> BlockCborReader::readQR()
         if ( qri.query_extra_info )
             readExtraInfo(*query, *(qri.query_extra_info));
 
-        if ( sig.qr_flags & block_cbor::QUERY_HAS_OPT )
+        if ( ( sig.qr_flags & block_cbor::QUERY_HAS_OPT ) &&
+             ( projection_ & QUERY_SECTIONS ) )
         {
-            byte_string opt_rdata = block_.names_rdatas[sig.query_opt_rdata].str;
+            byte_string opt_rdata = block_.names_rdatas[sig.query_opt_rdata].str.as_byte_string();
 #if ENABLE_PSEUDOANONYMISATION
             if ( pseudo_anon_ )
             {
@@ -392,8 +511,11 @@ std::shared_ptr<QueryResponse> BlockCborReader::readQR()
     {
         response = make_unique<DNSMessage>();
         response->timestamp = qri.tstamp + qri.response_delay;
-        response->clientIP = block_.ip_addresses[qri.client_address].addr;
-        response->serverIP = block_.ip_addresses[sig.server_address].addr;
+        if ( projection_ & ADDRESSES )
+        {
+            response->clientIP = block_.ip_addresses[qri.client_address].addr;
+            response->serverIP = block_.ip_addresses[sig.server_address].addr;
+        }
         response->clientPort = qri.client_port;
         response->serverPort = sig.server_port;
         response->tcp = sig.transport_flags & BaseOutputWriter::TCP;
@@ -409,7 +531,8 @@ std::shared_ptr<QueryResponse> BlockCborReader::readQR()
             readExtraInfo(*response, *(qri.response_extra_info));
     }
 
-    if ( sig.qr_flags & block_cbor::QR_HAS_QUESTION )
+    if ( ( sig.qr_flags & block_cbor::QR_HAS_QUESTION ) &&
+         ( projection_ & QUESTION ) )
     {
         CaptureDNS::query q = makeQuery(qri.qname, sig.query_classtype);
         if ( query )
@@ -457,21 +580,21 @@ void BlockCborReader::readExtraInfo(DNSMessage& dns, const block_cbor::QueryResp
 
 CaptureDNS::query BlockCborReader::makeQuery(block_cbor::index_t qname_id, block_cbor::index_t class_type_id) const
 {
-    byte_string qname = block_.names_rdatas[qname_id].str;
+    DNSName qname = block_.names_rdatas[qname_id].str;
     const block_cbor::ClassType& ct = block_.class_types[class_type_id];
-    return CaptureDNS::query(qname,
+    return CaptureDNS::query(std::move(qname),
                             static_cast<CaptureDNS::QueryType>(ct.qtype),
                             static_cast<CaptureDNS::QueryClass>(ct.qclass));
 }
 
 CaptureDNS::resource BlockCborReader::makeResource(const block_cbor::ResourceRecord& rr) const
 {
-    byte_string name = block_.names_rdatas[rr.name].str;
+    DNSName name = block_.names_rdatas[rr.name].str;
     const block_cbor::ClassType& ct = block_.class_types[rr.classtype];
-    byte_string rdata = block_.names_rdatas[rr.rdata].str;
+    byte_string rdata = block_.names_rdatas[rr.rdata].str.as_byte_string();
 
-    CaptureDNS::resource res(name,
-                             rdata,
+    CaptureDNS::resource res(std::move(name),
+                             std::move(rdata),
                              static_cast<CaptureDNS::QueryType>(ct.qtype),
                              static_cast<CaptureDNS::QueryClass>(ct.qclass),
                              rr.ttl);
@@ -15,6 +15,7 @@
 
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/functional/hash.hpp>
@@ -43,6 +44,24 @@
 class BlockCborReader
 {
 public:
+    /**
+     * \brief Query/response data a caller can request.
+     *
+     * Timestamps, transaction IDs and the DNS header information recorded
+     * in the query signature are always present. Block tables needed
+     * only for data not requested are skipped when reading.
+     */
+    enum Projection
+    {
+        ADDRESSES = (1 << 0),
+        QUESTION = (1 << 1),
+        QUERY_SECTIONS = (1 << 2),
+        RESPONSE_SECTIONS = (1 << 3),
+        STATISTICS = (1 << 4),
+        ADDRESS_EVENTS = (1 << 5),
+        ALL = (1 << 6) - 1,
+    };
+
     /**
      * \brief Constructor.
      *
@@ -64,6 +83,46 @@ public:
      */
     std::shared_ptr<QueryResponse> readQR();
 
+    /**
+     * \brief Declare the query/response data required.
+     *
+     * Takes effect from the next block read. Data not requested is
+     * left empty in the Query/Response pairs returned, and statistics
+     * and address events not requested are not reported.
+     *
+     * \param projection the data required, a combination of `Projection`
+     *                   values.
+     */
+    void set_projection(unsigned projection);
+
+    /**
+     * \brief Search for matching Query/Response pairs.
+     *
+     * Takes effect from the next block read. Only Query/Response pairs
+     * matching the search are returned. Blocks whose filters show they
+     * contain no matches are not decoded. Addresses are matched before
+     * any pseudo-anonymisation is applied when reading.
+     *
+     * \param search the search criteria.
+     */
+    void set_search(const block_cbor::BlockSearch& search);
+
+    /**
+     * \brief Return the number of blocks read.
+     */
+    uint64_t blocks_read() const
+    {
+        return current_block_num_;
+    }
+
+    /**
+     * \brief Return the number of blocks skipped by a search.
+     */
+    uint64_t blocks_skipped() const
+    {
+        return blocks_skipped_;
+    }
+
     /**
      * \brief Dump the statistics for the block to the stream provided
      *
@@ -159,6 +218,19 @@ private:
      */
     bool readBlock();
 
+    /**
+     * \brief Find the block table entries matching the search.
+     */
+    void findSearchMatches();
+
+    /**
+     * \brief Determine if a Query/Response item matches the search.
+     *
+     * \param qri the item.
+     * \returns `true` if the item matches.
+     */
+    bool searchMatches(const block_cbor::QueryResponseItem& qri) const;
+
     /**
      * \brief the decoder to read from.
      */
@@ -214,6 +286,36 @@ private:
      */
     boost::optional<PseudoAnonymise> pseudo_anon_;
 
+    /**
+     * \brief the query/response data required.
+     */
+    unsigned projection_;
+
+    /**
+     * \brief the block parts to decode.
+     */
+    unsigned parts_;
+
+    /**
+     * \brief the search to apply, if any.
+     */
+    boost::optional<block_cbor::BlockSearch> search_;
+
+    /**
+     * \brief indexes of current block addresses matching the search.
+     */
+    std::vector<block_cbor::index_t> search_addresses_;
+
+    /**
+     * \brief indexes of current block names matching the search.
+     */
+    std::vector<block_cbor::index_t> search_names_;
+
+    /**
+     * \brief the number of blocks skipped by the search.
+     */
+    uint64_t blocks_skipped_;
+
     /**
      * \brief accumulated address events from the file.
      */
@@ -12,6 +12,7 @@
 
 #include <chrono>
 #include <stdexcept>
+#include <vector>
 
 #include <limits.h>
 #include <unistd.h>
@@ -20,6 +21,7 @@
 
 #include "capturedns.hpp"
 #include "cborencoder.hpp"
+#include "clientsampler.hpp"
 #include "dnsmessage.hpp"
 #include "makeunique.hpp"
 #include "blockcbor.hpp"
@@ -27,13 +29,14 @@
 #include "blockcborwriter.hpp"
 
 BlockCborWriter::BlockCborWriter(const Configuration& config,
-                                     std::unique_ptr<CborBaseStreamFileEncoder> enc)
+                                 std::unique_ptr<CborBaseStreamFileEncoder> enc,
+                                 boost::optional<PseudoAnonymise> pseudo_anon)
     : BaseOutputWriter(config),
-      output_pattern_(config.output_pattern + enc->suggested_extension(),
+      output_pattern_(config.output_pattern + ( enc ? enc->suggested_extension() : "" ),
                       std::chrono::seconds(config.rotation_period)),
       enc_(std::move(enc)), data_(make_unique<block_cbor::BlockData>(config.max_block_qr_items)),
       query_response_(), ext_rr_(nullptr), ext_group_(nullptr),
-      last_end_block_statistics_()
+      last_end_block_statistics_(), pseudo_anon_(pseudo_anon)
 {
 }
 
@@ -44,6 +47,14 @@ BlockCborWriter::~BlockCborWriter()
 
 void BlockCborWriter::close()
 {
+    if ( !enc_ )
+    {
+        // Only streaming. Send any part block.
+        if ( !data_->query_response_items.empty() || !data_->address_event_counts.empty() )
+            writeBlock();
+        return;
+    }
+
     if ( enc_->is_open() )
     {
         writeBlock();
@@ -52,6 +63,18 @@ void BlockCborWriter::close()
     }
 }
 
+void BlockCborWriter::set_streamer(std::shared_ptr<BlockStreamer> streamer)
+{
+    streamer_ = streamer;
+    if ( streamer_ )
+    {
+        CborBufferEncoder header;
+        writeFileHeader(header);
+        header.flush();
+        streamer_->set_header(header.bytes());
+    }
+}
+
 void BlockCborWriter::writeAE(const std::shared_ptr<AddressEvent>& ae,
                                 const PacketStatistics& stats)
 {
@@ -61,12 +84,15 @@ void BlockCborWriter::writeAE(const std::shared_ptr<AddressEvent>& ae,
 
 void BlockCborWriter::checkForRotation(const std::chrono::system_clock::time_point& timestamp)
 {
+    if ( !enc_ )
+        return;
+
     if ( !enc_->is_open() || output_pattern_.need_rotate(timestamp, config_) )
     {
         close();
         filename_ = output_pattern_.filename(timestamp, config_);
         enc_->open(filename_);
-        writeFileHeader();
+        writeFileHeader(*enc_);
     }
 }
 
@@ -147,7 +173,7 @@ void BlockCborWriter::writeBasic(const std::shared_ptr<QueryResponse>& qr,
             qri.qr_flags |= block_cbor::QUERY_HAS_OPT;
             qs.query_edns_payload_size = edns0->udp_payload_size();
             qs.query_edns_version = edns0->edns_version();
-            qs.query_opt_rdata = data_->add_name_rdata(edns0->rr().data());
+            qs.query_opt_rdata = data_->add_name_rdata(pseudo_anonymise_opt_rdata(edns0->rr().data()));
         }
     }
 
@@ -240,7 +266,10 @@ void BlockCborWriter::writeResourceRecord(const CaptureDNS::resource& resource)
     ct.qclass = resource.query_class();
     rr.classtype = data_->add_classtype(ct);
     rr.ttl = resource.ttl();
-    rr.rdata = data_->add_name_rdata(resource.data());
+    if ( ct.qtype == CaptureDNS::OPT )
+        rr.rdata = data_->add_name_rdata(pseudo_anonymise_opt_rdata(resource.data()));
+    else
+        rr.rdata = data_->add_name_rdata(resource.data());
     ext_rr_->push_back(data_->add_resource_record(rr));
 }
 
@@ -254,7 +283,7 @@ void BlockCborWriter::startAdditionalSection()
     ext_rr_ = &extra_additional_;
 }
 
-void BlockCborWriter::writeFileHeader()
+void BlockCborWriter::writeFileHeader(CborBaseEncoder& enc)
 {
     constexpr unsigned major_format_index = block_cbor::find_file_preamble_index(block_cbor::FilePreambleField::major_format_version);
     constexpr unsigned minor_format_index = block_cbor::find_file_preamble_index(block_cbor::FilePreambleField::minor_format_version);
@@ -262,37 +291,41 @@ void BlockCborWriter::writeFileHeader()
     constexpr unsigned generator_index = block_cbor::find_file_preamble_index(block_cbor::FilePreambleField::generator_id);
     constexpr unsigned host_index = block_cbor::find_file_preamble_index(block_cbor::FilePreambleField::host_id);
 
-    enc_->writeArrayHeader(3);
-    enc_->write(block_cbor::FILE_FORMAT_ID);
+    enc.writeArrayHeader(3);
+    enc.write(block_cbor::FILE_FORMAT_ID);
 
     // File preamble.
-    enc_->writeMapHeader();
-    enc_->write(major_format_index);
-    enc_->write(block_cbor::FILE_FORMAT_MAJOR_VERSION);
-    enc_->write(minor_format_index);
-    enc_->write(block_cbor::FILE_FORMAT_MINOR_VERSION);
+    enc.writeMapHeader();
+    enc.write(major_format_index);
+    enc.write(block_cbor::FILE_FORMAT_MAJOR_VERSION);
+    enc.write(minor_format_index);
+    enc.write(block_cbor::FILE_FORMAT_MINOR_VERSION);
 
-    enc_->write(configuration_index);
-    writeConfiguration();
+    enc.write(configuration_index);
+    writeConfiguration(enc);
 
     if ( !config_.omit_sysid )
     {
-        enc_->write(generator_index);
-        enc_->write(PACKAGE_STRING);
-
-        char buf[_POSIX_HOST_NAME_MAX];
-        gethostname(buf, sizeof(buf));
-        buf[_POSIX_HOST_NAME_MAX - 1] = '\0';
-        enc_->write(host_index);
-        enc_->write(std::string(buf));
+        enc.write(generator_index);
+        enc.write(PACKAGE_STRING);
+
+        // The host ID is not recorded if pseudo-anonymising.
+        if ( !pseudo_anon_ )
+        {
+            char buf[_POSIX_HOST_NAME_MAX];
+            gethostname(buf, sizeof(buf));
+            buf[_POSIX_HOST_NAME_MAX - 1] = '\0';
+            enc.write(host_index);
+            enc.write(std::string(buf));
+        }
     }
-    enc_->writeBreak(); // End of preamble
+    enc.writeBreak(); // End of preamble
 
     // Write file header: Start of file blocks.
-    enc_->writeArrayHeader();
+    enc.writeArrayHeader();
 }
 
-void BlockCborWriter::writeConfiguration()
+void BlockCborWriter::writeConfiguration(CborBaseEncoder& enc)
 {
     constexpr unsigned query_timeout_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::query_timeout);
     constexpr unsigned skew_timeout_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::skew_timeout);
@@ -307,52 +340,79 @@ void BlockCborWriter::writeConfiguration()
     constexpr unsigned accept_rr_types_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::accept_rr_types);
     constexpr unsigned ignore_rr_types_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::ignore_rr_types);
     constexpr unsigned max_block_qr_items_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::max_block_qr_items);
-
-    enc_->writeMapHeader();
-
-    enc_->write(query_timeout_index);
-    enc_->write(config_.query_timeout);
-    enc_->write(skew_timeout_index);
-    enc_->write(config_.skew_timeout);
-    enc_->write(snaplen_index);
-    enc_->write(config_.snaplen);
-    enc_->write(promisc_index);
-    enc_->write(config_.promisc_mode);
-    enc_->write(interfaces_index);
-    enc_->writeArrayHeader();
+    constexpr unsigned client_sample_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::compactor_client_sample);
+    constexpr unsigned client_sample_ipv4_prefix_length_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::compactor_client_sample_ipv4_prefix_length);
+    constexpr unsigned client_sample_ipv6_prefix_length_index = block_cbor::find_configuration_index(block_cbor::ConfigurationField::compactor_client_sample_ipv6_prefix_length);
+
+    enc.writeMapHeader();
+
+    enc.write(query_timeout_index);
+    enc.write(config_.query_timeout);
+    enc.write(skew_timeout_index);
+    enc.write(config_.skew_timeout);
+    enc.write(snaplen_index);
+    enc.write(config_.snaplen);
+    enc.write(promisc_index);
+    enc.write(config_.promisc_mode);
+    enc.write(interfaces_index);
+    enc.writeArrayHeader();
     for ( const auto& s : config_.network_interfaces )
-        enc_->write(s);
-    enc_->writeBreak();
-    enc_->write(server_addresses_index);
-    enc_->writeArrayHeader();
+        enc.write(s);
+    enc.writeBreak();
+    enc.write(server_addresses_index);
+    enc.writeArrayHeader();
     for ( const auto& s : config_.server_addresses )
-        enc_->write(s.asNetworkBinary());
-    enc_->writeBreak();
-    enc_->write(vlan_ids_index);
-    enc_->writeArrayHeader();
+    {
+#if ENABLE_PSEUDOANONYMISATION
+        if ( pseudo_anon_ )
+        {
+            enc.write(pseudo_anon_->address(s).asNetworkBinary());
+            continue;
+        }
+#endif
+        enc.write(s.asNetworkBinary());
+    }
+    enc.writeBreak();
+    enc.write(vlan_ids_index);
+    enc.writeArrayHeader();
     for ( const auto& id : config_.vlan_ids )
-        enc_->write(id);
-    enc_->writeBreak();
-    enc_->write(filter_index);
-    enc_->write(config_.filter);
-    enc_->write(query_options_index);
-    enc_->write(config_.output_options_queries);
-    enc_->write(response_options_index);
-    enc_->write(config_.output_options_responses);
-    enc_->write(accept_rr_types_index);
-    enc_->writeArrayHeader();
+        enc.write(id);
+    enc.writeBreak();
+    enc.write(filter_index);
+    // The filter may contain addresses, so don't record it if
+    // pseudo-anonymising.
+    enc.write(pseudo_anon_ ? std::string() : config_.filter);
+    enc.write(query_options_index);
+    enc.write(config_.output_options_queries);
+    enc.write(response_options_index);
+    enc.write(config_.output_options_responses);
+    enc.write(accept_rr_types_index);
+    enc.writeArrayHeader();
     for ( const auto&a_rr : config_.accept_rr_types )
-        enc_->write(a_rr);
-    enc_->writeBreak();
-    enc_->write(ignore_rr_types_index);
-    enc_->writeArrayHeader();
+        enc.write(a_rr);
+    enc.writeBreak();
+    enc.write(ignore_rr_types_index);
+    enc.writeArrayHeader();
     for ( const auto& i_rr : config_.ignore_rr_types )
-        enc_->write(i_rr);
-    enc_->writeBreak();
-    enc_->write(max_block_qr_items_index);
-    enc_->write(config_.max_block_qr_items);
+        enc.write(i_rr);
+    enc.writeBreak();
+    enc.write(max_block_qr_items_index);
+    enc.write(config_.max_block_qr_items);
+
+    // Record any client sample so readers can scale counts.
+    // The sample key is not recorded.
+    unsigned client_sample = ClientSampler::parts_per_million(config_.client_sample);
+    if ( client_sample < ClientSampler::PARTS )
+    {
+        enc.write(client_sample_index);
+        enc.write(client_sample);
+        enc.write(client_sample_ipv4_prefix_length_index);
+        enc.write(config_.client_sample_ipv4_prefix_length);
+        enc.write(client_sample_ipv6_prefix_length_index);
+        enc.write(config_.client_sample_ipv6_prefix_length);
+    }
 
-    enc_->writeBreak(); // End of config info
+    enc.writeBreak(); // End of config info
 }
 
 void BlockCborWriter::writeFileFooter()
@@ -363,6 +423,55 @@ void BlockCborWriter::writeFileFooter()
 void BlockCborWriter::writeBlock()
 {
     data_->last_packet_statistics = last_end_block_statistics_;
-    data_->writeCbor(*enc_);
+    if ( metrics_ )
+        metrics_->set_block_table_sizes(*data_);
+    pseudo_anonymise_addresses();
+    if ( config_.block_filter_bits > 0 )
+        data_->build_filters(config_.block_filter_bits);
+    if ( streamer_ )
+    {
+        stream_enc_.clear();
+        data_->writeCbor(stream_enc_);
+        stream_enc_.flush();
+        streamer_->publish(stream_enc_.bytes());
+        if ( enc_ )
+            enc_->writeEncoded(stream_enc_.bytes());
+    }
+    else
+        data_->writeCbor(*enc_);
     data_->clear();
 }
+
+void BlockCborWriter::pseudo_anonymise_addresses()
+{
+#if ENABLE_PSEUDOANONYMISATION
+    if ( !pseudo_anon_ || data_->ip_addresses.size() == 0 )
+        return;
+
+    // The address table holds each distinct address in the block once,
+    // so each is encrypted only once. Query/response items and address
+    // events refer to addresses by table index, so are unaffected.
+    // The table is cleared once written, so we can modify the
+    // addresses in place.
+    std::vector<IPAddress> addrs;
+    addrs.reserve(data_->ip_addresses.size());
+    for ( auto& a : data_->ip_addresses )
+        addrs.push_back(a.addr);
+    pseudo_anon_->addresses(addrs);
+    auto addr = addrs.begin();
+    for ( auto& a : data_->ip_addresses )
+        a.addr = *addr++;
+#endif
+}
+
+byte_string BlockCborWriter::pseudo_anonymise_opt_rdata(const byte_string& rdata) const
+{
+#if ENABLE_PSEUDOANONYMISATION
+    if ( pseudo_anon_ )
+    {
+        CaptureDNS::EDNS0 edns0(CaptureDNS::INTERNET, 0, rdata);
+        return pseudo_anon_->edns0(edns0).rr().data();
+    }
+#endif
+    return rdata;
+}
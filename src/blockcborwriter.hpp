@@ -16,10 +16,15 @@
 #include <chrono>
 #include <memory>
 
+#include <boost/optional.hpp>
+
 #include "baseoutputwriter.hpp"
+#include "blockstreamer.hpp"
 #include "cborencoder.hpp"
 #include "blockcbordata.hpp"
+#include "metrics.hpp"
 #include "packetstatistics.hpp"
+#include "pseudoanonymise.hpp"
 
 /**
  * \class BlockCborWriter
@@ -40,11 +45,21 @@ public:
     /**
      * \brief Constructor.
      *
-     * \param config output configuration.
-     * \param enc    file encoder to use for writing output.
+     * If pseudo-anonymisation is requested, addresses are recorded
+     * in the block address table as captured, and the table is
+     * pseudo-anonymised just before the block is written. Each distinct
+     * address is therefore encrypted at most once per block, and
+     * the work is done on the writer thread.
+     *
+     * \param config      output configuration.
+     * \param enc         file encoder to use for writing output, or
+     *                    `nullptr` to write no files, only streaming
+     *                    blocks.
+     * \param pseudo_anon pseudo-anonymisation, if to use.
      */
     BlockCborWriter(const Configuration& config,
-                      std::unique_ptr<CborBaseStreamFileEncoder> enc);
+                    std::unique_ptr<CborBaseStreamFileEncoder> enc,
+                    boost::optional<PseudoAnonymise> pseudo_anon = {});
     /**
      * \brief Destructor.
      *
@@ -57,6 +72,25 @@ public:
      */
     void close();
 
+    /**
+     * \brief Set metrics to be updated as blocks are written.
+     *
+     * \param metrics the metrics.
+     */
+    void set_metrics(std::shared_ptr<Metrics> metrics)
+    {
+        metrics_ = metrics;
+    }
+
+    /**
+     * \brief Set a streamer to receive each block as it is written.
+     *
+     * This sets the streamer header from this writer's configuration.
+     *
+     * \param streamer the streamer.
+     */
+    void set_streamer(std::shared_ptr<BlockStreamer> streamer);
+
     /**
      * \brief Write out a single address event.
      *
@@ -156,8 +190,10 @@ public:
 protected:
     /**
      * \brief Write file header, to start of first block.
+     *
+     * \param enc the encoder to write to.
      */
-    void writeFileHeader();
+    void writeFileHeader(CborBaseEncoder& enc);
 
     /**
      * \brief Write file footer, after end of last block.
@@ -171,8 +207,10 @@ protected:
 
     /**
      * \brief Write configuration out to file.
+     *
+     * \param enc the encoder to write to.
      */
-    void writeConfiguration();
+    void writeConfiguration(CborBaseEncoder& enc);
 
 private:
     /**
@@ -240,6 +278,39 @@ private:
      */
     PacketStatistics last_end_block_statistics_;
 
+    /**
+     * \brief pseudo-anonymisation, if to use.
+     */
+    boost::optional<PseudoAnonymise> pseudo_anon_;
+
+    /**
+     * \brief metrics to update, if any.
+     */
+    std::shared_ptr<Metrics> metrics_;
+
+    /**
+     * \brief streamer to receive blocks, if any.
+     */
+    std::shared_ptr<BlockStreamer> streamer_;
+
+    /**
+     * \brief encoder for blocks being streamed.
+     */
+    CborBufferEncoder stream_enc_;
+
+    /**
+     * \brief Pseudo-anonymise the block address table.
+     */
+    void pseudo_anonymise_addresses();
+
+    /**
+     * \brief Pseudo-anonymise OPT RDATA if required.
+     *
+     * \param rdata the OPT RDATA.
+     * \returns the RDATA to record.
+     */
+    byte_string pseudo_anonymise_opt_rdata(const byte_string& rdata) const;
+
     /**
      * \brief Clear in-progress extras info.
      */
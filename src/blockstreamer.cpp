@@ -0,0 +1,378 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "blockstreamer.hpp"
+#include "log.hpp"
+#include "threadplacement.hpp"
+
+namespace {
+    /**
+     * \brief how often to look for a FIFO reader, in milliseconds.
+     */
+    const int STREAM_POLL_MS = 500;
+
+    /**
+     * \brief how long to wait to end the stream to subscribers on exit.
+     */
+    const std::chrono::seconds STREAM_FINISH_TIMEOUT(2);
+
+    /**
+     * \brief the end of the stream. A CBOR break, ending the
+     * indefinite length array of blocks begun by the header.
+     */
+    const byte_string STREAM_FOOTER(1, 0xff);
+}
+
+BlockStreamer::BlockStreamer(const std::string& path, unsigned max_blocks)
+    : path_(path), max_blocks_(std::max(max_blocks, 1u)), fifo_(false),
+      listen_fd_(-1), socket_inode_(0), dropped_subscribers_(0),
+      dropped_blocks_(0), stop_(false)
+{
+    struct stat st;
+    if ( stat(path_.c_str(), &st) == 0 )
+    {
+        if ( S_ISFIFO(st.st_mode) )
+            fifo_ = true;
+        else if ( !S_ISSOCK(st.st_mode) )
+            throw std::runtime_error("Stream path " + path_ + " exists and is not a socket or FIFO");
+    }
+
+    if ( !fifo_ )
+    {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if ( path_.size() >= sizeof(addr.sun_path) )
+            throw std::runtime_error("Stream socket path too long: " + path_);
+        std::strcpy(addr.sun_path, path_.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if ( listen_fd_ == -1 )
+            throw std::runtime_error(std::string("Can't create stream socket: ") + std::strerror(errno));
+        unlink(path_.c_str());
+        if ( bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 ||
+             listen(listen_fd_, 8) == -1 )
+        {
+            int err = errno;
+            close(listen_fd_);
+            throw std::runtime_error("Can't listen on stream socket " + path_ + ": " + std::strerror(err));
+        }
+        if ( stat(path_.c_str(), &st) == 0 )
+            socket_inode_ = st.st_ino;
+    }
+
+    if ( pipe2(wake_fds_, O_NONBLOCK | O_CLOEXEC) == -1 )
+    {
+        int err = errno;
+        if ( listen_fd_ != -1 )
+        {
+            close(listen_fd_);
+            unlink(path_.c_str());
+        }
+        throw std::runtime_error(std::string("Can't create stream wakeup pipe: ") + std::strerror(err));
+    }
+
+    thread_ = std::thread(&BlockStreamer::serve, this);
+}
+
+BlockStreamer::~BlockStreamer()
+{
+    stop_ = true;
+    wakeup();
+    thread_.join();
+
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+    if ( listen_fd_ != -1 )
+    {
+        close(listen_fd_);
+
+        // On reload, another streamer may have replaced our socket.
+        struct stat st;
+        if ( stat(path_.c_str(), &st) == 0 && st.st_ino == socket_inode_ )
+            unlink(path_.c_str());
+    }
+}
+
+void BlockStreamer::set_header(const byte_string& header)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        header_ = std::make_shared<const byte_string>(header);
+    }
+    wakeup();
+}
+
+void BlockStreamer::publish(const byte_string& block)
+{
+    Data data = std::make_shared<const byte_string>(block);
+
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        for ( auto& sub : subscribers_ )
+        {
+            if ( sub.dropped )
+                continue;
+
+            if ( sub.queue.size() >= max_blocks_ )
+            {
+                if ( !fifo_ )
+                {
+                    sub.dropped = true;
+                    sub.queue.clear();
+                    ++dropped_subscribers_;
+                    continue;
+                }
+
+                // Drop whole blocks not yet started, so the reader
+                // still receives a valid stream.
+                std::size_t keep = ( sub.sent > 0 ) ? 1 : 0;
+                dropped_blocks_ += sub.queue.size() - keep;
+                sub.queue.resize(keep);
+                if ( !sub.lagging )
+                {
+                    LOG_WARN << "C-DNS stream FIFO reader too slow. Dropping blocks";
+                    sub.lagging = true;
+                }
+            }
+
+            sub.queue.push_back(data);
+        }
+    }
+    wakeup();
+}
+
+unsigned BlockStreamer::subscriber_count()
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return subscribers_.size();
+}
+
+void BlockStreamer::serve()
+{
+    set_thread_name("cdns stream");
+
+    // A write to a FIFO with no reader raises SIGPIPE, which would
+    // stop the capture. Block it in this thread, so the write just
+    // fails with EPIPE.
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
+    while ( !stop_ )
+    {
+        std::vector<struct pollfd> pfds;
+        pfds.push_back({ wake_fds_[0], POLLIN, 0 });
+
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if ( listen_fd_ != -1 && header_ )
+                pfds.push_back({ listen_fd_, POLLIN, 0 });
+
+            // Hang-ups are always reported, so a subscriber going
+            // away is noticed even when there is nothing to send.
+            for ( const auto& sub : subscribers_ )
+                pfds.push_back({ sub.fd, static_cast<short>(sub.queue.empty() ? 0 : POLLOUT), 0 });
+        }
+
+        int res = poll(pfds.data(), pfds.size(), STREAM_POLL_MS);
+        if ( res == -1 && errno != EINTR )
+        {
+            LOG_ERROR << "C-DNS stream poll failed: " << std::strerror(errno);
+            return;
+        }
+
+        char buf[64];
+        while ( read(wake_fds_[0], buf, sizeof(buf)) > 0 )
+            ;
+
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            std::size_t first_sub = pfds.size() - subscribers_.size();
+            for ( std::size_t i = 0; i < subscribers_.size(); ++i )
+            {
+                Subscriber& sub = subscribers_[i];
+                if ( sub.dropped )
+                    continue;
+
+                bool gone = ( res > 0 && ( pfds[first_sub + i].revents & ( POLLERR | POLLHUP ) ) );
+                if ( gone || !send_queued(sub) )
+                {
+                    LOG_INFO << "C-DNS stream subscriber disconnected";
+                    close(sub.fd);
+                    sub.fd = -1;
+                }
+            }
+
+            for ( auto& sub : subscribers_ )
+                if ( sub.dropped )
+                {
+                    LOG_WARN << "C-DNS stream subscriber too slow. Dropping subscriber";
+                    close(sub.fd);
+                    sub.fd = -1;
+                }
+
+            subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(),
+                                              [](const Subscriber& s) { return s.fd == -1; }),
+                               subscribers_.end());
+        }
+
+        if ( fifo_ )
+            open_fifo();
+        else if ( res > 0 && pfds.size() > 1 && pfds[1].fd == listen_fd_ && ( pfds[1].revents & POLLIN ) )
+            accept_subscriber();
+    }
+
+    finish_subscribers();
+}
+
+void BlockStreamer::accept_subscriber()
+{
+    int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if ( fd == -1 )
+    {
+        if ( errno != EINTR && errno != EAGAIN && errno != ECONNABORTED )
+            LOG_ERROR << "C-DNS stream accept failed: " << std::strerror(errno);
+        return;
+    }
+
+    LOG_INFO << "C-DNS stream subscriber connected";
+    add_subscriber(fd);
+}
+
+void BlockStreamer::open_fifo()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if ( !header_ || !subscribers_.empty() )
+            return;
+    }
+
+    // Opening a FIFO for writing without blocking fails if there
+    // is no reader.
+    int fd = open(path_.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if ( fd == -1 )
+    {
+        if ( errno != ENXIO && errno != EINTR )
+            LOG_ERROR << "Can't open C-DNS stream FIFO " << path_ << ": " << std::strerror(errno);
+        return;
+    }
+
+    LOG_INFO << "C-DNS stream FIFO reader connected";
+    add_subscriber(fd);
+}
+
+void BlockStreamer::add_subscriber(int fd)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    Subscriber sub;
+    sub.fd = fd;
+    sub.queue.push_back(header_);
+    sub.sent = 0;
+    sub.dropped = false;
+    sub.lagging = false;
+    subscribers_.push_back(std::move(sub));
+    send_queued(subscribers_.back());
+}
+
+bool BlockStreamer::send_queued(Subscriber& sub)
+{
+    while ( !sub.queue.empty() )
+    {
+        const byte_string& data = *sub.queue.front();
+        const unsigned char* p = data.data() + sub.sent;
+        std::size_t len = data.size() - sub.sent;
+
+        ssize_t n = fifo_
+            ? write(sub.fd, p, len)
+            : send(sub.fd, p, len, MSG_NOSIGNAL);
+        if ( n == -1 )
+        {
+            if ( errno == EINTR )
+                continue;
+            return ( errno == EAGAIN || errno == EWOULDBLOCK );
+        }
+
+        sub.sent += static_cast<std::size_t>(n);
+        if ( sub.sent == data.size() )
+        {
+            sub.queue.pop_front();
+            sub.sent = 0;
+        }
+    }
+
+    sub.lagging = false;
+    return true;
+}
+
+void BlockStreamer::finish_subscribers()
+{
+    std::lock_guard<std::mutex> lock(m_);
+    Data footer = std::make_shared<const byte_string>(STREAM_FOOTER);
+    for ( auto& sub : subscribers_ )
+        sub.queue.push_back(footer);
+
+    auto deadline = std::chrono::steady_clock::now() + STREAM_FINISH_TIMEOUT;
+    while ( !subscribers_.empty() )
+    {
+        std::vector<struct pollfd> pfds;
+        for ( auto& sub : subscribers_ )
+        {
+            if ( !send_queued(sub) || sub.queue.empty() )
+            {
+                close(sub.fd);
+                sub.fd = -1;
+            }
+            else
+                pfds.push_back({ sub.fd, POLLOUT, 0 });
+        }
+        subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(),
+                                          [](const Subscriber& s) { return s.fd == -1; }),
+                           subscribers_.end());
+
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if ( subscribers_.empty() || wait.count() <= 0 )
+            break;
+        poll(pfds.data(), pfds.size(), static_cast<int>(wait.count()));
+    }
+
+    for ( auto& sub : subscribers_ )
+    {
+        LOG_WARN << "C-DNS stream subscriber did not take the end of the stream";
+        close(sub.fd);
+    }
+    subscribers_.clear();
+}
+
+void BlockStreamer::wakeup()
+{
+    // If the pipe is full, the thread will wake anyway.
+    char c = 0;
+    ssize_t res = write(wake_fds_[1], &c, 1);
+    (void) res;
+}
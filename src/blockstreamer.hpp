@@ -0,0 +1,266 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef BLOCKSTREAMER_HPP
+#define BLOCKSTREAMER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "bytestring.hpp"
+
+/**
+ * \class BlockStreamer
+ * \brief Stream C-DNS blocks live to local subscribers.
+ *
+ * The streamer either listens on a Unix domain socket, where any
+ * number of subscribers may connect, or writes to an existing FIFO.
+ *
+ * Each subscriber first receives the C-DNS file header, and then
+ * each block as it is completed. When the streamer is stopped, the
+ * array of blocks is ended, so each subscriber receives a valid
+ * C-DNS file.
+ *
+ * Each subscriber has a bounded queue of blocks waiting to be sent.
+ * A socket subscriber that lets its queue fill is dropped. A FIFO
+ * can't tell one reader from the next, so if the FIFO reader falls
+ * behind, whole blocks are dropped instead. Output is never held up
+ * by a slow subscriber.
+ *
+ * The streamer runs in its own thread.
+ */
+class BlockStreamer
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * If `path` is an existing FIFO, write to it. Otherwise create
+     * a Unix domain socket at `path`.
+     *
+     * \param path       the socket or FIFO path.
+     * \param max_blocks the most blocks waiting for a subscriber.
+     * \throws std::runtime_error if the socket can't be opened.
+     */
+    BlockStreamer(const std::string& path, unsigned max_blocks);
+
+    /**
+     * \brief Destructor.
+     *
+     * End the stream to each subscriber, stop the streamer thread
+     * and remove the socket.
+     */
+    ~BlockStreamer();
+
+    BlockStreamer(const BlockStreamer&) = delete;
+    BlockStreamer& operator=(const BlockStreamer&) = delete;
+
+    /**
+     * \brief Set the header sent to new subscribers.
+     *
+     * No subscriber is accepted until a header is set.
+     *
+     * \param header the encoded C-DNS file header, up to the start
+     *               of the array of blocks.
+     */
+    void set_header(const byte_string& header);
+
+    /**
+     * \brief Send a completed block to all subscribers.
+     *
+     * \param block the encoded block.
+     */
+    void publish(const byte_string& block);
+
+    /**
+     * \brief Return the number of current subscribers.
+     *
+     * \returns the number of subscribers.
+     */
+    unsigned subscriber_count();
+
+    /**
+     * \brief Return the number of subscribers dropped for being slow.
+     *
+     * \returns the number of dropped subscribers.
+     */
+    uint64_t dropped_subscriber_count() const
+    {
+        return dropped_subscribers_;
+    }
+
+    /**
+     * \brief Return the number of blocks not sent to a slow FIFO reader.
+     *
+     * \returns the number of dropped blocks.
+     */
+    uint64_t dropped_block_count() const
+    {
+        return dropped_blocks_;
+    }
+
+private:
+    /**
+     * \brief a block, or header, shared between subscriber queues.
+     */
+    using Data = std::shared_ptr<const byte_string>;
+
+    /**
+     * \struct Subscriber
+     * \brief A subscriber and its queue of data waiting to be sent.
+     */
+    struct Subscriber
+    {
+        /**
+         * \brief the connection file descriptor.
+         */
+        int fd;
+
+        /**
+         * \brief data waiting to be sent.
+         */
+        std::deque<Data> queue;
+
+        /**
+         * \brief the number of bytes of the front item already sent.
+         */
+        std::size_t sent;
+
+        /**
+         * \brief `true` if the subscriber is to be dropped.
+         */
+        bool dropped;
+
+        /**
+         * \brief `true` if blocks are being dropped for this subscriber.
+         */
+        bool lagging;
+    };
+
+    /**
+     * \brief Streamer thread function.
+     */
+    void serve();
+
+    /**
+     * \brief Accept a new socket subscriber.
+     */
+    void accept_subscriber();
+
+    /**
+     * \brief Open the FIFO, if it has a reader and is not open.
+     */
+    void open_fifo();
+
+    /**
+     * \brief Add a subscriber, with the header queued.
+     *
+     * \param fd the subscriber file descriptor.
+     */
+    void add_subscriber(int fd);
+
+    /**
+     * \brief Send as much queued data as possible without blocking.
+     *
+     * \param sub the subscriber.
+     * \returns `false` if the subscriber has gone.
+     */
+    bool send_queued(Subscriber& sub);
+
+    /**
+     * \brief End the stream to each subscriber and close them.
+     *
+     * Wait a short while for the remaining data to be sent.
+     */
+    void finish_subscribers();
+
+    /**
+     * \brief Wake the streamer thread.
+     */
+    void wakeup();
+
+    /**
+     * \brief the socket or FIFO path.
+     */
+    std::string path_;
+
+    /**
+     * \brief the most blocks waiting for a subscriber.
+     */
+    std::size_t max_blocks_;
+
+    /**
+     * \brief `true` if writing to a FIFO.
+     */
+    bool fifo_;
+
+    /**
+     * \brief the listening socket, or -1 for a FIFO.
+     */
+    int listen_fd_;
+
+    /**
+     * \brief the inode of the socket, to check it is still ours on exit.
+     */
+    ino_t socket_inode_;
+
+    /**
+     * \brief pipe used to wake the streamer thread.
+     */
+    int wake_fds_[2];
+
+    /**
+     * \brief mutex protecting the header and subscribers.
+     */
+    std::mutex m_;
+
+    /**
+     * \brief the header sent to new subscribers.
+     */
+    Data header_;
+
+    /**
+     * \brief the current subscribers.
+     */
+    std::vector<Subscriber> subscribers_;
+
+    /**
+     * \brief the number of subscribers dropped for being slow.
+     */
+    std::atomic<uint64_t> dropped_subscribers_;
+
+    /**
+     * \brief the number of blocks not sent to a slow FIFO reader.
+     */
+    std::atomic<uint64_t> dropped_blocks_;
+
+    /**
+     * \brief flag indicating the streamer should stop.
+     */
+    std::atomic_bool stop_;
+
+    /**
+     * \brief the streamer thread.
+     */
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "blockcbor.hpp"
+
+#include "bloomfilter.hpp"
+
+namespace {
+    const unsigned MIN_BITS = 64;
+    const unsigned MAX_HASHES = 16;
+
+    const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+    const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+    // Finalizer from SplitMix64, to spread FNV-1a output over all bits.
+    uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+}
+
+BloomFilter::BloomFilter(std::size_t nitems, unsigned bits_per_item)
+{
+    std::size_t nbits = std::max<std::size_t>(nitems * bits_per_item, MIN_BITS);
+    bits_.assign((nbits + 7) / 8, 0);
+
+    // The optimal number of hashes is bits per item * ln(2).
+    nhashes_ = std::lround(bits_per_item * 0.693);
+    nhashes_ = std::min(std::max(nhashes_, 1U), MAX_HASHES);
+}
+
+void BloomFilter::hash(const byte_string& item, uint64_t& h1, uint64_t& h2)
+{
+    uint64_t h = FNV_OFFSET_BASIS;
+    for ( auto c : item )
+    {
+        h ^= c;
+        h *= FNV_PRIME;
+    }
+    h1 = mix(h);
+    // An odd step visits distinct positions for each hash.
+    h2 = mix(h1) | 1;
+}
+
+void BloomFilter::add(const byte_string& item)
+{
+    if ( bits_.empty() )
+        return;
+
+    uint64_t h1, h2;
+    hash(item, h1, h2);
+    uint64_t nbits = bits_.size() * 8;
+    for ( unsigned i = 0; i < nhashes_; ++i, h1 += h2 )
+    {
+        uint64_t bit = h1 % nbits;
+        bits_[bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+bool BloomFilter::may_contain(const byte_string& item) const
+{
+    if ( bits_.empty() )
+        return false;
+
+    uint64_t h1, h2;
+    hash(item, h1, h2);
+    uint64_t nbits = bits_.size() * 8;
+    for ( unsigned i = 0; i < nhashes_; ++i, h1 += h2 )
+    {
+        uint64_t bit = h1 % nbits;
+        if ( !( bits_[bit / 8] & ( 1 << (bit % 8) ) ) )
+            return false;
+    }
+    return true;
+}
+
+void BloomFilter::readCbor(CborBaseDecoder& dec)
+{
+    try
+    {
+        bool indef;
+        uint64_t n_elems = dec.readArrayHeader(indef);
+        if ( indef || n_elems != 2 )
+            throw cbor_file_format_error("Unexpected array length reading Bloom filter");
+        nhashes_ = dec.read_unsigned();
+        bits_ = dec.read_binary();
+        if ( nhashes_ == 0 || nhashes_ > MAX_HASHES )
+            throw cbor_file_format_error("Unexpected hash count reading Bloom filter");
+    }
+    catch (const std::logic_error& e)
+    {
+        throw cbor_file_format_error("Unexpected CBOR item reading Bloom filter");
+    }
+}
+
+void BloomFilter::writeCbor(CborBaseEncoder& enc) const
+{
+    enc.writeArrayHeader(2);
+    enc.write(nhashes_);
+    enc.write(bits_);
+}
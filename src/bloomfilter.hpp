@@ -0,0 +1,123 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef BLOOMFILTER_HPP
+#define BLOOMFILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bytestring.hpp"
+#include "cbordecoder.hpp"
+#include "cborencoder.hpp"
+
+/**
+ * \class BloomFilter
+ * \brief A Bloom filter over byte strings.
+ *
+ * The filter is written to C-DNS files and read back on other
+ * platforms, so item hashing does not depend on the platform or
+ * the standard library implementation. Each item is hashed
+ * with 64 bit FNV-1a, and the bit positions are derived from
+ * the hash by double hashing.
+ */
+class BloomFilter
+{
+public:
+    /**
+     * \brief Default constructor. The filter is empty.
+     */
+    BloomFilter() : nhashes_(0) {}
+
+    /**
+     * \brief Constructor.
+     *
+     * \param nitems        the expected number of items.
+     * \param bits_per_item the filter bits per item.
+     */
+    BloomFilter(std::size_t nitems, unsigned bits_per_item);
+
+    /**
+     * \brief Add an item to the filter.
+     *
+     * \param item the item.
+     */
+    void add(const byte_string& item);
+
+    /**
+     * \brief Check whether the filter may contain an item.
+     *
+     * An empty filter contains nothing.
+     *
+     * \param item the item.
+     * \returns `false` if the item was definitely not added.
+     */
+    bool may_contain(const byte_string& item) const;
+
+    /**
+     * \brief Determine if the filter is empty.
+     *
+     * \returns `true` if the filter has no bits.
+     */
+    bool empty() const
+    {
+        return bits_.empty();
+    }
+
+    /**
+     * \brief Clear the filter.
+     */
+    void clear()
+    {
+        bits_.clear();
+        nhashes_ = 0;
+    }
+
+    /**
+     * \brief Read the object contents from CBOR.
+     *
+     * \param dec CBOR stream to read from.
+     * \throws cbor_file_format_error on unexpected CBOR content.
+     * \throws cbor_decode_error on malformed CBOR items.
+     * \throws cbor_end_of_input on end of CBOR file.
+     */
+    void readCbor(CborBaseDecoder& dec);
+
+    /**
+     * \brief Write the object contents to CBOR.
+     *
+     * \param enc CBOR stream to write to.
+     */
+    void writeCbor(CborBaseEncoder& enc) const;
+
+private:
+    /**
+     * \brief Calculate the two base hashes of an item.
+     *
+     * \param item the item.
+     * \param h1   the first hash.
+     * \param h2   the second hash.
+     */
+    static void hash(const byte_string& item, uint64_t& h1, uint64_t& h2);
+
+    /**
+     * \brief the number of bit positions per item.
+     */
+    unsigned nhashes_;
+
+    /**
+     * \brief the filter bits.
+     */
+    byte_string bits_;
+};
+
+#endif
@@ -101,11 +101,12 @@ CaptureDNS::CaptureDNS(const uint8_t* buffer, uint32_t total_sz)
 {
     InputMemoryStream stream(buffer, total_sz);
     stream.read(header_);
+    validate_header_counts(total_sz);
 
     // Questions
     for ( uint16_t i = 0; i < questions_count(); ++i )
     {
-        byte_string dname(read_dname(stream, buffer, total_sz));
+        DNSName dname(read_dname(stream, buffer, total_sz));
         uint16_t query_type = stream.read_be<uint16_t>();
         uint16_t query_class = stream.read_be<uint16_t>();
         queries_.emplace_back(std::move(dname), static_cast<QueryType>(query_type), static_cast<QueryClass>(query_class));
@@ -122,14 +123,60 @@ CaptureDNS::CaptureDNS(const uint8_t* buffer, uint32_t total_sz)
     trailing_data_size_ = stream.size();
 }
 
-byte_string CaptureDNS::read_dname(InputMemoryStream& s, const uint8_t *buffer, uint32_t buflen)
+void CaptureDNS::validate_header_counts(uint32_t total_sz) const
 {
+    const uint32_t MIN_QUESTION_SIZE = 5;
+    const uint32_t MIN_RR_SIZE = 11;
+    uint32_t min_size =
+        MIN_QUESTION_SIZE * questions_count() +
+        MIN_RR_SIZE * (answers_count() + authority_count() + additional_count());
+
+    if ( min_size > total_sz - sizeof(header_) )
+        throw Tins::malformed_packet();
+}
+
+bool CaptureDNS::scan_uncompressed_dname(const uint8_t* ptr, const uint8_t* bufend, std::size_t& len)
+{
+    const uint8_t* start = ptr;
+
+    // Mirror the checks in read_dname_offset() exactly, so anything
+    // it would reject is handed back to it to reject.
+    if ( ptr >= bufend )
+        return false;
+
+    while ( *ptr != 0 )
+    {
+        uint8_t label_len = *ptr;
+
+        if ( label_len & 0xc0 )
+            return false;
+        if ( ptr + label_len + 1u >= bufend ||
+             static_cast<std::size_t>(ptr - start) + label_len >= MAX_DNAME_LEN )
+            return false;
+        ptr += label_len + 1;
+    }
+
+    len = ptr - start + 1;
+    return true;
+}
+
+DNSName CaptureDNS::read_dname(InputMemoryStream& s, const uint8_t *buffer, uint32_t buflen)
+{
+    std::size_t len;
+    const uint8_t* start = s.pointer();
+
+    if ( scan_uncompressed_dname(start, buffer + buflen, len) )
+    {
+        s.skip(len);
+        return DNSName(start, len);
+    }
+
     unsigned char namebuf[MAX_DNAME_LEN];
     unsigned char* res = namebuf;
 
     uint16_t offset = s.pointer() - buffer;
     s.skip(read_dname_offset(offset, buffer, buflen, res, namebuf + sizeof(namebuf)) - offset);
-    return byte_string(namebuf, res - namebuf);
+    return DNSName(namebuf, res - namebuf);
 }
 
 uint16_t CaptureDNS::read_dname_offset(uint16_t offset, const uint8_t *buffer, uint32_t buflen, unsigned char*& res, const unsigned char* res_end)
@@ -195,14 +242,14 @@ uint16_t CaptureDNS::read_dname_offset(uint16_t offset, const uint8_t *buffer, u
 
 // Implementation taken from Libtins dns.cpp.
 // cppcheck-suppress unusedFunction
-std::string CaptureDNS::decode_domain_name(const byte_string& label)
+std::string CaptureDNS::decode_domain_name(const uint8_t* label, std::size_t len)
 {
     std::string output;
-    if ( label.empty() )
+    if ( len == 0 )
         return output;
 
-    const uint8_t* ptr = label.data();
-    const uint8_t* end = ptr + label.size();
+    const uint8_t* ptr = label;
+    const uint8_t* end = ptr + len;
     while ( *ptr )
     {
         // We can't handle offsets
@@ -250,7 +297,7 @@ byte_string CaptureDNS::encode_domain_name(const std::string& name)
 
 void CaptureDNS::add_rr(CaptureDNS::resources_type& res, Tins::Memory::InputMemoryStream& s, const uint8_t *buffer, uint32_t buflen, bool allow_opt)
 {
-    byte_string dname(read_dname(s, buffer, buflen));
+    DNSName dname(read_dname(s, buffer, buflen));
     uint16_t query_type = s.read_be<uint16_t>();
     uint16_t query_class = s.read_be<uint16_t>();
     uint32_t ttl = s.read_be<uint32_t>();
@@ -272,7 +319,7 @@ void CaptureDNS::add_rr(CaptureDNS::resources_type& res, Tins::Memory::InputMemo
     res.emplace_back(std::move(dname), std::move(data), static_cast<QueryType>(query_type), static_cast<QueryClass>(query_class), ttl);
 }
 
-void CaptureDNS::add_edns0(const byte_string& dname, QueryClass query_class, uint32_t ttl, const byte_string& data)
+void CaptureDNS::add_edns0(const DNSName& dname, QueryClass query_class, uint32_t ttl, const byte_string& data)
 {
     // Name must be empty (apart from the terminating \0), and we mustn't have
     // one already.
@@ -291,6 +338,7 @@ byte_string CaptureDNS::expand_rr_data(uint16_t query_type, uint16_t offset, uin
     uint16_t rdata_end = offset + len;
     unsigned char namebuf[MAX_DNAME_LEN];
     unsigned char* name;
+    std::size_t name_len;
 
     switch(query_type)
     {
@@ -298,6 +346,12 @@ byte_string CaptureDNS::expand_rr_data(uint16_t query_type, uint16_t offset, uin
     case CNAME:
     case PTR:
         // RDATA is a single label.
+        if ( scan_uncompressed_dname(buf + offset, buf + buflen, name_len) )
+        {
+            res = byte_string(buf + offset, name_len);
+            offset += name_len;
+            break;
+        }
         name = namebuf;
         offset = read_dname_offset(offset, buf, buflen, name, namebuf + sizeof(namebuf));
         res = byte_string(namebuf, name - namebuf);
@@ -886,7 +940,7 @@ namespace {
                          const CaptureDNS::query& q,
                          LabelCompressionInfo& lci)
     {
-        auto l = lci.add_label(q.dname(), q.query_type(),
+        auto l = lci.add_label(q.dname().as_byte_string(), q.query_type(),
                                LabelHint(HINT_QUERY), stream.offset());
         stream.write(l->compressed_label().data(), l->compressed_label().size());
         stream.write_be<uint16_t>(q.query_type());
@@ -906,7 +960,7 @@ namespace {
                             LabelCompressionInfo& lci,
                             uint16_t rr_no)
     {
-        auto l = lci.add_label(r.dname(), r.query_type(),
+        auto l = lci.add_label(r.dname().as_byte_string(), r.query_type(),
                                LabelHint(HINT_NONE, rr_no), stream.offset());
         stream.write(l->compressed_label().data(), l->compressed_label().size());
         stream.write_be<uint16_t>(r.query_type());
@@ -968,7 +1022,7 @@ namespace {
     uint32_t size_query(const CaptureDNS::query& q,
                         LabelCompressionInfo& lci)
     {
-        auto l = lci.add_label(q.dname(), q.query_type(),
+        auto l = lci.add_label(q.dname().as_byte_string(), q.query_type(),
                                LabelHint(HINT_QUERY), 0);
         return l->compressed_label_size() + sizeof(uint16_t) * 2;
     }
@@ -985,7 +1039,7 @@ namespace {
                            LabelCompressionInfo& lci,
                            uint16_t rr_no)
     {
-        auto l = lci.add_label(r.dname(), r.query_type(),
+        auto l = lci.add_label(r.dname().as_byte_string(), r.query_type(),
                                LabelHint(HINT_NONE, rr_no), 0);
         return
             l->compressed_label_size() +
@@ -26,6 +26,7 @@
 #include <tins/memory_helpers.h>
 
 #include "bytestring.hpp"
+#include "dnsname.hpp"
 
 /**
  * \class CaptureDNS
@@ -239,8 +240,8 @@ public:
          * \param tp The query type.
          * \param cl The query class.
          */
-        query(byte_string&& nm, QueryType tp, QueryClass cl)
-            : name_(nm), type_(tp), qclass_(cl) {}
+        query(DNSName&& nm, QueryType tp, QueryClass cl)
+            : name_(std::move(nm)), type_(tp), qclass_(cl) {}
 
         /**
          * \brief Constructs a DNS query.
@@ -267,7 +268,7 @@ public:
          *
          * \returns name in label format.
          */
-        const byte_string& dname() const {
+        const DNSName& dname() const {
             return name_;
         }
 
@@ -292,7 +293,7 @@ public:
         /**
          * \brief query name (QNAME).
          */
-        byte_string name_;
+        DNSName name_;
         /**
          * \brief query type (QTYPE).
          */
@@ -319,12 +320,12 @@ public:
          * \param rclass The class of this record.
          * \param ttl The time-to-live of this record.
          */
-        resource(byte_string&& dname,
+        resource(DNSName&& dname,
                  byte_string&& data,
                  QueryType type,
                  QueryClass rclass,
                  uint32_t ttl)
-            : dname_(dname), data_(data),
+            : dname_(std::move(dname)), data_(std::move(data)),
               type_(type), qclass_(rclass), ttl_(ttl) {}
 
         /**
@@ -369,7 +370,7 @@ public:
          * \returns the domain name for which this record
          * provides an answer. The name is in label format.
          */
-        const byte_string& dname() const {
+        const DNSName& dname() const {
             return dname_;
         }
 
@@ -413,7 +414,7 @@ public:
         /**
          * \brief resource name.
          */
-        byte_string dname_;
+        DNSName dname_;
         /**
          * \brief resource data (RDATA).
          */
@@ -1084,7 +1085,36 @@ public:
      * \returns the printable name.
      * \throws Tins::invalid_domain_name
      */
-    static std::string decode_domain_name(const byte_string& label);
+    static std::string decode_domain_name(const byte_string& label)
+    {
+        return decode_domain_name(label.data(), label.size());
+    }
+
+    /**
+     * \brief Convert a DNS name from label to printable format.
+     *
+     * The label must not be compressed.
+     *
+     * \param label the label to convert.
+     * \returns the printable name.
+     * \throws Tins::invalid_domain_name
+     */
+    static std::string decode_domain_name(const DNSName& label)
+    {
+        return decode_domain_name(label.data(), label.size());
+    }
+
+    /**
+     * \brief Convert a DNS name from label to printable format.
+     *
+     * The label must not be compressed.
+     *
+     * \param label the label to convert.
+     * \param len   the label length.
+     * \returns the printable name.
+     * \throws Tins::invalid_domain_name
+     */
+    static std::string decode_domain_name(const uint8_t* label, std::size_t len);
 
     /**
      * \brief Convert a DNS name from printable to label format.
@@ -1163,7 +1193,7 @@ private:
      * \param buflen    the length of the packet.
      * \returns the printable name.
      */
-    static byte_string read_dname(Tins::Memory::InputMemoryStream& s, const uint8_t *buffer, uint32_t buflen);
+    static DNSName read_dname(Tins::Memory::InputMemoryStream& s, const uint8_t *buffer, uint32_t buflen);
 
     /**
      * \brief Read a DNS name at the given buffer offset and decompress it.
@@ -1181,6 +1211,37 @@ private:
      */
     static uint16_t read_dname_offset(uint16_t offset, const uint8_t *buffer, uint32_t buflen, unsigned char*& res, const unsigned char* res_end);
 
+    /**
+     * \brief Scan an uncompressed DNS name in place.
+     *
+     * This is the fast path for name reading. It walks the label
+     * lengths directly in the packet buffer, without copying. If the
+     * name is made up only of ordinary labels and is well formed, the
+     * name is a contiguous span of the buffer and its length is
+     * returned. If the name contains a compression pointer, or
+     * anything else unusual, `false` is returned and the caller must
+     * use `read_dname_offset()`, which will throw on any malformation.
+     *
+     * \param ptr       start of the name in the packet buffer.
+     * \param bufend    end of the packet buffer.
+     * \param len       set to the length of the name including the
+     *                  terminating empty label.
+     * \returns `true` if the name was scanned successfully.
+     */
+    static bool scan_uncompressed_dname(const uint8_t* ptr, const uint8_t* bufend, std::size_t& len);
+
+    /**
+     * \brief Check the header counts are plausible for the packet size.
+     *
+     * Each question occupies at least 5 bytes, and each RR at least 11.
+     * Reject packets whose header claims more records than could
+     * possibly fit before doing any further parsing.
+     *
+     * \param total_sz the length of the packet.
+     * \throws Tins::malformed_packet if the counts can't fit.
+     */
+    void validate_header_counts(uint32_t total_sz) const;
+
     /**
      * \brief Given RDATA, expand any compressed label items therein.
      *
@@ -1219,7 +1280,7 @@ private:
      * \param data              the resource data.
      * \throws Tins::malformed_packet if bad format or OPT already present.
      */
-    void add_edns0(const byte_string& dname, QueryClass query_class, uint32_t ttl, const byte_string& data);
+    void add_edns0(const DNSName& dname, QueryClass query_class, uint32_t ttl, const byte_string& data);
 
     /**
      * \brief write serialised version of the packet.
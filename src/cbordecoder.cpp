@@ -233,13 +233,7 @@ void CborBaseDecoder::skip()
             {
                 read_type_unsigned(major, minor, uint_val);
                 if ( major == this_major )
-                {
-                    while ( uint_val-- > 0 )
-                    {
-                        needRead();
-                        ++p_;
-                    }
-                }
+                    skip_bytes(uint_val);
                 else if ( major == BREAK_MAJOR && minor == BREAK_MINOR )
                     break;
                 else
@@ -247,11 +241,7 @@ void CborBaseDecoder::skip()
             }
         }
         else
-            while ( uint_val-- > 0 )
-            {
-                needRead();
-                ++p_;
-            }
+            skip_bytes(uint_val);
         break;
 
     case TYPE_ARRAY:
@@ -13,6 +13,7 @@
 #ifndef CBORDECODER_HPP
 #define CBORDECODER_HPP
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <fstream>
@@ -263,6 +264,22 @@ private:
         }
     }
 
+    /**
+     * \brief Move the read pointer past the given number of bytes.
+     *
+     * \param n_bytes the number of bytes to skip.
+     */
+    void skip_bytes(uint64_t n_bytes)
+    {
+        while ( n_bytes > 0 )
+        {
+            needRead();
+            uint64_t n = std::min<uint64_t>(n_bytes, bufend_ - p_);
+            p_ += n;
+            n_bytes -= n;
+        }
+    }
+
     /**
      * \brief Read the fundamental CBOR item values.
      *
@@ -334,8 +351,13 @@ protected:
         if ( is_.eof() )
             throw cbor_end_of_input();
 
-        is_.read(reinterpret_cast<char *>(p), n_bytes);
-        return is_.gcount();
+        // Only wait for the first byte, and take whatever else is
+        // already available. Input from a live stream is then
+        // decoded as it arrives.
+        is_.read(reinterpret_cast<char *>(p), 1);
+        if ( is_.gcount() == 0 )
+            return 0;
+        return 1 + is_.readsome(reinterpret_cast<char *>(p + 1), n_bytes - 1);
     }
 
     /**
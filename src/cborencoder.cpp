@@ -126,9 +126,14 @@ void CborBaseEncoder::write(const std::string& str, bool is_text)
 
 void CborBaseEncoder::write(const byte_string& str)
 {
-    writeTypeValue(2, str.size());
-    for ( auto c : str )
-        writeByte(c);
+    write(str.data(), str.size());
+}
+
+void CborBaseEncoder::write(const uint8_t* data, std::size_t len)
+{
+    writeTypeValue(2, len);
+    while ( len-- > 0 )
+        writeByte(*data++);
 }
 
 void CborBaseEncoder::write(const std::chrono::system_clock::time_point& t)
@@ -173,6 +178,5 @@ void CborBaseEncoder::writeBreak()
 template<>
 void ParallelWriterPool<StreamWriter>::compressFile(const std::string& input, const std::string& output)
 {
-    if ( std::rename(input.c_str(), output.c_str()) != 0 )
-        throw std::runtime_error("Can't rename " + input + " to " + output);
+    StreamWriter::rename_file(input, output);
 }
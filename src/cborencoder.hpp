@@ -30,6 +30,7 @@
 #include "log.hpp"
 #include "makeunique.hpp"
 #include "streamwriter.hpp"
+#include "threadplacement.hpp"
 
 /**
  * \class CborBaseEncoder
@@ -107,6 +108,14 @@ public:
      */
     void write(const byte_string& str);
 
+    /**
+     * \brief Write a byte string.
+     *
+     * \param data          the byte string data.
+     * \param len           the byte string length.
+     */
+    void write(const uint8_t* data, std::size_t len);
+
     /**
      * \brief Write a time point.
      *
@@ -151,6 +160,18 @@ public:
      */
     void writeBreak();
 
+    /**
+     * \brief Write CBOR that has already been encoded.
+     *
+     * \param bytes the encoded CBOR.
+     */
+    void writeEncoded(const byte_string& bytes)
+    {
+        flush();
+        if ( !bytes.empty() )
+            writeBytes(bytes.data(), static_cast<std::ptrdiff_t>(bytes.size()));
+    }
+
     /**
      * \brief Force writing of any accumulated output.
      */
@@ -214,6 +235,53 @@ private:
     uint8_t *p_;
 };
 
+/**
+ * \class CborBufferEncoder
+ * \brief Encode basic CBOR values to memory.
+ */
+class CborBufferEncoder : public CborBaseEncoder
+{
+public:
+    /**
+     * \brief Return the encoded output.
+     *
+     * Call `flush()` first to include all output written.
+     *
+     * \returns the encoded output.
+     */
+    const byte_string& bytes() const
+    {
+        return bytes_;
+    }
+
+    /**
+     * \brief Discard the encoded output.
+     */
+    void clear()
+    {
+        flush();
+        bytes_.clear();
+    }
+
+protected:
+    /**
+     * \brief Append accumulated output to the encoded output.
+     *
+     * \param p       pointer to the buffer.
+     * \param n_bytes number of bytes in the buffer.
+     */
+    virtual void writeBytes(const uint8_t *p, std::ptrdiff_t n_bytes)
+    {
+        bytes_.append(p, static_cast<std::size_t>(n_bytes));
+    }
+
+private:
+    /**
+     * \brief the encoded output.
+     */
+    byte_string bytes_;
+};
+
 /**
  * \class CborBaseStreamFileEncoder
  * \brief A virtual base class for encoding basic CBOR values to an output file.
@@ -399,6 +467,12 @@ public:
      */
     virtual void wait() = 0;
 
+    /**
+     * \brief Return the number of files being compressed or
+     * waiting to be compressed.
+     */
+    virtual unsigned backlog() = 0;
+
     /**
      * \brief Return the suggested extension for files using the
      * compression done by this pool.
@@ -491,9 +565,13 @@ public:
      * \param max_threads maximum number of threads to use when
      * compressing.
      * \param level       the compression level to use.
+     * \param cpus        CPUs on which to run the compression
+     *                    threads, or empty for any CPU.
      */
-    ParallelWriterPool(unsigned max_threads, unsigned level)
-        : level_(level), max_threads_(max_threads), nthreads_(0), abort_(false)
+    ParallelWriterPool(unsigned max_threads, unsigned level,
+                       const std::vector<unsigned>& cpus = {})
+        : level_(level), max_threads_(max_threads), nthreads_(0), nwaiting_(0),
+          abort_(false), cpus_(cpus)
     {
     }
 
@@ -522,7 +600,11 @@ public:
     {
         std::unique_lock<std::mutex> lock(m_);
         if ( nthreads_ >= max_threads_ )
+        {
+            ++nwaiting_;
             thread_finished_.wait(lock, [&](){ return nthreads_ < max_threads_; });
+            --nwaiting_;
+        }
         std::thread t([=]{ compressFileThread(input, output); });
         t.detach();
         ++nthreads_;
@@ -546,6 +628,16 @@ public:
             thread_finished_.wait(lock, [&](){ return nthreads_ == 0; });
     }
 
+    /**
+     * \brief Return the number of files being compressed or
+     * waiting to be compressed.
+     */
+    virtual unsigned backlog()
+    {
+        std::unique_lock<std::mutex> lock(m_);
+        return nthreads_ + nwaiting_;
+    }
+
     /**
      * \brief Return additional extension suggested for output file type.
      */
@@ -567,8 +659,14 @@ private:
      */
     void compressFileThread(const std::string& input, const std::string& output)
     {
+        set_thread_name("compress");
+        set_thread_cpus(cpus_);
+
         try
         {
+            // The input may still be being finished in the background.
+            StreamWriter::wait_for_file(input);
+
             std::ifstream ifs(input, std::ios::binary);
             if ( !ifs.is_open() )
                 throw std::runtime_error("Can't open file " + input);
@@ -619,11 +717,21 @@ private:
      */
     unsigned nthreads_;
 
+    /**
+     * \brief current number of files waiting for a compression thread.
+     */
+    unsigned nwaiting_;
+
     /**
      * \brief flag indicating whether compression should abort.
      */
     std::atomic_bool abort_;
 
+    /**
+     * \brief CPUs for the compression threads.
+     */
+    std::vector<unsigned> cpus_;
+
     /**
      * \brief mutex guarding state.
      */
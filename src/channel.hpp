@@ -14,9 +14,11 @@
 #define CHANNEL_HPP
 
 #include <condition_variable>
+#include <cstddef>
 #include <queue>
 #include <mutex>
 #include <thread>
+#include <utility>
 
 // This implementation of something vaguely like a Go channel is
 // based on https://st.xorian.net/blog/2012/08/go-style-channel-in-c/.
@@ -52,7 +54,7 @@ public:
      * \brief Default constructor.
      */
     explicit Channel(unsigned max_len = 0)
-        : closed_(false), max_len_(max_len) {}
+        : closed_(false), max_len_(max_len), high_watermark_(0) {}
 
     /**
      * \brief Mark the channel as closed.
@@ -100,6 +102,8 @@ public:
             throw std::logic_error("put to closed channel");
 
         queue_.push(i);
+        if ( queue_.size() > high_watermark_ )
+            high_watermark_ = queue_.size();
         cv_.notify_one();
         return true;
     }
@@ -130,7 +134,9 @@ public:
         if ( closed_ )
             throw std::logic_error("put to closed channel");
 
-        queue_.push(i);
+        queue_.push(std::move(i));
+        if ( queue_.size() > high_watermark_ )
+            high_watermark_ = queue_.size();
         cv_.notify_one();
         return true;
     }
@@ -169,6 +175,24 @@ public:
         max_len_ = max_items;
     }
 
+    /**
+     * \brief Return the number of items currently in the channel.
+     */
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return queue_.size();
+    }
+
+    /**
+     * \brief Return the largest number of items ever in the channel.
+     */
+    std::size_t high_watermark()
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return high_watermark_;
+    }
+
 private:
     /**
      * \brief the channel item queue.
@@ -196,6 +220,11 @@ private:
      * 0 means 'no maximum'.
      */
     unsigned max_len_;
+
+    /**
+     * \brief the largest number of items ever in the queue.
+     */
+    std::size_t high_watermark_;
 };
 
 #endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <cmath>
+
+#include "clientsampler.hpp"
+
+const unsigned ClientSampler::PARTS;
+
+ClientSampler::ClientSampler(double fraction,
+                             unsigned ipv4_prefix_length,
+                             unsigned ipv6_prefix_length,
+                             const std::string& key)
+    : parts_(parts_per_million(fraction)),
+      ipv4_prefix_length_(ipv4_prefix_length),
+      ipv6_prefix_length_(ipv6_prefix_length),
+      key_hi_(0), key_lo_(key.size())
+{
+    // Fold the key into 128 bits, 8 bytes at a time.
+    for ( std::size_t i = 0; i < key.size(); i += 8 )
+    {
+        uint64_t chunk = 0;
+        for ( std::size_t j = i; j < i + 8 && j < key.size(); ++j )
+            chunk = ( chunk << 8 ) | static_cast<unsigned char>(key[j]);
+        key_hi_ = fast_hash(key_hi_, chunk);
+        key_lo_ = fast_hash(key_lo_, key_hi_);
+    }
+}
+
+ClientSampler::ClientSampler(const Configuration& config)
+    : ClientSampler(config.client_sample,
+                    config.client_sample_ipv4_prefix_length,
+                    config.client_sample_ipv6_prefix_length,
+                    config.client_sample_key)
+{
+}
+
+unsigned ClientSampler::parts_per_million(double fraction)
+{
+    if ( fraction <= 0 )
+        return 0;
+    if ( fraction >= 1 )
+        return PARTS;
+    return static_cast<unsigned>(std::lround(fraction * PARTS));
+}
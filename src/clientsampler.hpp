@@ -0,0 +1,163 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef CLIENTSAMPLER_HPP
+#define CLIENTSAMPLER_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "configuration.hpp"
+#include "fasthash.hpp"
+#include "ipaddress.hpp"
+
+/**
+ * \class ClientSampler
+ * \brief Decide which clients to keep when sampling by client address.
+ *
+ * A client is kept if a keyed hash of its address falls below the
+ * sample fraction, so all traffic from a kept client is kept, and the
+ * same clients are kept from run to run and on every compactor given
+ * the same key. Changing the key selects a different set of clients.
+ *
+ * Clients may be grouped by network, so that, for example, all
+ * clients in an IPv4 /24 are kept or dropped together.
+ *
+ * The fraction is held in parts per million, and this is the value
+ * recorded in output so that readers can scale counts.
+ *
+ * A percentage of the sampled clients can be kept, for example to
+ * shed load. The clients kept are then a subset of the sampled
+ * clients, and of those kept at any higher percentage.
+ */
+class ClientSampler
+{
+public:
+    /**
+     * \brief the sample fraction denominator.
+     */
+    static const unsigned PARTS = 1000000;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param fraction           the fraction of clients to keep.
+     * \param ipv4_prefix_length the IPv4 prefix length to group clients by.
+     * \param ipv6_prefix_length the IPv6 prefix length to group clients by.
+     * \param key                the hash key.
+     */
+    ClientSampler(double fraction,
+                  unsigned ipv4_prefix_length,
+                  unsigned ipv6_prefix_length,
+                  const std::string& key);
+
+    /**
+     * \brief Constructor from the client sample configuration.
+     *
+     * \param config the configuration.
+     */
+    explicit ClientSampler(const Configuration& config);
+
+    /**
+     * \brief Check whether clients are being sampled.
+     *
+     * \returns `true` if not all clients are kept.
+     */
+    bool sampling() const
+    {
+        return parts_ < PARTS;
+    }
+
+    /**
+     * \brief Return the parts per million of clients kept.
+     */
+    unsigned parts_per_million() const
+    {
+        return parts_;
+    }
+
+    /**
+     * \brief Decide whether to keep traffic from a client.
+     *
+     * \param client the client address.
+     * \returns `true` if the client is kept.
+     */
+    bool keep_client(const IPAddress& client) const
+    {
+        if ( parts_ >= PARTS )
+            return true;
+
+        return position(client) < parts_;
+    }
+
+    /**
+     * \brief Decide whether to keep traffic from a client, keeping
+     * a percentage of the sampled clients.
+     *
+     * \param client  the client address.
+     * \param percent the percentage of sampled clients to keep.
+     * \returns `true` if the client is kept.
+     */
+    bool keep_client(const IPAddress& client, unsigned percent) const
+    {
+        return position(client) < static_cast<uint64_t>(parts_) * percent / 100;
+    }
+
+    /**
+     * \brief Convert a sample fraction to parts per million.
+     *
+     * \param fraction the fraction.
+     * \returns the parts per million, rounded to nearest.
+     */
+    static unsigned parts_per_million(double fraction);
+
+private:
+    /**
+     * \brief Find the position of a client in the sample.
+     *
+     * \param client the client address.
+     * \returns the keyed hash of the client network, in the range
+     * 0 to `PARTS - 1`.
+     */
+    uint64_t position(const IPAddress& client) const
+    {
+        IPAddress net = client.network(client.is_ipv6() ? ipv6_prefix_length_ : ipv4_prefix_length_);
+        return fast_hash(hash_value(net) ^ key_hi_, key_lo_) % PARTS;
+    }
+
+    /**
+     * \brief parts per million of clients kept.
+     */
+    unsigned parts_;
+
+    /**
+     * \brief IPv4 prefix length clients are grouped by.
+     */
+    unsigned ipv4_prefix_length_;
+
+    /**
+     * \brief IPv6 prefix length clients are grouped by.
+     */
+    unsigned ipv6_prefix_length_;
+
+    /**
+     * \brief first 64 bits of the hash key.
+     */
+    uint64_t key_hi_;
+
+    /**
+     * \brief last 64 bits of the hash key.
+     */
+    uint64_t key_lo_;
+};
+
+#endif
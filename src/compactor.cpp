@@ -14,7 +14,10 @@
 #include <csignal>
 #include <exception>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <thread>
 
 #include <boost/variant.hpp>
@@ -27,20 +30,36 @@
 #include "config.h"
 
 #include "addressevent.hpp"
+#include "aggregates.hpp"
 #include "channel.hpp"
+#include "clientsampler.hpp"
 #include "blockcborwriter.hpp"
+#include "blockstreamer.hpp"
 #include "configuration.hpp"
+#include "filestage.hpp"
+#include "loadshedder.hpp"
 #include "log.hpp"
 #include "makeunique.hpp"
 #include "matcher.hpp"
+#include "metrics.hpp"
+#include "packetreorderer.hpp"
 #include "packetstream.hpp"
 #include "pcapwriter.hpp"
+#include "pseudoanonymise.hpp"
 #include "queryresponse.hpp"
+#include "rotatingfilename.hpp"
 #include "sniffers.hpp"
 #include "streamwriter.hpp"
+#include "threadplacement.hpp"
 
 const std::string PROGNAME = "compactor";
 
+/**
+ * \brief how many C-DNS items to send between checks of the C-DNS
+ * channel fill.
+ */
+const unsigned SHED_CHECK_INTERVAL = 64;
+
 namespace po = boost::program_options;
 namespace cno = std::chrono;
 
@@ -83,6 +102,16 @@ struct CborItem
      * \brief the statistics as at the time of the item.
      */
     PacketStatistics stats;
+
+    /**
+     * \brief when the item was matched, if metrics are being collected.
+     */
+    cno::steady_clock::time_point matched;
+
+    /**
+     * \brief `true` if extended sections are not to be written.
+     */
+    bool omit_sections{false};
 };
 
 /**
@@ -101,7 +130,8 @@ struct OutputChannels
     OutputChannels()
         :raw_pcap(std::make_shared<Channel<std::shared_ptr<PcapItem>>>()),
          ignored_pcap(std::make_shared<Channel<std::shared_ptr<PcapItem>>>()),
-         cbor(std::make_shared<Channel<CborItem>>())
+         cbor(std::make_shared<Channel<CborItem>>()),
+         aggregates(std::make_shared<Channel<std::shared_ptr<QueryResponse>>>())
     {
     }
 
@@ -119,6 +149,11 @@ struct OutputChannels
      * \brief Channel for sending items to be written to C-DNS output thread.
      */
     std::shared_ptr<Channel<CborItem>> cbor;
+
+    /**
+     * \brief Channel for sending query/responses to traffic aggregation thread.
+     */
+    std::shared_ptr<Channel<std::shared_ptr<QueryResponse>>> aggregates;
 };
 
 /**
@@ -126,11 +161,17 @@ struct OutputChannels
  *
  * \param out the output destination.
  * \param chan the channel to receive packets from.
+ * \param config the configuration.
+ * \param name the thread name.
  */
 static void packet_writer(std::unique_ptr<PcapBaseRotatingWriter> out,
                           std::shared_ptr<Channel<std::shared_ptr<PcapItem>>> chan,
-                          const Configuration& config)
+                          const Configuration& config,
+                          const char* name)
 {
+    set_thread_name(name);
+    set_thread_cpus(config.output_cpus);
+
     std::shared_ptr<PcapItem> pcap;
     while ( chan->get(pcap) )
     {
@@ -158,14 +199,14 @@ public:
      * \param out the output writer.
      */
     explicit CborItemVisitor(std::unique_ptr<BlockCborWriter>& out)
-        : out_(std::move(out)), stats_() {}
+        : out_(std::move(out)), stats_(), sections_(true) {}
 
     /**
      * \brief Process a query/response.
      */
     void operator()(std::shared_ptr<QueryResponse>& qr)
     {
-        out_->writeQR(qr, *stats_);
+        out_->writeQR(qr, *stats_, sections_);
     }
 
     /**
@@ -184,6 +225,14 @@ public:
         stats_ = stats;
     }
 
+    /**
+     * \brief Set whether extended sections are written for the next data.
+     */
+    void set_sections(bool sections)
+    {
+        sections_ = sections;
+    }
+
 private:
     /**
      * \brief the output writer.
@@ -194,17 +243,29 @@ private:
      * \brief statistics for the next item to write.
      */
     const PacketStatistics* stats_;
+
+    /**
+     * \brief `true` if extended sections are written for the next item.
+     */
+    bool sections_;
 };
 
 /**
  * \brief Main function for thread writing C-DNS files.
  *
- * \param out the output destination.
- * \param chan the channel to receive packets from.
+ * \param out     the output destination.
+ * \param chan    the channel to receive packets from.
+ * \param metrics metrics to update, if any.
+ * \param cpus    CPUs on which to run, or empty for any CPU.
  */
 static void cbor_writer(std::unique_ptr<BlockCborWriter> out,
-                        std::shared_ptr<Channel<CborItem>> chan)
+                        std::shared_ptr<Channel<CborItem>> chan,
+                        std::shared_ptr<Metrics> metrics,
+                        std::vector<unsigned> cpus)
 {
+    set_thread_name("cdns writer");
+    set_thread_cpus(cpus);
+
     CborItemVisitor cbiv(out);
     CborItem cbi;
     while ( chan->get(cbi) )
@@ -212,7 +273,10 @@ static void cbor_writer(std::unique_ptr<BlockCborWriter> out,
         try
         {
             cbiv.set_stats(&cbi.stats);
+            cbiv.set_sections(!cbi.omit_sections);
             boost::apply_visitor(cbiv, cbi.payload);
+            if ( metrics && cbi.matched.time_since_epoch().count() != 0 )
+                metrics->latency(Metrics::MATCH_TO_BLOCK_WRITE).record(cno::steady_clock::now() - cbi.matched);
         }
         catch (const std::exception& err)
         {
@@ -221,153 +285,323 @@ static void cbor_writer(std::unique_ptr<BlockCborWriter> out,
     }
 }
 
+/**
+ * \brief Make the pseudo-anonymisation set in a configuration.
+ *
+ * \param config the configuration.
+ * \returns the pseudo-anonymisation, if configured.
+ */
+static boost::optional<PseudoAnonymise> make_pseudo_anonymise(const Configuration& config)
+{
+    boost::optional<PseudoAnonymise> pseudo_anon;
+#if ENABLE_PSEUDOANONYMISATION
+    if ( config.pseudo_anonymise )
+    {
+        if ( !config.pseudo_anon_key.empty() )
+            pseudo_anon = PseudoAnonymise(to_byte_string(config.pseudo_anon_key));
+        else
+            pseudo_anon = PseudoAnonymise(config.pseudo_anon_passphrase);
+    }
+#endif
+    return pseudo_anon;
+}
+
+/**
+ * \brief Main function for thread gathering traffic aggregates.
+ *
+ * Periods start at multiples of the aggregation period, timed by
+ * the query/responses. At the end of each period, the aggregates
+ * are written to file and published to metrics. If pseudo-anonymising,
+ * clients are counted by their pseudo-anonymised address.
+ *
+ * \param chan    the channel to receive query/responses from.
+ * \param config  the configuration.
+ * \param metrics metrics to update, if any.
+ */
+static void aggregates_writer(std::shared_ptr<Channel<std::shared_ptr<QueryResponse>>> chan,
+                              const Configuration& config,
+                              std::shared_ptr<Metrics> metrics)
+{
+    set_thread_name("aggregates");
+    set_thread_cpus(config.output_cpus);
+
+    cno::seconds period(config.aggregates_period);
+    RotatingFileName fname(config.aggregates_pattern, period);
+    std::unique_ptr<Aggregates> aggregates;
+    boost::optional<PseudoAnonymise> pseudo_anon = make_pseudo_anonymise(config);
+
+    auto finish_period =
+        [&]()
+        {
+            if ( !config.aggregates_pattern.empty() )
+            {
+                try
+                {
+                    CborStreamFileEncoder<StreamWriter> enc;
+                    enc.open(fname.filename(aggregates->start(), config));
+                    aggregates->write(enc);
+                    enc.close();
+                }
+                catch (const std::exception& err)
+                {
+                    LOG_ERROR << "Can't write traffic aggregates: " << err.what();
+                }
+            }
+
+            if ( metrics )
+                metrics->set_aggregates(std::move(aggregates));
+            aggregates.reset();
+        };
+
+    std::shared_ptr<QueryResponse> qr;
+    while ( chan->get(qr) )
+    {
+        cno::system_clock::time_point t = qr->timestamp();
+        if ( aggregates && t >= aggregates->start() + period )
+            finish_period();
+
+        if ( !aggregates )
+        {
+            cno::seconds since_epoch = cno::duration_cast<cno::seconds>(t.time_since_epoch());
+            cno::system_clock::time_point start(cno::seconds(since_epoch.count() - since_epoch.count() % period.count()));
+            aggregates = make_unique<Aggregates>(config.aggregates_top, start, period,
+                                                 pseudo_anon ? &*pseudo_anon : nullptr);
+        }
+
+        aggregates->add(*qr);
+    }
+
+    if ( aggregates )
+        finish_period();
+}
+
 static BaseSniffers* signal_handler_sniffers;
 static int signal_handler_signal;
+static bool signal_handler_reload;
 static void signal_handler(int signo)
 {
     if ( signal_handler_sniffers )
     {
         signal_handler_signal = signo;
-        signal_handler_sniffers->breakloop();
+        if ( signo == SIGHUP && signal_handler_reload )
+            signal_handler_sniffers->wakeup();
+        else
+            signal_handler_sniffers->breakloop();
     }
 }
 
+/**
+ * \brief Add the collection statistics of a finished sniffer.
+ *
+ * \param sniffer the sniffer.
+ * \param stats   the packet statistics.
+ */
+static void add_sniffer_statistics(BaseSniffers& sniffer, PacketStatistics& stats)
+{
+    // Retrieve PCAP stats, if available.
+    struct pcap_stat pcap_stat;
+    if ( sniffer.stats(pcap_stat) )
+    {
+        stats.pcap_recv_count += pcap_stat.ps_recv;
+        stats.pcap_drop_count += pcap_stat.ps_drop;
+        stats.pcap_ifdrop_count += pcap_stat.ps_ifdrop;
+    }
+    stats.capture_batch_count += sniffer.batch_count();
+    stats.capture_syscall_count += sniffer.syscall_count();
+}
+
+/**
+ * \brief Check whether a configuration produces C-DNS output.
+ *
+ * \param config the configuration.
+ * \returns `true` if C-DNS is written to file or streamed.
+ */
+static bool write_cdns(const Configuration& config)
+{
+    return !config.output_pattern.empty() || !config.output_stream.empty();
+}
+
 /**
  * \brief The main loop. Read packets from the sniffer and process them.
  *
  * Outputs are sent down one of the output channels.
  *
- * The loop continues until the sniffer reports EOF.
+ * The loop continues until the sniffer reports EOF or a wakeup.
  *
- * \param sniffer the Tins sniffer to read.
- * \param matcher the query/response matcher to use.
- * \param output  the output channels.
- * \param config  the current configuration.
- * \param stats   collect packet statistics here.
+ * If a reorderer is given, packets are passed through it so they are
+ * processed in timestamp order. Held packets are released when the
+ * sniffer wakes because capture is idle, and all are released at EOF.
+ *
+ * If metrics are being collected, the packet statistics and matcher
+ * counts are published to them at most once a second, and latencies
+ * recorded.
+ *
+ * \param sniffer        the Tins sniffer to read.
+ * \param matcher        the query/response matcher to use.
+ * \param packet_stream  the packet stream decoding the packets.
+ * \param output         the output channels.
+ * \param config         the current configuration.
+ * \param stats          collect packet statistics here.
+ * \param metrics        metrics to update, or `nullptr`.
+ * \param last_timestamp the timestamp of the last packet read.
+ * \param skip_until     skip packets with this timestamp or earlier.
+ * \param reorderer      the packet reorderer, or `nullptr`.
  */
 static void sniff_loop(BaseSniffers* sniffer,
                        QueryResponseMatcher& matcher,
+                       PacketStream& packet_stream,
                        OutputChannels& output,
                        const Configuration& config,
-                       PacketStatistics& stats)
+                       PacketStatistics& stats,
+                       Metrics* metrics,
+                       cno::system_clock::time_point& last_timestamp,
+                       cno::system_clock::time_point skip_until,
+                       PacketReorderer* reorderer)
 {
     bool seen_raw_overflow = false;
     // cppcheck-suppress variableScope
     bool seen_ignored_overflow = false;
-    // cppcheck-suppress variableScope
-    bool seen_ae_overflow = false;
 
     bool do_raw_pcap = !config.raw_pcap_pattern.empty();
     bool do_ignored_pcap = !config.ignored_pcap_pattern.empty();
-    bool do_decode = config.debug_qr || config.debug_dns || config.report_info  || !config.output_pattern.empty();
-    bool do_match = config.debug_qr || config.report_info || !config.output_pattern.empty();
+    bool do_decode = config.debug_qr || config.debug_dns || config.report_info  || write_cdns(config);
 
-    cno::system_clock::time_point last_timestamp;
     cno::system_clock::time_point next_stats_log;
     cno::system_clock::time_point last_stats_log_timestamp;
     PacketStatistics last_stats = stats;
+    cno::steady_clock::time_point next_metrics_publish;
 
-    auto dns_sink =
-        [&](std::unique_ptr<DNSMessage>& dns)
+    auto publish_metrics =
+        [&]()
         {
-            if ( config.debug_dns )
-                std::cout << *dns;
-
-            if ( do_match )
-                matcher.add(std::move(dns));
+            PacketStatistics current = stats;
+            add_sniffer_statistics(*sniffer, current);
+            metrics->set_packet_statistics(current);
+            metrics->set_matcher_counts(matcher.in_flight_count(),
+                                        matcher.unmatched_response_count());
+            if ( reorderer )
+                metrics->set_reorder_counts(reorderer->size(),
+                                            reorderer->high_watermark());
         };
 
-    auto address_event_sink =
-        [&](std::shared_ptr<AddressEvent>& event)
+    auto ignored_sink =
+        [&](std::shared_ptr<PcapItem>& pcap)
         {
-            if ( !config.output_pattern.empty() )
+            if ( do_ignored_pcap )
             {
-                CborItem cbi(event, stats);
-                if ( !output.cbor->put(cbi, false) )
+                if ( !output.ignored_pcap->put(pcap, false) )
                 {
-                    ++stats.output_cbor_drop_count;
-                    if ( !seen_ae_overflow )
+                    ++stats.output_ignored_pcap_drop_count;
+                    if ( !seen_ignored_overflow )
                     {
-                        LOG_ERROR << "C-DNS overflow. Dropping address event(s)";
+                        LOG_ERROR << "Ignored PCAP overflow. Dropping packet(s)";
                         // cppcheck-suppress unreadVariable
-                        seen_ae_overflow = true;
+                        seen_ignored_overflow = true;
                     }
                 }
             }
         };
 
-    auto ignored_sink =
+    auto process =
         [&](std::shared_ptr<PcapItem>& pcap)
         {
-            if ( do_ignored_pcap )
+            if ( do_raw_pcap )
             {
-                if ( !output.ignored_pcap->put(pcap, false) )
+                if ( !output.raw_pcap->put(pcap, false) )
                 {
-                    ++stats.output_ignored_pcap_drop_count;
-                    if ( !seen_ignored_overflow )
+                    ++stats.output_raw_pcap_drop_count;
+                    if ( !seen_raw_overflow )
                     {
-                        LOG_ERROR << "Ignored PCAP overflow. Dropping packet(s)";
-                        // cppcheck-suppress unreadVariable
-                        seen_ignored_overflow = true;
+                        LOG_ERROR << "Raw PCAP overflow. Dropping packet(s)";
+                        seen_raw_overflow = true;
                     }
                 }
             }
+
+            if ( do_decode )
+            {
+                bool ignored = false;
+
+                try
+                {
+                    packet_stream.process_packet(pcap);
+                }
+                catch (const unhandled_packet& e)
+                {
+                    ignored = true;
+                    ++stats.unhandled_packet_count;
+                }
+                catch (const malformed_packet& e)
+                {
+                    ignored = true;
+                    ++stats.malformed_packet_count;
+                }
+
+                if ( ignored )
+                    ignored_sink(pcap);
+
+                packet_stream.update_statistics(stats);
+            }
         };
 
-    signal_handler_sniffers = sniffer;
+    auto release_held =
+        [&](cno::system_clock::time_point now)
+        {
+            std::shared_ptr<PcapItem> held;
+            while ( ( held = reorderer->next(now) ) )
+                process(held);
+        };
 
-    PacketStream packet_stream(config, dns_sink, address_event_sink);
+    signal_handler_sniffers = sniffer;
 
     for (;;)
     {
         Tins::Packet pkt(sniffer->next_packet());
         if ( !pkt.pdu() )
-            break;
+        {
+            // A wakeup while capture is idle releases held packets.
+            // Anything else ends the loop.
+            if ( !reorderer || sniffer->eof() || signal_handler_signal )
+                break;
+            release_held(cno::system_clock::now());
+            continue;
+        }
 
         // Get the PDU controlled by a shared_ptr. This will avoid the need
         // to copy it.
         std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
 
+        // Packets already read by the sniffer this one replaced.
+        if ( pcap->timestamp <= skip_until )
+            continue;
+
         ++stats.raw_packet_count;
 
         if ( last_timestamp > pcap->timestamp )
             ++stats.out_of_order_packet_count;
         last_timestamp = pcap->timestamp;
 
-        if ( do_raw_pcap )
+        if ( reorderer )
         {
-            if ( !output.raw_pcap->put(pcap, false) )
+            if ( !reorderer->add(pcap) )
             {
-                ++stats.output_raw_pcap_drop_count;
-                if ( !seen_raw_overflow )
-                {
-                    LOG_ERROR << "Raw PCAP overflow. Dropping packet(s)";
-                    seen_raw_overflow = true;
-                }
+                ++stats.reorder_late_packet_count;
+                process(pcap);
             }
+            release_held(cno::system_clock::time_point());
         }
+        else
+            process(pcap);
 
-        if ( do_decode )
+        // Check the time only every so often to keep the cost down.
+        if ( metrics && ( stats.raw_packet_count & 0xff ) == 0 )
         {
-            bool ignored = false;
-
-            try
-            {
-                packet_stream.process_packet(pcap);
-            }
-            catch (const unhandled_packet& e)
-            {
-                ignored = true;
-                ++stats.unhandled_packet_count;
-            }
-            catch (const malformed_packet& e)
+            cno::steady_clock::time_point now = cno::steady_clock::now();
+            if ( now >= next_metrics_publish )
             {
-                ignored = true;
-                ++stats.malformed_packet_count;
+                publish_metrics();
+                next_metrics_publish = now + cno::seconds(1);
             }
-
-            if ( ignored )
-                ignored_sink(pcap);
         }
 
         if ( config.log_network_stats_period > 0 )
@@ -396,6 +630,17 @@ static void sniff_loop(BaseSniffers* sniffer,
                         " drop " << pcap_stat.ps_drop <<
                         " drop at iface " << pcap_stat.ps_ifdrop;
                 }
+                uint64_t batches = stats.capture_batch_count + sniffer->batch_count();
+                uint64_t syscalls = stats.capture_syscall_count + sniffer->syscall_count();
+                if ( batches > 0 )
+                    LOG_INFO << "Average capture batch " <<
+                        stats.raw_packet_count / batches << " packets, " <<
+                        ( stats.raw_packet_count > 0 ? syscalls * 1000 / stats.raw_packet_count : 0 ) <<
+                        " capture syscalls per 1k packets";
+                if ( reorderer )
+                    LOG_INFO << "Reorder held " << reorderer->size() <<
+                        " (max " << reorderer->high_watermark() << ") packets, late " <<
+                        stats.reorder_late_packet_count - last_stats.reorder_late_packet_count;
                 next_stats_log = last_timestamp + cno::seconds(config.log_network_stats_period);
                 last_stats_log_timestamp = last_timestamp;
                 last_stats = stats;
@@ -405,18 +650,94 @@ static void sniff_loop(BaseSniffers* sniffer,
 
     signal_handler_sniffers = nullptr;
 
-    // Retrieve PCAP stats, if available.
-    struct pcap_stat pcap_stat;
-    if ( sniffer->stats(pcap_stat) )
+    if ( reorderer && sniffer->eof() )
     {
-        stats.pcap_recv_count += pcap_stat.ps_recv;
-        stats.pcap_drop_count += pcap_stat.ps_drop;
-        stats.pcap_ifdrop_count += pcap_stat.ps_ifdrop;
+        std::shared_ptr<PcapItem> held;
+        while ( ( held = reorderer->flush_next() ) )
+            process(held);
     }
+
+    if ( metrics )
+        publish_metrics();
+}
+
+/**
+ * \brief Run the sniff loop on network capture.
+ *
+ * If metrics are being collected, the packets received and dropped by
+ * each capture socket are published while the capture runs.
+ *
+ * \param sniffer        the network sniffers.
+ * \param matcher        the query/response matcher.
+ * \param packet_stream  the packet stream decoding the packets.
+ * \param output         the output channels.
+ * \param config         the configuration.
+ * \param stats          the packet statistics.
+ * \param metrics        metrics to update, or `nullptr`.
+ * \param last_timestamp the timestamp of the last packet read.
+ * \param skip_until     skip packets with this timestamp or earlier.
+ * \param reorderer      the packet reorderer, or `nullptr`.
+ */
+static void network_sniff_loop(NetworkSniffers& sniffer,
+                               QueryResponseMatcher& matcher,
+                               PacketStream& packet_stream,
+                               OutputChannels& output,
+                               const Configuration& config,
+                               PacketStatistics& stats,
+                               Metrics* metrics,
+                               cno::system_clock::time_point& last_timestamp,
+                               cno::system_clock::time_point skip_until,
+                               PacketReorderer* reorderer)
+{
+    std::vector<std::string> socket_labels;
+    std::map<std::string, unsigned> interface_sockets;
+
+    if ( metrics )
+        for ( std::size_t i = 0; i < sniffer.source_count(); ++i )
+        {
+            std::ostringstream labels;
+            labels << "interface=\"" << sniffer.source_name(i) << "\",socket=\""
+                   << interface_sockets[sniffer.source_name(i)]++ << "\"";
+            socket_labels.push_back(labels.str());
+
+            NetworkSniffers* s = &sniffer;
+            metrics->add_gauge("compactor_capture_socket_received_packets", labels.str(),
+                               "Packets received by each capture socket reported by PCAP.",
+                               [s, i]()
+                               {
+                                   struct pcap_stat pcap_stat;
+                                   return s->source_stats(i, pcap_stat) ? pcap_stat.ps_recv : 0;
+                               });
+            metrics->add_gauge("compactor_capture_socket_dropped_packets", labels.str(),
+                               "Packets dropped by the kernel for each capture socket reported by PCAP.",
+                               [s, i]()
+                               {
+                                   struct pcap_stat pcap_stat;
+                                   return s->source_stats(i, pcap_stat) ? pcap_stat.ps_drop : 0;
+                               });
+        }
+
+    auto remove_socket_gauges =
+        [&]()
+        {
+            for ( const auto& labels : socket_labels )
+                metrics->remove_gauges(labels);
+        };
+
+    try
+    {
+        sniff_loop(&sniffer, matcher, packet_stream, output, config, stats, metrics,
+                   last_timestamp, skip_until, reorderer);
+    }
+    catch (...)
+    {
+        remove_socket_gauges();
+        throw;
+    }
+    remove_socket_gauges();
 }
 
 /**
- * \brief Create an output PCAP writer with configured compression options.
  *
  * \param fname  filename pattern.
  * \param config configuration.
@@ -442,28 +763,61 @@ static std::unique_ptr<PcapBaseRotatingWriter> make_pcap_writer(const std::strin
 }
 
 /**
- * \brief Do a collection run using the given configuration.
+ * \brief Start the output threads for a configuration.
  *
  * \param vm          the configuration variable map.
  * \param config      the configuration values.
+ * \param output      the output channels.
  * \param threads     a vector for all program threads.
  * \param writer_pool pool of compression threads.
- * \returns 0 on normal exit, 1 on SIGHUP, 2 on SIGINT.
+ * \param streamer    C-DNS block streamer, if any.
+ * \param metrics     metrics to update, if any.
  */
-static int run_configuration(const po::variables_map& vm,
-                             const Configuration& config,
-                             std::vector<std::thread>& threads,
-                             std::shared_ptr<BaseParallelWriterPool> writer_pool)
+static void start_outputs(const po::variables_map& vm,
+                          const Configuration& config,
+                          OutputChannels& output,
+                          std::vector<std::thread>& threads,
+                          std::shared_ptr<BaseParallelWriterPool> writer_pool,
+                          std::shared_ptr<BlockStreamer> streamer,
+                          std::shared_ptr<Metrics> metrics)
 {
-    // Output channels for this run.
-    OutputChannels output;
+    if ( metrics )
+    {
+        std::vector<std::pair<std::string, std::shared_ptr<Channel<std::shared_ptr<PcapItem>>>>> pcap_chans = {
+            { "channel=\"raw_pcap\"", output.raw_pcap },
+            { "channel=\"ignored_pcap\"", output.ignored_pcap },
+        };
+        for ( const auto& c : pcap_chans )
+        {
+            auto chan = c.second;
+            metrics->add_gauge("compactor_channel_items", c.first,
+                               "Items waiting in each output channel.",
+                               [chan]() { return chan->size(); });
+            metrics->add_gauge("compactor_channel_high_watermark", c.first,
+                               "Most items ever waiting in each output channel.",
+                               [chan]() { return chan->high_watermark(); });
+        }
+        auto cbor_chan = output.cbor;
+        metrics->add_gauge("compactor_channel_items", "channel=\"cbor\"",
+                           "Items waiting in each output channel.",
+                           [cbor_chan]() { return cbor_chan->size(); });
+        metrics->add_gauge("compactor_channel_high_watermark", "channel=\"cbor\"",
+                           "Most items ever waiting in each output channel.",
+                           [cbor_chan]() { return cbor_chan->high_watermark(); });
+        auto aggregates_chan = output.aggregates;
+        metrics->add_gauge("compactor_channel_items", "channel=\"aggregates\"",
+                           "Items waiting in each output channel.",
+                           [aggregates_chan]() { return aggregates_chan->size(); });
+        metrics->add_gauge("compactor_channel_high_watermark", "channel=\"aggregates\"",
+                           "Most items ever waiting in each output channel.",
+                           [aggregates_chan]() { return aggregates_chan->high_watermark(); });
+    }
 
-    // Reset signal handler record.
-    signal_handler_signal = 0;
-    std::signal(SIGINT, signal_handler);
-    std::signal(SIGPIPE, signal_handler);
-    std::signal(SIGTERM, signal_handler);
-    std::signal(SIGHUP, signal_handler);
+    StreamWriter::set_write_queue_depth(config.write_queue_depth);
+    if ( !config.prepare_output_files )
+        StreamWriter::set_file_stage(nullptr);
+    else if ( !StreamWriter::file_stage() )
+        StreamWriter::set_file_stage(std::make_shared<FileStage>());
 
     // Set output limits only when we're capturing. If we set them
     // when reading from a capture, we'll just lose items from the
@@ -473,6 +827,7 @@ static int run_configuration(const po::variables_map& vm,
         output.raw_pcap->set_max_items(config.max_channel_size);
         output.ignored_pcap->set_max_items(config.max_channel_size);
         output.cbor->set_max_items(config.max_channel_size);
+        output.aggregates->set_max_items(config.max_channel_size);
     }
 
 
@@ -481,7 +836,7 @@ static int run_configuration(const po::variables_map& vm,
     {
         std::unique_ptr<PcapBaseRotatingWriter> raw_pcap =
             make_pcap_writer(config.raw_pcap_pattern, config);
-        threads.emplace_back(packet_writer, std::move(raw_pcap), output.raw_pcap, std::ref(config));
+        threads.emplace_back(packet_writer, std::move(raw_pcap), output.raw_pcap, std::ref(config), "raw pcap");
     }
 
     if ( vm.count("ignored-pcap") &&
@@ -489,19 +844,61 @@ static int run_configuration(const po::variables_map& vm,
     {
         std::unique_ptr<PcapBaseRotatingWriter> ignored_pcap =
             make_pcap_writer(config.ignored_pcap_pattern, config);
-        threads.emplace_back(packet_writer, std::move(ignored_pcap), output.ignored_pcap, std::ref(config));
+        threads.emplace_back(packet_writer, std::move(ignored_pcap), output.ignored_pcap, std::ref(config), "ignored pcap");
     }
 
-    if ( vm.count("output") && !config.output_pattern.empty() )
+    if ( ( vm.count("output") && !config.output_pattern.empty() ) || streamer )
     {
         std::unique_ptr<CborBaseStreamFileEncoder> encoder;
-        encoder = make_unique<CborParallelStreamFileEncoder>(writer_pool);
+        if ( vm.count("output") && !config.output_pattern.empty() )
+            encoder = make_unique<CborParallelStreamFileEncoder>(writer_pool);
 
         std::unique_ptr<BlockCborWriter> cbor =
-            make_unique<BlockCborWriter>(config, std::move(encoder));
-        threads.emplace_back(cbor_writer, std::move(cbor), output.cbor);
+            make_unique<BlockCborWriter>(config, std::move(encoder), make_pseudo_anonymise(config));
+        cbor->set_metrics(metrics);
+        cbor->set_streamer(streamer);
+        threads.emplace_back(cbor_writer, std::move(cbor), output.cbor, metrics, config.output_cpus);
+    }
+
+    if ( config.aggregates_period > 0 )
+        threads.emplace_back(aggregates_writer, output.aggregates, std::ref(config), metrics);
+}
+
+/**
+ * \brief Stop the output threads.
+ *
+ * The output channels are closed. The threads finish writing the
+ * items already sent to them, and then exit.
+ *
+ * \param output  the output channels.
+ * \param metrics metrics to update, or `nullptr`.
+ */
+static void stop_outputs(OutputChannels& output, Metrics* metrics)
+{
+    output.raw_pcap->close();
+    output.ignored_pcap->close();
+    output.cbor->close();
+    output.aggregates->close();
+
+    if ( metrics )
+    {
+        metrics->remove_gauges("channel=\"raw_pcap\"");
+        metrics->remove_gauges("channel=\"ignored_pcap\"");
+        metrics->remove_gauges("channel=\"cbor\"");
+        metrics->remove_gauges("channel=\"aggregates\"");
     }
+}
 
+/**
+ * \brief Make the sniffer configuration for a configuration.
+ *
+ * \param vm     the configuration variable map.
+ * \param config the configuration values.
+ * \returns the sniffer configuration.
+ */
+static SniffersConfiguration make_sniff_config(const po::variables_map& vm,
+                                               const Configuration& config)
+{
     SniffersConfiguration sniff_config;
     sniff_config.set_snap_len(config.snaplen);
     sniff_config.set_promisc_mode(config.promisc_mode);
@@ -509,10 +906,128 @@ static int run_configuration(const po::variables_map& vm,
     if ( vm.count("filter") )
         sniff_config.set_filter(config.filter);
     sniff_config.set_chan_max_size(config.max_channel_size);
+    sniff_config.set_batch_size(config.capture_batch_size);
+    sniff_config.set_batch_timeout(config.capture_batch_timeout);
+    sniff_config.set_fanout(config.capture_fanout);
+    sniff_config.set_idle_wakeup(config.capture_reorder_hold > 0);
+    sniff_config.set_cpus(config.capture_cpus);
+    return sniff_config;
+}
+
+/**
+ * \brief Check whether two configurations decode packets the same way.
+ *
+ * If they do, a packet stream, with its part-assembled TCP flows and
+ * IP fragments, can carry on across a change between them. Client
+ * sampling and message filters are not compared, as they are updated
+ * on a packet stream that carries on.
+ *
+ * \param a the first configuration.
+ * \param b the second configuration.
+ * \returns `true` if the packet stream settings are the same.
+ */
+static bool same_packet_stream_settings(const Configuration& a, const Configuration& b)
+{
+    return a.vlan_ids == b.vlan_ids &&
+        a.max_tcp_flows == b.max_tcp_flows &&
+        a.max_tcp_memory == b.max_tcp_memory &&
+        a.tcp_flow_timeout == b.tcp_flow_timeout &&
+        a.max_fragmented_datagrams == b.max_fragmented_datagrams &&
+        a.max_fragment_memory == b.max_fragment_memory &&
+        a.fragment_timeout == b.fragment_timeout;
+}
+
+/**
+ * \brief Do a collection run using the given configuration.
+ *
+ * On network capture, SIGHUP reloads the configuration without
+ * stopping capture. A new set of sniffers is opened on the new
+ * configuration while the current set is still capturing. The current
+ * sniffers are then drained of everything they have received, and
+ * processing switches to the new sniffers and new outputs. Packets
+ * the new sniffers received that are no later than the last packet
+ * from the old sniffers are skipped as duplicates. Query/response
+ * matching carries on across the switch, as does TCP and IP fragment
+ * reassembly unless its settings changed. If the new configuration
+ * can't be used, capture continues with the current configuration.
+ *
+ * \param vm          the configuration variable map.
+ * \param config      the configuration values.
+ * \param threads     a vector for all program threads.
+ * \param reloads     configurations loaded on SIGHUP. These must be
+ *                    kept until the output threads have finished.
+ * \param writer_pool pool of compression threads.
+ * \param streamer    C-DNS block streamer, if any.
+ * \param metrics     metrics to update, if any.
+ * \returns 0 on normal exit, 2 on SIGINT.
+ */
+static int run_configuration(const po::variables_map& vm,
+                             const Configuration& config,
+                             std::vector<std::thread>& threads,
+                             std::vector<std::unique_ptr<Configuration>>& reloads,
+                             std::shared_ptr<BaseParallelWriterPool> writer_pool,
+                             std::shared_ptr<BlockStreamer> streamer,
+                             std::shared_ptr<Metrics> metrics)
+{
+    // The configuration and output channels in use. These change
+    // on a reload.
+    const Configuration* cur_config = &config;
+
+    // Move this thread before allocating, so the output channels
+    // are allocated on the NUMA node of the processing thread.
+    set_thread_cpus(config.process_cpus);
+    std::unique_ptr<OutputChannels> cur_output = make_unique<OutputChannels>();
+
+    start_outputs(vm, config, *cur_output, threads, writer_pool, streamer, metrics);
+
+    // Reset signal handler record.
+    signal_handler_signal = 0;
+    signal_handler_reload = !vm.count("capture-file");
+    std::signal(SIGINT, signal_handler);
+    std::signal(SIGPIPE, signal_handler);
+    std::signal(SIGTERM, signal_handler);
+    std::signal(SIGHUP, signal_handler);
 
     PacketStatistics stats{};
     // cppcheck-suppress variableScope
     bool seen_qr_overflow = false;
+    // cppcheck-suppress variableScope
+    bool seen_ae_overflow = false;
+    // cppcheck-suppress variableScope
+    bool seen_aggregates_overflow = false;
+
+    // Shed C-DNS output in tiers as the C-DNS channel fills. Checking
+    // the channel size takes its lock, so only check every so often.
+    // File conversion waits for the channel, so never sheds.
+    LoadShedder shedder(config.shed_sections_fill, config.shed_sample_fill, config.shed_min_sample,
+                        ClientSampler(config));
+    std::size_t shed_max_items = vm.count("capture-file") ? 0 : config.max_channel_size;
+    unsigned shed_check = 0;
+    auto update_shedder =
+        [&]()
+        {
+            if ( ++shed_check < SHED_CHECK_INTERVAL )
+                return;
+            shed_check = 0;
+
+            bool was_shedding = shedder.shed_sections();
+            unsigned was_sample = shedder.sample_percent();
+            shedder.set_fill(cur_output->cbor->size(), shed_max_items);
+            if ( shedder.shed_sections() != was_shedding )
+            {
+                if ( shedder.shed_sections() )
+                    LOG_INFO << "C-DNS output backlog. Shedding extended sections and address events";
+                else
+                    LOG_INFO << "C-DNS output backlog cleared. Writing all sections";
+            }
+            if ( shedder.sampling() != ( was_sample < 100 ) )
+            {
+                if ( shedder.sampling() )
+                    LOG_INFO << "C-DNS output backlog. Sampling clients";
+                else
+                    LOG_INFO << "C-DNS output backlog eased. Stopped sampling clients";
+            }
+        };
 
     QueryResponseMatcher matcher(
         [&](std::shared_ptr<QueryResponse> qr)
@@ -527,12 +1042,47 @@ static int run_configuration(const po::variables_map& vm,
             else
                 ++stats.response_without_query_count;
 
-            if ( config.debug_qr )
+            if ( cur_config->debug_qr )
                 std::cout << *qr;
-            if ( !config.output_pattern.empty() )
+
+            // Aggregates cover all traffic, so are gathered before
+            // any C-DNS load shedding.
+            if ( cur_config->aggregates_period > 0 &&
+                 !cur_output->aggregates->put(qr, false) &&
+                 !seen_aggregates_overflow )
             {
+                LOG_ERROR << "Aggregates overflow. Dropping query/response(s)";
+                // cppcheck-suppress unreadVariable
+                seen_aggregates_overflow = true;
+            }
+
+            if ( write_cdns(*cur_config) )
+            {
+                update_shedder();
+                if ( shedder.sampling() )
+                {
+                    const IPAddress& client = qr->has_query()
+                        ? qr->query().clientIP
+                        : qr->response().clientIP;
+                    if ( !shedder.keep_client(client) )
+                    {
+                        ++stats.sampled_out_qr_count;
+                        return;
+                    }
+                }
+
                 CborItem cbi(qr, stats);
-                if ( !output.cbor->put(cbi, false) )
+                cbi.omit_sections = shedder.shed_sections();
+                if ( metrics )
+                {
+                    // Measure from the first message of the item, so
+                    // the time waiting for a response or timeout counts.
+                    const DNSMessage& first = qr->has_query() ? qr->query() : qr->response();
+                    cbi.matched = cno::steady_clock::now();
+                    if ( first.decoded.time_since_epoch().count() != 0 )
+                        metrics->latency(Metrics::DECODE_TO_MATCH).record(cbi.matched - first.decoded);
+                }
+                if ( !cur_output->cbor->put(cbi, false) )
                 {
                     ++stats.output_cbor_drop_count;
                     if ( !seen_qr_overflow )
@@ -542,11 +1092,69 @@ static int run_configuration(const po::variables_map& vm,
                         seen_qr_overflow = true;
                     }
                 }
+                else
+                {
+                    // Count only pairs actually output.
+                    if ( shedder.sampling() )
+                        ++stats.sampled_qr_count;
+                    if ( cbi.omit_sections )
+                        ++stats.shed_sections_qr_count;
+                }
             }
         });
     matcher.set_query_timeout(std::chrono::seconds(config.query_timeout));
     matcher.set_skew_timeout(std::chrono::microseconds(config.skew_timeout));
 
+    auto dns_sink =
+        [&](std::unique_ptr<DNSMessage>& dns)
+        {
+            if ( cur_config->debug_dns )
+                std::cout << *dns;
+
+            if ( metrics )
+            {
+                metrics->latency(Metrics::CAPTURE_TO_DECODE).record(cno::system_clock::now() - dns->timestamp);
+                dns->decoded = cno::steady_clock::now();
+            }
+
+            if ( cur_config->debug_qr || cur_config->report_info ||
+                 write_cdns(*cur_config) || cur_config->aggregates_period > 0 )
+                matcher.add(std::move(dns));
+        };
+
+    auto address_event_sink =
+        [&](std::shared_ptr<AddressEvent>& event)
+        {
+            if ( write_cdns(*cur_config) )
+            {
+                update_shedder();
+                if ( shedder.shed_sections() )
+                {
+                    ++stats.shed_address_event_count;
+                    return;
+                }
+
+                CborItem cbi(event, stats);
+                if ( !cur_output->cbor->put(cbi, false) )
+                {
+                    ++stats.output_cbor_drop_count;
+                    if ( !seen_ae_overflow )
+                    {
+                        LOG_ERROR << "C-DNS overflow. Dropping address event(s)";
+                        // cppcheck-suppress unreadVariable
+                        seen_ae_overflow = true;
+                    }
+                }
+            }
+        };
+
+    cno::system_clock::time_point last_timestamp;
+
+    // Put packets from several sources back in time order, if wanted.
+    std::unique_ptr<PacketReorderer> reorderer;
+    if ( config.capture_reorder_hold > 0 )
+        reorderer = make_unique<PacketReorderer>(cno::microseconds(config.capture_reorder_hold));
+
     // We assume that network capture is typically a daemon process, and
     // log errors. File conversion, on the other hand, is typically a
     // manual process, and so errors go to stderr.
@@ -557,16 +1165,110 @@ static int run_configuration(const po::variables_map& vm,
         if ( !vm.count("capture-file") )
         {
             LOG_INFO << "Starting network capture";
-            NetworkSniffers sniffer(config.network_interfaces, sniff_config);
+            std::unique_ptr<PacketStream> packet_stream =
+                make_unique<PacketStream>(config, dns_sink, address_event_sink);
+            std::unique_ptr<NetworkSniffers> sniffer =
+                make_unique<NetworkSniffers>(config.network_interfaces, make_sniff_config(vm, config));
+            cno::system_clock::time_point skip_until;
+
+            for (;;)
+            {
+                network_sniff_loop(*sniffer, matcher, *packet_stream, *cur_output, *cur_config,
+                                   stats, metrics.get(), last_timestamp, skip_until,
+                                   reorderer.get());
+                if ( sniffer->eof() )
+                    break;
+
+                // Woken by SIGHUP. Open the new capture before
+                // stopping the current one, so nothing is missed.
+                signal_handler_signal = 0;
+                LOG_INFO << "Re-reading configuration";
+
+                po::variables_map new_vm;
+                std::unique_ptr<Configuration> new_config;
+                std::unique_ptr<NetworkSniffers> new_sniffer;
+                try
+                {
+                    new_config = config.reload(new_vm);
+                    new_sniffer = make_unique<NetworkSniffers>(new_config->network_interfaces,
+                                                               make_sniff_config(new_vm, *new_config));
+                }
+                catch (const po::error& err)
+                {
+                    LOG_ERROR << err.what() << ". Continuing with current configuration";
+                    continue;
+                }
+                catch (const std::runtime_error& err)
+                {
+                    LOG_ERROR << err.what() << ". Continuing with current configuration";
+                    continue;
+                }
 
-            sniff_loop(&sniffer, matcher, output, config, stats);
+                // The stream is set up at startup. Keep its settings.
+                if ( new_config->output_stream != cur_config->output_stream )
+                    LOG_WARN << "C-DNS output stream changes take effect on restart";
+                new_config->output_stream = cur_config->output_stream;
+
+                // Process everything the current capture has received.
+                // A further SIGHUP meanwhile is ignored.
+                sniffer->drain();
+                do
+                    network_sniff_loop(*sniffer, matcher, *packet_stream, *cur_output, *cur_config,
+                                       stats, metrics.get(), last_timestamp, skip_until,
+                                       reorderer.get());
+                while ( !sniffer->eof() );
+                add_sniffer_statistics(*sniffer, stats);
+                skip_until = last_timestamp;
+                if ( signal_handler_signal == SIGHUP )
+                    signal_handler_signal = 0;
+
+                // Switch to the new configuration. Closing the old
+                // outputs finishes their files.
+                stop_outputs(*cur_output, metrics.get());
+                set_thread_cpus(new_config->process_cpus);
+                cur_output = make_unique<OutputChannels>();
+                start_outputs(new_vm, *new_config, *cur_output, threads, writer_pool, streamer, metrics);
+
+                shedder = LoadShedder(new_config->shed_sections_fill,
+                                      new_config->shed_sample_fill,
+                                      new_config->shed_min_sample,
+                                      ClientSampler(*new_config));
+                shed_max_items = new_config->max_channel_size;
+
+                matcher.set_query_timeout(std::chrono::seconds(new_config->query_timeout));
+                matcher.set_skew_timeout(std::chrono::microseconds(new_config->skew_timeout));
+                if ( !same_packet_stream_settings(*cur_config, *new_config) )
+                    packet_stream = make_unique<PacketStream>(*new_config, dns_sink, address_event_sink);
+                else
+                    packet_stream->update_selection(*new_config);
+
+                // The drained reorderer is empty, so can be replaced.
+                if ( new_config->capture_reorder_hold > 0 )
+                    reorderer = make_unique<PacketReorderer>(cno::microseconds(new_config->capture_reorder_hold));
+                else
+                    reorderer.reset();
+
+                cur_config = new_config.get();
+                reloads.push_back(std::move(new_config));
+                sniffer = std::move(new_sniffer);
+                LOG_INFO << "Configuration reloaded";
+
+                if ( signal_handler_signal )
+                    break;
+            }
+
+            add_sniffer_statistics(*sniffer, stats);
         }
         else
         {
             for ( const auto& fname : vm["capture-file"].as<std::vector<std::string>>() )
             {
-                FileSniffer sniffer(fname, sniff_config);
-                sniff_loop(&sniffer, matcher, output, config, stats);
+                FileSniffer sniffer(fname, make_sniff_config(vm, config));
+                PacketStream packet_stream(config, dns_sink, address_event_sink);
+                sniff_loop(&sniffer, matcher, packet_stream, *cur_output, config, stats,
+                           metrics.get(), last_timestamp, cno::system_clock::time_point(),
+                           reorderer.get());
+                add_sniffer_statistics(sniffer, stats);
                 if ( signal_handler_signal )
                     break;
             }
@@ -579,6 +1281,13 @@ static int run_configuration(const po::variables_map& vm,
         else
             std::cerr << "Error: " << err.what() << std::endl;
     }
+    catch (const pcap_reader_error& err)
+    {
+        if ( log_errs )
+            LOG_ERROR << err.what();
+        else
+            std::cerr << "Error: " << err.what() << std::endl;
+    }
     catch (const Tins::invalid_pcap_filter& err)
     {
         if ( log_errs )
@@ -595,15 +1304,11 @@ static int run_configuration(const po::variables_map& vm,
         break;
 
     case SIGHUP:
-        // Re-reading configuration and restarting doesn't really make
-        // sense if we're reading from file rather than doing network
-        // capture. If we're reading from file, treat HUP as a termination.
+        // On network capture, SIGHUP reloads the configuration, and
+        // is only seen here if capture ended at the same time. If
+        // we're reading from file, treat HUP as a termination.
         if ( !vm.count("capture-file") )
-        {
-            LOG_INFO << "Re-reading configuration";
-            res = 1;
             break;
-        }
         // Else fall through.
 
     default:
@@ -617,13 +1322,11 @@ static int run_configuration(const po::variables_map& vm,
 
     matcher.flush();
 
-    output.raw_pcap->close();
-    output.ignored_pcap->close();
-    output.cbor->close();
+    stop_outputs(*cur_output, metrics.get());
 
-    if ( config.report_info )
+    if ( cur_config->report_info )
     {
-        config.dump_config(std::cout);
+        cur_config->dump_config(std::cout);
         stats.dump_stats(std::cout);
     }
 
@@ -678,9 +1381,13 @@ int main(int ac, char *av[])
             return 1;
         }
 
-        // Disable collection stats logging if reading from file.
+        // Disable collection stats logging and metrics if reading from file.
         if ( vm.count("capture-file") )
+        {
             configuration.log_network_stats_period = 0;
+            configuration.metrics_socket.clear();
+            configuration.metrics_port = 0;
+        }
 
         // To enable a SIGHUP to not lose data, file compression
         // must survive the restart. That means compression
@@ -691,22 +1398,77 @@ int main(int ac, char *av[])
         {
             if ( configuration.xz_output )
             {
-                writer_pool = std::make_shared<ParallelWriterPool<XzStreamWriter>>(configuration.max_compression_threads, configuration.xz_preset);
+                writer_pool = std::make_shared<ParallelWriterPool<XzStreamWriter>>(configuration.max_compression_threads, configuration.xz_preset, configuration.compression_cpus);
             }
             else if ( configuration.gzip_output )
             {
-                writer_pool = std::make_shared<ParallelWriterPool<GzipStreamWriter>>(configuration.max_compression_threads, configuration.gzip_level);
+                writer_pool = std::make_shared<ParallelWriterPool<GzipStreamWriter>>(configuration.max_compression_threads, configuration.gzip_level, configuration.compression_cpus);
             }
             else
             {
-                writer_pool = std::make_shared<ParallelWriterPool<StreamWriter>>(configuration.max_compression_threads, 0);
+                writer_pool = std::make_shared<ParallelWriterPool<StreamWriter>>(configuration.max_compression_threads, 0, configuration.compression_cpus);
+            }
+        }
+
+        // Streaming subscribers also stay connected over a SIGHUP
+        // restart. Changes to the stream settings only take effect
+        // on a full restart.
+        std::shared_ptr<BlockStreamer> streamer;
+
+        if ( !configuration.output_stream.empty() )
+        {
+            try
+            {
+                streamer = std::make_shared<BlockStreamer>(configuration.output_stream, configuration.output_stream_blocks);
+            }
+            catch (const std::runtime_error& err)
+            {
+                LOG_ERROR << err.what();
+                std::cerr << "Error: " << err.what() << std::endl;
+                return 1;
+            }
+        }
+
+        // Like compression, metrics must survive a SIGHUP restart,
+        // so the server is started here. Changes to the metrics
+        // settings only take effect on a full restart.
+        std::shared_ptr<Metrics> metrics;
+        std::unique_ptr<MetricsServer> metrics_server;
+
+        if ( !configuration.metrics_socket.empty() || configuration.metrics_port != 0 )
+        {
+            metrics = std::make_shared<Metrics>();
+            if ( writer_pool )
+                metrics->add_gauge("compactor_compression_backlog_files", "",
+                                   "C-DNS files being compressed or waiting to be compressed.",
+                                   [writer_pool]() { return writer_pool->backlog(); });
+            if ( streamer )
+            {
+                metrics->add_gauge("compactor_stream_subscribers", "",
+                                   "C-DNS stream subscribers connected.",
+                                   [streamer]() { return streamer->subscriber_count(); });
+                metrics->add_gauge("compactor_stream_dropped_subscribers", "",
+                                   "C-DNS stream subscribers dropped for being too slow.",
+                                   [streamer]() { return streamer->dropped_subscriber_count(); });
+                metrics->add_gauge("compactor_stream_dropped_blocks", "",
+                                   "C-DNS blocks not sent to a slow stream FIFO reader.",
+                                   [streamer]() { return streamer->dropped_block_count(); });
+            }
+            try
+            {
+                metrics_server = make_unique<MetricsServer>(metrics, configuration.metrics_socket, configuration.metrics_port);
+            }
+            catch (const std::runtime_error& err)
+            {
+                LOG_ERROR << err.what();
+                std::cerr << "Error: " << err.what() << std::endl;
+                return 1;
             }
         }
 
         std::vector<std::thread> threads;
-        int res;
-        while ( ( res = run_configuration(vm, configuration, threads, writer_pool) ) == 1 )
-            configuration.reread_config_file();
+        std::vector<std::unique_ptr<Configuration>> reloads;
+        int res = run_configuration(vm, configuration, threads, reloads, writer_pool, streamer, metrics);
 
         // On interrupt, abort ongoing compressions.
         if ( res == 2 && writer_pool )
@@ -715,6 +1477,9 @@ int main(int ac, char *av[])
         // Wait for in progress output to complete.
         for ( auto& thread : threads )
             thread.join();
+
+        // Finish off output files still being written in the background.
+        StreamWriter::set_file_stage(nullptr);
     }
     catch (po::error& err)
     {
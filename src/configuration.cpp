@@ -13,14 +13,20 @@
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
+#include <utility>
 
 #include <boost/filesystem.hpp>
 
 #include <tins/network_interface.h>
 #include <tins/tins.h>
 
+#include "config.h"
+
+#include "clientsampler.hpp"
 #include "configuration.hpp"
 #include "log.hpp"
+#include "makeunique.hpp"
+#include "threadplacement.hpp"
 
 namespace po = boost::program_options;
 
@@ -122,6 +128,68 @@ namespace {
         }
     }
 
+    /**
+     * \brief Set an address configuration item.
+     *
+     * \param config    the item to set.
+     * \param addresses the addresses.
+     * \throws boost::program_options::error if an address is not valid.
+     */
+    void set_address_config(std::vector<IPAddress>& config, const std::vector<std::string>& addresses)
+    {
+        for ( const auto& s : addresses )
+        {
+            try
+            {
+                config.emplace_back(s);
+            }
+            catch (Tins::invalid_address&)
+            {
+                std::ostringstream oss;
+                oss << "'" << s << "' is not a valid IPv4 or IPv6 address.";
+                throw po::error(oss.str());
+            }
+        }
+    }
+
+    /**
+     * \brief Check a domain name.
+     *
+     * The root must be given as `.`. Escapes are not supported.
+     *
+     * \param domain the domain name, in presentation format.
+     * \throws boost::program_options::error if the name is not valid.
+     */
+    void check_domain_name(const std::string& domain)
+    {
+        if ( domain.empty() )
+            throw po::error("empty domain name, use . for the root.");
+        if ( domain == "." )
+            return;
+
+        std::size_t label_len = 0;
+        std::size_t name_len = 1;
+        for ( auto c : domain )
+        {
+            if ( c == '\\' )
+                throw po::error("escapes are not supported in domain name " + domain);
+            else if ( c == '.' )
+            {
+                // Only the final label may be empty, for a trailing dot.
+                if ( label_len == 0 )
+                    throw po::error("empty label in domain name " + domain);
+                name_len += label_len + 1;
+                label_len = 0;
+            }
+            else if ( ++label_len > 63 )
+                throw po::error("label too long in domain name " + domain);
+        }
+        if ( label_len > 0 )
+            name_len += label_len + 1;
+        if ( name_len > 255 )
+            throw po::error("domain name too long " + domain);
+    }
+
     /**
      * \brief Check a network interface exists.
      *
@@ -183,18 +251,28 @@ namespace {
 }
 
 Configuration::Configuration()
-    : gzip_output(false), gzip_level(6),
+    : output_stream_blocks(16), aggregates_period(0), aggregates_top(20),
+      gzip_output(false), gzip_level(6),
       xz_output(false), xz_preset(6),
       gzip_pcap(false), gzip_level_pcap(6),
       xz_pcap(false), xz_preset_pcap(6),
-      max_compression_threads(2),
+      max_compression_threads(2), write_queue_depth(0),
+      prepare_output_files(false),
       rotation_period(300),
       query_timeout(5), skew_timeout(10),
+      max_tcp_flows(100000), max_tcp_memory(64), tcp_flow_timeout(60),
+      max_fragmented_datagrams(10000), max_fragment_memory(16), fragment_timeout(30),
       snaplen(65535),
       promisc_mode(false),
+      capture_batch_size(64), capture_batch_timeout(1000),
+      capture_fanout(1), capture_reorder_hold(0),
       output_options_queries(0), output_options_responses(0),
-      max_block_qr_items(5000),
-      report_info(false), log_network_stats_period(0),
+      max_block_qr_items(5000), block_filter_bits(0),
+      shed_sections_fill(100), shed_sample_fill(100), shed_min_sample(10),
+      client_sample(1.0), client_sample_ipv4_prefix_length(32),
+      client_sample_ipv6_prefix_length(128),
+      pseudo_anonymise(false),
+      report_info(false), log_network_stats_period(0), metrics_port(0),
       debug_dns(false), debug_qr(false), omit_sysid(false),
       max_channel_size(10000),
       config_file_(CONFFILE),
@@ -245,12 +323,54 @@ Configuration::Configuration()
         ("skew-timeout,k",
          po::value<unsigned int>(&skew_timeout)->default_value(10),
          "timeout period for a query to arrive after its response, in microseconds.")
+        ("max-tcp-flows",
+         po::value<unsigned int>(&max_tcp_flows)->default_value(100000),
+         "maximum number of TCP flows to track.")
+        ("max-tcp-memory",
+         po::value<unsigned int>(&max_tcp_memory)->default_value(64),
+         "maximum memory to use for TCP flows, in megabytes.")
+        ("tcp-flow-timeout",
+         po::value<unsigned int>(&tcp_flow_timeout)->default_value(60),
+         "timeout period for idle TCP flows, in seconds.")
+        ("max-fragmented-datagrams",
+         po::value<unsigned int>(&max_fragmented_datagrams)->default_value(10000),
+         "maximum number of fragmented IP datagrams to reassemble at once.")
+        ("max-fragment-memory",
+         po::value<unsigned int>(&max_fragment_memory)->default_value(16),
+         "maximum memory to use for IP fragment reassembly, in megabytes.")
+        ("fragment-timeout",
+         po::value<unsigned int>(&fragment_timeout)->default_value(30),
+         "timeout period for IP fragment reassembly, in seconds.")
         ("snaplen,s",
          po::value<unsigned int>(&snaplen)->default_value(65535),
          "capture this many bytes per packet.")
         ("promiscuous-mode,p",
          po::value<bool>(&promisc_mode)->implicit_value(true),
          "put the capture interface into promiscuous mode.")
+        ("capture-batch-size",
+         po::value<unsigned int>(&capture_batch_size)->default_value(64),
+         "maximum number of captured packets passed between threads at once.")
+        ("capture-batch-timeout",
+         po::value<unsigned int>(&capture_batch_timeout)->default_value(1000),
+         "maximum time to wait for a capture batch to fill, in microseconds.")
+        ("capture-fanout",
+         po::value<unsigned int>(&capture_fanout)->default_value(1),
+         "number of capture sockets per network interface, sharing traffic by flow.")
+        ("capture-reorder-hold",
+         po::value<unsigned int>(&capture_reorder_hold)->default_value(0),
+         "maximum time to hold captured packets to put them in time order, in microseconds.")
+        ("capture-cpus",
+         po::value<std::string>(),
+         "CPUs on which to run capture threads, e.g. 0-3,8.")
+        ("process-cpus",
+         po::value<std::string>(),
+         "CPUs on which to run the packet processing thread.")
+        ("output-cpus",
+         po::value<std::string>(),
+         "CPUs on which to run output writing threads.")
+        ("compression-cpus",
+         po::value<std::string>(),
+         "CPUs on which to run output compression threads.")
         ("interface,i",
          po::value<std::vector<std::string>>(&network_interfaces),
          "network interface from which to capture.")
@@ -272,12 +392,69 @@ Configuration::Configuration()
         ("ignore-rr-type,g",
          po::value<std::vector<std::string>>(),
         "RR types to be ignored.")
+        ("include-qname-suffix",
+         po::value<std::vector<std::string>>(&include_qname_suffixes),
+         "capture only messages with a query name in these domains.")
+        ("exclude-qname-suffix",
+         po::value<std::vector<std::string>>(&exclude_qname_suffixes),
+         "don't capture messages with a query name in these domains.")
+        ("include-server-address",
+         po::value<std::vector<std::string>>(),
+         "capture only messages to or from these server addresses.")
+        ("exclude-server-address",
+         po::value<std::vector<std::string>>(),
+         "don't capture messages to or from these server addresses.")
+        ("include-qtype",
+         po::value<std::vector<std::string>>(),
+         "capture only messages with these query types.")
+        ("exclude-qtype",
+         po::value<std::vector<std::string>>(),
+         "don't capture messages with these query types.")
         ("max-block-qr-items",
          po::value<unsigned int>(&max_block_qr_items)->default_value(5000),
          "maximum number of query/response items in an output block.")
+        ("block-filter-bits",
+         po::value<unsigned int>(&block_filter_bits)->default_value(0),
+         "bits per entry in block address and name search filters, 0 for no filters.")
+        ("shed-sections-fill",
+         po::value<unsigned int>(&shed_sections_fill)->default_value(100),
+         "C-DNS output queue fill percentage at which extended sections and address events are dropped, 100 for never.")
+        ("shed-sample-fill",
+         po::value<unsigned int>(&shed_sample_fill)->default_value(100),
+         "C-DNS output queue fill percentage at which clients are sampled, 100 for never.")
+        ("shed-min-sample",
+         po::value<unsigned int>(&shed_min_sample)->default_value(10),
+         "percentage of clients kept when the C-DNS output queue is full.")
+        ("client-sample",
+         po::value<double>(&client_sample)->default_value(1.0, "1"),
+         "fraction of clients whose traffic is captured.")
+        ("client-sample-ipv4-prefix-length",
+         po::value<unsigned int>(&client_sample_ipv4_prefix_length)->default_value(32),
+         "IPv4 prefix length by which clients are sampled.")
+        ("client-sample-ipv6-prefix-length",
+         po::value<unsigned int>(&client_sample_ipv6_prefix_length)->default_value(128),
+         "IPv6 prefix length by which clients are sampled.")
+        ("client-sample-key",
+         po::value<std::string>(&client_sample_key),
+         "key selecting which clients are sampled.")
         ("output,o",
          po::value<std::string>(&output_pattern),
          "filename pattern for storing C-DNS output.")
+        ("output-stream",
+         po::value<std::string>(&output_stream),
+         "Unix domain socket or FIFO to stream C-DNS blocks to.")
+        ("output-stream-blocks",
+         po::value<unsigned int>(&output_stream_blocks)->default_value(16),
+         "maximum C-DNS blocks waiting to be sent to a stream subscriber.")
+        ("aggregates-output",
+         po::value<std::string>(&aggregates_pattern),
+         "filename pattern for storing traffic aggregates.")
+        ("aggregates-period",
+         po::value<unsigned int>(&aggregates_period)->default_value(0),
+         "traffic aggregation period in seconds, 0 for no aggregates.")
+        ("aggregates-top",
+         po::value<unsigned int>(&aggregates_top)->default_value(20),
+         "number of most frequent query names and clients in traffic aggregates.")
         ("raw-pcap,w",
          po::value<std::string>(&raw_pcap_pattern),
          "filename pattern for storing raw PCAP output.")
@@ -311,15 +488,37 @@ Configuration::Configuration()
         ("max-compression-threads",
          po::value<unsigned int>(&max_compression_threads)->default_value(2),
          "maximum number of compression threads.")
+        ("write-queue-depth",
+         po::value<unsigned int>(&write_queue_depth)->default_value(0),
+         "maximum number of asynchronous writes in flight per output file, 0 for synchronous writes.")
+        ("prepare-output-files",
+         po::value<bool>(&prepare_output_files)->implicit_value(true),
+         "open and reserve space for the next output files, and finish written output files, in the background.")
         ("log-network-stats-period,L",
          po::value<unsigned int>(&log_network_stats_period)->default_value(0),
          "log network collection stats period.")
+        ("metrics-socket",
+         po::value<std::string>(&metrics_socket),
+         "Unix socket path on which to serve metrics.")
+        ("metrics-port",
+         po::value<unsigned int>(&metrics_port)->default_value(0),
+         "loopback TCP port on which to serve metrics.")
+        ("pseudo-anonymise",
+         po::value<bool>(&pseudo_anonymise)->implicit_value(true),
+         "pseudo-anonymise addresses in C-DNS output.")
+        ("pseudo-anonymisation-key",
+         po::value<std::string>(&pseudo_anon_key),
+         "pseudo-anonymisation key.")
+        ("pseudo-anonymisation-passphrase",
+         po::value<std::string>(&pseudo_anon_passphrase),
+         "pseudo-anonymisation passphrase.")
         ;
 }
 
 po::variables_map Configuration::parse_command_line(int ac, char *av[])
 {
     cmdline_vars_.clear();
+    cmdline_args_.assign(av, av + ac);
 
     po::options_description all("Options");
     all.add(cmdline_options_).add(cmdline_hidden_options_).add(config_file_options_);
@@ -360,6 +559,18 @@ po::variables_map Configuration::reread_config_file()
     return res;
 }
 
+std::unique_ptr<Configuration> Configuration::reload(po::variables_map& vm) const
+{
+    std::vector<char*> av;
+    for ( const auto& arg : cmdline_args_ )
+        av.push_back(const_cast<char*>(arg.c_str()));
+    av.push_back(nullptr);
+
+    std::unique_ptr<Configuration> res = make_unique<Configuration>();
+    vm = res->parse_command_line(static_cast<int>(cmdline_args_.size()), av.data());
+    return res;
+}
+
 std::string Configuration::options_usage() const
 {
     po::options_description visible("Options");
@@ -421,6 +632,10 @@ void Configuration::dump_config(std::ostream& os) const
     dump_RR_types(os, true);
     os << "  Ignore RR types      : ";
     dump_RR_types(os, false);
+    if ( client_sample < 1 )
+        os << "  Client sample        : " << client_sample
+           << " (IPv4 /" << client_sample_ipv4_prefix_length
+           << ", IPv6 /" << client_sample_ipv6_prefix_length << ")\n";
 }
 
 void Configuration::set_config_items(const po::variables_map& vm)
@@ -469,6 +684,49 @@ void Configuration::set_config_items(const po::variables_map& vm)
     if ( max_compression_threads < 1 )
         throw po::error("number of compression threads must be at least 1.");
 
+    if ( output_stream_blocks < 1 )
+        throw po::error("output stream blocks must be 1 or more.");
+
+    if ( !aggregates_pattern.empty() && aggregates_period == 0 )
+        throw po::error("aggregates output needs an aggregates period.");
+
+    if ( aggregates_top < 1 || aggregates_top > 10000 )
+        throw po::error("aggregates top must be in the range 1-10000.");
+
+    if ( write_queue_depth > 256 )
+        throw po::error("write queue depth must be 256 or below.");
+
+    if ( capture_batch_size < 1 )
+        throw po::error("capture batch size must be at least 1.");
+
+    if ( capture_fanout < 1 )
+        throw po::error("capture fanout must be at least 1.");
+
+    const std::pair<const char*, std::vector<unsigned>*> cpu_options[] = {
+        { "capture-cpus", &capture_cpus },
+        { "process-cpus", &process_cpus },
+        { "output-cpus", &output_cpus },
+        { "compression-cpus", &compression_cpus },
+    };
+    for ( const auto& opt : cpu_options )
+    {
+        opt.second->clear();
+        if ( vm.count(opt.first) )
+        {
+            try
+            {
+                *opt.second = parse_cpu_list(vm[opt.first].as<std::string>());
+            }
+            catch (const cpu_list_error& err)
+            {
+                throw po::error(std::string(opt.first) + ": " + err.what() + ".");
+            }
+        }
+    }
+
+    if ( max_fragmented_datagrams < 1 )
+        throw po::error("maximum number of fragmented datagrams must be at least 1.");
+
     if ( snaplen == 0 )
         snaplen = 65535;
 
@@ -478,6 +736,46 @@ void Configuration::set_config_items(const po::variables_map& vm)
     if ( gzip_pcap && xz_pcap )
         throw po::error("You cannot select more than one PCAP compression method.");
 
+    if ( pseudo_anonymise )
+    {
+#if ENABLE_PSEUDOANONYMISATION
+        if ( vm.count("pseudo-anonymisation-key") && vm.count("pseudo-anonymisation-passphrase") )
+            throw po::error("Specify pseudo-anonymisation key or passphrase, but not both.");
+        if ( vm.count("pseudo-anonymisation-key") && pseudo_anon_key.size() != 16 )
+            throw po::error("Pseudo-anonymisation key must be exactly 16 bytes long.");
+        if ( !vm.count("pseudo-anonymisation-key") && !vm.count("pseudo-anonymisation-passphrase") )
+            throw po::error("To pseudo-anonymise output you must specify a passphrase or key.");
+#else
+        throw po::error("Pseudo-anonymisation is not supported in this build.");
+#endif
+    }
+
+    if ( block_filter_bits > 64 )
+        throw po::error("block filter bits must be 64 or below.");
+
+    if ( shed_sections_fill > 100 || shed_sample_fill > 100 )
+        throw po::error("shedding fill levels must be 100 or below.");
+
+    if ( shed_min_sample < 1 || shed_min_sample > 100 )
+        throw po::error("minimum sample percentage must be in the range 1-100.");
+
+    if ( ClientSampler::parts_per_million(client_sample) < 1 || client_sample > 1 )
+        throw po::error("client sample must be in the range 0.000001-1.");
+
+    if ( client_sample_ipv4_prefix_length > 32 )
+        throw po::error("client sample IPv4 prefix length must be 32 or below.");
+
+    if ( client_sample_ipv6_prefix_length > 128 )
+        throw po::error("client sample IPv6 prefix length must be 128 or below.");
+
+    if ( max_tcp_flows < 1 )
+        throw po::error("maximum number of TCP flows must be at least 1.");
+
+    if ( metrics_port > 65535 )
+        throw po::error("Metrics port must be 65535 or below.");
+    if ( !metrics_socket.empty() && metrics_port != 0 )
+        throw po::error("Specify a metrics socket or port, but not both.");
+
     if ( vm.count("ignore-rr-type") && vm.count("accept-rr-type") )
         throw po::error("You can specify only accept-rr-type or ignore-rr-type, not both.");
 
@@ -488,6 +786,23 @@ void Configuration::set_config_items(const po::variables_map& vm)
     if ( vm.count("accept-rr-type") )
         set_rr_type_config(accept_rr_types, vm["accept-rr-type"].as<std::vector<std::string>>());
 
+    for ( const auto& d : include_qname_suffixes )
+        check_domain_name(d);
+    for ( const auto& d : exclude_qname_suffixes )
+        check_domain_name(d);
+    include_server_addresses.clear();
+    if ( vm.count("include-server-address") )
+        set_address_config(include_server_addresses, vm["include-server-address"].as<std::vector<std::string>>());
+    exclude_server_addresses.clear();
+    if ( vm.count("exclude-server-address") )
+        set_address_config(exclude_server_addresses, vm["exclude-server-address"].as<std::vector<std::string>>());
+    include_qtypes.clear();
+    if ( vm.count("include-qtype") )
+        set_rr_type_config(include_qtypes, vm["include-qtype"].as<std::vector<std::string>>());
+    exclude_qtypes.clear();
+    if ( vm.count("exclude-qtype") )
+        set_rr_type_config(exclude_qtypes, vm["exclude-qtype"].as<std::vector<std::string>>());
+
     for ( const auto& ifname : network_interfaces )
         check_network_interface(ifname);
 
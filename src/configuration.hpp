@@ -13,6 +13,7 @@
 #ifndef CONFIGURATION_HPP
 #define CONFIGURATION_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -74,6 +75,41 @@ public:
      */
     std::string output_pattern;
 
+    /**
+     * \brief path of a Unix domain socket or FIFO to stream C-DNS to.
+     *
+     * If not empty, each C-DNS block is sent to stream subscribers
+     * as it is completed.
+     */
+    std::string output_stream;
+
+    /**
+     * \brief most C-DNS blocks waiting to be sent to a stream subscriber.
+     */
+    unsigned int output_stream_blocks;
+
+    /**
+     * \brief output filename pattern for traffic aggregates.
+     *
+     * If not empty, the traffic aggregates for each aggregation
+     * period are written to this file.
+     *
+     * The filename pattern is run through `strftime()` to generate the filename.
+     */
+    std::string aggregates_pattern;
+
+    /**
+     * \brief traffic aggregation period, in seconds.
+     *
+     * If 0, traffic aggregates are not gathered.
+     */
+    unsigned int aggregates_period;
+
+    /**
+     * \brief number of most frequent query names and clients aggregated.
+     */
+    unsigned int aggregates_top;
+
     /**
      * \brief compress output data using gzip.
      */
@@ -119,6 +155,18 @@ public:
      */
     unsigned int max_compression_threads;
 
+    /**
+     * \brief maximum number of asynchronous writes in flight per
+     * output file. 0 for synchronous writes.
+     */
+    unsigned int write_queue_depth;
+
+    /**
+     * \brief prepare the next output files, and finish off written
+     * output files, in the background?
+     */
+    bool prepare_output_files;
+
     /**
      * \brief rotation period for all output files, in seconds.
      */
@@ -138,6 +186,36 @@ public:
      */
     unsigned int skew_timeout;
 
+    /**
+     * \brief maximum number of TCP flows to track.
+     */
+    unsigned int max_tcp_flows;
+
+    /**
+     * \brief maximum memory to use for TCP flows, in megabytes.
+     */
+    unsigned int max_tcp_memory;
+
+    /**
+     * \brief timeout period for idle TCP flows, in seconds.
+     */
+    unsigned int tcp_flow_timeout;
+
+    /**
+     * \brief maximum number of fragmented IP datagrams to reassemble at once.
+     */
+    unsigned int max_fragmented_datagrams;
+
+    /**
+     * \brief maximum memory to use for IP fragment reassembly, in megabytes.
+     */
+    unsigned int max_fragment_memory;
+
+    /**
+     * \brief timeout period for IP fragment reassembly, in seconds.
+     */
+    unsigned int fragment_timeout;
+
     /**
      * \brief packet capture snap length. See `tcpdump` documentation for more.
      */
@@ -149,6 +227,49 @@ public:
      */
     bool promisc_mode;
 
+    /**
+     * \brief maximum number of captured packets passed between
+     * threads in one batch.
+     */
+    unsigned int capture_batch_size;
+
+    /**
+     * \brief maximum time to wait for a capture batch to fill,
+     * in microseconds.
+     */
+    unsigned int capture_batch_timeout;
+
+    /**
+     * \brief number of capture sockets per network interface.
+     */
+    unsigned int capture_fanout;
+
+    /**
+     * \brief maximum time to hold captured packets to put them in
+     * time order, in microseconds. 0 disables reordering.
+     */
+    unsigned int capture_reorder_hold;
+
+    /**
+     * \brief CPUs for the capture threads. Empty for any CPU.
+     */
+    std::vector<unsigned> capture_cpus;
+
+    /**
+     * \brief CPUs for the packet processing thread. Empty for any CPU.
+     */
+    std::vector<unsigned> process_cpus;
+
+    /**
+     * \brief CPUs for the output writing threads. Empty for any CPU.
+     */
+    std::vector<unsigned> output_cpus;
+
+    /**
+     * \brief CPUs for the output compression threads. Empty for any CPU.
+     */
+    std::vector<unsigned> compression_cpus;
+
     /**
      * \brief the network interfaces to capture from.
      *
@@ -201,11 +322,104 @@ public:
      */
     unsigned int max_block_qr_items;
 
+    /**
+     * \brief bits per entry in block address and name filters.
+     * 0 if no filters are to be written.
+     */
+    unsigned int block_filter_bits;
+
+    /**
+     * \brief C-DNS channel fill percentage at which extended sections
+     * and address events are shed.
+     */
+    unsigned int shed_sections_fill;
+
+    /**
+     * \brief C-DNS channel fill percentage at which client sampling starts.
+     */
+    unsigned int shed_sample_fill;
+
+    /**
+     * \brief percentage of clients kept when the C-DNS channel is full.
+     */
+    unsigned int shed_min_sample;
+
+    /**
+     * \brief fraction of clients kept by client sampling.
+     *
+     * 1 if all clients are kept.
+     */
+    double client_sample;
+
+    /**
+     * \brief IPv4 prefix length by which clients are sampled.
+     */
+    unsigned int client_sample_ipv4_prefix_length;
+
+    /**
+     * \brief IPv6 prefix length by which clients are sampled.
+     */
+    unsigned int client_sample_ipv6_prefix_length;
+
+    /**
+     * \brief the client sampling hash key.
+     */
+    std::string client_sample_key;
+
     /**
      * \brief which RR types are to be included on output.
      */
     std::vector<unsigned> accept_rr_types;
 
+    /**
+     * \brief capture only messages with a query name in these domains.
+     */
+    std::vector<std::string> include_qname_suffixes;
+
+    /**
+     * \brief don't capture messages with a query name in these domains.
+     */
+    std::vector<std::string> exclude_qname_suffixes;
+
+    /**
+     * \brief capture only messages to or from these server addresses.
+     */
+    std::vector<IPAddress> include_server_addresses;
+
+    /**
+     * \brief don't capture messages to or from these server addresses.
+     */
+    std::vector<IPAddress> exclude_server_addresses;
+
+    /**
+     * \brief capture only messages with these query types.
+     */
+    std::vector<unsigned> include_qtypes;
+
+    /**
+     * \brief don't capture messages with these query types.
+     */
+    std::vector<unsigned> exclude_qtypes;
+
+    /**
+     * \brief pseudo-anonymise addresses in C-DNS output.
+     */
+    bool pseudo_anonymise;
+
+    /**
+     * \brief the pseudo-anonymisation key, if given.
+     *
+     * This must be exactly 16 bytes long.
+     */
+    std::string pseudo_anon_key;
+
+    /**
+     * \brief the pseudo-anonymisation passphrase, if given.
+     *
+     * The key is generated from the passphrase.
+     */
+    std::string pseudo_anon_passphrase;
+
     /**
      * \brief report statistics on exit
      */
@@ -216,6 +430,18 @@ public:
      */
     unsigned int log_network_stats_period;
 
+    /**
+     * \brief Unix socket path on which to serve live metrics.
+     */
+    std::string metrics_socket;
+
+    /**
+     * \brief loopback TCP port on which to serve live metrics.
+     *
+     * 0 means do not serve metrics on TCP.
+     */
+    unsigned int metrics_port;
+
     /**
      * \brief output text summary of individual DNS messages.
      */
@@ -264,6 +490,19 @@ public:
      */
     boost::program_options::variables_map reread_config_file();
 
+    /**
+     * \brief Read the configuration again into a new configuration.
+     *
+     * The command line given to `parse_command_line()` is parsed
+     * again, and the configuration file re-read. This configuration
+     * is not changed, so it stays valid for threads still using it.
+     *
+     * \param vm set to the variable map of the new configuration.
+     * \returns the new configuration.
+     * \throws boost::program_options::error on error.
+     */
+    std::unique_ptr<Configuration> reload(boost::program_options::variables_map& vm) const;
+
     /**
      * \brief Return the options for usage output.
      *
@@ -290,6 +529,11 @@ private:
      */
     std::string config_file_;
 
+    /**
+     * \brief the command line arguments.
+     */
+    std::vector<std::string> cmdline_args_;
+
     /**
      * \brief variable map from command line only parse.
      */
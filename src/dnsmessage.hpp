@@ -117,6 +117,11 @@ struct DNSMessage
      */
     std::chrono::system_clock::time_point timestamp;
 
+    /**
+     * \brief when the message was decoded, if metrics are being collected.
+     */
+    std::chrono::steady_clock::time_point decoded;
+
     /**
      * \brief IP address of client.
      *
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+
+#include "fasthash.hpp"
+
+#include "dnsname.hpp"
+
+bool DNSName::operator<(const DNSName& rhs) const
+{
+    int res = std::memcmp(data(), rhs.data(), std::min(size_, rhs.size_));
+    return res < 0 || ( res == 0 && size_ < rhs.size_ );
+}
+
+void DNSName::assign(const uint8_t* data, std::size_t len)
+{
+    if ( len > INLINE_CAPACITY )
+    {
+        // Reuse an existing heap buffer if it is big enough.
+        if ( !heap_ || size_ < len )
+        {
+            delete[] heap_;
+            heap_ = nullptr;
+            heap_ = new uint8_t[len];
+        }
+        std::memcpy(heap_, data, len);
+    }
+    else
+    {
+        delete[] heap_;
+        heap_ = nullptr;
+        std::memcpy(inline_, data, len);
+    }
+    size_ = len;
+    set_hash();
+}
+
+void DNSName::take(DNSName& other) noexcept
+{
+    delete[] heap_;
+    heap_ = other.heap_;
+    size_ = other.size_;
+    hash_ = other.hash_;
+    if ( !heap_ )
+        std::memcpy(inline_, other.inline_, size_);
+    other.heap_ = nullptr;
+    other.size_ = 0;
+    other.set_hash();
+}
+
+void DNSName::set_hash()
+{
+    // Hash 16 bytes at a time. The hash is never stored, so
+    // reading the bytes in host order is fine.
+    const uint8_t* p = data();
+    std::size_t len = size_;
+    uint64_t h = len;
+    uint64_t a, b;
+
+    for ( ; len >= 16; len -= 16, p += 16 )
+    {
+        std::memcpy(&a, p, 8);
+        std::memcpy(&b, p + 8, 8);
+        h = fast_hash(h ^ a, b);
+    }
+
+    a = b = 0;
+    std::memcpy(&a, p, std::min<std::size_t>(len, 8));
+    if ( len > 8 )
+        std::memcpy(&b, p + 8, len - 8);
+    h = fast_hash(h ^ a, b);
+    hash_ = static_cast<uint32_t>(h ^ (h >> 32));
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef DNSNAME_HPP
+#define DNSNAME_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "bytestring.hpp"
+
+/**
+ * \class DNSName
+ * \brief A DNS name in label format.
+ *
+ * Most DNS names are too long for the small string optimisation of
+ * `byte_string`, so would need a heap allocation. A `DNSName` holds
+ * names up to `INLINE_CAPACITY` bytes inline, and only allocates
+ * for longer names. The object is the size of a typical cache line.
+ *
+ * The name hash is calculated on construction, so names can be
+ * compared and looked up in hash tables without reading the name
+ * bytes unless the hashes match.
+ *
+ * Block header tables also store RDATA with names, so a `DNSName`
+ * may hold any byte string.
+ */
+class DNSName
+{
+public:
+    /**
+     * \brief the longest name stored without a heap allocation.
+     */
+    static const std::size_t INLINE_CAPACITY = 48;
+
+    /**
+     * \brief Default constructor. The name is empty.
+     */
+    DNSName() : heap_(nullptr), size_(0)
+    {
+        set_hash();
+    }
+
+    /**
+     * \brief Constructor.
+     *
+     * \param data the name data.
+     * \param len  the name length.
+     */
+    DNSName(const uint8_t* data, std::size_t len) : heap_(nullptr), size_(0)
+    {
+        assign(data, len);
+    }
+
+    /**
+     * \brief Constructor.
+     *
+     * \param str the name data.
+     */
+    explicit DNSName(const byte_string& str) : heap_(nullptr), size_(0)
+    {
+        assign(str.data(), str.size());
+    }
+
+    /**
+     * \brief Copy constructor.
+     *
+     * \param other the name to copy.
+     */
+    DNSName(const DNSName& other) : heap_(nullptr), size_(0)
+    {
+        assign(other.data(), other.size_);
+    }
+
+    /**
+     * \brief Move constructor.
+     *
+     * \param other the name to move.
+     */
+    DNSName(DNSName&& other) noexcept : heap_(nullptr), size_(0)
+    {
+        take(other);
+    }
+
+    /**
+     * \brief Destructor.
+     */
+    ~DNSName()
+    {
+        delete[] heap_;
+    }
+
+    /**
+     * \brief Copy assignment.
+     *
+     * \param other the name to copy.
+     * \returns this name.
+     */
+    DNSName& operator=(const DNSName& other)
+    {
+        if ( this != &other )
+            assign(other.data(), other.size_);
+        return *this;
+    }
+
+    /**
+     * \brief Move assignment.
+     *
+     * \param other the name to move.
+     * \returns this name.
+     */
+    DNSName& operator=(DNSName&& other) noexcept
+    {
+        if ( this != &other )
+            take(other);
+        return *this;
+    }
+
+    /**
+     * \brief Return the name data.
+     */
+    const uint8_t* data() const
+    {
+        return heap_ ? heap_ : inline_;
+    }
+
+    /**
+     * \brief Return the name length.
+     */
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    /**
+     * \brief Determine if the name is empty.
+     */
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    /**
+     * \brief Return iterator to the start of the name data.
+     */
+    const uint8_t* begin() const
+    {
+        return data();
+    }
+
+    /**
+     * \brief Return iterator to the end of the name data.
+     */
+    const uint8_t* end() const
+    {
+        return data() + size_;
+    }
+
+    /**
+     * \brief Return a name byte.
+     *
+     * \param i the byte index.
+     * \returns the byte.
+     */
+    uint8_t operator[](std::size_t i) const
+    {
+        return data()[i];
+    }
+
+    /**
+     * \brief Return the name as a byte string.
+     */
+    byte_string as_byte_string() const
+    {
+        return byte_string(data(), size_);
+    }
+
+    /**
+     * \brief Equality operator.
+     *
+     * \param rhs the name to compare to.
+     * \returns `true` if the names are equal.
+     */
+    bool operator==(const DNSName& rhs) const
+    {
+        return hash_ == rhs.hash_ && size_ == rhs.size_ &&
+            std::memcmp(data(), rhs.data(), size_) == 0;
+    }
+
+    /**
+     * \brief Inequality operator.
+     *
+     * \param rhs the name to compare to.
+     * \returns `false` if the names are equal.
+     */
+    bool operator!=(const DNSName& rhs) const
+    {
+        return !( *this == rhs );
+    }
+
+    /**
+     * \brief Less than operator.
+     *
+     * Names order as their byte strings.
+     *
+     * \param rhs the name to compare to.
+     * \returns `true` if this name orders before `rhs`.
+     */
+    bool operator<(const DNSName& rhs) const;
+
+    /**
+     * \brief Return the hash value of the name.
+     *
+     * \param name the name.
+     * \returns the hash value.
+     */
+    friend std::size_t hash_value(const DNSName& name)
+    {
+        return name.hash_;
+    }
+
+private:
+    /**
+     * \brief Set the name value.
+     *
+     * \param data the name data.
+     * \param len  the name length.
+     */
+    void assign(const uint8_t* data, std::size_t len);
+
+    /**
+     * \brief Take the value of another name, leaving it empty.
+     *
+     * \param other the name to take.
+     */
+    void take(DNSName& other) noexcept;
+
+    /**
+     * \brief Calculate the hash of the current value.
+     */
+    void set_hash();
+
+    /**
+     * \brief the name data if it does not fit inline, or `nullptr`.
+     */
+    uint8_t* heap_;
+
+    /**
+     * \brief the name length.
+     */
+    uint32_t size_;
+
+    /**
+     * \brief the name hash.
+     */
+    uint32_t hash_;
+
+    /**
+     * \brief the name data if it fits inline.
+     */
+    uint8_t inline_[INLINE_CAPACITY];
+};
+
+#endif
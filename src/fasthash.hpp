@@ -0,0 +1,63 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef FASTHASH_HPP
+#define FASTHASH_HPP
+
+#include <cstdint>
+
+/**
+ * \brief Multiply two 64 bit values, and fold the 128 bit product.
+ *
+ * \param a first value.
+ * \param b second value.
+ * \returns the XOR of the high and low halves of the product.
+ */
+inline uint64_t fast_hash_mum(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = static_cast<uint32_t>(a);
+    uint64_t hb = b >> 32, lb = static_cast<uint32_t>(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = ( t < rl );
+    uint64_t lo = t + (rm1 << 32);
+    carry += ( lo < t );
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    return lo ^ hi;
+#endif
+}
+
+/**
+ * \brief Hash a 128 bit value.
+ *
+ * The construction follows wyhash, and costs two multiplications.
+ * It is intended for hash tables, not for values stored or compared
+ * across platforms.
+ *
+ * \param a first 64 bits of the value.
+ * \param b second 64 bits of the value.
+ * \returns hash value.
+ */
+inline uint64_t fast_hash(uint64_t a, uint64_t b)
+{
+    const uint64_t P0 = 0xa0761d6478bd642fULL;
+    const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+    const uint64_t P2 = 0x8ebc6af09c88c6e3ULL;
+
+    return fast_hash_mum(fast_hash_mum(a ^ P0, b ^ P1) ^ P2, 16 ^ P1);
+}
+
+#endif
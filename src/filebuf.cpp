@@ -0,0 +1,126 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "filebuf.hpp"
+#include "log.hpp"
+
+void FileBuf::close()
+{
+    int fd = release();
+    if ( ::close(fd) == -1 )
+        throw file_write_error("Error closing " + name_ + ": " + std::strerror(errno));
+}
+
+FileBuf::int_type FileBuf::overflow(int_type ch)
+{
+    if ( !submit() )
+        return traits_type::eof();
+
+    if ( !traits_type::eq_int_type(ch, traits_type::eof()) )
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize FileBuf::xsputn(const char_type* s, std::streamsize n)
+{
+    std::streamsize done = 0;
+
+    while ( done < n )
+    {
+        std::streamsize room = epptr() - pptr();
+        if ( room == 0 )
+        {
+            if ( !submit() )
+                break;
+            continue;
+        }
+
+        std::streamsize len = std::min(room, n - done);
+        std::memcpy(pptr(), s + done, static_cast<std::size_t>(len));
+        pbump(static_cast<int>(len));
+        done += len;
+    }
+
+    return done;
+}
+
+int FileBuf::sync()
+{
+    return submit() ? 0 : -1;
+}
+
+FdFileBuf::FdFileBuf(int fd, const std::string& name)
+    : FileBuf(fd, name), buffer_(BUFFER_SIZE), error_(0)
+{
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+FdFileBuf::~FdFileBuf()
+{
+    if ( fd_ == -1 )
+        return;
+
+    try
+    {
+        close();
+    }
+    catch (const std::exception& err)
+    {
+        LOG_ERROR << err.what();
+    }
+}
+
+int FdFileBuf::release()
+{
+    submit();
+
+    int fd = fd_;
+    fd_ = -1;
+    if ( error_ != 0 )
+    {
+        ::close(fd);
+        throw file_write_error("Error writing " + name_ + ": " + std::strerror(error_));
+    }
+    return fd;
+}
+
+bool FdFileBuf::submit()
+{
+    const char* p = pbase();
+    std::size_t len = static_cast<std::size_t>(pptr() - pbase());
+
+    while ( len > 0 && error_ == 0 )
+    {
+        ssize_t res = ::write(fd_, p, len);
+        if ( res < 0 )
+        {
+            if ( errno != EINTR )
+                error_ = errno;
+            continue;
+        }
+        p += res;
+        len -= static_cast<std::size_t>(res);
+        size_ += static_cast<uint64_t>(res);
+    }
+
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    return error_ == 0;
+}
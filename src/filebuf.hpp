@@ -0,0 +1,199 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef FILEBUF_HPP
+#define FILEBUF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * \exception file_write_error
+ * \brief Signals an error writing an output file.
+ */
+class file_write_error : public std::runtime_error
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param what message detailing the problem.
+     */
+    explicit file_write_error(const std::string& what)
+        : std::runtime_error(what) {}
+};
+
+/**
+ * \class FileBuf
+ * \brief Base class for output stream buffers writing to a file descriptor.
+ *
+ * Output is collected in a buffer, and passed on by the derived
+ * class when the buffer is full or the stream is flushed. Once all
+ * output is written, the file descriptor can be closed, or released
+ * for the caller to finish off the file.
+ */
+class FileBuf : public std::streambuf
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param fd   the file descriptor, which is owned by the buffer.
+     * \param name the file name, for error messages.
+     */
+    FileBuf(int fd, const std::string& name)
+        : fd_(fd), name_(name), size_(0) {}
+
+    /**
+     * \brief Destructor.
+     */
+    virtual ~FileBuf() {}
+
+    FileBuf(const FileBuf&) = delete;
+    FileBuf& operator=(const FileBuf&) = delete;
+
+    /**
+     * \brief Write all output, wait for it to be written, and give up
+     * the file descriptor.
+     *
+     * \returns the file descriptor, which the caller must close.
+     * \throws file_write_error if any write failed. The file
+     * descriptor is then closed.
+     */
+    virtual int release() = 0;
+
+    /**
+     * \brief Write all output, wait for it to be written, and close
+     * the file.
+     *
+     * \throws file_write_error if any write failed.
+     */
+    void close();
+
+    /**
+     * \brief Return the number of bytes output.
+     *
+     * \returns the number of bytes.
+     */
+    uint64_t size() const
+    {
+        return size_;
+    }
+
+protected:
+    /**
+     * \brief Pass on the buffered output, and start an empty buffer.
+     *
+     * \returns `false` on error.
+     */
+    virtual bool submit() = 0;
+
+    /**
+     * \brief Pass on the full buffer, and start another.
+     *
+     * \param ch a character to add to the new buffer, or EOF.
+     * \returns EOF on error, otherwise a value other than EOF.
+     */
+    virtual int_type overflow(int_type ch);
+
+    /**
+     * \brief Add a run of characters to the output.
+     *
+     * \param s the characters.
+     * \param n the number of characters.
+     * \returns the number of characters added.
+     */
+    virtual std::streamsize xsputn(const char_type* s, std::streamsize n);
+
+    /**
+     * \brief Pass on the buffered output.
+     *
+     * \returns 0 on success, -1 on error.
+     */
+    virtual int sync();
+
+    /**
+     * \brief the file descriptor, or -1 once released.
+     */
+    int fd_;
+
+    /**
+     * \brief the file name.
+     */
+    std::string name_;
+
+    /**
+     * \brief the number of bytes passed on.
+     */
+    uint64_t size_;
+};
+
+/**
+ * \class FdFileBuf
+ * \brief An output stream buffer writing a file synchronously.
+ */
+class FdFileBuf : public FileBuf
+{
+public:
+    /**
+     * \brief size of the output buffer.
+     */
+    static const std::size_t BUFFER_SIZE = 64 * 1024;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param fd   the file descriptor, which is owned by the buffer.
+     * \param name the file name, for error messages.
+     */
+    FdFileBuf(int fd, const std::string& name);
+
+    /**
+     * \brief Destructor.
+     *
+     * Close the file if not released. Errors are logged.
+     */
+    virtual ~FdFileBuf();
+
+    /**
+     * \brief Write all output and give up the file descriptor.
+     *
+     * \returns the file descriptor, which the caller must close.
+     * \throws file_write_error if any write failed.
+     */
+    virtual int release();
+
+protected:
+    /**
+     * \brief Write the buffered output.
+     *
+     * \returns `false` on error.
+     */
+    virtual bool submit();
+
+private:
+    /**
+     * \brief the output buffer.
+     */
+    std::vector<char> buffer_;
+
+    /**
+     * \brief the first write error, as an `errno` value, or 0.
+     */
+    int error_;
+};
+
+#endif
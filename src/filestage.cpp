@@ -0,0 +1,219 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "config.h"
+
+#include "filestage.hpp"
+#include "log.hpp"
+#include "threadplacement.hpp"
+
+FileStage::FileStage()
+{
+    // Spares are created with mkstemp(), which gives mode 0600.
+    // Give the files the mode they would have had if created
+    // normally. The umask can only be read by setting it, so do
+    // it once here at startup.
+    mode_t mask = umask(022);
+    umask(mask);
+    mode_ = 0666 & ~mask;
+
+    thread_ = std::thread([this]{ run(); });
+}
+
+FileStage::~FileStage()
+{
+    jobs_.close();
+    thread_.join();
+
+    for ( const auto& s : spares_ )
+    {
+        ::close(s.second.fd);
+        std::remove(s.second.name.c_str());
+    }
+}
+
+int FileStage::take(const std::string& name)
+{
+    std::string dir = directory(name);
+    int fd = -1;
+    std::string spare_name;
+
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        auto s = spares_.find(dir);
+        if ( s != spares_.end() )
+        {
+            fd = s->second.fd;
+            spare_name = s->second.name;
+            spares_.erase(s);
+        }
+        if ( preparing_.insert(dir).second )
+            jobs_.put([this, dir]{ prepare(dir); });
+    }
+
+    if ( fd != -1 )
+        jobs_.put([spare_name, name]
+                  {
+                      if ( std::rename(spare_name.c_str(), name.c_str()) != 0 )
+                          LOG_ERROR << "file rename from " << spare_name << " to " << name << " failed";
+                  });
+    return fd;
+}
+
+void FileStage::finish(int fd, uint64_t size, const std::string& name, const std::string& final_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        finishing_.insert(final_name);
+        last_size_[directory(final_name)] = size;
+    }
+
+    jobs_.put([this, fd, size, name, final_name]
+              {
+                  // Release any reserved space beyond the data.
+                  if ( ftruncate(fd, static_cast<off_t>(size)) != 0 )
+                      LOG_ERROR << "Can't truncate file " << name << ": " << std::strerror(errno);
+                  if ( fdatasync(fd) != 0 )
+                      LOG_ERROR << "Can't sync file " << name << ": " << std::strerror(errno);
+                  if ( ::close(fd) != 0 )
+                      LOG_ERROR << "Error closing " << name << ": " << std::strerror(errno);
+                  if ( std::rename(name.c_str(), final_name.c_str()) != 0 )
+                      LOG_ERROR << "file rename from " << name << " to " << final_name << " failed";
+
+                  std::lock_guard<std::mutex> lock(m_);
+                  finishing_.erase(finishing_.find(final_name));
+                  finished_.notify_all();
+              });
+}
+
+void FileStage::rename(const std::string& name, const std::string& new_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        finishing_.insert(new_name);
+    }
+
+    jobs_.put([this, name, new_name]
+              {
+                  if ( std::rename(name.c_str(), new_name.c_str()) != 0 )
+                      LOG_ERROR << "file rename from " << name << " to " << new_name << " failed";
+
+                  std::lock_guard<std::mutex> lock(m_);
+                  finishing_.erase(finishing_.find(new_name));
+                  finished_.notify_all();
+              });
+}
+
+void FileStage::remove(const std::string& name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        finishing_.insert(name);
+    }
+
+    jobs_.put([this, name]
+              {
+                  if ( std::remove(name.c_str()) != 0 )
+                      LOG_ERROR << "Can't remove file " << name << ": " << std::strerror(errno);
+
+                  std::lock_guard<std::mutex> lock(m_);
+                  finishing_.erase(finishing_.find(name));
+                  finished_.notify_all();
+              });
+}
+
+void FileStage::wait_for(const std::string& final_name)
+{
+    std::unique_lock<std::mutex> lock(m_);
+    finished_.wait(lock, [&]{ return finishing_.count(final_name) == 0; });
+}
+
+std::string FileStage::directory(const std::string& name)
+{
+    std::string res = boost::filesystem::path(name).parent_path().string();
+    return res.empty() ? "." : res;
+}
+
+void FileStage::prepare(const std::string& dir)
+{
+    uint64_t reserve;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        preparing_.erase(dir);
+        reserve = std::min(last_size_[dir], MAX_RESERVE);
+    }
+
+    std::string pattern = dir + "/.compactor-spare-XXXXXX";
+    std::vector<char> spare_name(pattern.begin(), pattern.end());
+    spare_name.push_back('\0');
+
+    int fd = mkstemp(spare_name.data());
+    if ( fd == -1 )
+    {
+        LOG_ERROR << "Can't create spare output file in " << dir << ": " << std::strerror(errno);
+        return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fchmod(fd, mode_);
+
+#ifdef HAVE_FALLOCATE
+    // Reserve space without changing the file size, so a file
+    // finished early has no trailing zeros.
+    if ( reserve > 0 &&
+         fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(reserve)) != 0 &&
+         errno != EOPNOTSUPP )
+        LOG_WARN << "Can't reserve space for spare output file in " << dir << ": " << std::strerror(errno);
+#else
+    (void) reserve;
+#endif
+
+    std::lock_guard<std::mutex> lock(m_);
+    auto s = spares_.find(dir);
+    if ( s != spares_.end() )
+    {
+        // A spare was prepared meanwhile. Keep the newer one.
+        ::close(s->second.fd);
+        std::remove(s->second.name.c_str());
+    }
+    spares_[dir] = Spare{fd, spare_name.data()};
+}
+
+void FileStage::run()
+{
+    set_thread_name("file stage");
+
+    std::function<void()> job;
+    while ( jobs_.get(job) )
+    {
+        try
+        {
+            job();
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what();
+        }
+    }
+}
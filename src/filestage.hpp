@@ -0,0 +1,208 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef FILESTAGE_HPP
+#define FILESTAGE_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <sys/types.h>
+
+#include "channel.hpp"
+
+/**
+ * \class FileStage
+ * \brief Prepare output files ahead of use, and finish them off
+ * after use, in a background thread.
+ *
+ * For each output directory a spare file is kept open, with disk
+ * space reserved for it to the size of the last file finished in
+ * that directory. When an output file is opened the spare is
+ * taken, so opening a file on rotation doesn't touch the file
+ * system, and another spare is prepared.
+ *
+ * When an output file has been written, it is truncated to its
+ * written size, synced, closed and renamed to its final name in
+ * the background.
+ */
+class FileStage
+{
+public:
+    /**
+     * \brief the most disk space reserved for a spare file.
+     */
+    static const uint64_t MAX_RESERVE = 1024ULL * 1024 * 1024;
+
+    /**
+     * \brief Constructor.
+     *
+     * Start the background thread.
+     */
+    FileStage();
+
+    /**
+     * \brief Destructor.
+     *
+     * Finish all queued work, remove unused spare files and stop
+     * the background thread.
+     */
+    ~FileStage();
+
+    FileStage(const FileStage&) = delete;
+    FileStage& operator=(const FileStage&) = delete;
+
+    /**
+     * \brief Take the spare file for the directory of a new output file.
+     *
+     * The spare is renamed to the output file name in the background.
+     * A new spare for the directory is prepared.
+     *
+     * \param name the name of the new output file.
+     * \returns an open descriptor for the empty file, or -1 if no
+     *          spare is ready. The caller must then create the file.
+     */
+    int take(const std::string& name);
+
+    /**
+     * \brief Finish off a written output file in the background.
+     *
+     * \param fd         the open file descriptor. It is owned by the
+     *                   stage from now on.
+     * \param size       the number of bytes written.
+     * \param name       the current name of the file.
+     * \param final_name the final name of the file.
+     */
+    void finish(int fd, uint64_t size, const std::string& name, const std::string& final_name);
+
+    /**
+     * \brief Rename a file in the background.
+     *
+     * The rename happens after any work already queued, so a file
+     * still being finished can be renamed.
+     *
+     * \param name     the current file name.
+     * \param new_name the new file name.
+     */
+    void rename(const std::string& name, const std::string& new_name);
+
+    /**
+     * \brief Remove a file in the background.
+     *
+     * The removal happens after any work already queued, so a file
+     * taken from a spare can be removed. Waiting for the file name
+     * waits for the removal.
+     *
+     * \param name the file name.
+     */
+    void remove(const std::string& name);
+
+    /**
+     * \brief Wait until no file is being finished to a given name.
+     *
+     * \param final_name the final file name.
+     */
+    void wait_for(const std::string& final_name);
+
+private:
+    /**
+     * \struct Spare
+     * \brief A spare file ready for use.
+     */
+    struct Spare
+    {
+        /**
+         * \brief the open file descriptor.
+         */
+        int fd;
+
+        /**
+         * \brief the spare file name.
+         */
+        std::string name;
+    };
+
+    /**
+     * \brief Return the directory part of a file name.
+     *
+     * \param name the file name.
+     * \returns the directory.
+     */
+    static std::string directory(const std::string& name);
+
+    /**
+     * \brief Create a spare file for a directory.
+     *
+     * Run in the background thread.
+     *
+     * \param dir the directory.
+     */
+    void prepare(const std::string& dir);
+
+    /**
+     * \brief Run queued work until the queue is closed.
+     */
+    void run();
+
+    /**
+     * \brief queued work for the background thread.
+     */
+    Channel<std::function<void()>> jobs_;
+
+    /**
+     * \brief mutex protecting the stage state.
+     */
+    std::mutex m_;
+
+    /**
+     * \brief signalled when a file has been finished.
+     */
+    std::condition_variable finished_;
+
+    /**
+     * \brief spare files ready, by directory.
+     */
+    std::map<std::string, Spare> spares_;
+
+    /**
+     * \brief directories with a spare file queued for preparation.
+     */
+    std::set<std::string> preparing_;
+
+    /**
+     * \brief size of the last file finished, by directory.
+     */
+    std::map<std::string, uint64_t> last_size_;
+
+    /**
+     * \brief final names of files being finished.
+     */
+    std::multiset<std::string> finishing_;
+
+    /**
+     * \brief file creation mode, allowing for the process umask.
+     */
+    mode_t mode_;
+
+    /**
+     * \brief the background thread.
+     */
+    std::thread thread_;
+};
+
+#endif
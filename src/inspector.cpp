@@ -14,11 +14,20 @@
 #include <functional>
 #include <iostream>
 #include <cstdio>
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 #include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
 
@@ -100,6 +109,11 @@ struct Options
      * \brief pseudo-anonymisation, if to use.
      */
     boost::optional<PseudoAnonymise> pseudo_anon;
+
+    /**
+     * \brief output only query/response pairs matching this search.
+     */
+    block_cbor::BlockSearch search;
 };
 
 using PacketSink = std::function<void (std::shared_ptr<QueryResponse>)>;
@@ -112,14 +126,24 @@ static void report_regeneration(std::ostream& os, unsigned wire_size)
             "  Incorrect wire size: " << wire_size << " packets\n\n";
 }
 
+static void report_search(std::ostream& os, BlockCborReader& cbr)
+{
+    os <<
+        "SEARCH:\n"
+        "  Blocks read          : " << cbr.blocks_read() << "\n"
+        "  Blocks skipped       : " << cbr.blocks_skipped() << "\n\n";
+}
+
 static void report(std::ostream& os, Configuration& config, BlockCborReader& cbr,
-                   unsigned bad_response_wire_size_count)
+                   unsigned bad_response_wire_size_count, const Options& options)
 {
     config.dump_config(os);
     cbr.dump_collector(os);
     cbr.dump_stats(os);
     cbr.dump_address_events(os);
     report_regeneration(os, bad_response_wire_size_count);
+    if ( !options.search.empty() )
+        report_search(os, cbr);
 }
 
 static void convert_stream(std::istream& is, PacketSink packet_sink, std::ofstream& info, const Options& options, const std::string& out)
@@ -133,6 +157,19 @@ static void convert_stream(std::istream& is, PacketSink packet_sink, std::ofstre
     std::chrono::system_clock::time_point earliest_time, latest_time;
     bool first_time = true;
 
+    // Decode only what is needed. Writing PCAP, dumping Query/Responses
+    // or checking regenerated response sizes needs full messages. Reports
+    // need only the timestamps, statistics and address events.
+    if ( !options.debug_qr &&
+         !( using_compression && config.output_options_responses == Configuration::ALL ) )
+    {
+        if ( options.report_only || options.info_only )
+            cbr.set_projection(BlockCborReader::STATISTICS | BlockCborReader::ADDRESS_EVENTS);
+        else if ( options.query_only )
+            cbr.set_projection(BlockCborReader::ALL & ~BlockCborReader::RESPONSE_SECTIONS);
+    }
+    cbr.set_search(options.search);
+
     for ( std::shared_ptr<QueryResponse> qr = cbr.readQR();
           qr;
           qr = cbr.readQR() )
@@ -198,11 +235,11 @@ static void convert_stream(std::istream& is, PacketSink packet_sink, std::ofstre
     if ( !options.report_only )
     {
         if ( info.is_open() )
-            report(info, config, cbr, bad_response_wire_size_count);
+            report(info, config, cbr, bad_response_wire_size_count, options);
     }
 
     if ( options.report_info )
-        report(std::cout, config, cbr, bad_response_wire_size_count);
+        report(std::cout, config, cbr, bad_response_wire_size_count, options);
 }
 
 static void write_packet(PcapBaseWriter& writer,
@@ -458,6 +495,47 @@ static std::unique_ptr<PcapBaseWriter> make_writer(const std::string& name, cons
         return make_unique<PcapWriter<StreamWriter>>(name, 0, 65535);
 }
 
+/**
+ * \brief Open a C-DNS input.
+ *
+ * The input may be a C-DNS file, a FIFO or the Unix domain socket of
+ * a *compactor* C-DNS stream. Blocks from a stream are converted as
+ * they arrive.
+ *
+ * \param name the input name.
+ * \returns the input stream, or `nullptr` if it can't be opened.
+ */
+static std::unique_ptr<std::istream> open_input(const std::string& name)
+{
+    struct stat st;
+    if ( stat(name.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) )
+    {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if ( name.size() >= sizeof(addr.sun_path) )
+            return nullptr;
+        std::strcpy(addr.sun_path, name.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if ( fd == -1 )
+            return nullptr;
+        if ( connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 )
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        using fd_stream = boost::iostreams::stream<boost::iostreams::file_descriptor_source>;
+        return std::unique_ptr<std::istream>(new fd_stream(fd, boost::iostreams::close_handle));
+    }
+
+    std::unique_ptr<std::ifstream> ifs = make_unique<std::ifstream>(name, std::ifstream::binary);
+    if ( !ifs->is_open() )
+        return nullptr;
+    return std::unique_ptr<std::istream>(std::move(ifs));
+}
+
 int main(int ac, char *av[])
 {
     // I promise not to use C stdio in this code.
@@ -472,6 +550,8 @@ int main(int ac, char *av[])
     std::string pcap_file_name;
     std::string info_file_name;
     std::string compression_type;
+    std::string search_client;
+    std::string search_qname;
 #if ENABLE_PSEUDOANONYMISATION
     std::string pseudo_anon_passphrase;
     std::string pseudo_anon_key;
@@ -503,6 +583,12 @@ int main(int ac, char *av[])
          "don't generate PCAP output files, only info files.")
         ("report-only,R",
          "don't write output files, just report info.")
+        ("search-client",
+         po::value<std::string>(&search_client),
+         "output only query/responses from this client address.")
+        ("search-qname",
+         po::value<std::string>(&search_qname),
+         "output only query/responses with this QNAME.")
 #if ENABLE_PSEUDOANONYMISATION
         ("pseudo-anonymisation-key,k",
          po::value<std::string>(&pseudo_anon_key),
@@ -597,6 +683,28 @@ int main(int ac, char *av[])
             options.report_info = true;
 
         po::notify(vm);
+
+        if ( vm.count("search-client") )
+        {
+            try
+            {
+                options.search.client_address = IPAddress(search_client);
+            }
+            catch (const std::exception&)
+            {
+                throw po::error("invalid search client address " + search_client);
+            }
+        }
+
+        if ( vm.count("search-qname") )
+        {
+            // Names are stored without the trailing root dot.
+            if ( search_qname.size() > 1 && search_qname.back() == '.' )
+                search_qname.pop_back();
+            if ( search_qname == "." )
+                search_qname.clear();
+            options.search.qname = CaptureDNS::encode_domain_name(search_qname);
+        }
     }
     catch (po::error& err)
     {
@@ -709,11 +817,10 @@ int main(int ac, char *av[])
                 std::cout << "\n\n";
             }
 
-            std::ifstream ifs;
-            ifs.open(fname, std::ifstream::binary);
-            if ( ifs.is_open() )
+            std::unique_ptr<std::istream> is = open_input(fname);
+            if ( is )
             {
-                if ( !convert_stream_to_packet_writer(ifs, writer, info, options, fname))
+                if ( !convert_stream_to_packet_writer(*is, writer, info, options, fname))
                 {
                     if ( !vm.count("output") )
                     {
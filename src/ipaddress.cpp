@@ -1,5 +1,5 @@
 /*
- * Copyright 2016-2017 Internet Corporation for Assigned Names and Numbers.
+ * Copyright 2016-2018 Internet Corporation for Assigned Names and Numbers.
  *
  * This Source Code Form is subject to the terms of the Mozilla Public
  * License, v. 2.0. If a copy of the MPL was not distributed with this
@@ -16,34 +16,45 @@
 
 #include "ipaddress.hpp"
 
+namespace {
+    uint64_t load_be64(const uint8_t* p)
+    {
+        uint64_t res = 0;
+        for ( int i = 0; i < 8; ++i )
+            res = (res << 8) | p[i];
+        return res;
+    }
+
+    void store_be64(uint64_t v, uint8_t* p)
+    {
+        for ( int i = 7; i >= 0; --i, v >>= 8 )
+            p[i] = static_cast<uint8_t>(v);
+    }
+}
+
 IPAddress::IPAddress(const Tins::IPv4Address& a)
-    : addr4_(a), ipv6_(false)
 {
+    // The integer value of a TINS address is in network byte order.
+    union
+    {
+        uint32_t uint_val;
+        unsigned char c[sizeof(uint32_t)];
+    } u;
+    u.uint_val = a;
+    set_ipv4(u.c);
 }
 
 IPAddress::IPAddress(const Tins::IPv6Address& a)
-    : addr6_(a), ipv6_(true)
 {
+    set_ipv6(a.begin());
 }
 
 IPAddress::IPAddress(const byte_string& data)
 {
     if ( data.size() == sizeof(uint32_t) )
-    {
-        union
-        {
-            uint32_t uint_val;
-            unsigned char c[sizeof(uint32_t)];
-        } u;
-        ipv6_ = false;
-        std::copy(data.begin(), data.end(), u.c);
-        addr4_ = Tins::IPv4Address(u.uint_val);
-    }
+        set_ipv4(data.data());
     else if ( data.size() == Tins::IPv6Address::address_size )
-    {
-        ipv6_ = true;
-        addr6_ = Tins::IPv6Address(data.data());
-    }
+        set_ipv6(data.data());
     else
         throw Tins::invalid_address();
 }
@@ -57,48 +68,83 @@ IPAddress::IPAddress(const char* str)
 {
     try
     {
-        addr4_ = Tins::IPv4Address(str);
-        ipv6_ = false;
+        *this = IPAddress(Tins::IPv4Address(str));
     }
     catch (const Tins::invalid_address&)
     {
-        addr6_ = Tins::IPv6Address(str);
-        ipv6_ = true;
+        *this = IPAddress(Tins::IPv6Address(str));
     }
 }
 
-byte_string IPAddress::asNetworkBinary() const
+void IPAddress::set_ipv6(const uint8_t* data)
 {
-    if ( ipv6_ )
+    hi_ = load_be64(data);
+    lo_ = load_be64(data + 8);
+    ipv6_ = true;
+}
+
+void IPAddress::set_ipv4(const uint8_t* data)
+{
+    hi_ = 0;
+    lo_ = (V4_MAPPED_PREFIX << 32) |
+        (uint64_t(data[0]) << 24) | (uint64_t(data[1]) << 16) |
+        (uint64_t(data[2]) << 8) | uint64_t(data[3]);
+    ipv6_ = false;
+}
+
+IPAddress::operator Tins::IPv4Address() const
+{
+    union
     {
-        byte_string res(addr6_.begin(), addr6_.end());
-        return res;
-    }
+        uint32_t uint_val;
+        unsigned char c[sizeof(uint32_t)];
+    } u;
+    uint8_t buf[16];
+    store_be64(lo_, buf + 8);
+    std::copy(buf + 12, buf + 16, u.c);
+    return Tins::IPv4Address(u.uint_val);
+}
+
+IPAddress::operator Tins::IPv6Address() const
+{
+    uint8_t buf[16];
+    store_be64(hi_, buf);
+    store_be64(lo_, buf + 8);
+    return Tins::IPv6Address(buf);
+}
+
+byte_string IPAddress::asNetworkBinary() const
+{
+    uint8_t buf[16];
+    store_be64(hi_, buf);
+    store_be64(lo_, buf + 8);
+    if ( is_ipv6() )
+        return byte_string(buf, sizeof(buf));
     else
+        return byte_string(buf + 12, 4);
+}
+
+IPAddress IPAddress::network(unsigned prefix_length) const
+{
+    IPAddress res(*this);
+    if ( !is_ipv6() )
+        prefix_length += 96;
+
+    if ( prefix_length < 64 )
     {
-        union
-        {
-            uint32_t uint_val;
-            unsigned char c[sizeof(uint32_t)];
-        } u;
-        u.uint_val = addr4_;
-        return byte_string(std::begin(u.c), std::end(u.c));
+        res.hi_ &= ( prefix_length > 0 ) ? ~0ULL << ( 64 - prefix_length ) : 0;
+        res.lo_ = 0;
     }
+    else if ( prefix_length < 128 )
+        res.lo_ &= ~0ULL << ( 128 - prefix_length );
+    return res;
 }
 
 std::ostream& operator<<(std::ostream& output, const IPAddress& addr)
 {
-    if ( addr.ipv6_ )
-        output << addr.addr6_;
+    if ( addr.is_ipv6() )
+        output << static_cast<Tins::IPv6Address>(addr);
     else
-        output << addr.addr4_;
+        output << static_cast<Tins::IPv4Address>(addr);
     return output;
 }
-
-std::size_t hash_value(IPAddress const& addr)
-{
-    if ( addr.ipv6_ )
-        return boost::hash_range(addr.addr6_.begin(), addr.addr6_.end());
-    else
-        return boost::hash_value(static_cast<uint32_t>(addr.addr4_));
-}
@@ -14,6 +14,7 @@
 #define IPADDRESS_HPP
 
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -22,10 +23,18 @@
 #include <tins/tins.h>
 
 #include "bytestring.hpp"
+#include "fasthash.hpp"
 
 /**
  * \class IPAddress
  * \brief An IPv4 or an IPv6 address.
+ *
+ * All addresses are held as 16 byte IPv6 addresses, with IPv4
+ * addresses stored in IPv4-mapped form (RFC 4291 section 2.5.5.2),
+ * and a flag giving the address family. So an IPv4-mapped IPv6
+ * address stays IPv6, and is not equal to the IPv4 address. The
+ * address is held as two integers in host byte order, so comparison
+ * and hashing need no branches or byte swaps.
  */
 class IPAddress
 {
@@ -71,7 +80,7 @@ public:
     /**
      * \brief Default constructor for an empty address.
      */
-    IPAddress(){}
+    IPAddress() : hi_(0), lo_(0), ipv6_(true) {}
 
     /**
      * \brief Return `true` if this address is IPv6.
@@ -85,6 +94,17 @@ public:
      */
     byte_string asNetworkBinary() const;
 
+    /**
+     * \brief Return the network address with the given prefix length.
+     *
+     * The prefix length of an IPv4 address counts bits of the IPv4
+     * address, so 24 keeps the first three octets.
+     *
+     * \param prefix_length the number of leading address bits to keep.
+     * \returns the address with the remaining bits cleared.
+     */
+    IPAddress network(unsigned prefix_length) const;
+
     /**
      * \brief Equality operator.
      *
@@ -92,25 +112,22 @@ public:
      * \returns `true` if this address has the same value as `rhs`.
      */
     bool operator==(const IPAddress& rhs) const {
-        return
-            ( ipv6_ == rhs.ipv6_ ) &&
-            ( ipv6_ )
-            ? ( addr6_ == rhs.addr6_ )
-            : ( addr4_ == rhs.addr4_ );
+        return ( ( hi_ ^ rhs.hi_ ) | ( lo_ ^ rhs.lo_ ) | ( ipv6_ ^ rhs.ipv6_ ) ) == 0;
     }
 
     /**
      * \brief Less than operator.
      *
+     * IPv4 addresses order as their IPv4-mapped IPv6 equivalents,
+     * and before them.
+     *
      * \param rhs the address to compare to.
      * \returns `true` if this address has a value less than `rhs`.
      */
     bool operator<(const IPAddress& rhs) const {
-        return
-            ( ipv6_ == rhs.ipv6_ ) &&
-            ( ipv6_ )
-            ? ( addr6_ < rhs.addr6_ )
-            : ( addr4_ < rhs.addr4_ );
+        return ( hi_ < rhs.hi_ ) |
+            ( ( hi_ == rhs.hi_ ) &
+              ( ( lo_ < rhs.lo_ ) | ( ( lo_ == rhs.lo_ ) & ( ipv6_ < rhs.ipv6_ ) ) ) );
     }
 
     /**
@@ -125,19 +142,17 @@ public:
 
     /**
      * \brief Return IPv4 TINS address.
+     *
+     * For an IPv6 address, this is the low 32 bits of the address.
      */
-    operator Tins::IPv4Address() const
-    {
-        return addr4_;
-    }
+    operator Tins::IPv4Address() const;
 
     /**
      * \brief Return IPv6 TINS address.
+     *
+     * For an IPv4 address, this is the IPv4-mapped IPv6 address.
      */
-    operator Tins::IPv6Address() const
-    {
-        return addr6_;
-    }
+    operator Tins::IPv6Address() const;
 
     /**
      * \brief Write human-readable address to the output stream.
@@ -153,18 +168,40 @@ public:
      *
      * \returns hash value.
      */
-    friend std::size_t hash_value(const IPAddress& addr);
+    friend std::size_t hash_value(const IPAddress& addr)
+    {
+        return fast_hash(addr.hi_ ^ addr.ipv6_, addr.lo_);
+    }
 
 private:
     /**
-     * \brief IPv4 address.
+     * \brief bits 32-63 of an IPv4-mapped address.
+     */
+    static const uint64_t V4_MAPPED_PREFIX = 0xffff;
+
+    /**
+     * \brief Set from network binary data.
+     *
+     * \param data 16 bytes of IPv6 address.
+     */
+    void set_ipv6(const uint8_t* data);
+
+    /**
+     * \brief Set from network binary data.
+     *
+     * \param data 4 bytes of IPv4 address.
+     */
+    void set_ipv4(const uint8_t* data);
+
+    /**
+     * \brief the first 64 bits of the address.
      */
-    Tins::IPv4Address addr4_;
+    uint64_t hi_;
 
     /**
-     * \brief IPv6 address.
+     * \brief the last 64 bits of the address.
      */
-    Tins::IPv6Address addr6_;
+    uint64_t lo_;
 
     /**
      * \brief `true` if this address is IPv6, `false` if IPv4.
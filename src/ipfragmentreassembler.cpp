@@ -0,0 +1,211 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "ipfragmentreassembler.hpp"
+
+// Charge each datagram for its table entry plus an estimate of its map node.
+const std::size_t IPFragmentReassembler::DATAGRAM_OVERHEAD =
+    sizeof(IPFragmentReassembler::Datagram) + sizeof(IPFragmentReassembler::DatagramKey) + 4 * sizeof(void*);
+
+IPFragmentReassembler::IPFragmentReassembler(std::size_t max_datagrams,
+                                             std::size_t memory_budget,
+                                             std::chrono::seconds timeout)
+    : max_datagrams_(max_datagrams), memory_budget_(memory_budget),
+      timeout_(timeout), newest_(NO_DATAGRAM), oldest_(NO_DATAGRAM),
+      memory_used_(0), reassembled_count_(0), timeout_count_(0),
+      evicted_count_(0), dropped_count_(0)
+{
+}
+
+bool IPFragmentReassembler::process(const DatagramKey& key, std::size_t offset, bool more,
+                                    const uint8_t* data, std::size_t len,
+                                    std::chrono::system_clock::time_point timestamp,
+                                    std::vector<uint8_t>& datagram)
+{
+    expire(timestamp);
+
+    uint32_t index;
+    auto it = index_.find(key);
+    if ( it != index_.end() )
+        index = it->second;
+    else
+    {
+        if ( max_datagrams_ == 0 )
+            return false;
+        index = create_datagram(key, timestamp);
+    }
+
+    Datagram& dg = datagrams_[index];
+    std::size_t old_size = dg.buf.size();
+    if ( !add_fragment(dg, offset, more, data, len) )
+    {
+        ++dropped_count_;
+        remove_datagram(index);
+        return false;
+    }
+    memory_used_ += dg.buf.size() - old_size;
+    if ( !enforce_budget(index) )
+        return false;
+
+    if ( dg.total_len == 0 || dg.ranges.size() != 1 ||
+         dg.ranges[0].first != 0 || dg.ranges[0].second != dg.total_len )
+        return false;
+
+    // Complete. Hand over the buffer rather than copying it.
+    memory_used_ -= dg.buf.size();
+    datagram.swap(dg.buf);
+    dg.buf.clear();
+    ++reassembled_count_;
+    remove_datagram(index);
+    return true;
+}
+
+bool IPFragmentReassembler::add_fragment(Datagram& dg, std::size_t offset, bool more,
+                                         const uint8_t* data, std::size_t len)
+{
+    std::size_t end = offset + len;
+
+    if ( len == 0 || end > MAX_DATAGRAM_SIZE || ++dg.nfragments > MAX_FRAGMENTS )
+        return false;
+
+    if ( more )
+    {
+        // All but the last fragment carry a multiple of 8 bytes.
+        if ( len % 8 != 0 || ( dg.total_len != 0 && end > dg.total_len ) )
+            return false;
+    }
+    else
+    {
+        if ( ( dg.total_len != 0 && dg.total_len != end ) || dg.buf.size() > end )
+            return false;
+        dg.total_len = end;
+    }
+
+    // Find the first range ending after the fragment start.
+    auto pos = dg.ranges.begin();
+    while ( pos != dg.ranges.end() && pos->second <= offset )
+        ++pos;
+
+    if ( pos != dg.ranges.end() && pos->first < end )
+    {
+        // Overlap. Only an exact repeat of data already held is allowed.
+        return pos->first <= offset && end <= pos->second &&
+            std::memcmp(dg.buf.data() + offset, data, len) == 0;
+    }
+
+    if ( end > dg.buf.size() )
+        dg.buf.resize(end);
+    std::memcpy(dg.buf.data() + offset, data, len);
+
+    // Record the range, merging with neighbours.
+    bool join_prev = ( pos != dg.ranges.begin() && (pos - 1)->second == offset );
+    bool join_next = ( pos != dg.ranges.end() && pos->first == end );
+    if ( join_prev && join_next )
+    {
+        (pos - 1)->second = pos->second;
+        dg.ranges.erase(pos);
+    }
+    else if ( join_prev )
+        (pos - 1)->second = end;
+    else if ( join_next )
+        pos->first = offset;
+    else
+        dg.ranges.emplace(pos, offset, end);
+
+    return true;
+}
+
+uint32_t IPFragmentReassembler::create_datagram(const DatagramKey& key,
+                                                std::chrono::system_clock::time_point timestamp)
+{
+    if ( index_.size() >= max_datagrams_ && oldest_ != NO_DATAGRAM )
+    {
+        ++evicted_count_;
+        remove_datagram(oldest_);
+    }
+
+    uint32_t index;
+    if ( free_.empty() )
+    {
+        index = datagrams_.size();
+        datagrams_.emplace_back();
+    }
+    else
+    {
+        index = free_.back();
+        free_.pop_back();
+    }
+
+    // New datagrams are always the newest, so the list stays in
+    // order of first fragment time.
+    Datagram& dg = datagrams_[index];
+    dg.key = key;
+    dg.first_seen = timestamp;
+    dg.total_len = 0;
+    dg.nfragments = 0;
+    dg.newer = NO_DATAGRAM;
+    dg.older = newest_;
+    if ( newest_ != NO_DATAGRAM )
+        datagrams_[newest_].newer = index;
+    newest_ = index;
+    if ( oldest_ == NO_DATAGRAM )
+        oldest_ = index;
+
+    index_.emplace(key, index);
+    memory_used_ += DATAGRAM_OVERHEAD;
+    return index;
+}
+
+void IPFragmentReassembler::remove_datagram(uint32_t index)
+{
+    Datagram& dg = datagrams_[index];
+    index_.erase(dg.key);
+
+    if ( dg.newer != NO_DATAGRAM )
+        datagrams_[dg.newer].older = dg.older;
+    else
+        newest_ = dg.older;
+    if ( dg.older != NO_DATAGRAM )
+        datagrams_[dg.older].newer = dg.newer;
+    else
+        oldest_ = dg.newer;
+
+    memory_used_ -= DATAGRAM_OVERHEAD + dg.buf.size();
+    std::vector<uint8_t>().swap(dg.buf);
+    dg.ranges.clear();
+    free_.push_back(index);
+}
+
+void IPFragmentReassembler::expire(std::chrono::system_clock::time_point now)
+{
+    while ( oldest_ != NO_DATAGRAM && datagrams_[oldest_].first_seen + timeout_ < now )
+    {
+        ++timeout_count_;
+        remove_datagram(oldest_);
+    }
+}
+
+bool IPFragmentReassembler::enforce_budget(uint32_t index)
+{
+    while ( memory_used_ > memory_budget_ && oldest_ != NO_DATAGRAM )
+    {
+        uint32_t victim = oldest_;
+        ++evicted_count_;
+        remove_datagram(victim);
+        if ( victim == index )
+            return false;
+    }
+    return true;
+}
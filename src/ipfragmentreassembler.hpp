@@ -0,0 +1,356 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef IPFRAGMENTREASSEMBLER_HPP
+#define IPFRAGMENTREASSEMBLER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "ipaddress.hpp"
+
+/**
+ * \class IPFragmentReassembler
+ * \brief Reassemble fragmented IPv4 and IPv6 datagrams.
+ *
+ * The reassembler deals only in fragment payloads, so serves both
+ * address families. The caller extracts the fragment offset, the
+ * more fragments flag and the fragment payload from the IPv4 header
+ * or IPv6 fragment header.
+ *
+ * Datagrams being reassembled are held in a compact table, kept in
+ * order of arrival of their first fragment. Packet timestamps drive
+ * the timeout, so datagrams not completed within the timeout of their
+ * first fragment are removed. If a new datagram would exceed the
+ * maximum number of datagrams, or fragment data would exceed the
+ * memory budget, the oldest datagrams are evicted.
+ *
+ * Overlapping fragments are not allowed for IPv6 (RFC 5722) and are
+ * a well known attack vector for IPv4, so a datagram receiving a
+ * fragment overlapping previous data is dropped. An exact duplicate
+ * of a previous fragment is ignored.
+ */
+class IPFragmentReassembler
+{
+public:
+    /**
+     * \struct DatagramKey
+     * \brief Identify a fragmented datagram.
+     */
+    struct DatagramKey
+    {
+        /**
+         * \brief source address.
+         */
+        IPAddress src_addr;
+
+        /**
+         * \brief destination address.
+         */
+        IPAddress dst_addr;
+
+        /**
+         * \brief datagram identification.
+         */
+        uint32_t id;
+
+        /**
+         * \brief Equality operator.
+         *
+         * \param rhs the key to compare to.
+         * \returns `true` if the keys are equal.
+         */
+        bool operator==(const DatagramKey& rhs) const
+        {
+            return id == rhs.id &&
+                src_addr == rhs.src_addr && dst_addr == rhs.dst_addr;
+        }
+
+        /**
+         * \brief Calculate a hash value for the key.
+         *
+         * \returns hash value.
+         */
+        friend std::size_t hash_value(const DatagramKey& key)
+        {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, key.src_addr);
+            boost::hash_combine(seed, key.dst_addr);
+            boost::hash_combine(seed, key.id);
+            return seed;
+        }
+    };
+
+    /**
+     * \brief Maximum size of a reassembled datagram payload.
+     */
+    static const std::size_t MAX_DATAGRAM_SIZE = 65535;
+
+    /**
+     * \brief Maximum number of distinct fragments in a datagram.
+     */
+    static const std::size_t MAX_FRAGMENTS = 64;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param max_datagrams maximum number of datagrams to reassemble at once.
+     * \param memory_budget maximum memory used for datagrams, in bytes.
+     * \param timeout       time allowed to receive all fragments of a datagram.
+     */
+    IPFragmentReassembler(std::size_t max_datagrams, std::size_t memory_budget,
+                          std::chrono::seconds timeout);
+
+    /**
+     * \brief Process a fragment.
+     *
+     * \param key       the datagram the fragment belongs to.
+     * \param offset    the fragment offset, in bytes.
+     * \param more      `true` if this is not the last fragment.
+     * \param data      the fragment payload.
+     * \param len       the fragment payload length.
+     * \param timestamp the fragment timestamp.
+     * \param datagram  receives the datagram payload if it is complete.
+     * \returns `true` if the datagram is complete.
+     */
+    bool process(const DatagramKey& key, std::size_t offset, bool more,
+                 const uint8_t* data, std::size_t len,
+                 std::chrono::system_clock::time_point timestamp,
+                 std::vector<uint8_t>& datagram);
+
+    /**
+     * \brief Return the number of datagrams being reassembled.
+     */
+    std::size_t datagram_count() const
+    {
+        return index_.size();
+    }
+
+    /**
+     * \brief Return the memory currently charged to datagrams, in bytes.
+     */
+    std::size_t memory_used() const
+    {
+        return memory_used_;
+    }
+
+    /**
+     * \brief Return the number of datagrams reassembled.
+     */
+    uint64_t reassembled_count() const
+    {
+        return reassembled_count_;
+    }
+
+    /**
+     * \brief Return the number of datagrams timed out.
+     */
+    uint64_t timeout_count() const
+    {
+        return timeout_count_;
+    }
+
+    /**
+     * \brief Return the number of datagrams evicted to stay within the
+     * datagram limit or memory budget.
+     */
+    uint64_t evicted_count() const
+    {
+        return evicted_count_;
+    }
+
+    /**
+     * \brief Return the number of datagrams dropped because of
+     * invalid fragments.
+     */
+    uint64_t dropped_count() const
+    {
+        return dropped_count_;
+    }
+
+    /**
+     * \brief Approximate fixed memory cost of a datagram, in bytes.
+     */
+    static const std::size_t DATAGRAM_OVERHEAD;
+
+private:
+    /**
+     * \brief value marking no datagram.
+     */
+    static const uint32_t NO_DATAGRAM = UINT32_MAX;
+
+    /**
+     * \struct Datagram
+     * \brief The state of a single datagram.
+     */
+    struct Datagram
+    {
+        /**
+         * \brief the datagram key.
+         */
+        DatagramKey key;
+
+        /**
+         * \brief time the first fragment arrived.
+         */
+        std::chrono::system_clock::time_point first_seen;
+
+        /**
+         * \brief the next newer datagram.
+         */
+        uint32_t newer;
+
+        /**
+         * \brief the next older datagram.
+         */
+        uint32_t older;
+
+        /**
+         * \brief total payload length, or 0 if the last fragment
+         * has not been seen.
+         */
+        std::size_t total_len;
+
+        /**
+         * \brief number of fragments received.
+         */
+        std::size_t nfragments;
+
+        /**
+         * \brief the payload received so far.
+         */
+        std::vector<uint8_t> buf;
+
+        /**
+         * \brief the payload byte ranges received, in offset order.
+         */
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    };
+
+    /**
+     * \brief Create a datagram.
+     *
+     * \param key       the datagram key.
+     * \param timestamp time of the first fragment.
+     * \returns the datagram index.
+     */
+    uint32_t create_datagram(const DatagramKey& key,
+                             std::chrono::system_clock::time_point timestamp);
+
+    /**
+     * \brief Remove a datagram.
+     *
+     * \param index the datagram index.
+     */
+    void remove_datagram(uint32_t index);
+
+    /**
+     * \brief Add a fragment to a datagram.
+     *
+     * \param dg     the datagram.
+     * \param offset the fragment offset, in bytes.
+     * \param more   `true` if this is not the last fragment.
+     * \param data   the fragment payload.
+     * \param len    the fragment payload length.
+     * \returns `false` if the fragment is invalid.
+     */
+    bool add_fragment(Datagram& dg, std::size_t offset, bool more,
+                      const uint8_t* data, std::size_t len);
+
+    /**
+     * \brief Remove datagrams first seen before the timeout.
+     *
+     * \param now the current time.
+     */
+    void expire(std::chrono::system_clock::time_point now);
+
+    /**
+     * \brief Evict oldest datagrams until memory is within budget.
+     *
+     * \param index the current datagram index.
+     * \returns `false` if the current datagram was evicted.
+     */
+    bool enforce_budget(uint32_t index);
+
+    /**
+     * \brief maximum number of datagrams.
+     */
+    std::size_t max_datagrams_;
+
+    /**
+     * \brief memory budget.
+     */
+    std::size_t memory_budget_;
+
+    /**
+     * \brief reassembly timeout.
+     */
+    std::chrono::seconds timeout_;
+
+    /**
+     * \brief the datagram table.
+     */
+    std::vector<Datagram> datagrams_;
+
+    /**
+     * \brief indexes of unused entries in the datagram table.
+     */
+    std::vector<uint32_t> free_;
+
+    /**
+     * \brief map from datagram key to datagram table index.
+     */
+    std::unordered_map<DatagramKey, uint32_t, boost::hash<DatagramKey>> index_;
+
+    /**
+     * \brief the newest datagram.
+     */
+    uint32_t newest_;
+
+    /**
+     * \brief the oldest datagram.
+     */
+    uint32_t oldest_;
+
+    /**
+     * \brief memory currently charged to datagrams.
+     */
+    std::size_t memory_used_;
+
+    /**
+     * \brief count of datagrams reassembled.
+     */
+    uint64_t reassembled_count_;
+
+    /**
+     * \brief count of datagrams timed out.
+     */
+    uint64_t timeout_count_;
+
+    /**
+     * \brief count of datagrams evicted.
+     */
+    uint64_t evicted_count_;
+
+    /**
+     * \brief count of datagrams dropped.
+     */
+    uint64_t dropped_count_;
+};
+
+#endif
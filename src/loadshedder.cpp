@@ -0,0 +1,43 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+
+#include "loadshedder.hpp"
+
+LoadShedder::LoadShedder(unsigned sections_fill, unsigned sample_fill, unsigned min_sample,
+                         const ClientSampler& sampler)
+    : sections_fill_(sections_fill), sample_fill_(sample_fill),
+      min_sample_(min_sample), shed_sections_(false), sample_percent_(100),
+      sampler_(sampler)
+{
+}
+
+void LoadShedder::set_fill(std::size_t items, std::size_t max_items)
+{
+    if ( max_items == 0 )
+    {
+        shed_sections_ = false;
+        sample_percent_ = 100;
+        return;
+    }
+
+    std::size_t fill = std::min<std::size_t>(items * 100 / max_items, 100);
+
+    shed_sections_ = ( fill >= sections_fill_ && sections_fill_ < 100 );
+
+    if ( fill < sample_fill_ || sample_fill_ >= 100 )
+        sample_percent_ = 100;
+    else
+        sample_percent_ = 100 - static_cast<unsigned>(
+            ( 100 - min_sample_ ) * ( fill - sample_fill_ ) / ( 100 - sample_fill_ ));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef LOADSHEDDER_HPP
+#define LOADSHEDDER_HPP
+
+#include <cstddef>
+
+#include "clientsampler.hpp"
+#include "ipaddress.hpp"
+
+/**
+ * \class LoadShedder
+ * \brief Decide what C-DNS output to shed as the output channel fills.
+ *
+ * Rather than losing whole query/response pairs when the C-DNS
+ * output channel is full, output is shed in tiers as the channel
+ * fills:
+ *
+ * 1. From the sections fill level, query/response pairs are sent
+ *    without their extended sections, and address events are not
+ *    sent.
+ * 2. From the sample fill level, query/response pairs are also
+ *    sampled by client address. The percentage of clients kept falls
+ *    from 100% at the sample fill level to the minimum sample
+ *    percentage when the channel is full. A client is kept or not
+ *    depending on the keyed hash of its address used for client
+ *    sampling, so all traffic from a kept client is kept, and the
+ *    clients kept are a subset of the configured client sample.
+ * 3. When the channel is full, items are dropped.
+ *
+ * Fill levels are percentages of the channel maximum size.
+ */
+class LoadShedder
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param sections_fill fill percentage at which extended sections
+     *                      and address events are shed, 100 for never.
+     * \param sample_fill   fill percentage at which client sampling
+     *                      starts, 100 for never.
+     * \param min_sample    percentage of clients kept when full.
+     * \param sampler       the client sampler.
+     */
+    LoadShedder(unsigned sections_fill, unsigned sample_fill, unsigned min_sample,
+                const ClientSampler& sampler);
+
+    /**
+     * \brief Set the current channel fill.
+     *
+     * \param items     the number of items in the channel.
+     * \param max_items the maximum number of items in the channel,
+     *                  or 0 if unlimited.
+     */
+    void set_fill(std::size_t items, std::size_t max_items);
+
+    /**
+     * \brief Check whether extended sections and address events are shed.
+     *
+     * \returns `true` if they are shed.
+     */
+    bool shed_sections() const
+    {
+        return shed_sections_;
+    }
+
+    /**
+     * \brief Check whether query/response pairs are being sampled.
+     *
+     * \returns `true` if sampling.
+     */
+    bool sampling() const
+    {
+        return sample_percent_ < 100;
+    }
+
+    /**
+     * \brief Return the percentage of clients currently kept.
+     *
+     * \returns the percentage.
+     */
+    unsigned sample_percent() const
+    {
+        return sample_percent_;
+    }
+
+    /**
+     * \brief Check whether to keep a client's query/response pairs.
+     *
+     * \param client the client address.
+     * \returns `true` if the client is kept.
+     */
+    bool keep_client(const IPAddress& client) const
+    {
+        return sampler_.keep_client(client, sample_percent_);
+    }
+
+private:
+    /**
+     * \brief fill percentage at which sections are shed.
+     */
+    unsigned sections_fill_;
+
+    /**
+     * \brief fill percentage at which sampling starts.
+     */
+    unsigned sample_fill_;
+
+    /**
+     * \brief percentage of clients kept when full.
+     */
+    unsigned min_sample_;
+
+    /**
+     * \brief `true` if sections are being shed.
+     */
+    bool shed_sections_;
+
+    /**
+     * \brief percentage of clients currently kept.
+     */
+    unsigned sample_percent_;
+
+    /**
+     * \brief the client sampler.
+     */
+    ClientSampler sampler_;
+};
+
+#endif
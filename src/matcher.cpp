@@ -15,8 +15,7 @@
 #include <unordered_map>
 #include <utility>
 
-#include <boost/functional/hash.hpp>
-
+#include "fasthash.hpp"
 #include "makeunique.hpp"
 
 #include "matcher.hpp"
@@ -255,13 +254,13 @@ LiveQueries::matchResponse(const DNSMessage &m)
 
 std::size_t LiveQueries::makeKey(const DNSMessage &m)
 {
-    std::size_t seed = hash_value(m.clientIP);
-    boost::hash_combine(seed, hash_value(m.serverIP));
-    boost::hash_combine(seed, m.clientPort);
-    boost::hash_combine(seed, m.serverPort);
-    boost::hash_combine(seed, m.tcp);
-    boost::hash_combine(seed, m.dns.id());
-    return seed;
+    uint64_t ports_id =
+        (uint64_t(m.clientPort) << 48) |
+        (uint64_t(m.serverPort) << 32) |
+        (uint64_t(m.dns.id()) << 1) |
+        uint64_t(m.tcp);
+    return fast_hash(fast_hash(hash_value(m.clientIP), hash_value(m.serverIP)),
+                     ports_id);
 }
 
 /**
@@ -311,6 +310,16 @@ void QueryResponseMatcher::set_skew_timeout(std::chrono::microseconds timeout)
     skew_timeout_ = timeout;
 }
 
+std::size_t QueryResponseMatcher::in_flight_count() const
+{
+    return data_->output.size();
+}
+
+std::size_t QueryResponseMatcher::unmatched_response_count() const
+{
+    return data_->response_queue.size();
+}
+
 void QueryResponseMatcher::flush()
 {
     for ( auto& r : data_->response_queue )
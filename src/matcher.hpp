@@ -14,6 +14,7 @@
 #define MATCHER_HPP
 
 #include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 
@@ -97,6 +98,19 @@ public:
      */
     void set_skew_timeout(std::chrono::microseconds t);
 
+    /**
+     * \brief Return the number of items waiting for output.
+     *
+     * This includes queries awaiting a response and completed items
+     * queued behind them.
+     */
+    std::size_t in_flight_count() const;
+
+    /**
+     * \brief Return the number of responses waiting for a query.
+     */
+    std::size_t unmatched_response_count() const;
+
 protected:
     /**
      * \brief add a new query message to the outstanding queries.
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include "fasthash.hpp"
+
+#include "messagefilter.hpp"
+
+namespace {
+    /**
+     * \brief Fold an ASCII character to lower case.
+     *
+     * \param c the character.
+     * \returns the lower case character.
+     */
+    inline uint8_t fold(uint8_t c)
+    {
+        return ( c >= 'A' && c <= 'Z' ) ? c + ( 'a' - 'A' ) : c;
+    }
+
+    /**
+     * \brief Set entries in a type table.
+     *
+     * \param table the table.
+     * \param types the types to set.
+     */
+    void set_types(std::vector<bool>& table, const std::vector<unsigned>& types)
+    {
+        if ( types.empty() )
+            return;
+
+        table.assign(65536, false);
+        for ( auto t : types )
+            table[t & 0xffff] = true;
+    }
+}
+
+const std::size_t NameSuffixTrie::MAX_LABELS;
+
+NameSuffixTrie::NameSuffixTrie()
+    : edges_(16), n_edges_(0), terminal_(1, 0), empty_(true)
+{
+}
+
+void NameSuffixTrie::add(const std::string& domain)
+{
+    std::vector<std::string> labels;
+    std::string label;
+    for ( auto c : domain )
+    {
+        if ( c == '.' )
+        {
+            if ( !label.empty() )
+                labels.push_back(label);
+            label.clear();
+        }
+        else
+            label.push_back(fold(c));
+    }
+    if ( !label.empty() )
+        labels.push_back(label);
+
+    uint32_t node = 0;
+    for ( auto l = labels.rbegin(); l != labels.rend(); ++l )
+    {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(l->data());
+        uint32_t child = find(node, data, l->size());
+        if ( child == 0 )
+        {
+            child = static_cast<uint32_t>(terminal_.size());
+            terminal_.push_back(0);
+
+            Edge edge;
+            edge.parent = node;
+            edge.child = child;
+            edge.label = static_cast<uint32_t>(labels_.size());
+            edge.len = static_cast<uint8_t>(l->size());
+            labels_.append(data, l->size());
+            insert(edge, hash(node, data, l->size()));
+        }
+        node = child;
+    }
+
+    terminal_[node] = 1;
+    empty_ = false;
+}
+
+bool NameSuffixTrie::match(const uint8_t* const* labels, std::size_t n_labels) const
+{
+    uint32_t node = 0;
+    if ( terminal_[node] )
+        return true;
+
+    while ( n_labels-- > 0 )
+    {
+        const uint8_t* label = labels[n_labels];
+        node = find(node, label + 1, *label);
+        if ( node == 0 )
+            return false;
+        if ( terminal_[node] )
+            return true;
+    }
+    return false;
+}
+
+uint64_t NameSuffixTrie::hash(uint32_t parent, const uint8_t* label, std::size_t len)
+{
+    // 64 bit FNV-1a over the case folded label.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for ( std::size_t i = 0; i < len; ++i )
+    {
+        h ^= fold(label[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return fast_hash(h, parent);
+}
+
+uint32_t NameSuffixTrie::find(uint32_t parent, const uint8_t* label, std::size_t len) const
+{
+    std::size_t mask = edges_.size() - 1;
+    for ( std::size_t i = hash(parent, label, len) & mask; edges_[i].child != 0; i = ( i + 1 ) & mask )
+    {
+        const Edge& e = edges_[i];
+        if ( e.parent != parent || e.len != len )
+            continue;
+
+        const uint8_t* l = labels_.data() + e.label;
+        std::size_t j = 0;
+        while ( j < len && l[j] == fold(label[j]) )
+            ++j;
+        if ( j == len )
+            return e.child;
+    }
+    return 0;
+}
+
+void NameSuffixTrie::insert(const Edge& edge, uint64_t h)
+{
+    // Keep the table no more than half full.
+    if ( ( n_edges_ + 1 ) * 2 > edges_.size() )
+    {
+        std::vector<Edge> old(edges_.size() * 2);
+        old.swap(edges_);
+        n_edges_ = 0;
+        for ( const auto& e : old )
+            if ( e.child != 0 )
+                insert(e, hash(e.parent, labels_.data() + e.label, e.len));
+    }
+
+    std::size_t mask = edges_.size() - 1;
+    std::size_t i = h & mask;
+    while ( edges_[i].child != 0 )
+        i = ( i + 1 ) & mask;
+    edges_[i] = edge;
+    ++n_edges_;
+}
+
+MessageFilter::MessageFilter(const Configuration& config)
+    : include_servers_(config.include_server_addresses.begin(), config.include_server_addresses.end()),
+      exclude_servers_(config.exclude_server_addresses.begin(), config.exclude_server_addresses.end())
+{
+    for ( const auto& s : config.include_qname_suffixes )
+        include_names_.add(s);
+    for ( const auto& s : config.exclude_qname_suffixes )
+        exclude_names_.add(s);
+    set_types(include_qtypes_, config.include_qtypes);
+    set_types(exclude_qtypes_, config.exclude_qtypes);
+
+    filtering_ = !include_names_.empty() || !exclude_names_.empty() ||
+        !include_servers_.empty() || !exclude_servers_.empty() ||
+        !include_qtypes_.empty() || !exclude_qtypes_.empty();
+}
+
+bool MessageFilter::keep(const uint8_t* msg, std::size_t len, const IPAddress& server) const
+{
+    if ( !filtering_ )
+        return true;
+
+    if ( !include_servers_.empty() && include_servers_.count(server) == 0 )
+        return false;
+    if ( exclude_servers_.count(server) != 0 )
+        return false;
+
+    bool need_question = !include_names_.empty() || !exclude_names_.empty() ||
+        !include_qtypes_.empty() || !exclude_qtypes_.empty();
+    if ( !need_question )
+        return true;
+
+    const std::size_t HEADER_SIZE = 12;
+    if ( len < HEADER_SIZE )
+        return true;
+
+    // A message without a question matches no name or type.
+    unsigned qdcount = ( msg[4] << 8 ) | msg[5];
+    if ( qdcount == 0 )
+        return include_names_.empty() && include_qtypes_.empty();
+
+    // Find the labels of the first question name.
+    const uint8_t* labels[NameSuffixTrie::MAX_LABELS];
+    std::size_t n_labels = 0;
+    std::size_t pos = HEADER_SIZE;
+    for (;;)
+    {
+        if ( pos >= len )
+            return true;
+        uint8_t label_len = msg[pos];
+        if ( label_len == 0 )
+            break;
+        if ( label_len > 63 || n_labels == NameSuffixTrie::MAX_LABELS )
+            return true;
+        labels[n_labels++] = msg + pos;
+        pos += label_len + 1;
+    }
+    ++pos;
+    if ( pos + 2 > len )
+        return true;
+
+    unsigned qtype = ( msg[pos] << 8 ) | msg[pos + 1];
+    if ( !include_qtypes_.empty() && !include_qtypes_[qtype] )
+        return false;
+    if ( !exclude_qtypes_.empty() && exclude_qtypes_[qtype] )
+        return false;
+
+    if ( !include_names_.empty() && !include_names_.match(labels, n_labels) )
+        return false;
+    if ( !exclude_names_.empty() && exclude_names_.match(labels, n_labels) )
+        return false;
+
+    return true;
+}
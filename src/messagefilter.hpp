@@ -0,0 +1,252 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef MESSAGEFILTER_HPP
+#define MESSAGEFILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "bytestring.hpp"
+#include "configuration.hpp"
+#include "ipaddress.hpp"
+
+/**
+ * \class NameSuffixTrie
+ * \brief A set of domain names, matching names in any of the domains.
+ *
+ * The names are held as a trie of labels, starting from the last
+ * label, so checking a name is a single walk from its last label
+ * towards its first, whatever the number of names in the set.
+ *
+ * The trie edges are held in a single open addressing hash table,
+ * keyed on the parent node and the label, with the labels in one
+ * contiguous pool, so a check does no allocation. Labels are compared
+ * with ASCII case folded.
+ */
+class NameSuffixTrie
+{
+public:
+    /**
+     * \brief Constructor.
+     */
+    NameSuffixTrie();
+
+    /**
+     * \brief Add a domain to the set.
+     *
+     * The domain is given in presentation format, e.g. `example.com`.
+     * A trailing dot is optional. `.` matches all names.
+     *
+     * \param domain the domain name.
+     */
+    void add(const std::string& domain);
+
+    /**
+     * \brief Check whether the set is empty.
+     *
+     * \returns `true` if no domains have been added.
+     */
+    bool empty() const
+    {
+        return empty_;
+    }
+
+    /**
+     * \brief Check whether a name is in any of the domains.
+     *
+     * The name is given as the positions of its labels in wire format,
+     * each pointing to the label length byte, first label first.
+     *
+     * \param labels   the labels.
+     * \param n_labels the number of labels.
+     * \returns `true` if the name is in one of the domains.
+     */
+    bool match(const uint8_t* const* labels, std::size_t n_labels) const;
+
+    /**
+     * \brief the maximum number of labels in a name.
+     */
+    static const std::size_t MAX_LABELS = 128;
+
+private:
+    /**
+     * \struct Edge
+     * \brief An edge from a node to a child node.
+     */
+    struct Edge
+    {
+        /**
+         * \brief the parent node.
+         */
+        uint32_t parent;
+
+        /**
+         * \brief the child node. 0 if the table slot is empty.
+         */
+        uint32_t child;
+
+        /**
+         * \brief offset of the edge label in the label pool.
+         */
+        uint32_t label;
+
+        /**
+         * \brief length of the edge label.
+         */
+        uint8_t len;
+    };
+
+    /**
+     * \brief Hash an edge.
+     *
+     * \param parent the parent node.
+     * \param label  the label.
+     * \param len    the label length.
+     * \returns the hash.
+     */
+    static uint64_t hash(uint32_t parent, const uint8_t* label, std::size_t len);
+
+    /**
+     * \brief Find the child of a node.
+     *
+     * \param parent the parent node.
+     * \param label  the label.
+     * \param len    the label length.
+     * \returns the child node, or 0 if none.
+     */
+    uint32_t find(uint32_t parent, const uint8_t* label, std::size_t len) const;
+
+    /**
+     * \brief Add an edge to the table.
+     *
+     * \param edge the edge.
+     * \param h    the edge hash.
+     */
+    void insert(const Edge& edge, uint64_t h);
+
+    /**
+     * \brief the edge table. The size is a power of 2.
+     */
+    std::vector<Edge> edges_;
+
+    /**
+     * \brief number of edges in the table.
+     */
+    std::size_t n_edges_;
+
+    /**
+     * \brief for each node, whether a domain ends at the node.
+     */
+    std::vector<uint8_t> terminal_;
+
+    /**
+     * \brief the edge labels, with ASCII case folded to lower case.
+     */
+    byte_string labels_;
+
+    /**
+     * \brief `true` if no domains have been added.
+     */
+    bool empty_;
+};
+
+/**
+ * \class MessageFilter
+ * \brief Filter DNS messages on query name, server address and query type.
+ *
+ * Each of query name, server address and query type may have a list
+ * of values to include and a list of values to exclude. A message is
+ * kept if, for each include list that is not empty, it matches a
+ * value in the list, and it matches no value in any exclude list.
+ * Query names match if they are in one of the listed domains.
+ *
+ * The filter works on the raw message, and reads only the DNS header
+ * and the first question. A message that can't be read that far, or
+ * with a compressed first question name, is kept and left to the
+ * decoder.
+ */
+class MessageFilter
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param config the configuration with the filter lists.
+     */
+    explicit MessageFilter(const Configuration& config);
+
+    /**
+     * \brief Check whether any filtering is configured.
+     *
+     * \returns `true` if there is at least one filter list.
+     */
+    bool filtering() const
+    {
+        return filtering_;
+    }
+
+    /**
+     * \brief Decide whether to keep a message.
+     *
+     * \param msg    the raw DNS message.
+     * \param len    the message length.
+     * \param server the server address.
+     * \returns `true` if the message is kept.
+     */
+    bool keep(const uint8_t* msg, std::size_t len, const IPAddress& server) const;
+
+private:
+    /**
+     * \brief domains to include.
+     */
+    NameSuffixTrie include_names_;
+
+    /**
+     * \brief domains to exclude.
+     */
+    NameSuffixTrie exclude_names_;
+
+    /**
+     * \brief server addresses to include.
+     */
+    std::unordered_set<IPAddress, boost::hash<IPAddress>> include_servers_;
+
+    /**
+     * \brief server addresses to exclude.
+     */
+    std::unordered_set<IPAddress, boost::hash<IPAddress>> exclude_servers_;
+
+    /**
+     * \brief query types to include, indexed by type.
+     * Empty if no include list.
+     */
+    std::vector<bool> include_qtypes_;
+
+    /**
+     * \brief query types to exclude, indexed by type.
+     * Empty if no exclude list.
+     */
+    std::vector<bool> exclude_qtypes_;
+
+    /**
+     * \brief `true` if any filter list is given.
+     */
+    bool filtering_;
+};
+
+#endif
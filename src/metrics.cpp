@@ -0,0 +1,641 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aggregates.hpp"
+#include "blockcbordata.hpp"
+#include "capturedns.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "threadplacement.hpp"
+
+namespace {
+    /**
+     * \brief Names of the latency stages, in Stage order.
+     */
+    const char* const STAGE_NAMES[] = {
+        "capture_to_decode",
+        "decode_to_match",
+        "match_to_block_write",
+    };
+
+    /**
+     * \brief Names of the block tables, in BlockTable order.
+     */
+    const char* const BLOCK_TABLE_NAMES[] = {
+        "ip_addresses",
+        "class_types",
+        "questions",
+        "resource_records",
+        "names_rdatas",
+        "query_signatures",
+        "questions_lists",
+        "rrs_lists",
+        "query_response_items",
+        "address_event_counts",
+    };
+
+    /**
+     * \brief Poll interval for the server thread to check for stop.
+     */
+    const int SERVER_POLL_MS = 250;
+
+    /**
+     * \brief Maximum HTTP request size read.
+     */
+    const std::size_t MAX_REQUEST_SIZE = 4096;
+
+    /**
+     * \brief Write a metric series.
+     *
+     * \param os     the output stream.
+     * \param name   the metric name.
+     * \param labels the series labels, or empty.
+     * \param value  the series value.
+     */
+    template<typename T>
+    void write_series(std::ostream& os, const std::string& name,
+                      const std::string& labels, T value)
+    {
+        os << name;
+        if ( !labels.empty() )
+            os << "{" << labels << "}";
+        os << " " << value << "\n";
+    }
+
+    /**
+     * \brief Write a metric HELP and TYPE header.
+     *
+     * \param os   the output stream.
+     * \param name the metric name.
+     * \param type the metric type.
+     * \param help the metric help.
+     */
+    void write_header(std::ostream& os, const std::string& name,
+                      const char* type, const std::string& help)
+    {
+        os << "# HELP " << name << " " << help << "\n"
+           << "# TYPE " << name << " " << type << "\n";
+    }
+
+    /**
+     * \brief Write a counter with a single series.
+     *
+     * \param os    the output stream.
+     * \param name  the metric name.
+     * \param help  the metric help.
+     * \param value the counter value.
+     */
+    void write_counter(std::ostream& os, const std::string& name,
+                       const std::string& help, uint64_t value)
+    {
+        write_header(os, name, "counter", help);
+        write_series(os, name, "", value);
+    }
+
+    /**
+     * \brief Return labels with an extra label added.
+     *
+     * \param labels the existing labels, or empty.
+     * \param extra  the label to add.
+     */
+    std::string add_label(const std::string& labels, const std::string& extra)
+    {
+        return labels.empty() ? extra : labels + "," + extra;
+    }
+
+    /**
+     * \brief Return a label with its value escaped.
+     *
+     * \param name  the label name.
+     * \param value the label value.
+     */
+    std::string make_label(const std::string& name, const std::string& value)
+    {
+        std::string res = name + "=\"";
+        for ( char c : value )
+        {
+            if ( c == '\\' || c == '"' )
+                res += '\\';
+            else if ( c == '\n' )
+            {
+                res += "\\n";
+                continue;
+            }
+            res += c;
+        }
+        return res + "\"";
+    }
+
+    /**
+     * \brief Write traffic aggregates.
+     *
+     * \param os  the output stream.
+     * \param agg the aggregates.
+     */
+    void write_aggregates(std::ostream& os, const Aggregates& agg)
+    {
+        write_header(os, "compactor_aggregate_period_start_seconds", "gauge",
+                     "Start of the last complete traffic aggregation period.");
+        write_series(os, "compactor_aggregate_period_start_seconds", "",
+                     std::chrono::duration_cast<std::chrono::seconds>(agg.start().time_since_epoch()).count());
+        write_header(os, "compactor_aggregate_query_responses", "gauge",
+                     "Query/response items in the last aggregation period.");
+        write_series(os, "compactor_aggregate_query_responses", "", agg.count());
+        write_header(os, "compactor_aggregate_unanswered_queries", "gauge",
+                     "Queries without a response in the last aggregation period.");
+        write_series(os, "compactor_aggregate_unanswered_queries", "", agg.unanswered());
+        write_header(os, "compactor_aggregate_distinct_clients", "gauge",
+                     "Estimated distinct clients in the last aggregation period.");
+        write_series(os, "compactor_aggregate_distinct_clients", "", agg.distinct_clients());
+
+        write_header(os, "compactor_aggregate_rcode_responses", "gauge",
+                     "Responses by RCODE in the last aggregation period.");
+        for ( const auto& r : agg.rcodes() )
+            write_series(os, "compactor_aggregate_rcode_responses",
+                         make_label("rcode", std::to_string(r.first)), r.second);
+        write_header(os, "compactor_aggregate_qtype_query_responses", "gauge",
+                     "Query/response items by query type in the last aggregation period.");
+        for ( const auto& q : agg.qtypes() )
+            write_series(os, "compactor_aggregate_qtype_query_responses",
+                         make_label("qtype", std::to_string(q.first)), q.second);
+        write_header(os, "compactor_aggregate_transport_query_responses", "gauge",
+                     "Query/response items by transport in the last aggregation period.");
+        for ( std::size_t i = 0; i < Aggregates::TRANSPORT_COUNT; ++i )
+        {
+            Aggregates::Transport t = static_cast<Aggregates::Transport>(i);
+            write_series(os, "compactor_aggregate_transport_query_responses",
+                         make_label("transport", Aggregates::transport_name(t)),
+                         agg.transport(t));
+        }
+
+        write_header(os, "compactor_aggregate_top_qname_query_responses", "gauge",
+                     "Estimated query/response items for the most frequent query names in the last aggregation period.");
+        unsigned rank = 0;
+        for ( const auto& c : agg.top_qnames() )
+            write_series(os, "compactor_aggregate_top_qname_query_responses",
+                         add_label(make_label("rank", std::to_string(++rank)),
+                                   make_label("qname", CaptureDNS::decode_domain_name(c.key))),
+                         c.count);
+        write_header(os, "compactor_aggregate_top_client_query_responses", "gauge",
+                     "Estimated query/response items for the most frequent clients in the last aggregation period.");
+        rank = 0;
+        for ( const auto& c : agg.top_clients() )
+        {
+            std::ostringstream client;
+            client << c.key;
+            write_series(os, "compactor_aggregate_top_client_query_responses",
+                         add_label(make_label("rank", std::to_string(++rank)),
+                                   make_label("client", client.str())),
+                         c.count);
+        }
+
+        write_header(os, "compactor_aggregate_response_latency_seconds", "histogram",
+                     "Response latency in the last aggregation period.");
+        LatencyHistogram::write_counts(os, "compactor_aggregate_response_latency_seconds", "",
+                                       agg.latencies(), agg.latency_sum());
+    }
+}
+
+const unsigned LatencyHistogram::SUB_BUCKETS;
+const std::size_t LatencyHistogram::BUCKETS;
+
+LatencyHistogram::LatencyHistogram()
+    : count_(0), sum_(0)
+{
+    for ( auto& b : buckets_ )
+        b = 0;
+}
+
+uint64_t LatencyHistogram::value_at_quantile(double q) const
+{
+    uint64_t total = 0;
+    std::array<uint64_t, BUCKETS> counts;
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+    {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if ( total == 0 )
+        return 0;
+
+    q = std::min(std::max(q, 0.0), 1.0);
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(q * total + 0.5));
+    uint64_t seen = 0;
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+    {
+        seen += counts[i];
+        if ( seen >= target )
+            return bucket_upper_bound(i);
+    }
+    return bucket_upper_bound(BUCKETS - 1);
+}
+
+void LatencyHistogram::write(std::ostream& os, const std::string& name, const std::string& labels) const
+{
+    Counts counts;
+    for ( std::size_t i = 0; i < BUCKETS; ++i )
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    write_counts(os, name, labels, counts, sum());
+}
+
+void LatencyHistogram::write_counts(std::ostream& os, const std::string& name, const std::string& labels,
+                                    const Counts& counts, uint64_t sum)
+{
+    // Export buckets at each power of two nanoseconds. Bucket i
+    // holds values below its upper bound, and sub-bucket 0 of each
+    // power of two starts exactly on that power.
+    uint64_t cumulative = 0;
+    std::size_t i = 0;
+    for ( unsigned exponent = 0; exponent <= MAX_EXPONENT; ++exponent )
+    {
+        uint64_t bound = 1ULL << exponent;
+        while ( i < BUCKETS - 1 && bucket_upper_bound(i) <= bound )
+            cumulative += counts[i++];
+
+        std::ostringstream le;
+        le << "le=\"" << bound / 1e9 << "\"";
+        write_series(os, name + "_bucket", add_label(labels, le.str()), cumulative);
+    }
+    while ( i < BUCKETS )
+        cumulative += counts[i++];
+    write_series(os, name + "_bucket", add_label(labels, "le=\"+Inf\""), cumulative);
+    write_series(os, name + "_sum", labels, sum / 1e9);
+    write_series(os, name + "_count", labels, cumulative);
+}
+
+Metrics::Metrics()
+    : blocks_written_(0), matcher_in_flight_(0), matcher_unmatched_response_(0),
+      reorder_held_(0), reorder_high_watermark_(0),
+      stats_()
+{
+    for ( auto& s : block_table_sizes_ )
+        s = 0;
+}
+
+void Metrics::set_packet_statistics(const PacketStatistics& stats)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    stats_ = stats;
+}
+
+void Metrics::set_matcher_counts(std::size_t in_flight, std::size_t unmatched_response)
+{
+    matcher_in_flight_.store(in_flight, std::memory_order_relaxed);
+    matcher_unmatched_response_.store(unmatched_response, std::memory_order_relaxed);
+}
+
+void Metrics::set_reorder_counts(std::size_t held, std::size_t high_watermark)
+{
+    reorder_held_.store(held, std::memory_order_relaxed);
+    reorder_high_watermark_.store(high_watermark, std::memory_order_relaxed);
+}
+
+void Metrics::set_block_table_sizes(const block_cbor::BlockData& data)
+{
+    block_table_sizes_[IP_ADDRESSES] = data.ip_addresses.size();
+    block_table_sizes_[CLASS_TYPES] = data.class_types.size();
+    block_table_sizes_[QUESTIONS] = data.questions.size();
+    block_table_sizes_[RESOURCE_RECORDS] = data.resource_records.size();
+    block_table_sizes_[NAMES_RDATAS] = data.names_rdatas.size();
+    block_table_sizes_[QUERY_SIGNATURES] = data.query_signatures.size();
+    block_table_sizes_[QUESTIONS_LISTS] = data.questions_lists.size();
+    block_table_sizes_[RRS_LISTS] = data.rrs_lists.size();
+    block_table_sizes_[QUERY_RESPONSE_ITEMS] = data.query_response_items.size();
+    block_table_sizes_[ADDRESS_EVENT_COUNTS] = data.address_event_counts.size();
+    ++blocks_written_;
+}
+
+void Metrics::set_aggregates(std::shared_ptr<const Aggregates> aggregates)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    aggregates_ = aggregates;
+}
+
+void Metrics::add_gauge(const std::string& name, const std::string& labels,
+                        const std::string& help, Gauge gauge)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    GaugeFamily& family = gauges_[name];
+    family.help = help;
+    family.series.emplace_back(labels, gauge);
+}
+
+void Metrics::remove_gauges(const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    for ( auto it = gauges_.begin(); it != gauges_.end(); )
+    {
+        auto& series = it->second.series;
+        series.erase(std::remove_if(series.begin(), series.end(),
+                                    [&](const std::pair<std::string, Gauge>& s)
+                                    {
+                                        return s.first == labels;
+                                    }),
+                     series.end());
+        if ( series.empty() )
+            it = gauges_.erase(it);
+        else
+            ++it;
+    }
+}
+
+void Metrics::write(std::ostream& os)
+{
+    PacketStatistics stats;
+    std::shared_ptr<const Aggregates> aggregates;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        stats = stats_;
+        aggregates = aggregates_;
+    }
+
+    write_counter(os, "compactor_packets_total",
+                  "Packets received.", stats.raw_packet_count);
+    write_counter(os, "compactor_malformed_packets_total",
+                  "Malformed DNS packets received.", stats.malformed_packet_count);
+    write_counter(os, "compactor_out_of_order_packets_total",
+                  "Packets received out of time order.", stats.out_of_order_packet_count);
+    write_counter(os, "compactor_unhandled_packets_total",
+                  "Non-DNS packets received.", stats.unhandled_packet_count);
+    write_counter(os, "compactor_query_response_pairs_total",
+                  "Matched query/response pairs.", stats.qr_pair_count);
+    write_counter(os, "compactor_queries_without_response_total",
+                  "Queries with no matching response.", stats.query_without_response_count);
+    write_counter(os, "compactor_responses_without_query_total",
+                  "Responses with no matching query.", stats.response_without_query_count);
+    write_counter(os, "compactor_pcap_received_packets_total",
+                  "Packets received reported by PCAP.", stats.pcap_recv_count);
+    write_counter(os, "compactor_pcap_dropped_packets_total",
+                  "Packets dropped by the kernel reported by PCAP.", stats.pcap_drop_count);
+    write_counter(os, "compactor_pcap_interface_dropped_packets_total",
+                  "Packets dropped by the interface reported by PCAP.", stats.pcap_ifdrop_count);
+    write_counter(os, "compactor_raw_pcap_dropped_packets_total",
+                  "Raw PCAP packets dropped by output.", stats.output_raw_pcap_drop_count);
+    write_counter(os, "compactor_ignored_pcap_dropped_packets_total",
+                  "Ignored PCAP packets dropped by output.", stats.output_ignored_pcap_drop_count);
+    write_counter(os, "compactor_cbor_dropped_items_total",
+                  "C-DNS items dropped by output.", stats.output_cbor_drop_count);
+    write_counter(os, "compactor_tcp_flows_lru_evicted_total",
+                  "TCP flows evicted to make room for new flows.", stats.tcp_flow_lru_evicted_count);
+    write_counter(os, "compactor_tcp_flows_memory_evicted_total",
+                  "TCP flows evicted to stay within the TCP memory budget.", stats.tcp_flow_memory_evicted_count);
+    write_counter(os, "compactor_tcp_flows_timed_out_total",
+                  "Idle TCP flows timed out.", stats.tcp_flow_timeout_count);
+    write_counter(os, "compactor_tcp_flows_desynchronised_total",
+                  "TCP flows abandoned because of missing data.", stats.tcp_flow_desync_count);
+    write_counter(os, "compactor_ip_fragments_reassembled_total",
+                  "Fragmented IP datagrams reassembled.", stats.ip_fragment_reassembled_count);
+    write_counter(os, "compactor_ip_fragments_timed_out_total",
+                  "Fragmented IP datagrams not completed in time.", stats.ip_fragment_timeout_count);
+    write_counter(os, "compactor_ip_fragments_evicted_total",
+                  "Fragmented IP datagrams evicted to stay within limits.", stats.ip_fragment_evicted_count);
+    write_counter(os, "compactor_ip_fragments_dropped_total",
+                  "Fragmented IP datagrams dropped because of invalid fragments.", stats.ip_fragment_dropped_count);
+    write_counter(os, "compactor_capture_batches_total",
+                  "Captured packet batches passed to processing.", stats.capture_batch_count);
+    write_counter(os, "compactor_capture_syscalls_total",
+                  "System calls made waiting for and reading captured packets.", stats.capture_syscall_count);
+    write_counter(os, "compactor_shed_sections_items_total",
+                  "Query/response pairs output without extended sections to shed load.", stats.shed_sections_qr_count);
+    write_counter(os, "compactor_shed_address_events_total",
+                  "Address events dropped to shed load.", stats.shed_address_event_count);
+    write_counter(os, "compactor_sampled_items_total",
+                  "Query/response pairs output while sampling clients to shed load.", stats.sampled_qr_count);
+    write_counter(os, "compactor_sampled_out_items_total",
+                  "Query/response pairs dropped by sampling clients to shed load.", stats.sampled_out_qr_count);
+    write_counter(os, "compactor_client_sampled_out_messages_total",
+                  "DNS messages dropped by the configured client sample.", stats.client_sampled_out_message_count);
+    write_counter(os, "compactor_filtered_out_messages_total",
+                  "DNS messages dropped by the query name, server address and query type filters.", stats.filtered_out_message_count);
+    write_counter(os, "compactor_reorder_late_packets_total",
+                  "Captured packets arriving too late to be put in time order.", stats.reorder_late_packet_count);
+
+    write_header(os, "compactor_matcher_in_flight", "gauge",
+                 "Query/response items in the matcher waiting for output.");
+    write_series(os, "compactor_matcher_in_flight", "",
+                 matcher_in_flight_.load(std::memory_order_relaxed));
+    write_header(os, "compactor_matcher_unmatched_responses", "gauge",
+                 "Responses in the matcher waiting for a query.");
+    write_series(os, "compactor_matcher_unmatched_responses", "",
+                 matcher_unmatched_response_.load(std::memory_order_relaxed));
+    write_header(os, "compactor_reorder_held_packets", "gauge",
+                 "Captured packets held to put them in time order.");
+    write_series(os, "compactor_reorder_held_packets", "",
+                 reorder_held_.load(std::memory_order_relaxed));
+    write_header(os, "compactor_reorder_held_packets_high_watermark", "gauge",
+                 "Most captured packets ever held to put them in time order.");
+    write_series(os, "compactor_reorder_held_packets_high_watermark", "",
+                 reorder_high_watermark_.load(std::memory_order_relaxed));
+
+    write_counter(os, "compactor_blocks_written_total",
+                  "C-DNS blocks written.", blocks_written_);
+    write_header(os, "compactor_block_table_items", "gauge",
+                 "Items in each table of the last C-DNS block written.");
+    for ( std::size_t i = 0; i < BLOCK_TABLE_COUNT; ++i )
+        write_series(os, "compactor_block_table_items",
+                     std::string("table=\"") + BLOCK_TABLE_NAMES[i] + "\"",
+                     block_table_sizes_[i].load(std::memory_order_relaxed));
+
+    write_header(os, "compactor_stage_latency_seconds", "histogram",
+                 "Latency of each processing stage.");
+    for ( std::size_t i = 0; i < STAGE_COUNT; ++i )
+        latency_[i].write(os, "compactor_stage_latency_seconds",
+                          std::string("stage=\"") + STAGE_NAMES[i] + "\"");
+
+    write_header(os, "compactor_stage_latency_quantile_seconds", "gauge",
+                 "Latency quantiles of each processing stage.");
+    for ( std::size_t i = 0; i < STAGE_COUNT; ++i )
+        for ( double q : { 0.5, 0.9, 0.99, 0.999 } )
+        {
+            std::ostringstream labels;
+            labels << "stage=\"" << STAGE_NAMES[i] << "\",quantile=\"" << q << "\"";
+            write_series(os, "compactor_stage_latency_quantile_seconds", labels.str(),
+                         latency_[i].value_at_quantile(q) / 1e9);
+        }
+
+    if ( aggregates )
+        write_aggregates(os, *aggregates);
+
+    std::lock_guard<std::mutex> lock(m_);
+    for ( const auto& family : gauges_ )
+    {
+        write_header(os, family.first, "gauge", family.second.help);
+        for ( const auto& series : family.second.series )
+            write_series(os, family.first, series.first, series.second());
+    }
+}
+
+MetricsServer::MetricsServer(std::shared_ptr<Metrics> metrics,
+                             const std::string& socket_path, unsigned port)
+    : metrics_(metrics), socket_path_(socket_path), fd_(-1), stop_(false)
+{
+    if ( !socket_path_.empty() )
+    {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if ( socket_path_.size() >= sizeof(addr.sun_path) )
+            throw std::runtime_error("Metrics socket path too long: " + socket_path_);
+        std::strcpy(addr.sun_path, socket_path_.c_str());
+
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if ( fd_ == -1 )
+            throw std::runtime_error(std::string("Can't create metrics socket: ") + std::strerror(errno));
+        unlink(socket_path_.c_str());
+        if ( bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 )
+        {
+            int err = errno;
+            close(fd_);
+            throw std::runtime_error("Can't bind metrics socket " + socket_path_ + ": " + std::strerror(err));
+        }
+    }
+    else
+    {
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if ( fd_ == -1 )
+            throw std::runtime_error(std::string("Can't create metrics socket: ") + std::strerror(errno));
+        int on = 1;
+        setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if ( bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 )
+        {
+            int err = errno;
+            close(fd_);
+            throw std::runtime_error("Can't bind metrics port " + std::to_string(port) + ": " + std::strerror(err));
+        }
+    }
+
+    if ( listen(fd_, 8) == -1 )
+    {
+        int err = errno;
+        close(fd_);
+        throw std::runtime_error(std::string("Can't listen on metrics socket: ") + std::strerror(err));
+    }
+
+    thread_ = std::thread(&MetricsServer::serve, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop_ = true;
+    thread_.join();
+    close(fd_);
+    if ( !socket_path_.empty() )
+        unlink(socket_path_.c_str());
+}
+
+void MetricsServer::serve()
+{
+    set_thread_name("metrics");
+
+    while ( !stop_ )
+    {
+        struct pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = POLLIN;
+        int res = poll(&pfd, 1, SERVER_POLL_MS);
+        if ( res == -1 && errno != EINTR )
+        {
+            LOG_ERROR << "Metrics server poll failed: " << std::strerror(errno);
+            return;
+        }
+        if ( res <= 0 )
+            continue;
+
+        int conn = accept(fd_, nullptr, nullptr);
+        if ( conn == -1 )
+        {
+            if ( errno != EINTR && errno != EAGAIN && errno != ECONNABORTED )
+                LOG_ERROR << "Metrics server accept failed: " << std::strerror(errno);
+            continue;
+        }
+
+        try
+        {
+            respond(conn);
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what();
+        }
+        close(conn);
+    }
+}
+
+void MetricsServer::respond(int fd)
+{
+    // Don't let a slow client hold up the server.
+    struct timeval tv;
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Read the request headers. Whatever the request, the
+    // response is the metrics.
+    std::string request;
+    char buf[512];
+    while ( request.size() < MAX_REQUEST_SIZE &&
+            request.find("\r\n\r\n") == std::string::npos &&
+            request.find("\n\n") == std::string::npos )
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if ( n <= 0 )
+            break;
+        request.append(buf, n);
+    }
+
+    std::ostringstream body;
+    metrics_->write(body);
+    std::string content = body.str();
+
+    std::ostringstream response;
+    response << "HTTP/1.0 200 OK\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << content.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << content;
+    std::string out = response.str();
+
+    const char* p = out.data();
+    std::size_t left = out.size();
+    while ( left > 0 )
+    {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if ( n <= 0 )
+        {
+            if ( n == -1 && errno == EINTR )
+                continue;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+}
@@ -0,0 +1,488 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "packetstatistics.hpp"
+
+namespace block_cbor {
+    struct BlockData;
+}
+
+class Aggregates;
+
+/**
+ * \class LatencyHistogram
+ * \brief A high dynamic range histogram of latencies.
+ *
+ * Latencies are recorded in nanoseconds. Values below
+ * 2^SUB_BUCKET_BITS are recorded exactly. Above that, each power of two
+ * is split into 2^SUB_BUCKET_BITS linear sub-buckets, so any value is
+ * recorded with a relative error of at most 1/2^SUB_BUCKET_BITS.
+ * Values too large for the histogram are recorded in the top bucket.
+ *
+ * Recording is lock-free and uses only relaxed atomic increments,
+ * so it may be done from any thread at very low cost. Reads made
+ * while recording is in progress are not an atomic snapshot,
+ * but each individual count is accurate.
+ */
+class LatencyHistogram
+{
+public:
+    /**
+     * \brief number of bits of sub-bucket resolution.
+     */
+    static const unsigned SUB_BUCKET_BITS = 3;
+
+    /**
+     * \brief number of sub-buckets per power of two.
+     */
+    static const unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+
+    /**
+     * \brief largest power of two recorded, in nanoseconds.
+     *
+     * 2^40ns is a little over 18 minutes.
+     */
+    static const unsigned MAX_EXPONENT = 40;
+
+    /**
+     * \brief total number of buckets.
+     */
+    static const std::size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    /**
+     * \typedef Counts
+     * \brief A count for each bucket.
+     */
+    using Counts = std::array<uint64_t, BUCKETS>;
+
+    /**
+     * \brief Constructor.
+     */
+    LatencyHistogram();
+
+    /**
+     * \brief Record a latency.
+     *
+     * Negative latencies are recorded as zero.
+     *
+     * \param d the latency.
+     */
+    void record(std::chrono::nanoseconds d) noexcept
+    {
+        uint64_t ns = ( d.count() > 0 ) ? static_cast<uint64_t>(d.count()) : 0;
+        buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Return the number of latencies recorded.
+     */
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Return the sum of latencies recorded, in nanoseconds.
+     */
+    uint64_t sum() const
+    {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * \brief Return the latency at the given quantile.
+     *
+     * \param q the quantile, from 0 to 1.
+     * \returns the upper bound in nanoseconds of the bucket holding the
+     *          quantile, or 0 if no latencies have been recorded.
+     */
+    uint64_t value_at_quantile(double q) const;
+
+    /**
+     * \brief Write the histogram in Prometheus text format.
+     *
+     * The histogram is written as the series of the Prometheus histogram
+     * `name`, with values in seconds and buckets at each power of two
+     * nanoseconds. Quantiles 0.5, 0.9, 0.99 and 0.999 are written as
+     * the gauge `name_quantile`. The HELP and TYPE lines are not written.
+     *
+     * \param os     the output stream.
+     * \param name   the metric name.
+     * \param labels labels to add to each series, or empty.
+     */
+    void write(std::ostream& os, const std::string& name, const std::string& labels) const;
+
+    /**
+     * \brief Write bucket counts as a Prometheus histogram.
+     *
+     * The counts are written as by `write()`.
+     *
+     * \param os     the output stream.
+     * \param name   the metric name.
+     * \param labels labels to add to each series, or empty.
+     * \param counts the bucket counts.
+     * \param sum    the total of values counted, in nanoseconds.
+     */
+    static void write_counts(std::ostream& os, const std::string& name, const std::string& labels,
+                             const Counts& counts, uint64_t sum);
+
+    /**
+     * \brief Return the bucket index for a value.
+     *
+     * \param ns the value in nanoseconds.
+     * \returns the bucket index.
+     */
+    static std::size_t bucket_index(uint64_t ns) noexcept
+    {
+        if ( ns < SUB_BUCKETS )
+            return ns;
+
+        unsigned exponent = 63 - __builtin_clzll(ns);
+        if ( exponent > MAX_EXPONENT )
+            return BUCKETS - 1;
+        unsigned shift = exponent - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((ns >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /**
+     * \brief Return the upper bound of values in a bucket.
+     *
+     * \param index the bucket index.
+     * \returns the smallest value, in nanoseconds, above those in the bucket.
+     */
+    static uint64_t bucket_upper_bound(std::size_t index) noexcept
+    {
+        if ( index < SUB_BUCKETS )
+            return index + 1;
+
+        unsigned shift = index / SUB_BUCKETS - 1;
+        uint64_t sub = index % SUB_BUCKETS;
+        return (SUB_BUCKETS + sub + 1) << shift;
+    }
+
+private:
+    /**
+     * \brief the bucket counts.
+     */
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_;
+
+    /**
+     * \brief the total count.
+     */
+    std::atomic<uint64_t> count_;
+
+    /**
+     * \brief the total of values recorded, in nanoseconds.
+     */
+    std::atomic<uint64_t> sum_;
+};
+
+/**
+ * \class Metrics
+ * \brief Live operational metrics.
+ *
+ * Metrics are gathered from the threads doing the work and made
+ * available in Prometheus text format.
+ *
+ * Packet statistics and matcher counts belong to the capture thread,
+ * which publishes a copy periodically. Block table sizes are published by
+ * the C-DNS writer thread as each block is written. Other values, such
+ * as channel depths, are read when metrics are requested via registered
+ * gauge functions, which must therefore be thread-safe.
+ */
+class Metrics
+{
+public:
+    /**
+     * \enum Stage
+     * \brief Processing stages for which latency is recorded.
+     *
+     * Decode to match runs from decoding the query, or the response
+     * if there is no query, to the query/response item leaving the
+     * matcher, so includes the time waiting for a response.
+     */
+    enum Stage
+    {
+        CAPTURE_TO_DECODE,
+        DECODE_TO_MATCH,
+        MATCH_TO_BLOCK_WRITE,
+        STAGE_COUNT
+    };
+
+    /**
+     * \enum BlockTable
+     * \brief Block tables whose sizes are recorded.
+     */
+    enum BlockTable
+    {
+        IP_ADDRESSES,
+        CLASS_TYPES,
+        QUESTIONS,
+        RESOURCE_RECORDS,
+        NAMES_RDATAS,
+        QUERY_SIGNATURES,
+        QUESTIONS_LISTS,
+        RRS_LISTS,
+        QUERY_RESPONSE_ITEMS,
+        ADDRESS_EVENT_COUNTS,
+        BLOCK_TABLE_COUNT
+    };
+
+    /**
+     * \typedef Gauge
+     * \brief A function returning the current value of a gauge.
+     */
+    using Gauge = std::function<double ()>;
+
+    /**
+     * \brief Constructor.
+     */
+    Metrics();
+
+    /**
+     * \brief Return the latency histogram for a stage.
+     *
+     * \param stage the stage.
+     */
+    LatencyHistogram& latency(Stage stage)
+    {
+        return latency_[stage];
+    }
+
+    /**
+     * \brief Publish the current packet statistics.
+     *
+     * \param stats the statistics.
+     */
+    void set_packet_statistics(const PacketStatistics& stats);
+
+    /**
+     * \brief Publish the current query/response matcher counts.
+     *
+     * \param in_flight          number of items waiting for output.
+     * \param unmatched_response number of responses waiting for a query.
+     */
+    void set_matcher_counts(std::size_t in_flight, std::size_t unmatched_response);
+
+    /**
+     * \brief Publish the current capture reorder counts.
+     *
+     * \param held           number of packets held.
+     * \param high_watermark most packets ever held.
+     */
+    void set_reorder_counts(std::size_t held, std::size_t high_watermark);
+
+    /**
+     * \brief Publish the table sizes of a block about to be written.
+     *
+     * \param data the block data.
+     */
+    void set_block_table_sizes(const block_cbor::BlockData& data);
+
+    /**
+     * \brief Publish the traffic aggregates of the last complete period.
+     *
+     * \param aggregates the aggregates.
+     */
+    void set_aggregates(std::shared_ptr<const Aggregates> aggregates);
+
+    /**
+     * \brief Add a gauge.
+     *
+     * \param name   the metric name.
+     * \param labels the series labels, or empty.
+     * \param help   the metric help text.
+     * \param gauge  function returning the current gauge value.
+     */
+    void add_gauge(const std::string& name, const std::string& labels,
+                   const std::string& help, Gauge gauge);
+
+    /**
+     * \brief Remove all gauges with the given labels.
+     *
+     * \param labels the series labels.
+     */
+    void remove_gauges(const std::string& labels);
+
+    /**
+     * \brief Write all metrics in Prometheus text format.
+     *
+     * \param os the output stream.
+     */
+    void write(std::ostream& os);
+
+private:
+    /**
+     * \struct GaugeFamily
+     * \brief All the gauges with a given name.
+     */
+    struct GaugeFamily
+    {
+        /**
+         * \brief the metric help text.
+         */
+        std::string help;
+
+        /**
+         * \brief the label set and value function of each series.
+         */
+        std::vector<std::pair<std::string, Gauge>> series;
+    };
+
+    /**
+     * \brief latency histograms for each stage.
+     */
+    std::array<LatencyHistogram, STAGE_COUNT> latency_;
+
+    /**
+     * \brief table sizes in the last block written.
+     */
+    std::array<std::atomic<uint64_t>, BLOCK_TABLE_COUNT> block_table_sizes_;
+
+    /**
+     * \brief number of blocks written.
+     */
+    std::atomic<uint64_t> blocks_written_;
+
+    /**
+     * \brief matcher items waiting for output.
+     */
+    std::atomic<uint64_t> matcher_in_flight_;
+
+    /**
+     * \brief matcher responses waiting for a query.
+     */
+    std::atomic<uint64_t> matcher_unmatched_response_;
+
+    /**
+     * \brief captured packets held for reordering.
+     */
+    std::atomic<uint64_t> reorder_held_;
+
+    /**
+     * \brief most captured packets ever held for reordering.
+     */
+    std::atomic<uint64_t> reorder_high_watermark_;
+
+    /**
+     * \brief the last published packet statistics.
+     */
+    PacketStatistics stats_;
+
+    /**
+     * \brief the last published traffic aggregates, if any.
+     */
+    std::shared_ptr<const Aggregates> aggregates_;
+
+    /**
+     * \brief the registered gauges, by name.
+     */
+    std::map<std::string, GaugeFamily> gauges_;
+
+    /**
+     * \brief mutex guarding packet statistics, aggregates and gauges.
+     */
+    std::mutex m_;
+};
+
+/**
+ * \class MetricsServer
+ * \brief Serve metrics over a local socket.
+ *
+ * The server listens on either a Unix domain socket or on a TCP
+ * port on the loopback interface. Each connection receives a single
+ * HTTP response containing the current metrics in Prometheus text
+ * format, and is then closed. The server runs in its own thread.
+ */
+class MetricsServer
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * Exactly one of `socket_path` and `port` should be given.
+     *
+     * \param metrics     the metrics to serve.
+     * \param socket_path path of Unix domain socket to listen on, or empty.
+     * \param port        loopback TCP port to listen on, or 0.
+     * \throws std::runtime_error if the socket can't be opened.
+     */
+    MetricsServer(std::shared_ptr<Metrics> metrics,
+                  const std::string& socket_path, unsigned port);
+
+    /**
+     * \brief Destructor.
+     *
+     * Stop the server thread and close the socket.
+     */
+    ~MetricsServer();
+
+private:
+    /**
+     * \brief Server thread function.
+     */
+    void serve();
+
+    /**
+     * \brief Answer a single connection.
+     *
+     * \param fd the connection file descriptor.
+     */
+    void respond(int fd);
+
+    /**
+     * \brief the metrics to serve.
+     */
+    std::shared_ptr<Metrics> metrics_;
+
+    /**
+     * \brief path of Unix domain socket, if used.
+     */
+    std::string socket_path_;
+
+    /**
+     * \brief the listening socket.
+     */
+    int fd_;
+
+    /**
+     * \brief flag indicating the server should stop.
+     */
+    std::atomic_bool stop_;
+
+    /**
+     * \brief the server thread.
+     */
+    std::thread thread_;
+};
+
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+
+#include "packetreorderer.hpp"
+
+PacketReorderer::PacketReorderer(std::chrono::microseconds hold_time)
+    : hold_time_(hold_time), next_seq_(0), high_watermark_(0)
+{
+}
+
+bool PacketReorderer::add(const std::shared_ptr<PcapItem>& pcap)
+{
+    if ( pcap->timestamp < released_ )
+        return false;
+
+    if ( pcap->timestamp > newest_ )
+        newest_ = pcap->timestamp;
+
+    heap_.push_back({ pcap->timestamp, next_seq_++, pcap });
+    std::push_heap(heap_.begin(), heap_.end());
+    high_watermark_ = std::max(high_watermark_, heap_.size());
+    return true;
+}
+
+std::shared_ptr<PcapItem> PacketReorderer::next(std::chrono::system_clock::time_point now)
+{
+    if ( heap_.empty() || heap_.front().timestamp + hold_time_ > std::max(newest_, now) )
+        return nullptr;
+    return pop();
+}
+
+std::shared_ptr<PcapItem> PacketReorderer::flush_next()
+{
+    if ( heap_.empty() )
+        return nullptr;
+    return pop();
+}
+
+std::shared_ptr<PcapItem> PacketReorderer::pop()
+{
+    std::pop_heap(heap_.begin(), heap_.end());
+    std::shared_ptr<PcapItem> res = std::move(heap_.back().pcap);
+    released_ = heap_.back().timestamp;
+    heap_.pop_back();
+    return res;
+}
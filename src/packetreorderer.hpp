@@ -0,0 +1,167 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef PACKETREORDERER_HPP
+#define PACKETREORDERER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "packetstream.hpp"
+
+/**
+ * \class PacketReorderer
+ * \brief Put packets from several capture sources back in time order.
+ *
+ * Packets from each capture source arrive in time order, but packets
+ * from different sources are interleaved in the order they were read.
+ * Packets are held in a heap ordered by timestamp, so the sources are
+ * merged into a single stream in timestamp order.
+ *
+ * A packet is held until the newest time seen is its timestamp plus
+ * the hold time. The newest time seen is the latest packet timestamp,
+ * or the current time if that is given and later. A packet that
+ * arrives with a timestamp before one already released is late, and
+ * is not held.
+ */
+class PacketReorderer
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param hold_time the maximum time to hold a packet.
+     */
+    explicit PacketReorderer(std::chrono::microseconds hold_time);
+
+    /**
+     * \brief Add a packet.
+     *
+     * \param pcap the packet.
+     * \returns `false` if the packet is late and was not held.
+     */
+    bool add(const std::shared_ptr<PcapItem>& pcap);
+
+    /**
+     * \brief Remove the next packet whose hold time has passed.
+     *
+     * \param now the current time, or a default value to judge by
+     *            packet timestamps only.
+     * \returns the packet, or `nullptr` if none are ready.
+     */
+    std::shared_ptr<PcapItem> next(std::chrono::system_clock::time_point now = {});
+
+    /**
+     * \brief Remove the earliest held packet, however long it has been held.
+     *
+     * \returns the packet, or `nullptr` if none are held.
+     */
+    std::shared_ptr<PcapItem> flush_next();
+
+    /**
+     * \brief Return the number of packets held.
+     *
+     * \returns the number of packets.
+     */
+    std::size_t size() const
+    {
+        return heap_.size();
+    }
+
+    /**
+     * \brief Return the most packets ever held.
+     *
+     * \returns the number of packets.
+     */
+    std::size_t high_watermark() const
+    {
+        return high_watermark_;
+    }
+
+private:
+    /**
+     * \struct Entry
+     * \brief A held packet.
+     */
+    struct Entry
+    {
+        /**
+         * \brief the packet timestamp.
+         */
+        std::chrono::system_clock::time_point timestamp;
+
+        /**
+         * \brief the arrival order, so packets with the same
+         * timestamp keep their order.
+         */
+        uint64_t seq;
+
+        /**
+         * \brief the packet.
+         */
+        std::shared_ptr<PcapItem> pcap;
+
+        /**
+         * \brief Heap comparison, putting the earliest packet at the top.
+         *
+         * \param rhs the entry to compare with.
+         * \returns `true` if this entry is later than `rhs`.
+         */
+        bool operator<(const Entry& rhs) const
+        {
+            return timestamp > rhs.timestamp ||
+                ( timestamp == rhs.timestamp && seq > rhs.seq );
+        }
+    };
+
+    /**
+     * \brief Remove the packet at the top of the heap.
+     *
+     * \returns the packet.
+     */
+    std::shared_ptr<PcapItem> pop();
+
+    /**
+     * \brief the maximum time to hold a packet.
+     */
+    std::chrono::microseconds hold_time_;
+
+    /**
+     * \brief the held packets.
+     */
+    std::vector<Entry> heap_;
+
+    /**
+     * \brief the latest packet timestamp seen.
+     */
+    std::chrono::system_clock::time_point newest_;
+
+    /**
+     * \brief the timestamp of the last packet released.
+     */
+    std::chrono::system_clock::time_point released_;
+
+    /**
+     * \brief the arrival order of the next packet.
+     */
+    uint64_t next_seq_;
+
+    /**
+     * \brief the most packets ever held.
+     */
+    std::size_t high_watermark_;
+};
+
+#endif
@@ -91,6 +91,92 @@ using PacketStatistics = struct PacketStatistics_s
      */
     uint64_t output_cbor_drop_count;
 
+    /**
+     * \brief count of TCP flows evicted to make room for new flows.
+     */
+    uint64_t tcp_flow_lru_evicted_count;
+
+    /**
+     * \brief count of TCP flows evicted to stay within the TCP memory budget.
+     */
+    uint64_t tcp_flow_memory_evicted_count;
+
+    /**
+     * \brief count of idle TCP flows timed out.
+     */
+    uint64_t tcp_flow_timeout_count;
+
+    /**
+     * \brief count of TCP flows abandoned because of missing data.
+     */
+    uint64_t tcp_flow_desync_count;
+
+    /**
+     * \brief count of fragmented IP datagrams reassembled.
+     */
+    uint64_t ip_fragment_reassembled_count;
+
+    /**
+     * \brief count of fragmented IP datagrams not completed within the timeout.
+     */
+    uint64_t ip_fragment_timeout_count;
+
+    /**
+     * \brief count of fragmented IP datagrams evicted to stay within limits.
+     */
+    uint64_t ip_fragment_evicted_count;
+
+    /**
+     * \brief count of fragmented IP datagrams dropped because of invalid fragments.
+     */
+    uint64_t ip_fragment_dropped_count;
+
+    /**
+     * \brief count of captured packet batches passed to processing.
+     */
+    uint64_t capture_batch_count;
+
+    /**
+     * \brief count of system calls made capturing packets.
+     */
+    uint64_t capture_syscall_count;
+
+    /**
+     * \brief count of packets arriving too late to be put in time order.
+     */
+    uint64_t reorder_late_packet_count;
+
+    /**
+     * \brief count of query/response pairs output without extended
+     * sections to shed load.
+     */
+    uint64_t shed_sections_qr_count;
+
+    /**
+     * \brief count of address events dropped to shed load.
+     */
+    uint64_t shed_address_event_count;
+
+    /**
+     * \brief count of query/response pairs output while sampling clients.
+     */
+    uint64_t sampled_qr_count;
+
+    /**
+     * \brief count of query/response pairs dropped by sampling clients.
+     */
+    uint64_t sampled_out_qr_count;
+
+    /**
+     * \brief count of DNS messages dropped by configured client sampling.
+     */
+    uint64_t client_sampled_out_message_count;
+
+    /**
+     * \brief count of DNS messages dropped by the message filter.
+     */
+    uint64_t filtered_out_message_count;
+
     /**
      * \brief Dump the stats to the stream provided
      *
@@ -105,7 +191,13 @@ using PacketStatistics = struct PacketStatistics_s
            << "  Malformed DNS packets                    : " << malformed_packet_count << "\n"
            << "  Non-DNS packets                          : " << unhandled_packet_count  << "\n"
            << "  Out-of-order DNS query/responses         : " << out_of_order_packet_count << "\n"
+           << "  Packets too late to reorder              : " << reorder_late_packet_count << "\n"
            << "  Dropped C-DNS items (overload)           : " << output_cbor_drop_count << "\n"
+           << "  C-DNS items without sections (overload)  : " << shed_sections_qr_count << "\n"
+           << "  Dropped address events (overload)        : " << shed_address_event_count << "\n"
+           << "  Sampled out C-DNS items (overload)       : " << sampled_out_qr_count << "\n"
+           << "  Sampled out DNS messages (client sample) : " << client_sampled_out_message_count << "\n"
+           << "  Filtered out DNS messages                : " << filtered_out_message_count << "\n"
            << "  Dropped raw PCAP packets (overload)      : " << output_raw_pcap_drop_count << "\n"
            << "  Dropped non-DNS packets (overload)       : " << output_ignored_pcap_drop_count << "\n\n";
     }
@@ -13,53 +13,64 @@
 #include <functional>
 #include <iostream>
 
+#include <netinet/in.h>
+
 #include "dnsmessage.hpp"
 #include "makeunique.hpp"
-#include "nocopypacket.hpp"
 
 #include "packetstream.hpp"
 
 PacketStream::PacketStream(const Configuration& config, DNSSink dns_sink, AddressEventSink address_event_sink)
-    : config_(config), dns_sink_(dns_sink), address_event_sink_(address_event_sink)
+    : config_(config), dns_sink_(dns_sink), address_event_sink_(address_event_sink),
+      fragment_reassembler_(config.max_fragmented_datagrams,
+                            static_cast<std::size_t>(config.max_fragment_memory) * 1024 * 1024,
+                            std::chrono::seconds(config.fragment_timeout)),
+      tcp_reassembler_(config.max_tcp_flows,
+                       static_cast<std::size_t>(config.max_tcp_memory) * 1024 * 1024,
+                       std::chrono::seconds(config.tcp_flow_timeout)),
+      client_sampler_(config),
+      sampled_out_message_count_(0),
+      message_filter_(config),
+      filtered_out_message_count_(0),
+      reported_()
 {
-    tcp_stream_follower_.new_stream_callback(std::bind(&PacketStream::on_new_stream, this, std::placeholders::_1));
-}
-
-void PacketStream::on_new_stream(Tins::TCPIP::Stream& stream)
-{
-    // I will handle clearing the payloads.
-    stream.auto_cleanup_payloads(false);
-
-    stream.client_data_callback(std::bind(&PacketStream::on_new_client_data, this, std::placeholders::_1));
-    stream.server_data_callback(std::bind(&PacketStream::on_new_server_data, this, std::placeholders::_1));
 }
 
-void PacketStream::on_new_client_data(Tins::TCPIP::Stream& stream)
+void PacketStream::update_statistics(PacketStatistics& stats)
 {
-    on_new_stream_data(stream.client_payload());
-}
-
-void PacketStream::on_new_server_data(Tins::TCPIP::Stream& stream)
-{
-    on_new_stream_data(stream.server_payload());
+    auto add =
+        [](uint64_t& total, uint64_t& reported, uint64_t count)
+        {
+            total += count - reported;
+            reported = count;
+        };
+
+    add(stats.ip_fragment_reassembled_count, reported_.ip_fragment_reassembled_count,
+        fragment_reassembler_.reassembled_count());
+    add(stats.ip_fragment_timeout_count, reported_.ip_fragment_timeout_count,
+        fragment_reassembler_.timeout_count());
+    add(stats.ip_fragment_evicted_count, reported_.ip_fragment_evicted_count,
+        fragment_reassembler_.evicted_count());
+    add(stats.ip_fragment_dropped_count, reported_.ip_fragment_dropped_count,
+        fragment_reassembler_.dropped_count());
+    add(stats.tcp_flow_lru_evicted_count, reported_.tcp_flow_lru_evicted_count,
+        tcp_reassembler_.lru_evicted_count());
+    add(stats.tcp_flow_memory_evicted_count, reported_.tcp_flow_memory_evicted_count,
+        tcp_reassembler_.memory_evicted_count());
+    add(stats.tcp_flow_timeout_count, reported_.tcp_flow_timeout_count,
+        tcp_reassembler_.timeout_count());
+    add(stats.tcp_flow_desync_count, reported_.tcp_flow_desync_count,
+        tcp_reassembler_.desync_count());
+    add(stats.client_sampled_out_message_count, reported_.client_sampled_out_message_count,
+        sampled_out_message_count_);
+    add(stats.filtered_out_message_count, reported_.filtered_out_message_count,
+        filtered_out_message_count_);
 }
 
-void PacketStream::on_new_stream_data(Tins::TCPIP::Stream::payload_type& payload)
+void PacketStream::update_selection(const Configuration& config)
 {
-    for (;;)
-    {
-        if ( payload.size() < 2 )
-            break;
-
-        unsigned dns_len = (payload[0] << 8) + payload[1];
-        if ( (dns_len + 2) > payload.size() )
-            break;
-
-        Tins::RawPDU pdu(&(payload.data()[2]), dns_len);
-        dispatch_dns(&pdu, *last_tcp_packet_data_);
-
-        payload.erase(payload.begin(), payload.begin() + dns_len + 2);
-    }
+    client_sampler_ = ClientSampler(config);
+    message_filter_ = MessageFilter(config);
 }
 
 Tins::PDU* PacketStream::find_ip_pdu(std::shared_ptr<PcapItem>& pcap)
@@ -96,11 +107,34 @@ Tins::PDU* PacketStream::find_ip_pdu(std::shared_ptr<PcapItem>& pcap)
     return res;
 }
 
+namespace {
+    /**
+     * \brief Skip IPv6 extension headers preceding the upper layer header.
+     *
+     * \param data      the packet data.
+     * \param len       the packet data length.
+     * \param pos       the offset of the first header. Updated to the
+     *                  offset of the first unskipped header.
+     * \param next      the type of the first header. Updated to the type
+     *                  of the first unskipped header.
+     * \throws malformed_packet if a header is truncated.
+     */
+    void skip_ipv6_extension_headers(const uint8_t* data, std::size_t len,
+                                     std::size_t& pos, uint8_t& next)
+    {
+        while ( next == IPPROTO_HOPOPTS || next == IPPROTO_ROUTING ||
+                next == IPPROTO_DSTOPTS )
+        {
+            if ( pos + 8 > len )
+                throw malformed_packet();
+            next = data[pos];
+            pos += (data[pos + 1] + 1) * 8;
+        }
+    }
+}
+
 Tins::PDU* PacketStream::ipv4_packet(Tins::IP* ip, PktData& pkt_data)
 {
-    if ( reassembler_ipv4_.process(*ip) == Tins::IPv4Reassembler::FRAGMENTED )
-        return NULL;
-
     pkt_data.hoplimit = ip->ttl();
     pkt_data.srcIP = IPAddress(ip->src_addr());
     pkt_data.dstIP = IPAddress(ip->dst_addr());
@@ -109,16 +143,64 @@ Tins::PDU* PacketStream::ipv4_packet(Tins::IP* ip, PktData& pkt_data)
     if ( !res )
         throw malformed_packet();
 
+    if ( ip->is_fragmented() )
+    {
+        Tins::PDU::serialization_type payload;
+        const uint8_t* data;
+        std::size_t len;
+
+        // Fragment payloads are not decoded, so should be raw.
+        if ( res->pdu_type() == Tins::PDU::RAW )
+        {
+            const Tins::RawPDU* raw = reinterpret_cast<const Tins::RawPDU*>(res);
+            data = raw->payload().data();
+            len = raw->payload().size();
+        }
+        else
+        {
+            payload = res->serialize();
+            data = payload.data();
+            len = payload.size();
+        }
+
+        res = reassemble(ip, ip->id(), ip->fragment_offset() * 8,
+                         ip->flags() & Tins::IP::MORE_FRAGMENTS,
+                         ip->protocol(), data, len, pkt_data);
+    }
+
     return res;
 }
 
 Tins::PDU* PacketStream::ipv6_packet(Tins::IPv6* ip6, PktData& pkt_data)
 {
-    // TODO: Add IPv6 fragmentation detection into condition.
     pkt_data.hoplimit = ip6->hop_limit();
     pkt_data.srcIP = IPAddress(ip6->src_addr());
     pkt_data.dstIP = IPAddress(ip6->dst_addr());
 
+    if ( ip6->search_header(Tins::IPv6::FRAGMENT) )
+    {
+        // Find the fragment header in the wire format, where the
+        // header chain is explicit.
+        Tins::PDU::serialization_type pkt = ip6->serialize();
+        if ( pkt.size() < 40 )
+            throw malformed_packet();
+        std::size_t pos = 40;
+        uint8_t next = pkt[6];
+        skip_ipv6_extension_headers(pkt.data(), pkt.size(), pos, next);
+        if ( next != IPPROTO_FRAGMENT || pos + 8 > pkt.size() )
+            throw malformed_packet();
+
+        uint8_t protocol = pkt[pos];
+        uint16_t offset_flags = (pkt[pos + 2] << 8) | pkt[pos + 3];
+        uint32_t id = (pkt[pos + 4] << 24) | (pkt[pos + 5] << 16) |
+            (pkt[pos + 6] << 8) | pkt[pos + 7];
+        pos += 8;
+
+        return reassemble(ip6, id, offset_flags & 0xfff8, offset_flags & 1,
+                          protocol, pkt.data() + pos, pkt.size() - pos,
+                          pkt_data);
+    }
+
     Tins::PDU* res = ip6->inner_pdu();
     if ( !res )
         throw malformed_packet();
@@ -126,6 +208,62 @@ Tins::PDU* PacketStream::ipv6_packet(Tins::IPv6* ip6, PktData& pkt_data)
     return res;
 }
 
+Tins::PDU* PacketStream::reassemble(Tins::PDU* ip, uint32_t id, std::size_t offset,
+                                    bool more, uint8_t protocol,
+                                    const uint8_t* data, std::size_t len,
+                                    PktData& pkt_data)
+{
+    IPFragmentReassembler::DatagramKey key{pkt_data.srcIP, pkt_data.dstIP, id};
+    if ( !fragment_reassembler_.process(key, offset, more, data, len,
+                                        pkt_data.timestamp, datagram_) )
+        return nullptr;
+
+    // IPv6 extension headers after the fragment header are part
+    // of the datagram.
+    std::size_t pos = 0;
+    if ( ip->pdu_type() == Tins::PDU::IPv6 )
+        skip_ipv6_extension_headers(datagram_.data(), datagram_.size(), pos, protocol);
+    if ( pos >= datagram_.size() )
+        throw malformed_packet();
+
+    const uint8_t* payload = datagram_.data() + pos;
+    uint32_t payload_len = datagram_.size() - pos;
+    Tins::PDU* res;
+
+    try
+    {
+        switch (protocol)
+        {
+        case IPPROTO_UDP:
+            res = new Tins::UDP(payload, payload_len);
+            break;
+
+        case IPPROTO_TCP:
+            res = new Tins::TCP(payload, payload_len);
+            break;
+
+        case IPPROTO_ICMP:
+            res = new Tins::ICMP(payload, payload_len);
+            break;
+
+        case IPPROTO_ICMPV6:
+            res = new Tins::ICMPv6(payload, payload_len);
+            break;
+
+        default:
+            throw unhandled_packet();
+        }
+    }
+    catch (const Tins::malformed_packet&)
+    {
+        throw malformed_packet();
+    }
+
+    // The IP PDU takes ownership.
+    ip->inner_pdu(res);
+    return res;
+}
+
 void PacketStream::udp_packet(Tins::UDP* udp, PktData& pkt_data)
 {
     if ( udp->dport() != 53 && udp->sport() != 53 )
@@ -142,8 +280,7 @@ void PacketStream::udp_packet(Tins::UDP* udp, PktData& pkt_data)
     dispatch_dns(reinterpret_cast<Tins::RawPDU*>(pdu), pkt_data);
 }
 
-void PacketStream::tcp_packet(Tins::TCP* tcp, Tins::PDU* ip_pdu,
-                              PktData& pkt_data)
+void PacketStream::tcp_packet(Tins::TCP* tcp, PktData& pkt_data)
 {
     if ( tcp->dport() != 53 && tcp->sport() != 53 )
         throw unhandled_packet();
@@ -151,7 +288,6 @@ void PacketStream::tcp_packet(Tins::TCP* tcp, Tins::PDU* ip_pdu,
     pkt_data.srcPort = tcp->sport();
     pkt_data.dstPort = tcp->dport();
     pkt_data.tcp = true;
-    last_tcp_packet_data_ = &pkt_data;
 
     if ( tcp->flags() & Tins::TCP::RST )
     {
@@ -160,14 +296,44 @@ void PacketStream::tcp_packet(Tins::TCP* tcp, Tins::PDU* ip_pdu,
         address_event_sink_(ae);
     }
 
-    // It looks like the TCP stream follower stuff *modifies* the
-    // PDU data fed into it. Since we're sharing the packet with the
-    // PCAP output queues, they can end up writing a modified version
-    // of the packet. What we see especially is zero length TCP packets
-    // at the first data packet in a transaction. So copy the packet before
-    // feeding the copy into the stream follower.
-    Tins::Packet pkt(ip_pdu, NoCopyPacket::tsToTins(pkt_data.timestamp));
-    tcp_stream_follower_.process_packet(pkt);
+    unsigned flags = 0;
+    if ( tcp->flags() & Tins::TCP::SYN )
+        flags |= TCPDNSReassembler::SYN;
+    if ( tcp->flags() & Tins::TCP::FIN )
+        flags |= TCPDNSReassembler::FIN;
+    if ( tcp->flags() & Tins::TCP::RST )
+        flags |= TCPDNSReassembler::RST;
+
+    const uint8_t* data = nullptr;
+    std::size_t len = 0;
+    const Tins::RawPDU* raw = tcp->find_pdu<Tins::RawPDU>();
+    if ( raw )
+    {
+        data = raw->payload().data();
+        len = raw->payload().size();
+    }
+
+    // A bad message doesn't stop the stream, but the packet
+    // completing it is reported as malformed.
+    bool malformed = false;
+    TCPDNSReassembler::FlowKey key{pkt_data.srcIP, pkt_data.dstIP,
+                                   pkt_data.srcPort, pkt_data.dstPort};
+    tcp_reassembler_.process(key, tcp->seq(), flags, data, len,
+                             pkt_data.timestamp,
+                             [&](const uint8_t* msg, std::size_t msg_len)
+                             {
+                                 try
+                                 {
+                                     Tins::RawPDU pdu(msg, msg_len);
+                                     dispatch_dns(&pdu, pkt_data);
+                                 }
+                                 catch (const malformed_packet&)
+                                 {
+                                     malformed = true;
+                                 }
+                             });
+    if ( malformed )
+        throw malformed_packet();
 }
 
 void PacketStream::icmp_packet(Tins::ICMP* icmp, Tins::PDU* ip_pdu,
@@ -268,6 +434,31 @@ void PacketStream::icmpv6_packet(Tins::ICMPv6* icmp, Tins::PDU* ip_pdu,
 
 void PacketStream::dispatch_dns(Tins::RawPDU* pdu, PktData& pkt_data)
 {
+    if ( client_sampler_.sampling() || message_filter_.filtering() )
+    {
+        // Find the client and server from the QR bit in the DNS
+        // header, and decide whether to keep the message from that
+        // and the question. Leave anything too short for that to
+        // the decoder.
+        const Tins::RawPDU::payload_type& payload = pdu->payload();
+        if ( payload.size() > 2 )
+        {
+            bool response = ( payload[2] & 0x80 );
+            const IPAddress& client = response ? pkt_data.dstIP : pkt_data.srcIP;
+            const IPAddress& server = response ? pkt_data.srcIP : pkt_data.dstIP;
+            if ( !client_sampler_.keep_client(client) )
+            {
+                ++sampled_out_message_count_;
+                return;
+            }
+            if ( !message_filter_.keep(payload.data(), payload.size(), server) )
+            {
+                ++filtered_out_message_count_;
+                return;
+            }
+        }
+    }
+
     auto dns =
         make_unique<DNSMessage>(*pdu,
                                 pkt_data.timestamp,
@@ -315,7 +506,7 @@ void PacketStream::process_packet(std::shared_ptr<PcapItem>& pcap)
             break;
 
         case Tins::PDU::TCP:
-            tcp_packet(reinterpret_cast<Tins::TCP*>(pdu), ip_pdu, pkt_data);
+            tcp_packet(reinterpret_cast<Tins::TCP*>(pdu), pkt_data);
             break;
 
         case Tins::PDU::ICMP:
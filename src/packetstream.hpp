@@ -16,15 +16,20 @@
 #include <chrono>
 #include <exception>
 #include <memory>
+#include <vector>
 
 #include <tins/tins.h>
-#include <tins/tcp_ip/stream_follower.h>
 
 #include "addressevent.hpp"
 #include "channel.hpp"
+#include "clientsampler.hpp"
 #include "configuration.hpp"
+#include "ipfragmentreassembler.hpp"
 #include "matcher.hpp"
+#include "messagefilter.hpp"
+#include "packetstatistics.hpp"
 #include "sniffers.hpp"
+#include "tcpdnsreassembler.hpp"
 
 /**
  ** Packet processing exceptions.
@@ -37,7 +42,7 @@
  * Signals that a packet was not handled for some reason. Currently this
  * indicates that the packet was:
  * - To/From ports other than 53.
- * - Fragmented.
+ * - A fragment of a datagram still being reassembled.
  * - TCP.
  * - Not able to be decoded as well-formed DNS messages.
  */
@@ -137,6 +142,27 @@ public:
      */
     void process_packet(std::shared_ptr<PcapItem>& pcap);
 
+    /**
+     * \brief Update statistics with IP fragment, TCP flow, client
+     * sampling and message filter counts.
+     *
+     * The counts since the last update are added, so totals carry on
+     * when a packet stream is replaced.
+     *
+     * \param stats the statistics to update.
+     */
+    void update_statistics(PacketStatistics& stats);
+
+    /**
+     * \brief Update which messages are kept from a new configuration.
+     *
+     * This replaces the client sampling and message filter without
+     * disturbing TCP or IP fragment reassembly.
+     *
+     * \param config the new configuration.
+     */
+    void update_selection(const Configuration& config);
+
 protected:
     /**
      * \struct PktData
@@ -180,34 +206,6 @@ protected:
         bool tcp;
     };
 
-    /**
-     * \brief Callback when a new TCP stream is created.
-     *
-     * \param stream the new stream.
-     */
-    void on_new_stream(Tins::TCPIP::Stream& stream);
-
-    /**
-     * \brief Callback when a TCP stream has fresh data.
-     *
-     * \param stream the stream.
-     */
-    void on_new_client_data(Tins::TCPIP::Stream& stream);
-
-    /**
-     * \brief Callback when a TCP stream has fresh data.
-     *
-     * \param stream the stream.
-     */
-    void on_new_server_data(Tins::TCPIP::Stream& stream);
-
-    /**
-     * \brief Callback when a TCP stream has fresh data.
-     *
-     * \param payload the stream data payload.
-     */
-    void on_new_stream_data(Tins::TCPIP::Stream::payload_type& payload);
-
     /**
      * \brief Find the IP or IPv6 PDU in the packet.
      *
@@ -220,7 +218,8 @@ protected:
     /**
      * \brief Process IPv4 packet.
      *
-     * Extract the source and destination addresses and hoplimit.
+     * Extract the source and destination addresses and hoplimit,
+     * and reassemble fragmented datagrams.
      *
      * \param pdu      IPv4 PDU.
      * \param pkt_data the packet data.
@@ -232,7 +231,8 @@ protected:
     /**
      * \brief Process IPv6 packet.
      *
-     * Extract the source and destination addresses and hoplimit.
+     * Extract the source and destination addresses and hoplimit,
+     * and reassemble fragmented datagrams.
      *
      * \param pdu      IPv6 PDU.
      * \param pkt_data the packet data.
@@ -241,6 +241,30 @@ protected:
      */
     Tins::PDU* ipv6_packet(Tins::IPv6* pdu, PktData& pkt_data);
 
+    /**
+     * \brief Add a fragment to its datagram.
+     *
+     * If this completes the datagram, decode the datagram payload
+     * and make it the inner PDU of the IP PDU.
+     *
+     * \param ip       the IP or IPv6 PDU.
+     * \param id       the datagram identification.
+     * \param offset   the fragment offset, in bytes.
+     * \param more     `true` if this is not the last fragment.
+     * \param protocol the datagram payload protocol.
+     * \param data     the fragment payload.
+     * \param len      the fragment payload length.
+     * \param pkt_data the packet data.
+     * \returns the datagram payload PDU, or `null` if the datagram
+     * is not complete.
+     * \throws malformed_packet if the payload cannot be decoded.
+     * \throws unhandled_packet if the payload protocol is not handled.
+     */
+    Tins::PDU* reassemble(Tins::PDU* ip, uint32_t id, std::size_t offset,
+                          bool more, uint8_t protocol,
+                          const uint8_t* data, std::size_t len,
+                          PktData& pkt_data);
+
     /**
      * \brief Process UDP packet contents.
      *
@@ -255,12 +279,12 @@ protected:
      * \brief Process TCP packet contents.
      *
      * \param tcp      TCP packet.
-     * \param ip       Enclosing IP/IPv6 packet.
      * \param pkt_data basic packet data so far.
-     * \throws malformed_packet if no data PDU found.
+     * \throws malformed_packet if a DNS message in the stream cannot
+     * be decoded.
      * \throws unhandled_packet if packet sent to port other than 53.
      */
-    void tcp_packet(Tins::TCP* tcp, Tins::PDU* ip, PktData& pkt_data);
+    void tcp_packet(Tins::TCP* tcp, PktData& pkt_data);
 
     /**
      * \brief Process ICMP packet contents.
@@ -285,6 +309,10 @@ protected:
     /**
      * \brief Dispatch a DNS message.
      *
+     * If sampling clients, messages from clients not sampled are
+     * dropped before the message is decoded. Messages not passing
+     * the message filter are dropped likewise.
+     *
      * \param pdu   the message data.
      * \param pkt_data basic packet data so far.
      */
@@ -320,19 +348,44 @@ private:
     AddressEventSink address_event_sink_;
 
     /**
-     * \brief IPv4 fragment reassembly.
+     * \brief IPv4 and IPv6 fragment reassembly.
+     */
+    IPFragmentReassembler fragment_reassembler_;
+
+    /**
+     * \brief buffer for reassembled datagrams.
+     */
+    std::vector<uint8_t> datagram_;
+
+    /**
+     * \brief DNS over TCP reassembly.
+     */
+    TCPDNSReassembler tcp_reassembler_;
+
+    /**
+     * \brief client sampling.
+     */
+    ClientSampler client_sampler_;
+
+    /**
+     * \brief count of DNS messages dropped by client sampling.
+     */
+    uint64_t sampled_out_message_count_;
+
+    /**
+     * \brief filter on query name, server address and query type.
      */
-    Tins::IPv4Reassembler reassembler_ipv4_;
+    MessageFilter message_filter_;
 
     /**
-     * \brief TCP stream follower.
+     * \brief count of DNS messages dropped by the message filter.
      */
-    Tins::TCPIP::StreamFollower tcp_stream_follower_;
+    uint64_t filtered_out_message_count_;
 
     /**
-     * \brief last seen TCP hop limit.
+     * \brief the counts added to statistics at the last update.
      */
-    PktData* last_tcp_packet_data_;
+    PacketStatistics reported_;
 };
 
 #endif
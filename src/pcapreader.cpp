@@ -0,0 +1,702 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <lzma.h>
+
+#include "streamwriter.hpp"
+
+#include "pcapreader.hpp"
+
+namespace {
+    const uint32_t PCAP_MAGIC = 0xa1b2c3d4;
+    const uint32_t PCAP_MAGIC_SWAPPED = 0xd4c3b2a1;
+    const uint32_t PCAP_NSEC_MAGIC = 0xa1b23c4d;
+    const uint32_t PCAP_NSEC_MAGIC_SWAPPED = 0x4d3cb2a1;
+
+    const uint32_t PCAPNG_SECTION_HEADER = 0x0a0d0d0a;
+    const uint32_t PCAPNG_INTERFACE_DESCRIPTION = 1;
+    const uint32_t PCAPNG_PACKET = 2;
+    const uint32_t PCAPNG_SIMPLE_PACKET = 3;
+    const uint32_t PCAPNG_ENHANCED_PACKET = 6;
+    const uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+    const uint32_t PCAPNG_BYTE_ORDER_MAGIC_SWAPPED = 0x4d3c2b1a;
+
+    const uint16_t PCAPNG_OPT_END = 0;
+    const uint16_t PCAPNG_OPT_IF_TSRESOL = 9;
+    const uint16_t PCAPNG_OPT_IF_TSOFFSET = 14;
+
+    const uint32_t LINKTYPE_RAW = 101;
+    const uint32_t LINKTYPE_PKTAP = 258;
+
+    // Largest packet and block accepted. This matches the largest
+    // snap length accepted by libpcap.
+    const uint32_t MAX_PACKET_LEN = 262144;
+    const uint32_t MAX_BLOCK_LEN = 16 * 1024 * 1024;
+
+    const std::size_t INPUT_CHUNK_SIZE = 1024 * 1024;
+
+    const uint8_t XZ_MAGIC[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+    const uint8_t GZIP_MAGIC[] = { 0x1f, 0x8b };
+
+    uint32_t host32(const uint8_t* p)
+    {
+        uint32_t res;
+        std::memcpy(&res, p, sizeof(res));
+        return res;
+    }
+
+    int linktype_to_dlt(uint32_t linktype)
+    {
+        // The upper bits of the classic PCAP link type may hold
+        // FCS information.
+        linktype &= 0x0fffffff;
+
+        // LINKTYPE_ values match DLT_ values except for a few
+        // whose DLT_ values differ between platforms.
+        switch (linktype)
+        {
+        case LINKTYPE_RAW:
+            return DLT_RAW;
+
+#ifdef DLT_PKTAP
+        case LINKTYPE_PKTAP:
+            return DLT_PKTAP;
+#endif
+
+        default:
+            return static_cast<int>(linktype);
+        }
+    }
+
+    /**
+     * \brief Read from a file descriptor, retrying if interrupted.
+     *
+     * \param fd  the file descriptor.
+     * \param buf the buffer.
+     * \param len the buffer size.
+     * \returns the number of bytes read, or -1 on error.
+     */
+    ssize_t read_fd(int fd, uint8_t* buf, std::size_t len)
+    {
+        ssize_t res;
+        do
+            res = ::read(fd, buf, len);
+        while ( res == -1 && errno == EINTR );
+        return res;
+    }
+}
+
+class PcapReader::Input
+{
+public:
+    /**
+     * \brief Destructor.
+     */
+    virtual ~Input() {}
+
+    /**
+     * \brief Read bytes.
+     *
+     * \param n the number of bytes.
+     * \returns a pointer to `n` contiguous bytes, valid until the
+     *          next read, or `nullptr` if fewer than `n` bytes remain.
+     */
+    virtual const uint8_t* read(std::size_t n) = 0;
+
+    /**
+     * \brief Determine if all bytes have been read.
+     *
+     * \returns `true` if no bytes remain.
+     */
+    virtual bool at_end() = 0;
+};
+
+namespace {
+    /**
+     * \class MappedInput
+     * \brief Input from a file mapped into memory.
+     */
+    class MappedInput : public PcapReader::Input
+    {
+    public:
+        MappedInput(int fd, std::size_t size)
+            : data_(nullptr), size_(size), pos_(0)
+        {
+            if ( size_ == 0 )
+                return;
+
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( p == MAP_FAILED )
+                throw pcap_reader_error(std::string("Can't map file: ") + std::strerror(errno));
+            data_ = static_cast<const uint8_t*>(p);
+            madvise(p, size_, MADV_SEQUENTIAL);
+            madvise(p, size_, MADV_WILLNEED);
+        }
+
+        virtual ~MappedInput()
+        {
+            if ( data_ )
+                munmap(const_cast<uint8_t*>(data_), size_);
+        }
+
+        virtual const uint8_t* read(std::size_t n)
+        {
+            if ( size_ - pos_ < n )
+                return nullptr;
+            const uint8_t* res = data_ + pos_;
+            pos_ += n;
+            return res;
+        }
+
+        virtual bool at_end()
+        {
+            return pos_ == size_;
+        }
+
+    private:
+        const uint8_t* data_;
+        std::size_t size_;
+        std::size_t pos_;
+    };
+
+    /**
+     * \class BufferedInput
+     * \brief Input read in large chunks into a buffer.
+     *
+     * Derived classes supply the data.
+     */
+    class BufferedInput : public PcapReader::Input
+    {
+    public:
+        BufferedInput()
+            : buf_(INPUT_CHUNK_SIZE), pos_(0), end_(0), eof_(false)
+        {
+        }
+
+        virtual const uint8_t* read(std::size_t n)
+        {
+            if ( end_ - pos_ < n && !fill(n) )
+                return nullptr;
+            const uint8_t* res = buf_.data() + pos_;
+            pos_ += n;
+            return res;
+        }
+
+        virtual bool at_end()
+        {
+            return pos_ == end_ && !fill(1);
+        }
+
+    protected:
+        /**
+         * \brief Read more data.
+         *
+         * \param buf the buffer.
+         * \param len the buffer size.
+         * \returns the number of bytes read, or 0 at the end of input.
+         */
+        virtual std::size_t read_some(uint8_t* buf, std::size_t len) = 0;
+
+    private:
+        bool fill(std::size_t n)
+        {
+            std::size_t avail = end_ - pos_;
+            if ( pos_ > 0 )
+            {
+                std::memmove(buf_.data(), buf_.data() + pos_, avail);
+                pos_ = 0;
+                end_ = avail;
+            }
+            if ( n > buf_.size() )
+                buf_.resize(n);
+
+            while ( end_ < n && !eof_ )
+            {
+                std::size_t got = read_some(buf_.data() + end_, buf_.size() - end_);
+                if ( got == 0 )
+                    eof_ = true;
+                end_ += got;
+            }
+
+            return end_ >= n;
+        }
+
+        std::vector<uint8_t> buf_;
+        std::size_t pos_;
+        std::size_t end_;
+        bool eof_;
+    };
+
+    /**
+     * \class FdInput
+     * \brief Uncompressed input from a file descriptor.
+     */
+    class FdInput : public BufferedInput
+    {
+    public:
+        FdInput(int fd, bool owned) : fd_(fd), owned_(owned) {}
+
+        virtual ~FdInput()
+        {
+            if ( owned_ )
+                close(fd_);
+        }
+
+    protected:
+        virtual std::size_t read_some(uint8_t* buf, std::size_t len)
+        {
+            ssize_t res = read_fd(fd_, buf, len);
+            if ( res < 0 )
+                throw pcap_reader_error(std::string("Read failed: ") + std::strerror(errno));
+            return res;
+        }
+
+    private:
+        int fd_;
+        bool owned_;
+    };
+
+    /**
+     * \class XzInput
+     * \brief Input decompressed from xz.
+     */
+    class XzInput : public BufferedInput
+    {
+    public:
+        explicit XzInput(int fd)
+            : fd_(fd), in_(INPUT_CHUNK_SIZE), xz_stream_(LZMA_STREAM_INIT),
+              finished_(false)
+        {
+            lzma_ret ret = lzma_stream_decoder(&xz_stream_, UINT64_MAX, LZMA_CONCATENATED);
+            if ( ret != LZMA_OK )
+                throw XzException(ret);
+        }
+
+        virtual ~XzInput()
+        {
+            lzma_end(&xz_stream_);
+            close(fd_);
+        }
+
+    protected:
+        virtual std::size_t read_some(uint8_t* buf, std::size_t len)
+        {
+            xz_stream_.next_out = buf;
+            xz_stream_.avail_out = len;
+
+            while ( !finished_ && xz_stream_.avail_out == len )
+            {
+                lzma_action action = LZMA_RUN;
+
+                if ( xz_stream_.avail_in == 0 )
+                {
+                    ssize_t got = read_fd(fd_, in_.data(), in_.size());
+                    if ( got < 0 )
+                        throw pcap_reader_error(std::string("Read failed: ") + std::strerror(errno));
+                    xz_stream_.next_in = in_.data();
+                    xz_stream_.avail_in = got;
+                    if ( got == 0 )
+                        action = LZMA_FINISH;
+                }
+
+                lzma_ret ret = lzma_code(&xz_stream_, action);
+                if ( ret == LZMA_STREAM_END )
+                    finished_ = true;
+                else if ( ret != LZMA_OK )
+                    throw XzException(ret);
+            }
+
+            return len - xz_stream_.avail_out;
+        }
+
+    private:
+        int fd_;
+        std::vector<uint8_t> in_;
+        lzma_stream xz_stream_;
+        bool finished_;
+    };
+
+    /**
+     * \class GzipInput
+     * \brief Input decompressed from gzip.
+     */
+    class GzipInput : public BufferedInput
+    {
+    public:
+        explicit GzipInput(const std::string& fname)
+        {
+            gzin_.push(boost::iostreams::gzip_decompressor());
+            gzin_.push(boost::iostreams::file_source(fname, std::ios_base::binary));
+        }
+
+    protected:
+        virtual std::size_t read_some(uint8_t* buf, std::size_t len)
+        {
+            try
+            {
+                gzin_.read(reinterpret_cast<char*>(buf), len);
+            }
+            catch (const boost::iostreams::gzip_error& err)
+            {
+                throw pcap_reader_error(std::string("Bad gzip data: ") + err.what());
+            }
+            return gzin_.gcount();
+        }
+
+    private:
+        boost::iostreams::filtering_istream gzin_;
+    };
+}
+
+PcapReader::PcapReader(const std::string& fname)
+    : fname_(fname), pcapng_(false), swapped_(false), nanosecond_(false),
+      linktype_(0)
+{
+    if ( fname == "-" )
+        input_.reset(new FdInput(STDIN_FILENO, false));
+    else
+    {
+        int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+        if ( fd == -1 )
+            throw pcap_reader_error(fname + ": " + std::strerror(errno));
+
+        try
+        {
+            // Recognise compressed files by their content. Inputs
+            // reading from the file descriptor take ownership of it.
+            uint8_t magic[sizeof(XZ_MAGIC)] = {};
+            ssize_t got = pread(fd, magic, sizeof(magic), 0);
+            struct stat st;
+
+            if ( got == sizeof(XZ_MAGIC) &&
+                 std::memcmp(magic, XZ_MAGIC, sizeof(XZ_MAGIC)) == 0 )
+            {
+                input_.reset(new XzInput(fd));
+                fd = -1;
+            }
+            else if ( got >= static_cast<ssize_t>(sizeof(GZIP_MAGIC)) &&
+                      std::memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC)) == 0 )
+                input_.reset(new GzipInput(fname));
+            else if ( fstat(fd, &st) == 0 && S_ISREG(st.st_mode) )
+                input_.reset(new MappedInput(fd, st.st_size));
+            else
+            {
+                input_.reset(new FdInput(fd, true));
+                fd = -1;
+            }
+        }
+        catch (const std::exception& err)
+        {
+            if ( fd != -1 )
+                close(fd);
+            throw pcap_reader_error(fname + ": " + err.what());
+        }
+
+        if ( fd != -1 )
+            close(fd);
+    }
+
+    const uint8_t* p = input_->read(4);
+    if ( !p )
+        bad_file("not a capture file");
+
+    switch (host32(p))
+    {
+    case PCAPNG_SECTION_HEADER:
+        pcapng_ = true;
+        read_section_header();
+        return;
+
+    case PCAP_MAGIC:
+        break;
+
+    case PCAP_MAGIC_SWAPPED:
+        swapped_ = true;
+        break;
+
+    case PCAP_NSEC_MAGIC:
+        nanosecond_ = true;
+        break;
+
+    case PCAP_NSEC_MAGIC_SWAPPED:
+        swapped_ = true;
+        nanosecond_ = true;
+        break;
+
+    default:
+        bad_file("not a capture file");
+    }
+
+    // Rest of the classic file header: version, time zone, sigfigs,
+    // snap length, link type.
+    p = input_->read(20);
+    if ( !p )
+        bad_file("truncated file header");
+    linktype_ = linktype_to_dlt(get32(p + 16));
+}
+
+PcapReader::~PcapReader()
+{
+}
+
+bool PcapReader::next(PcapRecord& rec)
+{
+    return pcapng_ ? next_pcapng(rec) : next_pcap(rec);
+}
+
+bool PcapReader::next_pcap(PcapRecord& rec)
+{
+    const uint8_t* p = input_->read(16);
+    if ( !p )
+    {
+        if ( input_->at_end() )
+            return false;
+        bad_file("truncated packet header");
+    }
+
+    uint32_t sec = get32(p);
+    uint32_t frac = get32(p + 4);
+    uint32_t caplen = get32(p + 8);
+    uint32_t len = get32(p + 12);
+
+    if ( caplen > MAX_PACKET_LEN )
+        bad_file("packet length " + std::to_string(caplen) + " too large");
+
+    rec.data = input_->read(caplen);
+    if ( !rec.data )
+        bad_file("truncated packet");
+
+    rec.linktype = linktype_;
+    rec.hdr.ts.tv_sec = sec;
+    rec.hdr.ts.tv_usec = nanosecond_ ? frac / 1000 : frac;
+    rec.hdr.caplen = caplen;
+    rec.hdr.len = len;
+    return true;
+}
+
+bool PcapReader::next_pcapng(PcapRecord& rec)
+{
+    for (;;)
+    {
+        const uint8_t* p = input_->read(4);
+        if ( !p )
+        {
+            if ( input_->at_end() )
+                return false;
+            bad_file("truncated block header");
+        }
+
+        uint32_t type = get32(p);
+        if ( type == PCAPNG_SECTION_HEADER )
+        {
+            read_section_header();
+            continue;
+        }
+
+        p = input_->read(4);
+        if ( !p )
+            bad_file("truncated block header");
+        uint32_t block_len = get32(p);
+        if ( block_len < 12 || block_len % 4 != 0 || block_len > MAX_BLOCK_LEN )
+            bad_file("bad block length " + std::to_string(block_len));
+
+        // Body, followed by the repeated block length.
+        std::size_t len = block_len - 12;
+        const uint8_t* body = input_->read(len + 4);
+        if ( !body )
+            bad_file("truncated block");
+
+        switch (type)
+        {
+        case PCAPNG_INTERFACE_DESCRIPTION:
+            read_interface_description(body, len);
+            break;
+
+        case PCAPNG_ENHANCED_PACKET:
+        case PCAPNG_PACKET:
+            {
+                if ( len < 20 )
+                    bad_file("truncated packet block");
+
+                std::size_t iface = ( type == PCAPNG_ENHANCED_PACKET )
+                    ? get32(body) : get16(body);
+                uint32_t caplen = get32(body + 12);
+                if ( iface >= interfaces_.size() )
+                    bad_file("packet for unknown interface");
+                if ( caplen > len - 20 )
+                    bad_file("packet length " + std::to_string(caplen) + " too large");
+
+                set_pcapng_timestamp(rec, iface, get32(body + 4), get32(body + 8));
+                rec.linktype = interfaces_[iface].linktype;
+                rec.hdr.caplen = caplen;
+                rec.hdr.len = get32(body + 16);
+                rec.data = body + 20;
+                return true;
+            }
+
+        case PCAPNG_SIMPLE_PACKET:
+            {
+                if ( len < 4 )
+                    bad_file("truncated packet block");
+                if ( interfaces_.empty() )
+                    bad_file("packet for unknown interface");
+
+                uint32_t origlen = get32(body);
+                uint32_t caplen = std::min<uint32_t>(origlen, len - 4);
+                if ( interfaces_[0].snaplen > 0 )
+                    caplen = std::min(caplen, interfaces_[0].snaplen);
+
+                rec.linktype = interfaces_[0].linktype;
+                rec.hdr.ts.tv_sec = 0;
+                rec.hdr.ts.tv_usec = 0;
+                rec.hdr.caplen = caplen;
+                rec.hdr.len = origlen;
+                rec.data = body + 4;
+                return true;
+            }
+
+        default:
+            // Skip blocks we don't use.
+            break;
+        }
+    }
+}
+
+void PcapReader::read_section_header()
+{
+    // Block length, byte order magic, version, section length.
+    const uint8_t* p = input_->read(20);
+    if ( !p )
+        bad_file("truncated section header");
+
+    switch (host32(p + 4))
+    {
+    case PCAPNG_BYTE_ORDER_MAGIC:
+        swapped_ = false;
+        break;
+
+    case PCAPNG_BYTE_ORDER_MAGIC_SWAPPED:
+        swapped_ = true;
+        break;
+
+    default:
+        bad_file("bad section header byte order");
+    }
+
+    uint32_t block_len = get32(p);
+    if ( block_len < 28 || block_len % 4 != 0 || block_len > MAX_BLOCK_LEN )
+        bad_file("bad block length " + std::to_string(block_len));
+
+    // Skip options and the repeated block length.
+    if ( !input_->read(block_len - 24) )
+        bad_file("truncated section header");
+
+    interfaces_.clear();
+}
+
+void PcapReader::read_interface_description(const uint8_t* body, std::size_t len)
+{
+    if ( len < 8 )
+        bad_file("truncated interface description");
+
+    Interface iface;
+    iface.linktype = linktype_to_dlt(get16(body));
+    iface.snaplen = get32(body + 4);
+    iface.units = 1000000;
+    iface.offset = 0;
+
+    std::size_t pos = 8;
+    while ( pos + 4 <= len )
+    {
+        uint16_t code = get16(body + pos);
+        uint16_t opt_len = get16(body + pos + 2);
+        pos += 4;
+        if ( code == PCAPNG_OPT_END || pos + opt_len > len )
+            break;
+
+        if ( code == PCAPNG_OPT_IF_TSRESOL && opt_len == 1 )
+        {
+            uint8_t resol = body[pos];
+            unsigned exp = resol & 0x7f;
+            if ( resol & 0x80 )
+                iface.units = ( exp < 64 ) ? ( 1ULL << exp ) : 0;
+            else
+            {
+                iface.units = 1;
+                for ( unsigned i = 0; i < exp && iface.units != 0; ++i )
+                    iface.units = ( iface.units > UINT64_MAX / 10 ) ? 0 : iface.units * 10;
+            }
+            if ( iface.units == 0 )
+                bad_file("unsupported timestamp resolution");
+        }
+        else if ( code == PCAPNG_OPT_IF_TSOFFSET && opt_len == 8 )
+        {
+            uint64_t v;
+            std::memcpy(&v, body + pos, sizeof(v));
+            iface.offset = static_cast<int64_t>(swapped_ ? __builtin_bswap64(v) : v);
+        }
+
+        pos += ( opt_len + 3 ) & ~3u;
+    }
+
+    interfaces_.push_back(iface);
+}
+
+void PcapReader::set_pcapng_timestamp(PcapRecord& rec, std::size_t iface,
+                                      uint32_t hi, uint32_t lo) const
+{
+    const Interface& i = interfaces_[iface];
+    uint64_t ts = ( static_cast<uint64_t>(hi) << 32 ) | lo;
+    uint64_t frac = ts % i.units;
+    uint64_t usec;
+
+    if ( i.units == 1000000 )
+        usec = frac;
+    else if ( i.units > 1000000 && i.units % 1000000 == 0 )
+        usec = frac / ( i.units / 1000000 );
+    else
+        usec = static_cast<uint64_t>(static_cast<double>(frac) * 1000000 / i.units);
+
+    rec.hdr.ts.tv_sec = static_cast<time_t>(ts / i.units + i.offset);
+    rec.hdr.ts.tv_usec = usec;
+}
+
+uint16_t PcapReader::get16(const uint8_t* p) const
+{
+    uint16_t res;
+    std::memcpy(&res, p, sizeof(res));
+    return swapped_ ? __builtin_bswap16(res) : res;
+}
+
+uint32_t PcapReader::get32(const uint8_t* p) const
+{
+    uint32_t res = host32(p);
+    return swapped_ ? __builtin_bswap32(res) : res;
+}
+
+void PcapReader::bad_file(const std::string& msg) const
+{
+    throw pcap_reader_error(fname_ + ": " + msg);
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef PCAPREADER_HPP
+#define PCAPREADER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <pcap/pcap.h>
+
+/**
+ * \exception pcap_reader_error
+ * \brief Signals an error reading a capture file.
+ */
+class pcap_reader_error : public std::runtime_error
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param what message detailing the problem.
+     */
+    explicit pcap_reader_error(const std::string& what)
+        : std::runtime_error(what) {}
+};
+
+/**
+ * \struct PcapRecord
+ * \brief A packet read from a capture file.
+ */
+struct PcapRecord
+{
+    /**
+     * \brief the packet link type, as a PCAP `DLT_` value.
+     */
+    int linktype;
+
+    /**
+     * \brief the packet header.
+     */
+    struct pcap_pkthdr hdr;
+
+    /**
+     * \brief the packet data.
+     *
+     * This is only valid until the next packet is read.
+     */
+    const uint8_t* data;
+};
+
+/**
+ * \class PcapReader
+ * \brief Read packets from a PCAP or pcapng capture file.
+ *
+ * Uncompressed files are mapped into memory, and packet data is
+ * returned in place. Files compressed with xz or gzip, which are
+ * recognised by their content rather than their name, are
+ * decompressed in large chunks into a buffer. Packets are read
+ * on the calling thread.
+ *
+ * The filename `-` reads uncompressed data from standard input.
+ */
+class PcapReader
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param fname the capture file name.
+     * \throws pcap_reader_error if the file can't be read, or is not a capture file.
+     */
+    explicit PcapReader(const std::string& fname);
+
+    /**
+     * \brief Destructor.
+     */
+    ~PcapReader();
+
+    /**
+     * \brief Read the next packet.
+     *
+     * \param rec the record to receive the packet.
+     * \returns `false` at the end of the file.
+     * \throws pcap_reader_error if the file is truncated or corrupt.
+     */
+    bool next(PcapRecord& rec);
+
+    /**
+     * \class Input
+     * \brief Source of capture file bytes.
+     */
+    class Input;
+
+private:
+    /**
+     * \brief Read the next packet from a classic PCAP file.
+     *
+     * \param rec the record to receive the packet.
+     * \returns `false` at the end of the file.
+     */
+    bool next_pcap(PcapRecord& rec);
+
+    /**
+     * \brief Read the next packet from a pcapng file.
+     *
+     * \param rec the record to receive the packet.
+     * \returns `false` at the end of the file.
+     */
+    bool next_pcapng(PcapRecord& rec);
+
+    /**
+     * \brief Read a pcapng section header block.
+     *
+     * The block type has already been read.
+     */
+    void read_section_header();
+
+    /**
+     * \brief Read a pcapng interface description block body.
+     *
+     * \param body the block body.
+     * \param len  the block body length.
+     */
+    void read_interface_description(const uint8_t* body, std::size_t len);
+
+    /**
+     * \brief Set the timestamp of a pcapng packet.
+     *
+     * \param rec   the record.
+     * \param iface the interface index.
+     * \param hi    the high 32 bits of the timestamp.
+     * \param lo    the low 32 bits of the timestamp.
+     */
+    void set_pcapng_timestamp(PcapRecord& rec, std::size_t iface,
+                              uint32_t hi, uint32_t lo) const;
+
+    /**
+     * \brief Return a 16 bit value in file byte order.
+     *
+     * \param p pointer to the value.
+     * \returns the value.
+     */
+    uint16_t get16(const uint8_t* p) const;
+
+    /**
+     * \brief Return a 32 bit value in file byte order.
+     *
+     * \param p pointer to the value.
+     * \returns the value.
+     */
+    uint32_t get32(const uint8_t* p) const;
+
+    /**
+     * \brief Signal a bad capture file.
+     *
+     * \param msg the problem.
+     * \throws pcap_reader_error always.
+     */
+    [[noreturn]] void bad_file(const std::string& msg) const;
+
+    /**
+     * \struct Interface
+     * \brief A pcapng capture interface.
+     */
+    struct Interface
+    {
+        /**
+         * \brief the link type, as a PCAP `DLT_` value.
+         */
+        int linktype;
+
+        /**
+         * \brief the snap length, or 0 if unlimited.
+         */
+        uint32_t snaplen;
+
+        /**
+         * \brief timestamp units per second.
+         */
+        uint64_t units;
+
+        /**
+         * \brief offset to add to timestamps, in seconds.
+         */
+        int64_t offset;
+    };
+
+    /**
+     * \brief the capture file name.
+     */
+    std::string fname_;
+
+    /**
+     * \brief the file input.
+     */
+    std::unique_ptr<Input> input_;
+
+    /**
+     * \brief `true` if the file is pcapng.
+     */
+    bool pcapng_;
+
+    /**
+     * \brief `true` if the file byte order is not the host byte order.
+     */
+    bool swapped_;
+
+    /**
+     * \brief `true` if classic PCAP timestamps are in nanoseconds.
+     */
+    bool nanosecond_;
+
+    /**
+     * \brief the classic PCAP link type.
+     */
+    int linktype_;
+
+    /**
+     * \brief the interfaces in the current pcapng section.
+     */
+    std::vector<Interface> interfaces_;
+};
+
+#endif
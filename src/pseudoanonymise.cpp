@@ -11,7 +11,9 @@
  */
 
 #include <cstring>
+#include <memory>
 #include <stdexcept>
+#include <utility>
 
 #include "config.h"
 
@@ -34,7 +36,13 @@ PseudoAnonymise::PseudoAnonymise(const char* str, const char* salt)
 {
 }
 
+namespace {
+    const std::size_t AES_BLOCK_LEN = 16;
+}
+
 PseudoAnonymise::PseudoAnonymise(const byte_string& key)
+    : key_(key), cache_max_items_(DEFAULT_CACHE_SIZE),
+      cache_hits_(0), cache_misses_(0)
 {
     if ( key.size() != 16 )
         throw std::logic_error("Keys must be 16 bytes long");
@@ -42,22 +50,123 @@ PseudoAnonymise::PseudoAnonymise(const byte_string& key)
         throw std::range_error("Key setup error");
 }
 
-IPAddress PseudoAnonymise::address(const IPAddress& addr) const
+void PseudoAnonymise::make_block(const IPAddress& addr, uint8_t* block)
 {
-    byte_string addr_in;
-    byte_string addr_out(16,'\0');
+    byte_string bin = addr.asNetworkBinary();
 
     if ( addr.is_ipv6() )
-        addr_in = addr.asNetworkBinary();
+        std::memcpy(block, bin.data(), AES_BLOCK_LEN);
     else
+        for ( std::size_t i = 0; i < AES_BLOCK_LEN; i += 4 )
+            std::memcpy(block + i, bin.data(), 4);
+}
+
+IPAddress PseudoAnonymise::from_block(const IPAddress& addr, const uint8_t* block)
+{
+    return IPAddress(byte_string(block, addr.is_ipv6() ? AES_BLOCK_LEN : 4));
+}
+
+void PseudoAnonymise::cache_add(const IPAddress& addr, const IPAddress& anon) const
+{
+    if ( cache_max_items_ == 0 )
+        return;
+    if ( cache_.size() >= cache_max_items_ )
+        cache_.clear();
+    cache_.emplace(addr, anon);
+}
+
+void PseudoAnonymise::set_cache_size(std::size_t max_items)
+{
+    cache_max_items_ = max_items;
+    if ( cache_.size() > cache_max_items_ )
+        cache_.clear();
+}
+
+IPAddress PseudoAnonymise::address(const IPAddress& addr) const
+{
+    auto cached = cache_.find(addr);
+    if ( cached != cache_.end() )
+    {
+        ++cache_hits_;
+        return cached->second;
+    }
+    ++cache_misses_;
+
+    uint8_t addr_in[AES_BLOCK_LEN];
+    uint8_t addr_out[AES_BLOCK_LEN];
+
+    make_block(addr, addr_in);
+    AES_encrypt(addr_in, addr_out, &aes_key);
+
+    IPAddress res = from_block(addr, addr_out);
+    cache_add(addr, res);
+    return res;
+}
+
+void PseudoAnonymise::addresses(std::vector<IPAddress>& addrs) const
+{
+    // Satisfy what we can from the cache, and note the distinct
+    // addresses that need encrypting.
+    std::unordered_map<IPAddress, std::size_t, boost::hash<IPAddress>> pending;
+    std::vector<IPAddress> to_encrypt;
+    std::vector<std::pair<std::size_t, std::size_t>> fill;
+
+    for ( std::size_t i = 0; i < addrs.size(); ++i )
     {
-        byte_string addr4 = addr.asNetworkBinary();
-        addr_in = addr4 + addr4 + addr4 + addr4;
+        auto cached = cache_.find(addrs[i]);
+        if ( cached != cache_.end() )
+        {
+            ++cache_hits_;
+            addrs[i] = cached->second;
+            continue;
+        }
+
+        auto p = pending.find(addrs[i]);
+        if ( p == pending.end() )
+        {
+            ++cache_misses_;
+            pending.emplace(addrs[i], to_encrypt.size());
+            fill.emplace_back(i, to_encrypt.size());
+            to_encrypt.push_back(addrs[i]);
+        }
+        else
+        {
+            ++cache_hits_;
+            fill.emplace_back(i, p->second);
+        }
     }
 
-    AES_encrypt(addr_in.data(), &addr_out.front(), &aes_key);
+    if ( to_encrypt.empty() )
+        return;
+
+    // ECB over the concatenated blocks is the same as encrypting
+    // each block individually.
+    std::vector<uint8_t> in(to_encrypt.size() * AES_BLOCK_LEN);
+    std::vector<uint8_t> out(in.size() + AES_BLOCK_LEN);
+    for ( std::size_t i = 0; i < to_encrypt.size(); ++i )
+        make_block(to_encrypt[i], &in[i * AES_BLOCK_LEN]);
+
+    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>
+        ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    int out_len;
+    if ( !ctx ||
+         EVP_EncryptInit_ex(ctx.get(), EVP_aes_128_ecb(), nullptr, key_.data(), nullptr) != 1 ||
+         EVP_CIPHER_CTX_set_padding(ctx.get(), 0) != 1 ||
+         EVP_EncryptUpdate(ctx.get(), out.data(), &out_len, in.data(), in.size()) != 1 ||
+         static_cast<std::size_t>(out_len) != in.size() )
+        throw std::runtime_error("Batch address encryption error");
+
+    std::vector<IPAddress> results;
+    results.reserve(to_encrypt.size());
+    for ( std::size_t i = 0; i < to_encrypt.size(); ++i )
+    {
+        results.push_back(from_block(to_encrypt[i], &out[i * AES_BLOCK_LEN]));
+        cache_add(to_encrypt[i], results.back());
+    }
 
-    return IPAddress(addr.is_ipv6() ? addr_out : addr_out.substr(0, 4));
+    // Now fill in the addresses that weren't in the cache.
+    for ( const auto& f : fill )
+        addrs[f.first] = results[f.second];
 }
 
 CaptureDNS::EDNS0 PseudoAnonymise::edns0(const CaptureDNS::EDNS0& edns0) const
@@ -13,12 +13,18 @@
 #ifndef PSEUDOANONYMISE_HPP
 #define PSEUDOANONYMISE_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "config.h"
 
 #if ENABLE_PSEUDOANONYMISATION
 
+#include <boost/functional/hash.hpp>
+
 #include <openssl/aes.h>
 
 #include "bytestring.hpp"
@@ -42,10 +48,19 @@
  * mechanism. Instead, a buffer containing 4 concatenated copies of the
  * the IPv4 address is run through AES-128 and the most significant 4
  * bytes of the result used as the pseudo-anonymised IPv4 address.
+ *
+ * Client address sets are typically highly repetitive, so results
+ * are kept in a bounded cache. When the cache reaches its maximum
+ * size it is emptied and refilled.
  */
 class PseudoAnonymise
 {
 public:
+    /**
+     * \brief Default maximum number of cached addresses.
+     */
+    static const std::size_t DEFAULT_CACHE_SIZE = 65536;
+
     /**
      * \brief Constructor
      *
@@ -76,6 +91,19 @@ public:
      */
     IPAddress address(const IPAddress& addr) const;
 
+    /**
+     * \brief Pseudo-anonymise a collection of addresses in place.
+     *
+     * Addresses not found in the cache are encrypted together in
+     * a single batch, allowing the AES implementation to pipeline
+     * the blocks. The results are identical to calling `address()`
+     * on each address.
+     *
+     * \param addrs the addresses to pseudo-anonymise.
+     * \throws std::runtime_error on an encryption error.
+     */
+    void addresses(std::vector<IPAddress>& addrs) const;
+
     /**
      * \brief Pseudo-anonymise EDNS0.
      *
@@ -92,8 +120,99 @@ public:
      */
     static byte_string generate_key(const char *str, const char *salt);
 
+    /**
+     * \brief Set the maximum number of addresses to cache.
+     *
+     * A size of 0 disables caching.
+     *
+     * \param max_items the maximum number of cached addresses.
+     */
+    void set_cache_size(std::size_t max_items);
+
+    /**
+     * \brief Return the number of address lookups satisfied by the cache.
+     */
+    uint64_t cache_hits() const
+    {
+        return cache_hits_;
+    }
+
+    /**
+     * \brief Return the number of address lookups requiring encryption.
+     */
+    uint64_t cache_misses() const
+    {
+        return cache_misses_;
+    }
+
+    /**
+     * \brief Return the proportion of address lookups satisfied by the cache.
+     *
+     * \returns the cache hit rate, between 0 and 1.
+     */
+    double cache_hit_rate() const
+    {
+        uint64_t total = cache_hits_ + cache_misses_;
+        return ( total > 0 ) ? static_cast<double>(cache_hits_) / total : 0.0;
+    }
+
 private:
+    /**
+     * \brief Build the AES input block for an address.
+     *
+     * \param addr  the address.
+     * \param block 16 byte buffer to receive the block.
+     */
+    static void make_block(const IPAddress& addr, uint8_t* block);
+
+    /**
+     * \brief Build the pseudo-anonymised address from the AES output.
+     *
+     * \param addr  the original address.
+     * \param block the 16 byte AES output block.
+     * \returns the pseudo-anonymised address.
+     */
+    static IPAddress from_block(const IPAddress& addr, const uint8_t* block);
+
+    /**
+     * \brief Add an address to the cache.
+     *
+     * If the cache is full, it is emptied first.
+     *
+     * \param addr the original address.
+     * \param anon the pseudo-anonymised address.
+     */
+    void cache_add(const IPAddress& addr, const IPAddress& anon) const;
+
+    /**
+     * \brief the expanded AES key.
+     */
     AES_KEY aes_key;
+
+    /**
+     * \brief the raw key, for batch encryption.
+     */
+    byte_string key_;
+
+    /**
+     * \brief cache of previously pseudo-anonymised addresses.
+     */
+    mutable std::unordered_map<IPAddress, IPAddress, boost::hash<IPAddress>> cache_;
+
+    /**
+     * \brief maximum number of cached addresses.
+     */
+    std::size_t cache_max_items_;
+
+    /**
+     * \brief number of lookups satisfied by the cache.
+     */
+    mutable uint64_t cache_hits_;
+
+    /**
+     * \brief number of lookups requiring encryption.
+     */
+    mutable uint64_t cache_misses_;
 };
 
 #else
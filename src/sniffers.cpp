@@ -10,18 +10,38 @@
  * Developed by Sinodun IT (www.sinodun.com)
  */
 
+#include "config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
 #include <errno.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#ifdef HAVE_LINUX_IF_PACKET_H
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#endif
 
 #include <tins/loopback.h>
 #include <tins/pktap.h>
 
 #include "log.hpp"
+#include "threadplacement.hpp"
 
 #include "sniffers.hpp"
 
 SniffersConfiguration::SniffersConfiguration()
     : flags_(0), snap_len_(65535), promisc_(false),
-      timeout_(1000), chan_max_size_(1000)
+      timeout_(1000), chan_max_size_(1000), batch_size_(1),
+      batch_timeout_(0), fanout_(1), idle_wakeup_(false)
 {
 }
 
@@ -44,6 +64,27 @@ void SniffersConfiguration::apply_promisc_mode(pcap_t* handle) const
             throw Tins::pcap_error(pcap_geterr(handle));
 }
 
+bool SniffersConfiguration::compile_offline_filter(int linktype, bpf_program& prog) const
+{
+    if ( !( flags_ & PACKET_FILTER ) )
+        return false;
+
+    pcap_t* handle = pcap_open_dead(linktype, snap_len_);
+    if ( !handle )
+        throw Tins::pcap_error("Can't compile filter");
+
+    int res = pcap_compile(handle, &prog, filter_.c_str(), 0, PCAP_NETMASK_UNKNOWN);
+    if ( res != 0 )
+    {
+        std::string err = pcap_geterr(handle);
+        pcap_close(handle);
+        throw Tins::invalid_pcap_filter(err.c_str());
+    }
+
+    pcap_close(handle);
+    return true;
+}
+
 void SniffersConfiguration::apply_filter(pcap_t* handle, bpf_u_int32 netmask) const
 {
     if ( flags_ & PACKET_FILTER )
@@ -63,6 +104,10 @@ void SniffersConfiguration::apply_filter(pcap_t* handle, bpf_u_int32 netmask) co
 namespace {
     const Tins::Packet::own_pdu DONT_COPY_PDU = {};
 
+#ifdef HAVE_SYS_EPOLL_H
+    const int MAX_WAIT_EVENTS = 64;
+#endif
+
     template<typename T>
     Tins::Packet make_generic_packet(const struct pcap_pkthdr* hdr,
                                         const u_char* data)
@@ -79,11 +124,11 @@ namespace {
             return Tins::Packet(new Tins::EthernetII(reinterpret_cast<const uint8_t*>(data), hdr->caplen), hdr->ts, DONT_COPY_PDU);
     }
 
-    Tins::Packet make_packet(pcap_t* handle,
+    Tins::Packet make_packet(int linktype,
                              const struct pcap_pkthdr* hdr,
                              const u_char* data)
     {
-        switch(pcap_datalink(handle))
+        switch(linktype)
         {
         case DLT_EN10MB:
             return make_eth_packet(hdr, data);
@@ -120,18 +165,63 @@ namespace {
             throw Tins::unknown_link_type();
         }
     }
+
+    /**
+     * \brief the number of fanout group IDs allocated.
+     *
+     * Sniffers opened while others are still capturing, as on a
+     * configuration reload, must not join the existing groups.
+     */
+    std::atomic<unsigned> fanout_groups_used(0);
+
+    /**
+     * \brief Join a capture socket to a flow hash fanout group.
+     *
+     * \param handle the PCAP handle of the socket.
+     * \param group  the fanout group ID.
+     */
+    void join_fanout_group(pcap_t* handle, uint16_t group)
+    {
+#if defined(HAVE_LINUX_IF_PACKET_H) && defined(PACKET_FANOUT)
+        // Defragment before hashing, so all fragments of a datagram
+        // go to the same socket.
+        int arg = group | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if ( setsockopt(pcap_fileno(handle), SOL_PACKET, PACKET_FANOUT,
+                        &arg, sizeof(arg)) == -1 )
+            throw Tins::pcap_error(std::string("Can't join capture fanout group: ") + std::strerror(errno));
+#else
+        (void) handle;
+        (void) group;
+        throw Tins::pcap_error("Capture fanout is not supported on this platform");
+#endif
+    }
 }
 
-BaseSniffers::BaseSniffers(unsigned chan_max_size)
-    : max_fd_(0), select_timeout_(1000), packets_(chan_max_size)
+BaseSniffers::BaseSniffers(unsigned chan_max_size,
+                           unsigned batch_size,
+                           unsigned batch_timeout,
+                           bool idle_wakeup,
+                           const std::vector<unsigned>& cpus)
+    : running_readers_(0), wakeup_(false), idle_wakeup_(idle_wakeup),
+      draining_(false), cpus_(cpus),
+      wait_timeout_(1000),
+      batch_size_(std::max(batch_size, 1u)),
+      batch_timeout_(batch_timeout),
+      batches_(std::max(chan_max_size / batch_size_, 1u)),
+      reading_pos_(0), batch_count_(0), eof_(false)
 {
-    FD_ZERO(&fdset_);
 }
 
 BaseSniffers::~BaseSniffers()
 {
     breakloop();
-    t_.join();
+    for ( auto& r : readers_ )
+    {
+        if ( r->t.joinable() )
+            r->t.join();
+        if ( r->epoll_fd != -1 )
+            close(r->epoll_fd);
+    }
 
     for ( auto h : handles_ )
         pcap_close(h);
@@ -139,26 +229,73 @@ BaseSniffers::~BaseSniffers()
 
 Tins::Packet BaseSniffers::next_packet()
 {
-    Tins::Packet p;
+    if ( !reading_ || reading_pos_ >= reading_->size() )
+    {
+        if ( reading_ )
+        {
+            reading_->clear();
+            std::lock_guard<std::mutex> lock(free_m_);
+            free_batches_.push_back(std::move(reading_));
+        }
+
+        reading_pos_ = 0;
+        if ( !batches_.get(reading_) )
+        {
+            reading_.reset();
+            eof_ = true;
+            return Tins::Packet();
+        }
+
+        // An empty batch is a wakeup.
+        if ( reading_->empty() )
+            return Tins::Packet();
+        ++batch_count_;
+    }
+
+    return std::move((*reading_)[reading_pos_++]);
+}
+
+uint64_t BaseSniffers::syscall_count() const
+{
+    uint64_t res = 0;
+    for ( const auto& r : readers_ )
+        res += r->syscall_count.load(std::memory_order_relaxed);
+    return res;
+}
+
+void BaseSniffers::flush_batch(Reader& reader)
+{
+    if ( reader.filling && !reader.filling->empty() )
+        batches_.put(std::move(reader.filling));
+}
+
+std::unique_ptr<PacketBatch> BaseSniffers::get_free_batch()
+{
+    std::unique_lock<std::mutex> lock(free_m_);
+    if ( !free_batches_.empty() )
+    {
+        std::unique_ptr<PacketBatch> res = std::move(free_batches_.back());
+        free_batches_.pop_back();
+        return res;
+    }
+    lock.unlock();
 
-    if ( packets_.get(p) )
-        return p;
-    else
-        return Tins::Packet();
+    std::unique_ptr<PacketBatch> res(new PacketBatch);
+    res->reserve(batch_size_);
+    return res;
 }
 
 bool BaseSniffers::stats(struct pcap_stat& stats)
 {
     bool res = true;
-    std::unique_lock<std::mutex> lock(m_);
 
     stats = { 0, 0, 0 };
 
-    for ( auto h : handles_ )
+    for ( std::size_t i = 0; i < handles_.size(); ++i )
     {
         struct pcap_stat istat;
 
-        if ( pcap_stats(h, &istat) == 0 )
+        if ( source_stats(i, istat) )
         {
             stats.ps_recv += istat.ps_recv;
             stats.ps_drop += istat.ps_drop;
@@ -171,141 +308,302 @@ bool BaseSniffers::stats(struct pcap_stat& stats)
     return res;
 }
 
+bool BaseSniffers::source_stats(std::size_t idx, struct pcap_stat& stats)
+{
+    std::lock_guard<std::mutex> lock(source_readers_[idx]->m);
+    return pcap_stats(handles_[idx], &stats) == 0;
+}
+
 void BaseSniffers::breakloop()
 {
-    std::unique_lock<std::mutex> lock(m_);
-    for ( auto h : handles_ )
-        pcap_breakloop(h);
+    for ( auto& r : readers_ )
+    {
+        std::lock_guard<std::mutex> lock(r->m);
+        for ( auto i : r->sources )
+            pcap_breakloop(handles_[i]);
+    }
 }
 
-void BaseSniffers::add_handle(pcap_t* handle)
+void BaseSniffers::drain()
+{
+    draining_ = true;
+}
+
+void BaseSniffers::add_handle(pcap_t* handle, const std::string& name,
+                              bool new_reader)
 {
     int fd = pcap_get_selectable_fd(handle);
     if ( fd < 0 )
         throw Tins::unsupported_function();
 
-    handles_.push_back(handle);
+    if ( new_reader || readers_.empty() )
+        readers_.emplace_back(new Reader);
+    Reader& reader = *readers_.back();
 
-    FD_SET(fd, &fdset_);
-    if ( fd > max_fd_ )
-        max_fd_ = fd;
+#ifdef HAVE_SYS_EPOLL_H
+    if ( reader.epoll_fd == -1 )
+    {
+        reader.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if ( reader.epoll_fd == -1 )
+            throw std::runtime_error(std::string("Can't create epoll instance: ") + std::strerror(errno));
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = handles_.size();
+    if ( epoll_ctl(reader.epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1 )
+        throw std::runtime_error(std::string("Can't add capture to epoll: ") + std::strerror(errno));
+#endif
+
+    reader.sources.push_back(handles_.size());
+    handles_.push_back(handle);
+    source_names_.push_back(name);
+    fds_.push_back(fd);
+    source_readers_.push_back(&reader);
 }
 
 void BaseSniffers::notify_read_timeout(unsigned timeout)
 {
-    if ( select_timeout_ < timeout )
-        select_timeout_ = timeout;
+    if ( wait_timeout_ < timeout )
+        wait_timeout_ = timeout;
+}
+
+void BaseSniffers::dispatch_packet(u_char* user,
+                                   const struct pcap_pkthdr* hdr,
+                                   const u_char* data)
+{
+    Reader* reader = reinterpret_cast<Reader*>(user);
+
+    // Don't let exceptions escape into libpcap. Note the first,
+    // stop dispatching, and rethrow it when dispatch returns.
+    if ( reader->dispatch_error )
+        return;
+
+    if ( reader->filling->empty() )
+        reader->filling_start = std::chrono::steady_clock::now();
+
+    try
+    {
+        reader->filling->push_back(make_packet(pcap_datalink(reader->dispatching), hdr, data));
+    }
+    catch (Tins::malformed_packet&)
+    {
+        // Unlike libtins, which just ignores them, pass malformed
+        // packets - packets where transport level decode fails -
+        // back to the application as RawPDU. There they will be
+        // treated as ignored and logged if appropriate.
+        reader->filling->push_back(Tins::Packet(new Tins::RawPDU(reinterpret_cast<const uint8_t*>(data), hdr->caplen), hdr->ts, DONT_COPY_PDU));
+    }
+    catch (...)
+    {
+        reader->dispatch_error = std::current_exception();
+        pcap_breakloop(reader->dispatching);
+    }
+}
+
+int BaseSniffers::dispatch(Reader& reader, std::size_t idx)
+{
+    if ( !reader.filling )
+        reader.filling = get_free_batch();
+
+    std::unique_lock<std::mutex> lock(reader.m);
+    reader.dispatching = handles_[idx];
+    int res = pcap_dispatch(reader.dispatching,
+                            static_cast<int>(batch_size_ - reader.filling->size()),
+                            dispatch_packet,
+                            reinterpret_cast<u_char*>(&reader));
+    reader.dispatching = nullptr;
+    lock.unlock();
+
+    reader.syscall_count.fetch_add(1, std::memory_order_relaxed);
+
+    if ( reader.dispatch_error )
+    {
+        std::exception_ptr e = reader.dispatch_error;
+        reader.dispatch_error = nullptr;
+        std::rethrow_exception(e);
+    }
+
+    return res;
+}
+
+bool BaseSniffers::wait_for_input(Reader& reader, int timeout)
+{
+    reader.ready.clear();
+    reader.syscall_count.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event events[MAX_WAIT_EVENTS];
+    int n = epoll_wait(reader.epoll_fd, events, MAX_WAIT_EVENTS, timeout);
+    for ( int i = 0; i < n; ++i )
+        reader.ready.push_back(events[i].data.u64);
+#else
+    std::vector<struct pollfd> pfds;
+    for ( auto i : reader.sources )
+        pfds.push_back({ fds_[i], POLLIN, 0 });
+    int n = poll(pfds.data(), pfds.size(), timeout);
+    for ( std::size_t i = 0; n > 0 && i < pfds.size(); ++i )
+        if ( pfds[i].revents )
+            reader.ready.push_back(reader.sources[i]);
+#endif
+
+    // A timeout or interrupted system call is not a failure. If
+    // interrupted, go round so that pcap may discover a breakloop
+    // if that was the cause.
+    return n >= 0 || errno == EAGAIN || errno == EINTR;
 }
 
-void BaseSniffers::packet_read_thread()
+void BaseSniffers::packet_read_thread(Reader& reader)
 {
     bool finished = false;
 
+    // Start by trying to read from every source.
+    reader.ready = reader.sources;
+
     while ( !finished )
     {
-        bool read_one;
-
-        do
+        // Read from the ready sources until they are all drained.
+        // A source that fills the batch may have more to read, so
+        // keep it ready.
+        while ( !reader.ready.empty() && !finished )
         {
-            read_one = false;
+            reader.still_ready.clear();
 
-            for ( auto h : handles_ )
+            for ( auto idx : reader.ready )
             {
-                std::unique_lock<std::mutex> lock(m_);
-                struct pcap_pkthdr* hdr;
-                const u_char* data;
-                int res = pcap_next_ex(h, &hdr, &data);
-                lock.unlock();
+                unsigned room = batch_size_ - ( reader.filling ? reader.filling->size() : 0 );
+                int res = dispatch(reader, idx);
 
-                switch (res)
+                if ( res == -1 )
                 {
-                case 1:
-                    read_one = true;
-                    try
-                    {
-                        packets_.put(make_packet(h, hdr, data));
-                    }
-                    catch (Tins::malformed_packet&)
-                    {
-                        // Unlike libtins, which just ignores them, pass malformed
-                        // packets - packets where transport level decode fails -
-                        // back to the application as RawPDU. There they will be
-                        // treated as ignored and logged if appropriate.
-                        packets_.put(Tins::Packet(new Tins::RawPDU(reinterpret_cast<const uint8_t*>(data), hdr->caplen), hdr->ts, DONT_COPY_PDU));
-                    }
-                    break;
-
-                case 0:
-                    break;
-
-                case -1:
                     // TODO: Find way to indicate error rather than EOF to
                     // receiving thread.
-                    LOG_ERROR << pcap_geterr(h);
+                    LOG_ERROR << pcap_geterr(handles_[idx]);
                     finished = true;
-                    break;
-
-                case -2:
+                }
+                else if ( res == -2 )
                     finished = true;
+                else if ( static_cast<unsigned>(res) >= room )
+                    reader.still_ready.push_back(idx);
+
+                if ( reader.filling->size() >= batch_size_ )
+                    flush_batch(reader);
+
+                if ( finished )
                     break;
-                }
             }
+
+            reader.ready.swap(reader.still_ready);
+
+            // Don't hold a partly filled batch longer than the timeout.
+            if ( reader.filling && !reader.filling->empty() &&
+                 std::chrono::steady_clock::now() - reader.filling_start >= batch_timeout_ )
+                flush_batch(reader);
         }
-        while ( read_one && !finished );
 
         if ( finished )
             continue;
 
-        // Nothing available for immediate read. Wait for something.
-        // Note that we may exit select with a timeout or interrupted
-        // system call and no data. If interrupted, go round so that
-        // pcap may discover a breakloop if that was the cause.
-        fd_set fd_selected = fdset_;
-        struct timeval tv;
-        tv.tv_sec = select_timeout_ / 1000;
-        tv.tv_usec = (select_timeout_ % 1000) * 1000;
-
-        switch (select(max_fd_ + 1, &fd_selected, nullptr, nullptr, &tv))
+        // Pass on a wakeup as an empty batch.
+        if ( wakeup_.exchange(false) )
         {
-        case -1:
-            switch(errno)
+            flush_batch(reader);
+            batches_.put(get_free_batch());
+        }
+
+        // When draining, make one more pass reading every source
+        // until it has nothing waiting, and then stop.
+        if ( draining_ )
+        {
+            if ( reader.drain_started )
             {
-            case EAGAIN:
-            case EINTR:
-                break;
-
-            default:
-                // TODO: Find way to indicate error rather than EOF to
-                // receiving thread.
-                LOG_ERROR << "Selecting next packet failed";
                 finished = true;
-                break;
+                continue;
             }
+            reader.drain_started = true;
+            reader.ready = reader.sources;
+            continue;
+        }
 
-        case 0:
-            // Timeout expired. Try again.
-            break;
+        // Nothing available for immediate read. Wait for something.
+        // If a batch is partly filled, wait no longer than its
+        // remaining time.
+        int timeout = wait_timeout_;
+        if ( reader.filling && !reader.filling->empty() )
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+                reader.filling_start + batch_timeout_ - std::chrono::steady_clock::now());
+            int remaining_ms = ( remaining.count() <= 0 )
+                ? 0 : static_cast<int>(( remaining.count() + 999 ) / 1000);
+            if ( remaining_ms < timeout )
+                timeout = remaining_ms;
+        }
 
-        default:
-            // Got something. Go round and read it.
-            break;
+        if ( !wait_for_input(reader, timeout) )
+        {
+            // TODO: Find way to indicate error rather than EOF to
+            // receiving thread.
+            LOG_ERROR << "Waiting for next packet failed";
+            finished = true;
+        }
+        else if ( reader.ready.empty() )
+        {
+            // Timed out or interrupted. Try reading every source,
+            // so that pcap may discover a breakloop, and so any
+            // partly filled batch is checked for timeout.
+            reader.ready = reader.sources;
+
+            // If there was nothing to wait for but input, capture is
+            // idle, so wake the receiving thread if wanted.
+            if ( idle_wakeup_ && timeout == static_cast<int>(wait_timeout_) )
+                batches_.put(get_free_batch());
         }
     }
 
-    packets_.close();
+    flush_batch(reader);
+
+    // Collection stops when any source finishes, unless draining,
+    // when each reader stops once its sources are drained. The last
+    // reader to stop signals the end of input.
+    if ( !draining_ )
+        breakloop();
+    if ( --running_readers_ == 0 )
+        batches_.close();
 }
 
 void BaseSniffers::capture_init_done()
 {
-    t_ = std::thread([=]{ packet_read_thread(); });
+    running_readers_ = readers_.size();
+    unsigned n = 0;
+    for ( auto& r : readers_ )
+    {
+        Reader* reader = r.get();
+        std::string name = "capture " + std::to_string(n++);
+        reader->t = std::thread([=]
+                                {
+                                    set_thread_name(name);
+                                    set_thread_cpus(cpus_);
+                                    packet_read_thread(*reader);
+                                });
+    }
 }
 
 NetworkSniffers::NetworkSniffers(const std::vector<std::string>& interfaces,
                                  const SniffersConfiguration& config)
-    : BaseSniffers(config.chan_max_size())
+    : BaseSniffers(config.chan_max_size(), config.batch_size(),
+                   config.batch_timeout(), config.idle_wakeup(),
+                   config.cpus())
 {
     notify_read_timeout(config.timeout_);
 
+    // Open the captures on the capture CPUs, so the kernel allocates
+    // the capture rings on the NUMA node of the capture threads.
+    ScopedThreadCpus on_capture_cpus(config.cpus());
+
+    unsigned fanout = std::max(config.fanout(), 1u);
+    uint16_t fanout_group = static_cast<uint16_t>(
+        getpid() + fanout_groups_used.fetch_add(interfaces.size()));
+
     for ( const auto& i : interfaces )
     {
         char errbuf[PCAP_ERRBUF_SIZE];
@@ -313,23 +611,31 @@ NetworkSniffers::NetworkSniffers(const std::vector<std::string>& interfaces,
         if ( pcap_lookupnet(i.c_str(), &ip, &netmask, errbuf) == -1 )
             netmask = PCAP_NETMASK_UNKNOWN;
 
-        pcap_t* handle = pcap_create(i.c_str(), errbuf);
-        if ( !handle )
-            throw Tins::pcap_error(errbuf);
+        for ( unsigned s = 0; s < fanout; ++s )
+        {
+            pcap_t* handle = pcap_create(i.c_str(), errbuf);
+            if ( !handle )
+                throw Tins::pcap_error(errbuf);
 
-        config.apply_snap_len(handle);
-        config.apply_timeout(handle);
-        config.apply_promisc_mode(handle);
+            config.apply_snap_len(handle);
+            config.apply_timeout(handle);
+            config.apply_promisc_mode(handle);
 
-        if ( pcap_activate(handle) < 0 )
-            throw Tins::pcap_error(pcap_geterr(handle));
+            if ( pcap_activate(handle) < 0 )
+                throw Tins::pcap_error(pcap_geterr(handle));
+
+            if ( pcap_setnonblock(handle, 1, errbuf) < 0 )
+                throw Tins::pcap_error(errbuf);
 
-        if ( pcap_setnonblock(handle, 1, errbuf) < 0 )
-            throw Tins::pcap_error(errbuf);
+            config.apply_filter(handle, netmask);
 
-        config.apply_filter(handle, netmask);
+            if ( fanout > 1 )
+                join_fanout_group(handle, fanout_group);
 
-        add_handle(handle);
+            add_handle(handle, i, fanout > 1);
+        }
+
+        ++fanout_group;
     }
 
     capture_init_done();
@@ -337,15 +643,64 @@ NetworkSniffers::NetworkSniffers(const std::vector<std::string>& interfaces,
 
 FileSniffer::FileSniffer(const std::string& fname,
                          const SniffersConfiguration& config)
-    : BaseSniffers(config.chan_max_size())
+    : BaseSniffers(config.chan_max_size(), config.batch_size(),
+                   config.batch_timeout()),
+      config_(config), reader_(fname), stop_(false), finished_(false)
 {
-    char errbuf[PCAP_ERRBUF_SIZE];
-    pcap_t* handle = pcap_open_offline(fname.c_str(), errbuf);
-    if ( !handle )
-        throw Tins::pcap_error(errbuf);
+}
+
+FileSniffer::~FileSniffer()
+{
+    for ( auto& f : filters_ )
+        if ( f.second.compiled )
+            pcap_freecode(&f.second.prog);
+}
 
-    config.apply_filter(handle, PCAP_NETMASK_UNKNOWN);
-    add_handle(handle);
+Tins::Packet FileSniffer::next_packet()
+{
+    PcapRecord rec;
 
-    capture_init_done();
+    try
+    {
+        while ( !stop_ && reader_.next(rec) )
+        {
+            Filter& filter = filters_[rec.linktype];
+            if ( !filter.checked )
+            {
+                filter.compiled = config_.compile_offline_filter(rec.linktype, filter.prog);
+                filter.checked = true;
+            }
+            if ( filter.compiled &&
+                 pcap_offline_filter(&filter.prog, &rec.hdr, rec.data) == 0 )
+                continue;
+
+            try
+            {
+                return make_packet(rec.linktype, &rec.hdr, rec.data);
+            }
+            catch (Tins::malformed_packet&)
+            {
+                // As for live capture, pass malformed packets back
+                // as RawPDU.
+                return Tins::Packet(new Tins::RawPDU(rec.data, rec.hdr.caplen), rec.hdr.ts, DONT_COPY_PDU);
+            }
+        }
+    }
+    catch (const pcap_reader_error& err)
+    {
+        LOG_ERROR << err.what();
+    }
+
+    finished_ = true;
+    return Tins::Packet();
+}
+
+bool FileSniffer::stats(struct pcap_stat&)
+{
+    return false;
+}
+
+void FileSniffer::breakloop()
+{
+    stop_ = true;
 }
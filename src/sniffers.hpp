@@ -13,6 +13,12 @@
 #ifndef SNIFFERS_HPP
 #define SNIFFERS_HPP
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -20,12 +26,11 @@
 
 #include <tins/tins.h>
 
-#include <sys/select.h>
-
 #include <pcap/pcap.h>
 
 #include "channel.hpp"
 #include "configuration.hpp"
+#include "pcapreader.hpp"
 
 /**
  * \class SniffersConfiguration
@@ -141,6 +146,106 @@ public:
         return chan_max_size_;
     }
 
+    /**
+     * \brief Set the packet batch size.
+     *
+     * \param batch_size the maximum number of packets in a batch.
+     */
+    void set_batch_size(unsigned batch_size)
+    {
+        batch_size_ = batch_size;
+    }
+
+    /**
+     * \brief Return the packet batch size.
+     *
+     * \returns the maximum number of packets in a batch.
+     */
+    unsigned batch_size() const
+    {
+        return batch_size_;
+    }
+
+    /**
+     * \brief Set the packet batch timeout.
+     *
+     * \param timeout the batch timeout, in microseconds.
+     */
+    void set_batch_timeout(unsigned timeout)
+    {
+        batch_timeout_ = timeout;
+    }
+
+    /**
+     * \brief Return the packet batch timeout.
+     *
+     * \returns the batch timeout, in microseconds.
+     */
+    unsigned batch_timeout() const
+    {
+        return batch_timeout_;
+    }
+
+    /**
+     * \brief Set the number of capture sockets per interface.
+     *
+     * \param fanout the number of sockets.
+     */
+    void set_fanout(unsigned fanout)
+    {
+        fanout_ = fanout;
+    }
+
+    /**
+     * \brief Return the number of capture sockets per interface.
+     *
+     * \returns the number of sockets.
+     */
+    unsigned fanout() const
+    {
+        return fanout_;
+    }
+
+    /**
+     * \brief Set whether to wake the receiving thread when capture is idle.
+     *
+     * \param idle_wakeup `true` to wake the receiving thread.
+     */
+    void set_idle_wakeup(bool idle_wakeup)
+    {
+        idle_wakeup_ = idle_wakeup;
+    }
+
+    /**
+     * \brief Return whether to wake the receiving thread when capture is idle.
+     *
+     * \returns `true` if the receiving thread is to be woken.
+     */
+    bool idle_wakeup() const
+    {
+        return idle_wakeup_;
+    }
+
+    /**
+     * \brief Set the CPUs on which to run the collection threads.
+     *
+     * \param cpus the CPUs, or empty for any CPU.
+     */
+    void set_cpus(const std::vector<unsigned>& cpus)
+    {
+        cpus_ = cpus;
+    }
+
+    /**
+     * \brief Return the CPUs on which to run the collection threads.
+     *
+     * \returns the CPUs, or empty for any CPU.
+     */
+    const std::vector<unsigned>& cpus() const
+    {
+        return cpus_;
+    }
+
 protected:
     friend class NetworkSniffers;
     friend class FileSniffer;
@@ -183,6 +288,15 @@ protected:
      */
     void apply_filter(pcap_t* handle, bpf_u_int32 netmask) const;
 
+    /**
+     * \brief Compile configured filter (if set) for offline use.
+     *
+     * \param linktype the link type of the packets to filter.
+     * \param prog     the program to receive the compiled filter.
+     * \returns `true` if a filter was compiled.
+     */
+    bool compile_offline_filter(int linktype, bpf_program& prog) const;
+
 private:
     /**
      * \brief Items present flag.
@@ -213,14 +327,56 @@ private:
      * \brief Channel maximum size.
      */
     unsigned chan_max_size_;
+
+    /**
+     * \brief Maximum packets in a batch.
+     */
+    unsigned batch_size_;
+
+    /**
+     * \brief Batch timeout, in microseconds.
+     */
+    unsigned batch_timeout_;
+
+    /**
+     * \brief Capture sockets per interface.
+     */
+    unsigned fanout_;
+
+    /**
+     * \brief Wake the receiving thread when capture is idle.
+     */
+    bool idle_wakeup_;
+
+    /**
+     * \brief CPUs for the collection threads.
+     */
+    std::vector<unsigned> cpus_;
 };
 
+/**
+ * \brief A batch of packets.
+ */
+using PacketBatch = std::vector<Tins::Packet>;
+
 /**
  * \class BaseSniffers
  * \brief Virtual base for sniffers.
  *
  * A virtual base class providing the necessary facilities for collecting
  * packets from multiple sniffers in parallel.
+ *
+ * Sources are read by one or more collection threads. Each thread
+ * waits for input on its sources with `epoll` where available,
+ * otherwise `poll`, so there is no limit on the number of sources.
+ * Each ready source is read with `pcap_dispatch()`, which adds
+ * packets directly to the batch being filled.
+ *
+ * Packets are passed from the collection threads in batches, so the
+ * channel lock is taken once per batch rather than once per packet.
+ * A batch is passed on when full, or when its first packet has
+ * waited for the batch timeout. Emptied batches are returned to a
+ * free list for reuse, so their storage is not reallocated.
  */
 class BaseSniffers
 {
@@ -228,9 +384,21 @@ public:
     /**
      * \brief The default constructor.
      *
-     * \param chan_max_size maximum size of channel delivering packets.
-     */
-    explicit BaseSniffers(unsigned chan_max_size = 1000);
+     * \param chan_max_size maximum number of packets in the channel
+     *                      delivering packets.
+     * \param batch_size    maximum number of packets in a batch.
+     * \param batch_timeout maximum time to wait for a batch to fill,
+     *                      in microseconds.
+     * \param idle_wakeup   `true` to wake the thread calling
+     *                      `next_packet()` when capture is idle.
+     * \param cpus          CPUs on which to run the collection
+     *                      threads, or empty for any CPU.
+     */
+    explicit BaseSniffers(unsigned chan_max_size = 1000,
+                          unsigned batch_size = 1,
+                          unsigned batch_timeout = 0,
+                          bool idle_wakeup = false,
+                          const std::vector<unsigned>& cpus = {});
 
     /**
      * \brief Destructor.
@@ -240,10 +408,34 @@ public:
     /**
      * \brief Get the next packet from the sniffers.
      *
+     * Packets are taken from the current batch. Only when the batch
+     * is exhausted is the channel consulted for the next batch.
+     *
      * \returns the next packet, or if EOF or collection interrupted
      * a packet with a null PDU.
      */
-    Tins::Packet next_packet();
+    virtual Tins::Packet next_packet();
+
+    /**
+     * \brief Return the number of packet batches received.
+     *
+     * Only call this from the thread calling `next_packet()`.
+     *
+     * \returns the number of batches.
+     */
+    uint64_t batch_count() const
+    {
+        return batch_count_;
+    }
+
+    /**
+     * \brief Return the number of system calls made by the collection threads.
+     *
+     * This counts the waits for input and the reads from live sources.
+     *
+     * \returns the number of system calls.
+     */
+    uint64_t syscall_count() const;
 
     /**
      * \brief Get stats on the sniffers.
@@ -251,27 +443,99 @@ public:
      * \param stats a PCAP stats structure.
      * \returns `true` if stats updated.
      */
-    bool stats(struct pcap_stat& stats);
+    virtual bool stats(struct pcap_stat& stats);
+
+    /**
+     * \brief Return the number of sources.
+     *
+     * \returns the number of sources.
+     */
+    std::size_t source_count() const
+    {
+        return handles_.size();
+    }
+
+    /**
+     * \brief Return the name of a source.
+     *
+     * \param idx the index of the source.
+     * \returns the source name.
+     */
+    const std::string& source_name(std::size_t idx) const
+    {
+        return source_names_[idx];
+    }
+
+    /**
+     * \brief Get stats on a single source.
+     *
+     * \param idx   the index of the source.
+     * \param stats a PCAP stats structure.
+     * \returns `true` if stats updated.
+     */
+    bool source_stats(std::size_t idx, struct pcap_stat& stats);
 
     /**
      * \brief Break out of the collection loop.
      *
      * This calls pcap_breakloop() on all underlying sniffers.
      */
-    void breakloop();
+    virtual void breakloop();
+
+    /**
+     * \brief Wake the thread calling `next_packet()`.
+     *
+     * Once the packets already collected have been delivered,
+     * `next_packet()` returns a packet with a null PDU, and `eof()`
+     * returns `false`. Collection continues. The collection threads
+     * notice the request when they next wake, so this may take up
+     * to the read timeout.
+     *
+     * This is safe to call from a signal handler.
+     */
+    void wakeup()
+    {
+        wakeup_ = true;
+    }
+
+    /**
+     * \brief Stop collection when the packets waiting have been read.
+     *
+     * Unlike `breakloop()`, packets received by the sources before
+     * the call are not discarded. Each source is read until it has
+     * nothing further waiting, and then collection ends.
+     */
+    void drain();
+
+    /**
+     * \brief Check whether all packets have been delivered.
+     *
+     * Only call this from the thread calling `next_packet()`.
+     *
+     * \returns `true` if `next_packet()` has reported the end of input,
+     * `false` if not or if it reported a wakeup.
+     */
+    virtual bool eof() const
+    {
+        return eof_;
+    }
 
 protected:
     /**
      * \brief Add a new PCAP handle to those being monitored.
      *
-     * \param handle handle to add.
+     * \param handle     handle to add.
+     * \param name       name of the source.
+     * \param new_reader `true` if the handle is to be read by its
+     *                   own collection thread.
      */
-    void add_handle(pcap_t* handle);
+    void add_handle(pcap_t* handle, const std::string& name,
+                    bool new_reader = false);
 
     /**
-     * \brief Update the select timeout.
+     * \brief Update the wait timeout.
      *
-     * Reduce the timeout if the read timeout is less.
+     * Increase the timeout if the read timeout is greater.
      *
      * \param timeout read timeout.
      */
@@ -280,15 +544,138 @@ protected:
     /**
      * \brief Capture initialisation done.
      *
-     * Start the packet reading thread.
+     * Start the packet reading threads.
      */
     void capture_init_done();
 
 private:
+    /**
+     * \struct Reader
+     * \brief A collection thread and the sources it reads.
+     */
+    struct Reader
+    {
+        /**
+         * \brief Constructor.
+         */
+        Reader() : epoll_fd(-1), dispatching(nullptr), drain_started(false),
+                   syscall_count(0) {}
+
+        /**
+         * \brief indexes of the sources read.
+         */
+        std::vector<std::size_t> sources;
+
+        /**
+         * \brief epoll instance waiting on the sources, or -1 if not used.
+         */
+        int epoll_fd;
+
+        /**
+         * \brief indexes of sources ready to read.
+         */
+        std::vector<std::size_t> ready;
+
+        /**
+         * \brief sources still ready after the current read pass.
+         */
+        std::vector<std::size_t> still_ready;
+
+        /**
+         * \brief the source being read by `dispatch()`.
+         */
+        pcap_t* dispatching;
+
+        /**
+         * \brief exception from the `pcap_dispatch()` callback.
+         */
+        std::exception_ptr dispatch_error;
+
+        /**
+         * \brief the batch being filled.
+         */
+        std::unique_ptr<PacketBatch> filling;
+
+        /**
+         * \brief when the first packet was added to the batch being filled.
+         */
+        std::chrono::steady_clock::time_point filling_start;
+
+        /**
+         * \brief `true` once a final read pass of all sources has started.
+         */
+        bool drain_started;
+
+        /**
+         * \brief the number of system calls made.
+         */
+        std::atomic<uint64_t> syscall_count;
+
+        /**
+         * \brief mutex guarding the PCAP handles of the sources.
+         */
+        std::mutex m;
+
+        /**
+         * \brief the collection thread.
+         */
+        std::thread t;
+    };
+
     /**
      * \brief Loop reading packets and adding to the channel.
+     *
+     * \param reader the reader.
+     */
+    void packet_read_thread(Reader& reader);
+
+    /**
+     * \brief Read packets from a source into the batch being filled.
+     *
+     * No more packets are read than the batch has room for, so the
+     * batch is never passed on while the PCAP handle lock is held.
+     *
+     * \param reader the reader.
+     * \param idx    the index of the source.
+     * \returns the `pcap_dispatch()` result.
+     */
+    int dispatch(Reader& reader, std::size_t idx);
+
+    /**
+     * \brief `pcap_dispatch()` callback adding a packet to the batch.
+     *
+     * \param user the dispatching reader.
+     * \param hdr  the packet header.
+     * \param data the packet data.
+     */
+    static void dispatch_packet(u_char* user,
+                                const struct pcap_pkthdr* hdr,
+                                const u_char* data);
+
+    /**
+     * \brief Wait until sources are ready to read, or a timeout.
+     *
+     * On return `reader.ready` holds the indexes of the ready sources.
+     *
+     * \param reader  the reader.
+     * \param timeout the maximum wait, in milliseconds.
+     * \returns `false` if the wait failed.
      */
-    void packet_read_thread();
+    bool wait_for_input(Reader& reader, int timeout);
+
+    /**
+     * \brief Pass on the batch being filled, if any.
+     *
+     * \param reader the reader.
+     */
+    void flush_batch(Reader& reader);
+
+    /**
+     * \brief Get an empty batch from the free list, or make a new one.
+     *
+     * \returns the batch.
+     */
+    std::unique_ptr<PacketBatch> get_free_batch();
 
     /**
      * \brief PCAP handles of all input sources.
@@ -296,34 +683,100 @@ private:
     std::vector<pcap_t*> handles_;
 
     /**
-     * \brief fdset for selecting on all input sources.
+     * \brief names of all input sources.
+     */
+    std::vector<std::string> source_names_;
+
+    /**
+     * \brief file descriptors of all input sources.
+     */
+    std::vector<int> fds_;
+
+    /**
+     * \brief the reader of each input source.
+     */
+    std::vector<Reader*> source_readers_;
+
+    /**
+     * \brief the collection threads.
+     */
+    std::vector<std::unique_ptr<Reader>> readers_;
+
+    /**
+     * \brief the number of collection threads still running.
+     */
+    std::atomic<unsigned> running_readers_;
+
+    /**
+     * \brief `true` if a wakeup has been requested.
+     */
+    std::atomic<bool> wakeup_;
+
+    /**
+     * \brief `true` to wake the thread calling `next_packet()` when
+     * a wait for input times out.
+     */
+    bool idle_wakeup_;
+
+    /**
+     * \brief `true` if collection is to stop once the sources are drained.
+     */
+    std::atomic<bool> draining_;
+
+    /**
+     * \brief CPUs on which to run the collection threads.
+     */
+    std::vector<unsigned> cpus_;
+
+    /**
+     * \brief timeout for waiting on input sources, in milliseconds.
+     */
+    unsigned wait_timeout_;
+
+    /**
+     * \brief maximum packets in a batch.
+     */
+    unsigned batch_size_;
+
+    /**
+     * \brief maximum time to wait for a batch to fill.
+     */
+    std::chrono::microseconds batch_timeout_;
+
+    /**
+     * \brief delivery channel for packet batches.
+     */
+    Channel<std::unique_ptr<PacketBatch>> batches_;
+
+    /**
+     * \brief batches available for reuse.
      */
-    fd_set fdset_;
+    std::vector<std::unique_ptr<PacketBatch>> free_batches_;
 
     /**
-     * \brief maximum fd for all input sources.
+     * \brief mutex guarding the free batch list.
      */
-    int max_fd_;
+    std::mutex free_m_;
 
     /**
-     * \brief timeout for selecting on input sources.
+     * \brief the batch being read by `next_packet()`.
      */
-    unsigned select_timeout_;
+    std::unique_ptr<PacketBatch> reading_;
 
     /**
-     * \brief delivery channel for packets.
+     * \brief the index of the next packet in the batch being read.
      */
-    Channel<Tins::Packet> packets_;
+    std::size_t reading_pos_;
 
     /**
-     * \brief mutex guarding PCAP handles.
+     * \brief the number of batches read.
      */
-    std::mutex m_;
+    uint64_t batch_count_;
 
     /**
-     * \brief background thread collecting packets.
+     * \brief `true` once `next_packet()` has reported the end of input.
      */
-    std::thread t_;
+    bool eof_;
 };
 
 
@@ -332,6 +785,12 @@ private:
  * \brief A collection of network sniffers.
  *
  * This class allows sniffing on multiple interfaces at once.
+ *
+ * If the configuration asks for more than one socket per interface,
+ * each interface is opened that many times and the sockets joined
+ * in a Linux `PACKET_FANOUT_HASH` group. The kernel then shares the
+ * interface traffic between the sockets by flow, and each socket is
+ * read by its own collection thread.
  */
 class NetworkSniffers : public BaseSniffers
 {
@@ -349,6 +808,11 @@ public:
 /**
  * \class FileSniffer
  * \brief A sniffer reading from a capture file.
+ *
+ * The file is read with `PcapReader` on the thread calling
+ * `next_packet()`, so packets do not pass through a collection
+ * thread and channel. The capture filter is compiled for each
+ * link type found in the file, and applied to each packet.
  */
 class FileSniffer : public BaseSniffers
 {
@@ -358,8 +822,95 @@ public:
      *
      * \param fname  pathname of capture file.
      * \param config the sniffing configuration.
+     * \throws pcap_reader_error if the file can't be read.
      */
     FileSniffer(const std::string& fname, const SniffersConfiguration& config);
+
+    /**
+     * \brief Destructor.
+     */
+    virtual ~FileSniffer();
+
+    /**
+     * \brief Get the next packet from the file.
+     *
+     * \returns the next packet, or if EOF, a read error or collection
+     * interrupted a packet with a null PDU.
+     */
+    virtual Tins::Packet next_packet();
+
+    /**
+     * \brief Get stats on the sniffer.
+     *
+     * There are no PCAP stats for a file.
+     *
+     * \param stats a PCAP stats structure.
+     * \returns `false`.
+     */
+    virtual bool stats(struct pcap_stat& stats);
+
+    /**
+     * \brief Stop reading the file.
+     */
+    virtual void breakloop();
+
+    /**
+     * \brief Check whether all packets have been delivered.
+     *
+     * \returns `true` if `next_packet()` has reported the end of input.
+     */
+    virtual bool eof() const
+    {
+        return finished_;
+    }
+
+private:
+    /**
+     * \struct Filter
+     * \brief The capture filter for a link type.
+     */
+    struct Filter
+    {
+        /**
+         * \brief `true` if the filter has been compiled if needed.
+         */
+        bool checked{false};
+
+        /**
+         * \brief `true` if there is a compiled filter.
+         */
+        bool compiled{false};
+
+        /**
+         * \brief the compiled filter.
+         */
+        bpf_program prog;
+    };
+
+    /**
+     * \brief the sniffing configuration.
+     */
+    const SniffersConfiguration& config_;
+
+    /**
+     * \brief the file reader.
+     */
+    PcapReader reader_;
+
+    /**
+     * \brief the capture filter for each link type seen.
+     */
+    std::map<int, Filter> filters_;
+
+    /**
+     * \brief `true` if reading has been stopped.
+     */
+    std::atomic<bool> stop_;
+
+    /**
+     * \brief `true` once the end of input has been reported.
+     */
+    bool finished_;
 };
 
 
@@ -20,28 +20,119 @@
 
 #include <iostream>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "config.h"
 
+#include "filebuf.hpp"
+#include "filestage.hpp"
 #include "log.hpp"
+#include "makeunique.hpp"
 #include "streamwriter.hpp"
+#include "uringfilebuf.hpp"
 
 const std::string& StreamWriter::STDOUT_FILE_NAME = "-";
 
+std::atomic<unsigned> StreamWriter::write_queue_depth_(0);
+std::shared_ptr<FileStage> StreamWriter::file_stage_;
+
 StreamWriter::StreamWriter(const std::string& name, unsigned)
     : os_(&std::cout), name_(name), temp_name_(name + ".tmp")
 {
     if ( name_ != STDOUT_FILE_NAME )
     {
-        ofs_.open(temp_name_, std::ofstream::binary);
-        if ( ofs_.fail() )
-            throw std::runtime_error("Can't open file " + temp_name_);
-        os_ = &ofs_;
+        unsigned depth = write_queue_depth_;
+        stage_ = std::atomic_load(&file_stage_);
+
+        int fd = -1;
+        if ( stage_ )
+            fd = stage_->take(temp_name_);
+        if ( fd == -1 && ( stage_ || depth > 0 ) )
+        {
+            fd = ::open(temp_name_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+            if ( fd == -1 )
+                throw std::runtime_error("Can't open file " + temp_name_);
+        }
+
+        if ( fd != -1 )
+        {
+            if ( depth > 0 )
+            {
+                try
+                {
+                    file_buf_ = make_unique<UringFileBuf>(fd, temp_name_, depth);
+                }
+                catch (const uring_error& err)
+                {
+                    // Don't try again for every file.
+                    LOG_WARN << err.what() << ". Writing files synchronously";
+                    write_queue_depth_ = 0;
+                }
+            }
+
+            if ( !file_buf_ )
+                file_buf_ = make_unique<FdFileBuf>(fd, temp_name_);
+            file_os_ = make_unique<std::ostream>(file_buf_.get());
+            os_ = file_os_.get();
+        }
+        else
+        {
+            ofs_.open(temp_name_, std::ofstream::binary);
+            if ( ofs_.fail() )
+                throw std::runtime_error("Can't open file " + temp_name_);
+            os_ = &ofs_;
+        }
     }
     os_->exceptions(std::ofstream::badbit);
 }
 
 StreamWriter::~StreamWriter()
 {
+    if ( file_buf_ && stage_ )
+    {
+        // The file may not yet have been renamed from the spare, so
+        // leave all work on the file to the stage, even on error.
+        int fd = -1;
+        try
+        {
+            fd = file_buf_->release();
+            stage_->finish(fd, file_buf_->size(), temp_name_, name_);
+            return;
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what() << ". Discarding " << temp_name_;
+        }
+
+        if ( fd != -1 )
+            ::close(fd);
+        try
+        {
+            stage_->remove(temp_name_);
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what();
+        }
+        return;
+    }
+
+    if ( file_buf_ )
+    {
+        try
+        {
+            file_buf_->close();
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what();
+        }
+        if ( std::rename(temp_name_.c_str(), name_.c_str()) != 0 )
+            LOG_ERROR << "file rename from " << temp_name_ << " to " << name_ << " failed";
+        return;
+    }
+
     os_->flush();
     if ( ofs_.is_open() )
     {
@@ -51,6 +142,22 @@ StreamWriter::~StreamWriter()
     }
 }
 
+void StreamWriter::wait_for_file(const std::string& name)
+{
+    std::shared_ptr<FileStage> stage = std::atomic_load(&file_stage_);
+    if ( stage )
+        stage->wait_for(name);
+}
+
+void StreamWriter::rename_file(const std::string& name, const std::string& new_name)
+{
+    std::shared_ptr<FileStage> stage = std::atomic_load(&file_stage_);
+    if ( stage )
+        stage->rename(name, new_name);
+    else if ( std::rename(name.c_str(), new_name.c_str()) != 0 )
+        throw std::runtime_error("Can't rename " + name + " to " + new_name);
+}
+
 void StreamWriter::writeBytes(const uint8_t *p, std::ptrdiff_t n_bytes)
 {
     os_->write(reinterpret_cast<const char *>(p), n_bytes);
@@ -21,9 +21,11 @@
 #ifndef STREAMWRITER_HPP
 #define STREAMWRITER_HPP
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <fstream>
+#include <memory>
 #include <string>
 
 #include <boost/iostreams/filtering_stream.hpp>
@@ -32,6 +34,9 @@
 
 #include <lzma.h>
 
+class FileBuf;
+class FileStage;
+
 /**
  * \class StreamWriter
  * \brief A basic output file write. Just write to the named file.
@@ -77,6 +82,67 @@ public:
         return "";
     }
 
+    /**
+     * \brief Set the number of writes in flight for files written
+     * asynchronously with io_uring.
+     *
+     * This applies to files opened after the call. If io_uring is
+     * not available, files are written synchronously.
+     *
+     * \param depth the most writes in flight, or 0 to write files
+     *              synchronously.
+     */
+    static void set_write_queue_depth(unsigned depth)
+    {
+        write_queue_depth_ = depth;
+    }
+
+    /**
+     * \brief Set the stage preparing and finishing output files.
+     *
+     * This applies to files opened after the call. Files open
+     * at the time keep the stage they were opened with.
+     *
+     * \param stage the file stage, or `nullptr` to open and finish
+     *              files in the writing thread.
+     */
+    static void set_file_stage(std::shared_ptr<FileStage> stage)
+    {
+        std::atomic_store(&file_stage_, stage);
+    }
+
+    /**
+     * \brief Return the stage preparing and finishing output files.
+     *
+     * \returns the file stage, or `nullptr` if none.
+     */
+    static std::shared_ptr<FileStage> file_stage()
+    {
+        return std::atomic_load(&file_stage_);
+    }
+
+    /**
+     * \brief Wait until an output file is complete under its final name.
+     *
+     * Files are finished in the background if a file stage is set.
+     * Call this before reading an output file just written.
+     *
+     * \param name the final file name.
+     */
+    static void wait_for_file(const std::string& name);
+
+    /**
+     * \brief Rename a complete output file.
+     *
+     * If a file stage is set, the file may still be being finished
+     * in the background, and the rename is queued behind that.
+     *
+     * \param name     the current file name.
+     * \param new_name the new file name.
+     * \throws std::runtime_error if the rename fails.
+     */
+    static void rename_file(const std::string& name, const std::string& new_name);
+
 protected:
     /**
      * \brief The output stream.
@@ -84,12 +150,37 @@ protected:
     std::ostream* os_;
 
 private:
+    /**
+     * \brief The number of writes in flight for asynchronous writes,
+     * or 0 for synchronous writes.
+     */
+    static std::atomic<unsigned> write_queue_depth_;
+
+    /**
+     * \brief The stage preparing and finishing output files, if any.
+     */
+    static std::shared_ptr<FileStage> file_stage_;
 
     /**
      * \brief File output stream, if required.
      */
     std::ofstream ofs_;
 
+    /**
+     * \brief File descriptor output buffer, if in use.
+     */
+    std::unique_ptr<FileBuf> file_buf_;
+
+    /**
+     * \brief Output stream for the file descriptor output buffer.
+     */
+    std::unique_ptr<std::ostream> file_os_;
+
+    /**
+     * \brief The stage finishing this file, if any.
+     */
+    std::shared_ptr<FileStage> stage_;
+
     /**
      * \brief The final output filename.
      */
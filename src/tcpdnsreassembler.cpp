@@ -0,0 +1,287 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+
+#include "tcpdnsreassembler.hpp"
+
+// Charge each flow for its table entry plus an estimate of its map node.
+const std::size_t TCPDNSReassembler::FLOW_OVERHEAD =
+    sizeof(TCPDNSReassembler::Flow) + sizeof(TCPDNSReassembler::FlowKey) + 4 * sizeof(void*);
+
+TCPDNSReassembler::TCPDNSReassembler(std::size_t max_flows,
+                                     std::size_t memory_budget,
+                                     std::chrono::seconds idle_timeout)
+    : max_flows_(max_flows), memory_budget_(memory_budget),
+      idle_timeout_(idle_timeout), newest_(NO_FLOW), oldest_(NO_FLOW),
+      memory_used_(0), lru_evicted_count_(0), memory_evicted_count_(0),
+      timeout_count_(0), desync_count_(0)
+{
+}
+
+void TCPDNSReassembler::process(const FlowKey& key, uint32_t seq, unsigned flags,
+                                const uint8_t* data, std::size_t len,
+                                std::chrono::system_clock::time_point timestamp,
+                                const MessageSink& sink)
+{
+    expire(timestamp);
+
+    if ( flags & RST )
+    {
+        remove_flow(key);
+        remove_flow(key.reverse());
+        return;
+    }
+
+    uint32_t index;
+    if ( flags & SYN )
+    {
+        // SYN occupies a sequence number. Any data follows it.
+        ++seq;
+        index = create_flow(key, seq);
+        if ( index == NO_FLOW )
+            return;
+    }
+    else
+    {
+        auto it = index_.find(key);
+        if ( it == index_.end() )
+            return;
+        index = it->second;
+        touch(index);
+    }
+
+    Flow& flow = flows_[index];
+    flow.last_seen = timestamp;
+
+    // Compare sequence numbers allowing for wraparound.
+    int32_t diff = static_cast<int32_t>(seq - flow.next_seq);
+    if ( diff > 0 )
+    {
+        ++desync_count_;
+        remove_flow(index);
+        return;
+    }
+    if ( diff < 0 )
+    {
+        // Skip data we have already seen.
+        std::size_t skip = -static_cast<int64_t>(diff);
+        if ( skip >= len )
+            len = 0;
+        else
+        {
+            data += skip;
+            len -= skip;
+        }
+    }
+    flow.next_seq += len;
+
+    if ( len > 0 && !consume(index, data, len, sink) )
+        return;
+
+    if ( flags & FIN )
+        remove_flow(index);
+}
+
+uint32_t TCPDNSReassembler::create_flow(const FlowKey& key, uint32_t seq)
+{
+    auto it = index_.find(key);
+    if ( it != index_.end() )
+    {
+        // Reused connection. Start afresh.
+        uint32_t index = it->second;
+        Flow& flow = flows_[index];
+        if ( flow.len_bytes == 2 )
+            memory_used_ -= flow.msg_len;
+        std::vector<uint8_t>().swap(flow.buf);
+        flow.msg_len = 0;
+        flow.len_bytes = 0;
+        flow.next_seq = seq;
+        touch(index);
+        return index;
+    }
+
+    if ( index_.size() >= max_flows_ && oldest_ != NO_FLOW )
+    {
+        ++lru_evicted_count_;
+        remove_flow(oldest_);
+    }
+
+    uint32_t index;
+    if ( free_.empty() )
+    {
+        index = flows_.size();
+        flows_.emplace_back();
+    }
+    else
+    {
+        index = free_.back();
+        free_.pop_back();
+    }
+
+    Flow& flow = flows_[index];
+    flow.key = key;
+    flow.next_seq = seq;
+    flow.msg_len = 0;
+    flow.len_bytes = 0;
+    flow.newer = NO_FLOW;
+    flow.older = newest_;
+    if ( newest_ != NO_FLOW )
+        flows_[newest_].newer = index;
+    newest_ = index;
+    if ( oldest_ == NO_FLOW )
+        oldest_ = index;
+
+    index_.emplace(key, index);
+    memory_used_ += FLOW_OVERHEAD;
+
+    if ( !enforce_budget(index) )
+        return NO_FLOW;
+    return index;
+}
+
+void TCPDNSReassembler::remove_flow(uint32_t index)
+{
+    Flow& flow = flows_[index];
+    index_.erase(flow.key);
+    unlink(index);
+    memory_used_ -= FLOW_OVERHEAD;
+    if ( flow.len_bytes == 2 )
+        memory_used_ -= flow.msg_len;
+    std::vector<uint8_t>().swap(flow.buf);
+    flow.msg_len = 0;
+    flow.len_bytes = 0;
+    free_.push_back(index);
+}
+
+void TCPDNSReassembler::remove_flow(const FlowKey& key)
+{
+    auto it = index_.find(key);
+    if ( it != index_.end() )
+        remove_flow(it->second);
+}
+
+void TCPDNSReassembler::touch(uint32_t index)
+{
+    if ( index == newest_ )
+        return;
+
+    unlink(index);
+    Flow& flow = flows_[index];
+    flow.older = newest_;
+    if ( newest_ != NO_FLOW )
+        flows_[newest_].newer = index;
+    newest_ = index;
+    if ( oldest_ == NO_FLOW )
+        oldest_ = index;
+}
+
+void TCPDNSReassembler::unlink(uint32_t index)
+{
+    Flow& flow = flows_[index];
+    if ( flow.newer != NO_FLOW )
+        flows_[flow.newer].older = flow.older;
+    else
+        newest_ = flow.older;
+    if ( flow.older != NO_FLOW )
+        flows_[flow.older].newer = flow.newer;
+    else
+        oldest_ = flow.newer;
+    flow.newer = flow.older = NO_FLOW;
+}
+
+void TCPDNSReassembler::expire(std::chrono::system_clock::time_point now)
+{
+    while ( oldest_ != NO_FLOW && flows_[oldest_].last_seen + idle_timeout_ < now )
+    {
+        ++timeout_count_;
+        remove_flow(oldest_);
+    }
+}
+
+bool TCPDNSReassembler::consume(uint32_t index, const uint8_t* data, std::size_t len,
+                                const MessageSink& sink)
+{
+    Flow& flow = flows_[index];
+
+    while ( len > 0 )
+    {
+        if ( flow.len_bytes < 2 )
+        {
+            if ( flow.len_bytes == 0 && len >= 2 )
+            {
+                std::size_t msg_len = (data[0] << 8) | data[1];
+                if ( len - 2 >= msg_len )
+                {
+                    // Complete message in the segment. No need to copy.
+                    if ( msg_len > 0 )
+                        sink(data + 2, msg_len);
+                    data += msg_len + 2;
+                    len -= msg_len + 2;
+                    continue;
+                }
+                flow.msg_len = msg_len;
+                flow.len_bytes = 2;
+                data += 2;
+                len -= 2;
+            }
+            else
+            {
+                flow.msg_len = (flow.msg_len << 8) | *data++;
+                --len;
+                if ( ++flow.len_bytes < 2 )
+                    continue;
+                if ( flow.msg_len == 0 )
+                {
+                    flow.len_bytes = 0;
+                    continue;
+                }
+            }
+
+            flow.buf.reserve(flow.msg_len);
+            memory_used_ += flow.msg_len;
+            if ( !enforce_budget(index) )
+                return false;
+            continue;
+        }
+
+        std::size_t take = std::min<std::size_t>(flow.msg_len - flow.buf.size(), len);
+        flow.buf.insert(flow.buf.end(), data, data + take);
+        data += take;
+        len -= take;
+
+        if ( flow.buf.size() == flow.msg_len )
+        {
+            std::vector<uint8_t> msg;
+            msg.swap(flow.buf);
+            memory_used_ -= flow.msg_len;
+            flow.msg_len = 0;
+            flow.len_bytes = 0;
+            sink(msg.data(), msg.size());
+        }
+    }
+
+    return true;
+}
+
+bool TCPDNSReassembler::enforce_budget(uint32_t index)
+{
+    while ( memory_used_ > memory_budget_ && oldest_ != NO_FLOW )
+    {
+        uint32_t victim = oldest_;
+        ++memory_evicted_count_;
+        remove_flow(victim);
+        if ( victim == index )
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef TCPDNSREASSEMBLER_HPP
+#define TCPDNSREASSEMBLER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "ipaddress.hpp"
+
+/**
+ * \class TCPDNSReassembler
+ * \brief Reassemble DNS messages from TCP segments.
+ *
+ * DNS over TCP frames each message with a 2 byte length. This class
+ * follows each direction of a TCP connection as a separate flow, and
+ * tracks only the expected next sequence number, the message length
+ * framing and the partial message in progress. Complete messages
+ * found within a single segment are passed on directly from the
+ * segment data without copying.
+ *
+ * A flow is created on seeing a SYN, and removed on FIN or RST.
+ * Out of order segments are not buffered. A segment beyond the next
+ * expected sequence number means data has been lost, so the flow is
+ * abandoned. Retransmitted data is skipped.
+ *
+ * Flows are held in a compact table and kept in least recently used
+ * order. Flows idle for longer than the timeout are removed. If a new
+ * flow would exceed the maximum number of flows, or buffered partial
+ * messages would exceed the memory budget, least recently used flows
+ * are evicted.
+ */
+class TCPDNSReassembler
+{
+public:
+    /**
+     * \struct FlowKey
+     * \brief Identify a single direction of a TCP connection.
+     */
+    struct FlowKey
+    {
+        /**
+         * \brief source address.
+         */
+        IPAddress src_addr;
+
+        /**
+         * \brief destination address.
+         */
+        IPAddress dst_addr;
+
+        /**
+         * \brief source port.
+         */
+        uint16_t src_port;
+
+        /**
+         * \brief destination port.
+         */
+        uint16_t dst_port;
+
+        /**
+         * \brief Return the key for the opposite direction.
+         */
+        FlowKey reverse() const
+        {
+            return FlowKey{dst_addr, src_addr, dst_port, src_port};
+        }
+
+        /**
+         * \brief Equality operator.
+         *
+         * \param rhs the key to compare to.
+         * \returns `true` if the keys are equal.
+         */
+        bool operator==(const FlowKey& rhs) const
+        {
+            return src_port == rhs.src_port && dst_port == rhs.dst_port &&
+                src_addr == rhs.src_addr && dst_addr == rhs.dst_addr;
+        }
+
+        /**
+         * \brief Calculate a hash value for the key.
+         *
+         * \returns hash value.
+         */
+        friend std::size_t hash_value(const FlowKey& key)
+        {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, key.src_addr);
+            boost::hash_combine(seed, key.dst_addr);
+            boost::hash_combine(seed, (key.src_port << 16) | key.dst_port);
+            return seed;
+        }
+    };
+
+    /**
+     * \brief TCP flag SYN.
+     */
+    static const unsigned SYN = 1;
+
+    /**
+     * \brief TCP flag FIN.
+     */
+    static const unsigned FIN = 2;
+
+    /**
+     * \brief TCP flag RST.
+     */
+    static const unsigned RST = 4;
+
+    /**
+     * \typedef MessageSink
+     * \brief Sink function for complete messages.
+     *
+     * The data is only valid for the duration of the call.
+     * The sink must not throw.
+     */
+    using MessageSink = std::function<void (const uint8_t* msg, std::size_t len)>;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param max_flows     maximum number of flows to track.
+     * \param memory_budget maximum memory used for flows, in bytes.
+     * \param idle_timeout  time after which an idle flow is removed.
+     */
+    TCPDNSReassembler(std::size_t max_flows, std::size_t memory_budget,
+                      std::chrono::seconds idle_timeout);
+
+    /**
+     * \brief Process a TCP segment.
+     *
+     * \param key       the flow the segment belongs to.
+     * \param seq       the segment sequence number.
+     * \param flags     the segment flags of interest.
+     * \param data      the segment payload.
+     * \param len       the segment payload length.
+     * \param timestamp the segment timestamp.
+     * \param sink      function to receive complete messages.
+     */
+    void process(const FlowKey& key, uint32_t seq, unsigned flags,
+                 const uint8_t* data, std::size_t len,
+                 std::chrono::system_clock::time_point timestamp,
+                 const MessageSink& sink);
+
+    /**
+     * \brief Return the number of flows being tracked.
+     */
+    std::size_t flow_count() const
+    {
+        return index_.size();
+    }
+
+    /**
+     * \brief Return the memory currently charged to flows, in bytes.
+     */
+    std::size_t memory_used() const
+    {
+        return memory_used_;
+    }
+
+    /**
+     * \brief Return the number of flows evicted to make room for new flows.
+     */
+    uint64_t lru_evicted_count() const
+    {
+        return lru_evicted_count_;
+    }
+
+    /**
+     * \brief Return the number of flows evicted to stay within the
+     * memory budget.
+     */
+    uint64_t memory_evicted_count() const
+    {
+        return memory_evicted_count_;
+    }
+
+    /**
+     * \brief Return the number of flows removed because they were idle.
+     */
+    uint64_t timeout_count() const
+    {
+        return timeout_count_;
+    }
+
+    /**
+     * \brief Return the number of flows abandoned due to missing data.
+     */
+    uint64_t desync_count() const
+    {
+        return desync_count_;
+    }
+
+    /**
+     * \brief Approximate fixed memory cost of a flow, in bytes.
+     */
+    static const std::size_t FLOW_OVERHEAD;
+
+private:
+    /**
+     * \brief value marking no flow.
+     */
+    static const uint32_t NO_FLOW = UINT32_MAX;
+
+    /**
+     * \struct Flow
+     * \brief The state of a single flow.
+     */
+    struct Flow
+    {
+        /**
+         * \brief the flow key.
+         */
+        FlowKey key;
+
+        /**
+         * \brief time the flow was last active.
+         */
+        std::chrono::system_clock::time_point last_seen;
+
+        /**
+         * \brief the next expected sequence number.
+         */
+        uint32_t next_seq;
+
+        /**
+         * \brief next more recently used flow.
+         */
+        uint32_t newer;
+
+        /**
+         * \brief next less recently used flow.
+         */
+        uint32_t older;
+
+        /**
+         * \brief length of the message in progress.
+         */
+        uint16_t msg_len;
+
+        /**
+         * \brief number of length bytes received for the message in progress.
+         */
+        uint8_t len_bytes;
+
+        /**
+         * \brief the partial message in progress.
+         */
+        std::vector<uint8_t> buf;
+    };
+
+    /**
+     * \brief Find or create a flow.
+     *
+     * \param key the flow key.
+     * \param seq the initial sequence number.
+     * \returns the flow index.
+     */
+    uint32_t create_flow(const FlowKey& key, uint32_t seq);
+
+    /**
+     * \brief Remove a flow.
+     *
+     * \param index the flow index.
+     */
+    void remove_flow(uint32_t index);
+
+    /**
+     * \brief Remove the flow with the given key, if present.
+     *
+     * \param key the flow key.
+     */
+    void remove_flow(const FlowKey& key);
+
+    /**
+     * \brief Make a flow the most recently used.
+     *
+     * \param index the flow index.
+     */
+    void touch(uint32_t index);
+
+    /**
+     * \brief Unlink a flow from the LRU list.
+     *
+     * \param index the flow index.
+     */
+    void unlink(uint32_t index);
+
+    /**
+     * \brief Remove flows idle since before the given time.
+     *
+     * \param now the current time.
+     */
+    void expire(std::chrono::system_clock::time_point now);
+
+    /**
+     * \brief Consume in-sequence segment data.
+     *
+     * \param index the flow index.
+     * \param data  the data.
+     * \param len   the data length.
+     * \param sink  function to receive complete messages.
+     * \returns `false` if the flow was evicted.
+     */
+    bool consume(uint32_t index, const uint8_t* data, std::size_t len,
+                 const MessageSink& sink);
+
+    /**
+     * \brief Evict least recently used flows until memory is within budget.
+     *
+     * \param index the current flow index.
+     * \returns `false` if the current flow was evicted.
+     */
+    bool enforce_budget(uint32_t index);
+
+    /**
+     * \brief maximum number of flows.
+     */
+    std::size_t max_flows_;
+
+    /**
+     * \brief memory budget.
+     */
+    std::size_t memory_budget_;
+
+    /**
+     * \brief idle timeout.
+     */
+    std::chrono::seconds idle_timeout_;
+
+    /**
+     * \brief the flow table.
+     */
+    std::vector<Flow> flows_;
+
+    /**
+     * \brief indexes of unused entries in the flow table.
+     */
+    std::vector<uint32_t> free_;
+
+    /**
+     * \brief map from flow key to flow table index.
+     */
+    std::unordered_map<FlowKey, uint32_t, boost::hash<FlowKey>> index_;
+
+    /**
+     * \brief most recently used flow.
+     */
+    uint32_t newest_;
+
+    /**
+     * \brief least recently used flow.
+     */
+    uint32_t oldest_;
+
+    /**
+     * \brief memory currently charged to flows.
+     */
+    std::size_t memory_used_;
+
+    /**
+     * \brief count of flows evicted for new flows.
+     */
+    uint64_t lru_evicted_count_;
+
+    /**
+     * \brief count of flows evicted for memory.
+     */
+    uint64_t memory_evicted_count_;
+
+    /**
+     * \brief count of flows timed out.
+     */
+    uint64_t timeout_count_;
+
+    /**
+     * \brief count of flows abandoned due to missing data.
+     */
+    uint64_t desync_count_;
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <pthread.h>
+
+#include "log.hpp"
+#include "threadplacement.hpp"
+
+namespace {
+    /**
+     * \brief the highest CPU number allowed in a CPU list, plus one.
+     */
+    const unsigned long MAX_CPUS = 1024;
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    /**
+     * \brief Get the CPUs the calling thread may run on.
+     *
+     * \returns the CPUs.
+     */
+    cpu_set_t current_cpus()
+    {
+        cpu_set_t res;
+        CPU_ZERO(&res);
+        if ( pthread_getaffinity_np(pthread_self(), sizeof(res), &res) != 0 )
+        {
+            for ( unsigned i = 0; i < CPU_SETSIZE; ++i )
+                CPU_SET(i, &res);
+        }
+        return res;
+    }
+
+    /**
+     * \brief the CPUs the process started with.
+     *
+     * This is initialised before `main()`, so before any thread is pinned.
+     */
+    const cpu_set_t initial_cpus = current_cpus();
+
+    /**
+     * \brief Move the calling thread to a set of CPUs.
+     *
+     * \param cpus the CPUs.
+     * \returns `true` on success.
+     */
+    bool move_thread(const cpu_set_t& cpus)
+    {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if ( err != 0 )
+        {
+            LOG_WARN << "Can't set thread CPUs: " << std::strerror(err);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * \brief Make a CPU set from CPU numbers.
+     *
+     * \param cpus the CPU numbers.
+     * \returns the CPU set.
+     */
+    cpu_set_t make_cpu_set(const std::vector<unsigned>& cpus)
+    {
+        cpu_set_t res;
+        CPU_ZERO(&res);
+        for ( auto cpu : cpus )
+            if ( cpu < CPU_SETSIZE )
+                CPU_SET(cpu, &res);
+        return res;
+    }
+#endif
+}
+
+std::vector<unsigned> parse_cpu_list(const std::string& list)
+{
+    std::vector<unsigned> res;
+    std::size_t pos = 0;
+
+    auto number = [&]() -> unsigned
+    {
+        if ( pos >= list.size() || list[pos] < '0' || list[pos] > '9' )
+            throw cpu_list_error("invalid CPU list '" + list + "'");
+        const char* start = list.c_str() + pos;
+        char* end;
+        unsigned long n = std::strtoul(start, &end, 10);
+        pos += static_cast<std::size_t>(end - start);
+        if ( n >= MAX_CPUS )
+            throw cpu_list_error("CPU number too large in CPU list '" + list + "'");
+        return static_cast<unsigned>(n);
+    };
+
+    for (;;)
+    {
+        unsigned first = number();
+        unsigned last = first;
+        if ( pos < list.size() && list[pos] == '-' )
+        {
+            ++pos;
+            last = number();
+            if ( last < first )
+                throw cpu_list_error("invalid CPU range in CPU list '" + list + "'");
+        }
+        for ( unsigned cpu = first; cpu <= last; ++cpu )
+            res.push_back(cpu);
+
+        if ( pos == list.size() )
+            break;
+        if ( list[pos] != ',' )
+            throw cpu_list_error("invalid CPU list '" + list + "'");
+        ++pos;
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+    return res;
+}
+
+void set_thread_name(const std::string& name)
+{
+#ifdef HAVE_PTHREAD_SETNAME_NP
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#else
+    (void) name;
+#endif
+}
+
+void set_thread_cpus(const std::vector<unsigned>& cpus)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if ( cpus.empty() )
+        move_thread(initial_cpus);
+    else
+        move_thread(make_cpu_set(cpus));
+#else
+    (void) cpus;
+#endif
+}
+
+ScopedThreadCpus::ScopedThreadCpus(const std::vector<unsigned>& cpus)
+    : moved_(false)
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if ( !cpus.empty() )
+    {
+        previous_ = current_cpus();
+        moved_ = move_thread(make_cpu_set(cpus));
+    }
+#else
+    (void) cpus;
+#endif
+}
+
+ScopedThreadCpus::~ScopedThreadCpus()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    if ( moved_ )
+        move_thread(previous_);
+#endif
+}
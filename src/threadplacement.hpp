@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef THREADPLACEMENT_HPP
+#define THREADPLACEMENT_HPP
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif
+
+/**
+ * \exception cpu_list_error
+ * \brief Signals an invalid CPU list.
+ */
+class cpu_list_error : public std::runtime_error
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param what message detailing the problem.
+     */
+    explicit cpu_list_error(const std::string& what)
+        : std::runtime_error(what) {}
+};
+
+/**
+ * \brief Parse a CPU list.
+ *
+ * The list is in the Linux `cpuset` format, a comma-separated list
+ * of CPU numbers or inclusive ranges, e.g. `0-3,8,10-11`.
+ *
+ * \param list the CPU list.
+ * \returns the CPU numbers, in ascending order without duplicates.
+ * \throws cpu_list_error if the list is invalid.
+ */
+std::vector<unsigned> parse_cpu_list(const std::string& list);
+
+/**
+ * \brief Set the name of the calling thread.
+ *
+ * The name is shown by tools such as `top -H` and `perf`. Linux
+ * limits names to 15 characters, so longer names are truncated.
+ * Does nothing where thread names aren't supported.
+ *
+ * \param name the thread name.
+ */
+void set_thread_name(const std::string& name);
+
+/**
+ * \brief Set the CPUs the calling thread may run on.
+ *
+ * New threads inherit the CPUs of the thread creating them. So a
+ * thread with no CPUs configured is returned to the CPUs the
+ * process started with, rather than inheriting those of its creator.
+ *
+ * Memory is allocated on the NUMA node of the CPU that first touches
+ * it, so a thread pinned before it allocates gets local memory.
+ *
+ * A failure is logged, and the thread left where it was. Does
+ * nothing where CPU affinity isn't supported.
+ *
+ * \param cpus the CPUs, or empty for the CPUs the process started with.
+ */
+void set_thread_cpus(const std::vector<unsigned>& cpus);
+
+/**
+ * \class ScopedThreadCpus
+ * \brief Run the calling thread on given CPUs until the end of a scope.
+ *
+ * This is for making the kernel allocate memory, such as a capture
+ * ring, on the NUMA node of the threads that will use it.
+ */
+class ScopedThreadCpus
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param cpus the CPUs. If empty, the calling thread is not moved.
+     */
+    explicit ScopedThreadCpus(const std::vector<unsigned>& cpus);
+
+    /**
+     * \brief Destructor. Return the thread to its previous CPUs.
+     */
+    ~ScopedThreadCpus();
+
+    ScopedThreadCpus(const ScopedThreadCpus&) = delete;
+    ScopedThreadCpus& operator=(const ScopedThreadCpus&) = delete;
+
+private:
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+    /**
+     * \brief the CPUs the thread was running on.
+     */
+    cpu_set_t previous_;
+#endif
+
+    /**
+     * \brief `true` if the thread was moved.
+     */
+    bool moved_;
+};
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <unistd.h>
+
+#include "log.hpp"
+#include "uringfilebuf.hpp"
+
+#ifdef HAVE_LIBURING
+
+namespace {
+    /**
+     * \brief alignment of buffers.
+     */
+    const std::size_t BUFFER_ALIGNMENT = 4096;
+}
+
+UringFileBuf::UringFileBuf(int fd, const std::string& name, unsigned depth)
+    : FileBuf(fd, name), depth_(std::max(depth, 1u)), current_(nullptr),
+      in_flight_(0), error_(0)
+{
+    int err = io_uring_queue_init(depth_, &ring_, 0);
+    if ( err < 0 )
+        throw uring_error(std::string("io_uring not available: ") + std::strerror(-err));
+
+    // One buffer more than the writes in flight, so there is always
+    // one to fill.
+    buffers_.resize(depth_ + 1);
+    for ( auto& buf : buffers_ )
+    {
+        void* p = nullptr;
+        if ( posix_memalign(&p, BUFFER_ALIGNMENT, BUFFER_SIZE) != 0 )
+        {
+            for ( auto& b : buffers_ )
+                std::free(b.data);
+            io_uring_queue_exit(&ring_);
+            ::close(fd_);
+            throw std::bad_alloc();
+        }
+        buf.data = static_cast<char*>(p);
+        free_.push_back(&buf);
+    }
+
+    current_ = free_.back();
+    free_.pop_back();
+    setp(current_->data, current_->data + BUFFER_SIZE);
+}
+
+UringFileBuf::~UringFileBuf()
+{
+    if ( fd_ != -1 )
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception& err)
+        {
+            LOG_ERROR << err.what();
+        }
+    }
+
+    for ( auto& buf : buffers_ )
+        std::free(buf.data);
+}
+
+int UringFileBuf::release()
+{
+    try
+    {
+        submit();
+        while ( in_flight_ > 0 )
+            reap(true);
+    }
+    catch (...)
+    {
+        io_uring_queue_exit(&ring_);
+        ::close(fd_);
+        fd_ = -1;
+        throw;
+    }
+
+    io_uring_queue_exit(&ring_);
+    int fd = fd_;
+    fd_ = -1;
+
+    if ( error_ != 0 )
+    {
+        ::close(fd);
+        throw uring_error("Error writing " + name_ + ": " + std::strerror(error_));
+    }
+    return fd;
+}
+
+bool UringFileBuf::submit()
+{
+    std::size_t len = static_cast<std::size_t>(pptr() - pbase());
+
+    // After an error, discard output rather than write a file with a hole.
+    if ( len > 0 && error_ == 0 )
+    {
+        current_->len = len;
+        current_->done = 0;
+        current_->offset = static_cast<off_t>(size_);
+        size_ += len;
+
+        // Only wait if the most writes are already in flight. With
+        // one buffer more than that, one is then always free.
+        reap(false);
+        while ( in_flight_ >= depth_ )
+            reap(true);
+        queue_write(current_);
+
+        current_ = free_.back();
+        free_.pop_back();
+    }
+
+    setp(current_->data, current_->data + BUFFER_SIZE);
+    return error_ == 0;
+}
+
+void UringFileBuf::queue_write(Buffer* buf)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if ( !sqe )
+    {
+        free_.push_back(buf);
+        throw uring_error("io_uring submission queue full writing " + name_);
+    }
+
+    io_uring_prep_write(sqe, fd_, buf->data + buf->done,
+                        static_cast<unsigned>(buf->len - buf->done),
+                        static_cast<uint64_t>(buf->offset) + buf->done);
+    io_uring_sqe_set_data(sqe, buf);
+
+    int err = io_uring_submit(&ring_);
+    if ( err < 0 )
+    {
+        free_.push_back(buf);
+        throw uring_error("io_uring submit failed writing " + name_ + ": " + std::strerror(-err));
+    }
+    ++in_flight_;
+}
+
+void UringFileBuf::reap(bool wait)
+{
+    while ( in_flight_ > 0 )
+    {
+        struct io_uring_cqe* cqe;
+        int err = wait
+            ? io_uring_wait_cqe(&ring_, &cqe)
+            : io_uring_peek_cqe(&ring_, &cqe);
+        if ( err == -EAGAIN )
+            break;
+        if ( err == -EINTR )
+            continue;
+        if ( err < 0 )
+            throw uring_error("io_uring wait failed writing " + name_ + ": " + std::strerror(-err));
+
+        // Having reaped one, reap any others without waiting.
+        wait = false;
+
+        Buffer* buf = static_cast<Buffer*>(io_uring_cqe_get_data(cqe));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring_, cqe);
+        --in_flight_;
+
+        if ( res == -EINTR || res == -EAGAIN )
+        {
+            queue_write(buf);
+            continue;
+        }
+
+        if ( res < 0 )
+        {
+            if ( error_ == 0 )
+                error_ = -res;
+        }
+        else if ( res == 0 && buf->done < buf->len )
+        {
+            if ( error_ == 0 )
+                error_ = EIO;
+        }
+        else
+        {
+            buf->done += static_cast<std::size_t>(res);
+            if ( buf->done < buf->len && error_ == 0 )
+            {
+                // Short write. Write the rest.
+                queue_write(buf);
+                continue;
+            }
+        }
+
+        free_.push_back(buf);
+    }
+}
+
+#else
+
+UringFileBuf::UringFileBuf(int fd, const std::string& name, unsigned)
+    : FileBuf(fd, name)
+{
+    throw uring_error("io_uring support not built");
+}
+
+UringFileBuf::~UringFileBuf()
+{
+}
+
+int UringFileBuf::release()
+{
+    return fd_;
+}
+
+bool UringFileBuf::submit()
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#ifndef URINGFILEBUF_HPP
+#define URINGFILEBUF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "config.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "filebuf.hpp"
+
+/**
+ * \exception uring_error
+ * \brief Signals an error setting up or writing with io_uring.
+ */
+class uring_error : public file_write_error
+{
+public:
+    /**
+     * \brief Constructor.
+     *
+     * \param what message detailing the problem.
+     */
+    explicit uring_error(const std::string& what)
+        : file_write_error(what) {}
+};
+
+/**
+ * \class UringFileBuf
+ * \brief An output stream buffer writing a file asynchronously with io_uring.
+ *
+ * Output is collected in large page-aligned buffers from a fixed
+ * pool. A full buffer is submitted as a write, and the writing thread
+ * carries on filling the next buffer from the pool. Completions are
+ * reaped whenever a buffer is submitted. The writing thread only
+ * waits if every buffer in the pool is being written, so a disk stall
+ * is absorbed until the pool is used up.
+ *
+ * A write error is reported on the next output after its completion
+ * is reaped, by the stream going bad, or by `release()` or `close()`.
+ */
+class UringFileBuf : public FileBuf
+{
+public:
+    /**
+     * \brief size of each buffer.
+     */
+    static const std::size_t BUFFER_SIZE = 256 * 1024;
+
+    /**
+     * \brief Constructor.
+     *
+     * \param fd    the file descriptor of the empty output file. It
+     *              is owned by the buffer once constructed.
+     * \param name  the file name, for error messages.
+     * \param depth the most writes in flight at once.
+     * \throws uring_error if io_uring is not available. The file
+     *         descriptor then remains owned by the caller.
+     */
+    UringFileBuf(int fd, const std::string& name, unsigned depth);
+
+    /**
+     * \brief Destructor.
+     *
+     * Close the file if not released. Errors are logged.
+     */
+    virtual ~UringFileBuf();
+
+    /**
+     * \brief Write all output, wait for the writes to finish, and
+     * give up the file descriptor.
+     *
+     * \returns the file descriptor, which the caller must close.
+     * \throws uring_error if any write failed.
+     */
+    virtual int release();
+
+protected:
+    /**
+     * \brief Submit the buffer being filled, if not empty, and start
+     * another.
+     *
+     * This does not wait for the write to finish.
+     *
+     * \returns `false` on error.
+     */
+    virtual bool submit();
+
+private:
+#ifdef HAVE_LIBURING
+    /**
+     * \struct Buffer
+     * \brief An output buffer and the state of its write.
+     */
+    struct Buffer
+    {
+        /**
+         * \brief the buffer data.
+         */
+        char* data;
+
+        /**
+         * \brief the number of bytes to write.
+         */
+        std::size_t len;
+
+        /**
+         * \brief the number of bytes written so far.
+         */
+        std::size_t done;
+
+        /**
+         * \brief the file offset of the start of the buffer.
+         */
+        off_t offset;
+    };
+
+    /**
+     * \brief Queue a write of the unwritten part of a buffer.
+     *
+     * \param buf the buffer.
+     */
+    void queue_write(Buffer* buf);
+
+    /**
+     * \brief Reap completed writes.
+     *
+     * \param wait `true` to wait for at least one completion.
+     */
+    void reap(bool wait);
+
+    /**
+     * \brief the io_uring instance.
+     */
+    struct io_uring ring_;
+
+    /**
+     * \brief the most writes in flight at once.
+     */
+    unsigned depth_;
+
+    /**
+     * \brief all buffers.
+     */
+    std::vector<Buffer> buffers_;
+
+    /**
+     * \brief buffers not being filled or written.
+     */
+    std::vector<Buffer*> free_;
+
+    /**
+     * \brief the buffer being filled.
+     */
+    Buffer* current_;
+
+    /**
+     * \brief the number of writes in flight.
+     */
+    unsigned in_flight_;
+
+    /**
+     * \brief the first write error, as an `errno` value, or 0.
+     */
+    int error_;
+#endif
+};
+
+#endif
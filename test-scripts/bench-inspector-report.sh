@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, you can obtain one at https://mozilla.org/MPL/2.0/.
+#
+# Benchmark inspector report generation.
+#
+# Usage: bench-inspector-report.sh <pcap-or-cdns-file> [runs]
+#
+# If given a PCAP file, it is first converted to C-DNS with the
+# compactor. The inspector is then run over the C-DNS file producing
+# full PCAP output, and again with --report-only, which decodes only
+# the block data needed for the report. The elapsed times are reported.
+# Use a real-size capture file for meaningful results.
+#
+# This is not part of 'make check'.
+
+COMP=${COMP:-./compactor}
+INSP=${INSP:-./inspector}
+INPUT=$1
+RUNS=${2:-3}
+
+if [ -z "$INPUT" ]; then
+    echo "Usage: $0 <pcap-or-cdns-file> [runs]" >&2
+    exit 1
+fi
+
+tmpdir=`mktemp -d -t "bench-inspector-report.XXXXXX"`
+
+cleanup()
+{
+    rm -rf $tmpdir
+    exit $1
+}
+
+trap "cleanup 1" HUP INT TERM
+
+case "$INPUT" in
+    *.pcap)
+        $COMP -c /dev/null -o $tmpdir/in.cbor $INPUT
+        if [ $? -ne 0 ]; then
+            cleanup 1
+        fi
+        CDNS=$tmpdir/in.cbor
+        ;;
+    *)
+        CDNS=$INPUT
+        ;;
+esac
+
+elapsed()
+{
+    start=`date +%s.%N`
+    "$@" > /dev/null
+    res=$?
+    end=`date +%s.%N`
+    echo "$end - $start" | bc
+    return $res
+}
+
+i=0
+while [ $i -lt $RUNS ]; do
+    full=`elapsed $INSP -o $tmpdir/full.pcap $CDNS` || cleanup 1
+    report=`elapsed $INSP --report-only $CDNS` || cleanup 1
+    echo "run $i: full ${full}s report-only ${report}s"
+    rm -f $tmpdir/full.pcap*
+    i=`expr $i + 1`
+done
+
+cleanup 0
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, you can obtain one at https://mozilla.org/MPL/2.0/.
+#
+# Benchmark inspector search using block filters.
+#
+# Usage: bench-inspector-search.sh <pcap-file> <client-address> [runs]
+#
+# The PCAP file is converted to C-DNS with the compactor, with block
+# filters. The inspector then converts the whole C-DNS file, and
+# searches it for the given client address using the block filters.
+# The elapsed times are reported. Use a real-size capture file for
+# meaningful results.
+#
+# This is not part of 'make check'.
+
+COMP=${COMP:-./compactor}
+INSP=${INSP:-./inspector}
+INPUT=$1
+CLIENT=$2
+RUNS=${3:-3}
+
+if [ -z "$INPUT" -o -z "$CLIENT" ]; then
+    echo "Usage: $0 <pcap-file> <client-address> [runs]" >&2
+    exit 1
+fi
+
+tmpdir=`mktemp -d -t "bench-inspector-search.XXXXXX"`
+
+cleanup()
+{
+    rm -rf $tmpdir
+    exit $1
+}
+
+trap "cleanup 1" HUP INT TERM
+
+$COMP -c /dev/null --block-filter-bits 10 -o $tmpdir/in.cbor $INPUT
+if [ $? -ne 0 ]; then
+    cleanup 1
+fi
+
+elapsed()
+{
+    start=`date +%s.%N`
+    "$@" > /dev/null
+    res=$?
+    end=`date +%s.%N`
+    echo "$end - $start" | bc
+    return $res
+}
+
+i=0
+while [ $i -lt $RUNS ]; do
+    full=`elapsed $INSP -o $tmpdir/full.pcap $tmpdir/in.cbor` || cleanup 1
+    search=`elapsed $INSP --search-client $CLIENT -o $tmpdir/search.pcap $tmpdir/in.cbor` || cleanup 1
+    echo "run $i: full ${full}s search ${search}s"
+    rm -f $tmpdir/full.pcap* $tmpdir/search.pcap*
+    i=`expr $i + 1`
+done
+
+cleanup 0
@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, you can obtain one at https://mozilla.org/MPL/2.0/.
+#
+# Benchmark inspector pseudo-anonymisation throughput.
+#
+# Usage: bench-pseudoanon-inspector.sh <pcap-or-cdns-file> [runs]
+#
+# If given a PCAP file, it is first converted to C-DNS with the
+# compactor. The inspector is then run over the C-DNS file with and
+# without pseudo-anonymisation, and the elapsed times reported. Use a
+# real-size capture file for meaningful results.
+#
+# This is not part of 'make check'.
+
+COMP=${COMP:-./compactor}
+INSP=${INSP:-./inspector}
+INPUT=$1
+RUNS=${2:-3}
+
+if [ -z "$INPUT" ]; then
+    echo "Usage: $0 <pcap-or-cdns-file> [runs]" >&2
+    exit 1
+fi
+
+tmpdir=`mktemp -d -t "bench-pseudoanon-inspector.XXXXXX"`
+
+cleanup()
+{
+    rm -rf $tmpdir
+    exit $1
+}
+
+trap "cleanup 1" HUP INT TERM
+
+case "$INPUT" in
+    *.pcap)
+        $COMP -c /dev/null -o $tmpdir/in.cbor $INPUT
+        if [ $? -ne 0 ]; then
+            cleanup 1
+        fi
+        CDNS=$tmpdir/in.cbor
+        ;;
+    *)
+        CDNS=$INPUT
+        ;;
+esac
+
+elapsed()
+{
+    start=`date +%s.%N`
+    "$@" > /dev/null
+    res=$?
+    end=`date +%s.%N`
+    echo "$end - $start" | bc
+    return $res
+}
+
+i=0
+while [ $i -lt $RUNS ]; do
+    plain=`elapsed $INSP -o $tmpdir/plain.pcap $CDNS` || cleanup 1
+    anon=`elapsed $INSP -p -k "some 16-byte key" -o $tmpdir/anon.pcap $CDNS` || cleanup 1
+    echo "run $i: plain ${plain}s pseudo-anonymised ${anon}s"
+    rm -f $tmpdir/plain.pcap* $tmpdir/anon.pcap*
+    i=`expr $i + 1`
+done
+
+cleanup 0
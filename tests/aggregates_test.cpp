@@ -0,0 +1,306 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <map>
+#include <memory>
+
+#include "catch.hpp"
+
+#include "aggregates.hpp"
+#include "dnsmessage.hpp"
+#include "fasthash.hpp"
+#include "makeunique.hpp"
+
+namespace {
+    /**
+     * \brief A key type, hashed as the key value.
+     */
+    struct TestKey
+    {
+        unsigned value;
+
+        bool operator==(const TestKey& rhs) const
+        {
+            return value == rhs.value;
+        }
+
+        friend std::size_t hash_value(const TestKey& k)
+        {
+            return k.value;
+        }
+    };
+
+    class TestEncoder : public CborBaseEncoder
+    {
+    public:
+        byte_string bytes;
+
+    protected:
+        virtual void writeBytes(const uint8_t* p, std::ptrdiff_t n_bytes)
+        {
+            bytes.append(p, n_bytes);
+        }
+    };
+
+    std::unique_ptr<DNSMessage> make_message(const char* addr, const char* qname,
+                                             bool query, bool tcp)
+    {
+        std::unique_ptr<DNSMessage> res = make_unique<DNSMessage>();
+        res->timestamp = std::chrono::system_clock::time_point(std::chrono::hours(24*365*20));
+        res->clientIP = IPAddress(Tins::IPv4Address(addr));
+        res->serverIP = IPAddress(Tins::IPv4Address("192.168.1.3"));
+        res->tcp = tcp;
+        res->dns.type(query ? CaptureDNS::QUERY : CaptureDNS::RESPONSE);
+        res->dns.add_query(CaptureDNS::query(qname, CaptureDNS::AAAA, CaptureDNS::IN));
+        if ( !query )
+        {
+            res->timestamp += std::chrono::milliseconds(2);
+            res->dns.rcode(3);
+        }
+        return res;
+    }
+}
+
+SCENARIO("Space-Saving finds the most frequent keys", "[aggregates]")
+{
+    GIVEN("A summary with a few counters")
+    {
+        SpaceSaving<TestKey> ss(10);
+
+        WHEN("fewer keys than counters are added")
+        {
+            for ( unsigned i = 0; i < 5; ++i )
+                for ( unsigned j = 0; j <= i; ++j )
+                    ss.add({ i });
+
+            THEN("counts are exact")
+            {
+                auto top = ss.top(3);
+                REQUIRE(top.size() == 3);
+                REQUIRE(top[0].key.value == 4);
+                REQUIRE(top[0].count == 5);
+                REQUIRE(top[0].error == 0);
+                REQUIRE(top[2].key.value == 2);
+                REQUIRE(top[2].count == 3);
+                REQUIRE(ss.min_count() == 0);
+            }
+        }
+
+        WHEN("many rare keys are added among frequent ones")
+        {
+            std::map<unsigned, uint64_t> actual;
+            for ( unsigned i = 0; i < 10000; ++i )
+            {
+                unsigned key = ( i % 4 == 0 ) ? 1 : ( i % 4 == 1 ) ? 2 : 100 + i;
+                ss.add({ key });
+                ++actual[key];
+            }
+
+            THEN("the frequent keys are found, with counts bounding the actual counts")
+            {
+                auto top = ss.top(2);
+                REQUIRE(top[0].key.value + top[1].key.value == 3);
+                for ( const auto& c : ss.top(10) )
+                {
+                    REQUIRE(c.count >= actual[c.key.value]);
+                    REQUIRE(c.count - c.error <= actual[c.key.value]);
+                }
+            }
+        }
+    }
+
+    GIVEN("Two summaries of different streams")
+    {
+        SpaceSaving<TestKey> a(4), b(4);
+        for ( unsigned i = 0; i < 100; ++i )
+        {
+            a.add({ 1 });
+            b.add({ 2 });
+            b.add({ 1 });
+            a.add({ 1000 + i });
+            b.add({ 2000 + i });
+        }
+
+        WHEN("they are merged")
+        {
+            a.merge(b);
+
+            THEN("the most frequent keys of the combined stream are found")
+            {
+                auto top = a.top(2);
+                REQUIRE(a.size() == 4);
+                REQUIRE(top[0].key.value == 1);
+                REQUIRE(top[0].count - top[0].error <= 200);
+                REQUIRE(top[0].count >= 200);
+                REQUIRE(top[1].key.value == 2);
+            }
+        }
+    }
+}
+
+SCENARIO("HyperLogLog estimates distinct items", "[aggregates]")
+{
+    GIVEN("An empty estimator")
+    {
+        HyperLogLog hll;
+
+        THEN("the estimate is zero")
+        {
+            REQUIRE(hll.estimate() == 0);
+        }
+
+        WHEN("items are added several times")
+        {
+            for ( int rep = 0; rep < 3; ++rep )
+                for ( uint64_t i = 0; i < 100000; ++i )
+                    hll.add(fast_hash(i, 0));
+
+            THEN("the estimate is close to the number of distinct items")
+            {
+                REQUIRE(hll.estimate() > 95000);
+                REQUIRE(hll.estimate() < 105000);
+            }
+        }
+
+        WHEN("two estimators of overlapping items are merged")
+        {
+            HyperLogLog other;
+            for ( uint64_t i = 0; i < 600; ++i )
+                hll.add(fast_hash(i, 0));
+            for ( uint64_t i = 400; i < 1000; ++i )
+                other.add(fast_hash(i, 0));
+            hll.merge(other);
+
+            THEN("the estimate is close to the number of distinct items in both")
+            {
+                REQUIRE(hll.estimate() > 970);
+                REQUIRE(hll.estimate() < 1030);
+            }
+        }
+    }
+}
+
+SCENARIO("Aggregates summarise query/responses", "[aggregates]")
+{
+    GIVEN("Some query/responses")
+    {
+        std::chrono::system_clock::time_point start(std::chrono::hours(24*365*20));
+        Aggregates agg(2, start, std::chrono::seconds(60));
+
+        QueryResponse qr1(make_message("192.168.1.2", "example.com", true, false));
+        qr1.set_response(make_message("192.168.1.2", "example.com", false, false));
+        QueryResponse qr2(make_message("192.168.1.2", "EXAMPLE.com", true, true));
+        QueryResponse qr3(make_message("192.168.1.4", "other.com", true, false));
+
+        WHEN("they are added")
+        {
+            agg.add(qr1);
+            agg.add(qr2);
+            agg.add(qr3);
+
+            THEN("the aggregates are as expected")
+            {
+                REQUIRE(agg.count() == 3);
+                REQUIRE(agg.unanswered() == 2);
+                REQUIRE(agg.distinct_clients() == 2);
+                REQUIRE(agg.rcodes() == Aggregates::Histogram({ { 3, 1 } }));
+                REQUIRE(agg.qtypes() == Aggregates::Histogram({ { CaptureDNS::AAAA, 3 } }));
+                REQUIRE(agg.transport(Aggregates::UDP_IPV4) == 2);
+                REQUIRE(agg.transport(Aggregates::TCP_IPV4) == 1);
+                REQUIRE(agg.transport(Aggregates::UDP_IPV6) == 0);
+                REQUIRE(agg.latency_count() == 1);
+                REQUIRE(agg.latency_sum() == 2000000);
+
+                auto qnames = agg.top_qnames();
+                REQUIRE(qnames.size() == 2);
+                REQUIRE(CaptureDNS::decode_domain_name(qnames[0].key) == "example.com");
+                REQUIRE(qnames[0].count == 2);
+                auto clients = agg.top_clients();
+                REQUIRE(clients[0].key == IPAddress(Tins::IPv4Address("192.168.1.2")));
+                REQUIRE(clients[0].count == 2);
+            }
+
+            THEN("they are written as a CBOR map")
+            {
+                TestEncoder enc;
+                agg.write(enc);
+                enc.flush();
+                REQUIRE(enc.bytes.size() > HyperLogLog::REGISTERS);
+                REQUIRE(enc.bytes[0] == 0xad);
+            }
+        }
+
+        WHEN("aggregates of another period are merged")
+        {
+            Aggregates later(2, start + std::chrono::seconds(60), std::chrono::seconds(60));
+            agg.add(qr1);
+            later.add(qr1);
+            later.add(qr3);
+            agg.merge(later);
+
+            THEN("the aggregates cover both periods")
+            {
+                REQUIRE(agg.start() == start);
+                REQUIRE(agg.count() == 3);
+                REQUIRE(agg.distinct_clients() == 2);
+                REQUIRE(agg.latency_count() == 2);
+                REQUIRE(agg.top_clients()[0].count == 2);
+            }
+        }
+    }
+}
+
+#if ENABLE_PSEUDOANONYMISATION
+SCENARIO("Aggregates report pseudo-anonymised clients", "[aggregates]")
+{
+    GIVEN("Aggregates with pseudo-anonymisation")
+    {
+        std::chrono::system_clock::time_point start(std::chrono::hours(24*365*20));
+        PseudoAnonymise anon("some 16-byte key"_b);
+        Aggregates agg(2, start, std::chrono::seconds(60), &anon);
+
+        QueryResponse qr1(make_message("192.168.1.2", "example.com", true, false));
+        QueryResponse qr2(make_message("192.168.1.2", "example.com", true, false));
+        QueryResponse qr3(make_message("192.168.1.4", "other.com", true, false));
+
+        WHEN("query/responses are added")
+        {
+            agg.add(qr1);
+            agg.add(qr2);
+            agg.add(qr3);
+
+            THEN("clients are counted by pseudo-anonymised address")
+            {
+                IPAddress client(Tins::IPv4Address("192.168.1.2"));
+                auto clients = agg.top_clients();
+                REQUIRE(clients.size() == 2);
+                REQUIRE(clients[0].key == anon.address(client));
+                REQUIRE(clients[0].key != client);
+                REQUIRE(clients[0].count == 2);
+                REQUIRE(clients[1].key != IPAddress(Tins::IPv4Address("192.168.1.4")));
+                REQUIRE(agg.distinct_clients() == 2);
+                REQUIRE(agg.transport(Aggregates::UDP_IPV4) == 3);
+            }
+
+            THEN("no client address is written")
+            {
+                TestEncoder enc;
+                agg.write(enc);
+                enc.flush();
+                REQUIRE(enc.bytes.find(IPAddress(Tins::IPv4Address("192.168.1.2")).asNetworkBinary()) == byte_string::npos);
+                REQUIRE(enc.bytes.find(IPAddress(Tins::IPv4Address("192.168.1.4")).asNetworkBinary()) == byte_string::npos);
+            }
+        }
+    }
+}
+#endif
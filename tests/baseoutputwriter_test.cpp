@@ -232,6 +232,21 @@ SCENARIO("Generating output", "[output]")
             }
         }
 
+        AND_WHEN("query additionals are configured but sections are omitted")
+        {
+            config.output_options_queries = Configuration::ADDITIONALS;
+            TestBaseOutputWriter tbow(config);
+            tbow.writeQR(qr, stats, false);
+
+            THEN("only base output is generated")
+            {
+                REQUIRE(tbow.actions ==
+                        "startRecord:1989-12-27 00h00m00s,"
+                        "writeBasic:1989-12-27 00h00m00s,"
+                        "endRecord:1989-12-27 00h00m00s");
+            }
+        }
+
         AND_WHEN("base output plus response additionals is required")
         {
             config.output_options_responses = Configuration::ADDITIONALS;
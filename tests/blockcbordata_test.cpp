@@ -10,8 +10,11 @@
  * Developed by Sinodun IT (www.sinodun.com)
  */
 
+#include <algorithm>
 #include <chrono>
+#include <iostream>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 #include <utility>
@@ -53,6 +56,11 @@ namespace {
             return true;
         }
 
+        const std::vector<uint8_t>& get_bytes() const
+        {
+            return bytes;
+        }
+
     protected:
         virtual void writeBytes(const uint8_t *p, std::ptrdiff_t nBytes)
         {
@@ -100,6 +108,72 @@ namespace {
         std::vector<uint8_t> bytes_;
     };
 
+    // Decode from a buffer in one go, for benchmarking.
+    class BufferCborDecoder : public CborBaseDecoder
+    {
+    public:
+        explicit BufferCborDecoder(const std::vector<uint8_t>& bytes)
+            : CborBaseDecoder(), bytes_(bytes), pos_(0) {}
+
+    protected:
+        virtual unsigned readBytes(uint8_t* p, std::ptrdiff_t n_bytes)
+        {
+            if ( pos_ == bytes_.size() )
+                throw cbor_end_of_input();
+
+            std::size_t res = std::min<std::size_t>(n_bytes, bytes_.size() - pos_);
+            std::copy(bytes_.begin() + pos_, bytes_.begin() + pos_ + res, p);
+            pos_ += res;
+            return res;
+        }
+
+    private:
+        const std::vector<uint8_t>& bytes_;
+        std::size_t pos_;
+    };
+
+    // Make a block with a query and response with answers in each item.
+    void make_block(BlockData& cd, unsigned nitems)
+    {
+        cd.earliest_time = std::chrono::system_clock::time_point(std::chrono::seconds(1));
+
+        ClassType ct;
+        ct.qtype = CaptureDNS::A;
+        ct.qclass = CaptureDNS::INTERNET;
+        QuerySignature qs;
+        qs.qr_flags = QUERY_AND_RESPONSE | QR_HAS_QUESTION;
+        qs.server_address = cd.add_address(IPAddress(Tins::IPv4Address("192.168.1.1")));
+        qs.query_classtype = cd.add_classtype(ct);
+        index_t sig = cd.add_query_signature(qs);
+
+        for ( unsigned i = 0; i < nitems; ++i )
+        {
+            std::string name = "name" + std::to_string(i) + ".example.com";
+            QueryResponseItem qri;
+            qri.qr_flags = QUERY_AND_RESPONSE | QR_HAS_QUESTION;
+            qri.tstamp = cd.earliest_time + std::chrono::microseconds(i);
+            qri.response_delay = std::chrono::microseconds(10);
+            qri.client_address = cd.add_address(IPAddress(Tins::IPv4Address(0x0a000000 + i)));
+            qri.client_port = 1000 + i % 1000;
+            qri.id = i;
+            qri.signature = sig;
+            qri.qname = cd.add_name_rdata(byte_string(reinterpret_cast<const unsigned char*>(name.data()), name.size()));
+
+            Question q;
+            q.qname = qri.qname;
+            q.classtype = qs.query_classtype;
+            ResourceRecord rr;
+            rr.name = qri.qname;
+            rr.classtype = qs.query_classtype;
+            rr.ttl = 300;
+            rr.rdata = cd.add_name_rdata(byte_string(4, static_cast<unsigned char>(i)));
+            qri.response_extra_info = make_unique<QueryResponseExtraInfo>();
+            qri.response_extra_info->questions_list = cd.add_questions_list({cd.add_question(q)});
+            qri.response_extra_info->answers_list = cd.add_rrs_list({cd.add_resource_record(rr)});
+            cd.query_response_items.push_back(std::move(qri));
+        }
+    }
+
     // In reality, we'd use the plain int as the key value.
     // But here we implement a whole-item key for testing.
     struct IntItem
@@ -192,9 +266,9 @@ SCENARIO("ByteStringItems can be compared and written", "[block]")
     GIVEN("Some sample strings")
     {
         ByteStringItem si1, si2, si3;
-        si1.str = "Hello"_b;
-        si2.str = "Hello"_b;
-        si3.str = "World"_b;
+        si1.str = DNSName("Hello"_b);
+        si2.str = DNSName("Hello"_b);
+        si3.str = DNSName("World"_b);
 
         WHEN("idential items are compared")
         {
@@ -753,6 +827,71 @@ SCENARIO("BlockData items can be written", "[block]")
     }
 }
 
+SCENARIO("BlockData load shedding statistics are written when present", "[block]")
+{
+    GIVEN("A BlockData with shedding statistics")
+    {
+        BlockData cd;
+        cd.earliest_time = std::chrono::system_clock::time_point(std::chrono::seconds(1));
+        cd.last_packet_statistics.shed_sections_qr_count = 2;
+        cd.last_packet_statistics.sampled_out_qr_count = 3;
+
+        WHEN("values are encoded")
+        {
+            TestCborEncoder tcbe;
+            cd.writeCbor(tcbe);
+            tcbe.flush();
+
+            THEN("only the non-zero shedding statistics are written")
+            {
+                const uint8_t EXPECTED[] =
+                    {
+                        (5 << 5) | 31,
+                        0, (5 << 5) | 1, 1, (4 << 5) | 2, 1, 0,
+
+                        1,
+                        (5 << 5) | 31,
+                        0, 0,
+                        1, 0,
+                        2, 0,
+                        3, 0,
+                        4, 0,
+                        10, 0,
+                        11, 0,
+                        12, 0,
+                        13, 0,
+                        14, 0,
+                        15, 2,
+                        18, 3,
+                        0xff,
+
+                        2,
+                        (5 << 5) | 31,
+                        0, (4 << 5) | 0,
+                        1, (4 << 5) | 0,
+                        2, (4 << 5) | 0,
+                        3, (4 << 5) | 0,
+                        4, (4 << 5) | 0,
+                        5, (4 << 5) | 0,
+                        6, (4 << 5) | 0,
+                        7, (4 << 5) | 0,
+                        0xff,
+
+                        3,
+                        (4 << 5) | 0,
+
+                        4,
+                        (4 << 5) | 0,
+
+                        0xff
+                    };
+
+                REQUIRE(tcbe.compareBytes(EXPECTED, sizeof(EXPECTED)));
+            }
+        }
+    }
+}
+
 SCENARIO("BlockData max items works", "[block]")
 {
     GIVEN("A sample BlockData")
@@ -823,8 +962,8 @@ SCENARIO("ByteStringItems can be read", "[block]")
     {
         TestCborDecoder tcbd;
         ByteStringItem si1, si2;
-        si1.str = "Hello"_b;
-        si2.str = "World"_b;
+        si1.str = DNSName("Hello"_b);
+        si2.str = DNSName("World"_b);
 
         WHEN("decoder is given encoded string data")
         {
@@ -1293,3 +1432,236 @@ SCENARIO("BlockData items can be read", "[block]")
         }
     }
 }
+
+SCENARIO("BlockData can be read selectively", "[block]")
+{
+    GIVEN("An encoded block with items and tables")
+    {
+        BlockData cd;
+        make_block(cd, 10);
+        TestCborEncoder tcbe;
+        cd.writeCbor(tcbe);
+        tcbe.flush();
+        TestCborDecoder tcbd(tcbe.get_bytes());
+        block_cbor::FileVersionFields fields;
+
+        WHEN("the whole block is read")
+        {
+            BlockData cd_r;
+            cd_r.readCbor(tcbd, fields);
+
+            THEN("all tables and items are present")
+            {
+                REQUIRE(cd_r.ip_addresses.size() == 11);
+                REQUIRE(cd_r.names_rdatas.size() == 20);
+                REQUIRE(cd_r.resource_records.size() == 10);
+                REQUIRE(cd_r.query_response_items.size() == 10);
+                REQUIRE(cd_r.query_response_items[3].response_extra_info);
+            }
+        }
+
+        WHEN("only items, signatures and addresses are read")
+        {
+            BlockData cd_r;
+            cd_r.readCbor(tcbd, fields,
+                          READ_ITEMS | READ_QUERY_SIGNATURES | READ_IP_ADDRESSES);
+
+            THEN("other tables and extra info are skipped")
+            {
+                REQUIRE(cd_r.earliest_time == cd.earliest_time);
+                REQUIRE(cd_r.ip_addresses.size() == 11);
+                REQUIRE(cd_r.query_signatures.size() == 1);
+                REQUIRE(cd_r.class_types.size() == 0);
+                REQUIRE(cd_r.names_rdatas.size() == 0);
+                REQUIRE(cd_r.questions_lists.size() == 0);
+                REQUIRE(cd_r.resource_records.size() == 0);
+                REQUIRE(cd_r.query_response_items.size() == 10);
+                REQUIRE(cd_r.query_response_items[3].tstamp == cd.query_response_items[3].tstamp);
+                REQUIRE(cd_r.query_response_items[3].client_address == cd.query_response_items[3].client_address);
+                REQUIRE(!cd_r.query_response_items[3].response_extra_info);
+            }
+        }
+
+        WHEN("items are not read")
+        {
+            BlockData cd_r;
+            cd_r.readCbor(tcbd, fields, READ_STATISTICS);
+
+            THEN("no items are present")
+            {
+                REQUIRE(cd_r.query_response_items.size() == 0);
+                REQUIRE(cd_r.ip_addresses.size() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("BlockData filters can be searched", "[block]")
+{
+    GIVEN("An encoded block with filters")
+    {
+        BlockData cd;
+        make_block(cd, 10);
+        cd.build_filters(10);
+        TestCborEncoder tcbe;
+        cd.writeCbor(tcbe);
+        tcbe.flush();
+        TestCborDecoder tcbd(tcbe.get_bytes());
+        block_cbor::FileVersionFields fields;
+
+        WHEN("the block is searched for a client it contains")
+        {
+            BlockSearch search;
+            search.client_address = IPAddress(Tins::IPv4Address(0x0a000003));
+            BlockData cd_r;
+            bool match = cd_r.readCbor(tcbd, fields, READ_ALL, &search);
+
+            THEN("the block is read")
+            {
+                REQUIRE(match);
+                REQUIRE(!cd_r.address_filter.empty());
+                REQUIRE(!cd_r.name_filter.empty());
+                REQUIRE(cd_r.query_response_items.size() == 10);
+                REQUIRE(cd_r.ip_addresses.size() == 11);
+            }
+        }
+
+        WHEN("the block is searched for a name it contains in a different case")
+        {
+            BlockSearch search;
+            search.qname = "NAME3.Example.COM"_b;
+            BlockData cd_r;
+            bool match = cd_r.readCbor(tcbd, fields, READ_ALL, &search);
+
+            THEN("the block is read")
+            {
+                REQUIRE(match);
+                REQUIRE(cd_r.query_response_items.size() == 10);
+            }
+        }
+
+        WHEN("the block is searched for a client it does not contain")
+        {
+            BlockSearch search;
+            search.client_address = IPAddress(Tins::IPv4Address(0x0b000001));
+            BlockData cd_r;
+            bool match = cd_r.readCbor(tcbd, fields, READ_ALL, &search);
+
+            THEN("the block tables and items are skipped")
+            {
+                REQUIRE(!match);
+                REQUIRE(cd_r.earliest_time == cd.earliest_time);
+                REQUIRE(cd_r.query_response_items.size() == 0);
+                REQUIRE(cd_r.ip_addresses.size() == 0);
+                REQUIRE(cd_r.names_rdatas.size() == 0);
+            }
+        }
+    }
+
+    GIVEN("An encoded block without filters")
+    {
+        BlockData cd;
+        make_block(cd, 10);
+        TestCborEncoder tcbe;
+        cd.writeCbor(tcbe);
+        tcbe.flush();
+        TestCborDecoder tcbd(tcbe.get_bytes());
+        block_cbor::FileVersionFields fields;
+
+        WHEN("the block is searched")
+        {
+            BlockSearch search;
+            search.client_address = IPAddress(Tins::IPv4Address(0x0b000001));
+            BlockData cd_r;
+            bool match = cd_r.readCbor(tcbd, fields, READ_ALL, &search);
+
+            THEN("the whole block is read")
+            {
+                REQUIRE(match);
+                REQUIRE(cd_r.address_filter.empty());
+                REQUIRE(cd_r.query_response_items.size() == 10);
+            }
+        }
+    }
+}
+
+TEST_CASE("BlockData filtered search", "[.benchmark]")
+{
+    const unsigned NITEMS = 5000;
+    const unsigned NREADS = 100;
+    BlockData cd;
+    make_block(cd, NITEMS);
+    cd.build_filters(10);
+    TestCborEncoder tcbe;
+    cd.writeCbor(tcbe);
+    tcbe.flush();
+    const std::vector<uint8_t>& bytes = tcbe.get_bytes();
+    block_cbor::FileVersionFields fields;
+
+    // Search for a client not in the block, as most blocks will be
+    // when searching for a single client.
+    BlockSearch search;
+    search.client_address = IPAddress(Tins::IPv4Address(0x0b000001));
+
+    auto time_reads = [&](const BlockSearch* s)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for ( unsigned i = 0; i < NREADS; ++i )
+            {
+                BufferCborDecoder dec(bytes);
+                BlockData cd_r;
+                cd_r.readCbor(dec, fields, READ_ALL, s);
+                REQUIRE(cd_r.query_response_items.size() == ( s ? 0 : NITEMS ));
+            }
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        };
+
+    auto full = time_reads(nullptr);
+    auto filtered = time_reads(&search);
+
+    std::cout << "Search " << NREADS << " blocks of " << NITEMS << " items ("
+              << bytes.size() << " bytes each)\n"
+              << "  full decode   : " << full << "ms\n"
+              << "  filter search : " << filtered << "ms\n";
+}
+
+TEST_CASE("BlockData report-only decoding", "[.benchmark]")
+{
+    const unsigned NITEMS = 5000;
+    const unsigned NREADS = 100;
+    BlockData cd;
+    make_block(cd, NITEMS);
+    TestCborEncoder tcbe;
+    cd.writeCbor(tcbe);
+    tcbe.flush();
+    const std::vector<uint8_t>& bytes = tcbe.get_bytes();
+    block_cbor::FileVersionFields fields;
+
+    // The parts the inspector decodes for --report-only.
+    const unsigned REPORT_PARTS =
+        READ_ITEMS | READ_QUERY_SIGNATURES | READ_IP_ADDRESSES |
+        READ_STATISTICS | READ_ADDRESS_EVENT_COUNTS;
+
+    auto time_reads = [&](unsigned parts)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for ( unsigned i = 0; i < NREADS; ++i )
+            {
+                BufferCborDecoder dec(bytes);
+                BlockData cd_r;
+                cd_r.readCbor(dec, fields, parts);
+                REQUIRE(cd_r.query_response_items.size() == NITEMS);
+            }
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        };
+
+    auto full = time_reads(READ_ALL);
+    auto report = time_reads(REPORT_PARTS);
+
+    std::cout << "Decode " << NREADS << " blocks of " << NITEMS << " items ("
+              << bytes.size() << " bytes each)\n"
+              << "  all parts        : " << full << "ms\n"
+              << "  report-only parts: " << report << "ms\n";
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "blockstreamer.hpp"
+#include "makeunique.hpp"
+
+namespace {
+    byte_string bytes(const std::string& s)
+    {
+        return byte_string(reinterpret_cast<const unsigned char*>(s.data()), s.size());
+    }
+
+    std::string temp_path()
+    {
+        char name[] = "/tmp/blockstreamer-test-XXXXXX";
+        int fd = mkstemp(name);
+        REQUIRE(fd != -1);
+        close(fd);
+        std::remove(name);
+        return name;
+    }
+
+    int connect_to(const std::string& path)
+    {
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        REQUIRE(fd != -1);
+        REQUIRE(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+        return fd;
+    }
+
+    byte_string read_all(int fd)
+    {
+        byte_string res;
+        unsigned char buf[4096];
+        ssize_t n;
+        while ( ( n = read(fd, buf, sizeof(buf)) ) > 0 )
+            res.append(buf, n);
+        return res;
+    }
+
+    template<typename Pred>
+    bool wait_until(Pred pred)
+    {
+        for ( int i = 0; i < 500 && !pred(); ++i )
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return pred();
+    }
+}
+
+SCENARIO("BlockStreamer streams blocks to socket subscribers", "[streamer]")
+{
+    GIVEN("A streamer on a Unix domain socket")
+    {
+        std::string path = temp_path();
+        std::unique_ptr<BlockStreamer> streamer = make_unique<BlockStreamer>(path, 4);
+
+        WHEN("two subscribers connect and blocks are published")
+        {
+            streamer->set_header(bytes("head"));
+            int fd1 = connect_to(path);
+            int fd2 = connect_to(path);
+            REQUIRE(wait_until([&]{ return streamer->subscriber_count() == 2; }));
+
+            streamer->publish(bytes("block1"));
+            streamer->publish(bytes("block2"));
+            streamer.reset();
+
+            THEN("each receives the header, the blocks and the end of the stream")
+            {
+                byte_string expected = bytes("headblock1block2");
+                expected.push_back(0xff);
+                REQUIRE(read_all(fd1) == expected);
+                REQUIRE(read_all(fd2) == expected);
+                struct stat st;
+                REQUIRE(stat(path.c_str(), &st) != 0);
+            }
+
+            close(fd1);
+            close(fd2);
+        }
+
+        WHEN("a subscriber doesn't read")
+        {
+            streamer->set_header(bytes("head"));
+            int fd = connect_to(path);
+            REQUIRE(wait_until([&]{ return streamer->subscriber_count() == 1; }));
+
+            byte_string big(1024 * 1024, 'x');
+            for ( int i = 0; i < 64 && streamer->dropped_subscriber_count() == 0; ++i )
+                streamer->publish(big);
+
+            THEN("it is dropped")
+            {
+                REQUIRE(streamer->dropped_subscriber_count() == 1);
+                REQUIRE(wait_until([&]{ return streamer->subscriber_count() == 0; }));
+            }
+
+            close(fd);
+        }
+    }
+}
+
+SCENARIO("BlockStreamer streams blocks to a FIFO", "[streamer]")
+{
+    GIVEN("A streamer on a FIFO with a reader")
+    {
+        std::string path = temp_path();
+        REQUIRE(mkfifo(path.c_str(), 0600) == 0);
+        int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        REQUIRE(fd != -1);
+        fcntl(fd, F_SETFL, 0);
+
+        std::unique_ptr<BlockStreamer> streamer = make_unique<BlockStreamer>(path, 4);
+        streamer->set_header(bytes("head"));
+
+        WHEN("blocks are published")
+        {
+            REQUIRE(wait_until([&]{ return streamer->subscriber_count() == 1; }));
+            streamer->publish(bytes("block1"));
+            streamer.reset();
+
+            THEN("the reader receives the header, blocks and the end of the stream")
+            {
+                byte_string expected = bytes("headblock1");
+                expected.push_back(0xff);
+                REQUIRE(read_all(fd) == expected);
+            }
+        }
+
+        close(fd);
+        std::remove(path.c_str());
+    }
+}
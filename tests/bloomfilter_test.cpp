@@ -0,0 +1,151 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "bloomfilter.hpp"
+
+namespace {
+    class TestCborEncoder : public CborBaseEncoder
+    {
+    public:
+        TestCborEncoder() : CborBaseEncoder() {}
+
+        const std::vector<uint8_t>& get_bytes() const
+        {
+            return bytes;
+        }
+
+    protected:
+        virtual void writeBytes(const uint8_t *p, std::ptrdiff_t nBytes)
+        {
+            while ( nBytes-- > 0 )
+                bytes.push_back(*p++);
+        }
+
+    private:
+        std::vector<uint8_t> bytes;
+    };
+
+    class TestCborDecoder : public CborBaseDecoder
+    {
+    public:
+        TestCborDecoder(const std::vector<uint8_t>& bytes)
+            : CborBaseDecoder(), bytes_(bytes) {}
+
+    protected:
+        virtual unsigned readBytes(uint8_t* p, std::ptrdiff_t n_bytes)
+        {
+            if ( bytes_.empty() )
+                throw cbor_end_of_input();
+
+            std::ptrdiff_t res = bytes_.size();
+            if ( res > n_bytes )
+                res = n_bytes;
+            for ( std::ptrdiff_t i = 0; i < res; ++i )
+                *p++ = bytes_[i];
+            bytes_.erase(bytes_.begin(), bytes_.begin() + res);
+            return res;
+        }
+
+    private:
+        std::vector<uint8_t> bytes_;
+    };
+
+    byte_string item(unsigned i)
+    {
+        return to_byte_string("item" + std::to_string(i));
+    }
+}
+
+SCENARIO("Bloom filters contain items added", "[bloom]")
+{
+    GIVEN("A filter with items added")
+    {
+        BloomFilter bf(1000, 10);
+        for ( unsigned i = 0; i < 1000; ++i )
+            bf.add(item(i));
+
+        THEN("all added items may be present")
+        {
+            for ( unsigned i = 0; i < 1000; ++i )
+                REQUIRE(bf.may_contain(item(i)));
+        }
+
+        THEN("few other items may be present")
+        {
+            unsigned false_positives = 0;
+            for ( unsigned i = 1000; i < 11000; ++i )
+                if ( bf.may_contain(item(i)) )
+                    ++false_positives;
+            // Expect around 1%.
+            REQUIRE(false_positives < 300);
+        }
+    }
+
+    GIVEN("Empty filters")
+    {
+        BloomFilter bf;
+        BloomFilter bf_sized(0, 10);
+
+        THEN("they contain nothing")
+        {
+            REQUIRE(bf.empty());
+            REQUIRE(!bf.may_contain(item(0)));
+            REQUIRE(!bf_sized.empty());
+            REQUIRE(!bf_sized.may_contain(item(0)));
+        }
+    }
+}
+
+SCENARIO("Bloom filters can be written and read", "[bloom]")
+{
+    GIVEN("A small filter")
+    {
+        BloomFilter bf(1, 10);
+        bf.add("a"_b);
+
+        WHEN("the filter is written")
+        {
+            TestCborEncoder tcbe;
+            bf.writeCbor(tcbe);
+            tcbe.flush();
+
+            THEN("the encoding is independent of the platform")
+            {
+                const std::vector<uint8_t> expected = {
+                    (4 << 5) | 2,
+                    7,
+                    (2 << 5) | 8,
+                    0x04, 0x10, 0x40, 0x20, 0x80, 0x00, 0x02, 0x01
+                };
+                REQUIRE(tcbe.get_bytes() == expected);
+            }
+
+            AND_WHEN("the filter is read back")
+            {
+                TestCborDecoder tcbd(tcbe.get_bytes());
+                BloomFilter bf_r;
+                bf_r.readCbor(tcbd);
+
+                THEN("it contains the same items")
+                {
+                    REQUIRE(bf_r.may_contain("a"_b));
+                    REQUIRE(!bf_r.may_contain("b"_b));
+                }
+            }
+        }
+    }
+}
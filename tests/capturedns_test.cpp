@@ -312,3 +312,83 @@ SCENARIO("DNS messages with EDNS0 options", "[dnspacket]")
         }
     }
 }
+
+SCENARIO("Parsing DNS names", "[dnspacket]")
+{
+    GIVEN("A sample query with an uncompressed name")
+    {
+        std::vector<uint8_t> QUERY
+            { 0x66,0x92,0x01,0x00,0x00,0x01,0x00,0x00,
+              0x00,0x00,0x00,0x00,0x04,0x73,0x65,0x63,
+              0x32,0x05,0x61,0x70,0x6e,0x69,0x63,0x03,
+              0x63,0x6f,0x6d,0x00,0x00,0x01,0x00,0x01
+            };
+        CaptureDNS msg(QUERY.data(), QUERY.size());
+
+        THEN("Name is read correctly")
+        {
+            REQUIRE(msg.questions_count() == 1);
+            REQUIRE(msg.queries().front().dname().as_byte_string() == CaptureDNS::encode_domain_name("sec2.apnic.com"));
+            REQUIRE(msg.queries().front().query_type() == CaptureDNS::A);
+            REQUIRE(msg.trailing_data_size() == 0);
+        }
+    }
+
+    GIVEN("A sample response with compressed and uncompressed names")
+    {
+        std::vector<uint8_t> RESPONSE
+            { 0x66,0x92,0x80,0x00,0x00,0x01,0x00,0x00,
+              0x00,0x02,0x00,0x00,0x04,0x73,0x65,0x63,
+              0x32,0x05,0x61,0x70,0x6e,0x69,0x63,0x03,
+              0x6e,0x65,0x74,0x00,0x00,0x01,0x00,0x01,
+              0xc0,0x17,0x00,0x02,0x00,0x01,0x00,0x02,
+              0xa3,0x00,0x00,0x11,0x01,0x61,0x0c,0x67,
+              0x74,0x6c,0x64,0x2d,0x73,0x65,0x72,0x76,
+              0x65,0x72,0x73,0xc0,0x17,0xc0,0x17,0x00,
+              0x02,0x00,0x01,0x00,0x02,0xa3,0x00,0x00,
+              0x04,0x01,0x62,0xc0,0x2e
+            };
+        CaptureDNS msg(RESPONSE.data(), RESPONSE.size());
+
+        THEN("All names are expanded")
+        {
+            REQUIRE(msg.queries().front().dname().as_byte_string() == CaptureDNS::encode_domain_name("sec2.apnic.net"));
+            REQUIRE(msg.authority_count() == 2);
+            auto it = msg.authority().begin();
+            REQUIRE(it->dname().as_byte_string() == CaptureDNS::encode_domain_name("net"));
+            REQUIRE(it->data() == CaptureDNS::encode_domain_name("a.gtld-servers.net"));
+            ++it;
+            REQUIRE(it->dname().as_byte_string() == CaptureDNS::encode_domain_name("net"));
+            REQUIRE(it->data() == CaptureDNS::encode_domain_name("b.gtld-servers.net"));
+        }
+    }
+
+    GIVEN("A query with a truncated name")
+    {
+        std::vector<uint8_t> QUERY
+            { 0x66,0x92,0x01,0x00,0x00,0x01,0x00,0x00,
+              0x00,0x00,0x00,0x00,0x04,0x73,0x65,0x63,
+              0x32,0x05,0x61,0x70,0x6e
+            };
+
+        THEN("Parsing fails")
+        {
+            REQUIRE_THROWS_AS(CaptureDNS(QUERY.data(), QUERY.size()), Tins::malformed_packet);
+        }
+    }
+
+    GIVEN("A query whose header claims more records than can fit")
+    {
+        std::vector<uint8_t> QUERY
+            { 0x66,0x92,0x01,0x00,0x00,0x01,0x00,0x01,
+              0x00,0x00,0x00,0x00,0x04,0x73,0x65,0x63,
+              0x32,0x05,0x61,0x70,0x6e,0x69,0x63,0x03,
+              0x63,0x6f,0x6d,0x00,0x00,0x01,0x00,0x01
+            };
+
+        THEN("Parsing fails")
+        {
+            REQUIRE_THROWS_AS(CaptureDNS(QUERY.data(), QUERY.size()), Tins::malformed_packet);
+        }
+    }
+}
@@ -10,6 +10,7 @@
  * Developed by Sinodun IT (www.sinodun.com)
  */
 
+#include <memory>
 #include <string>
 
 #include "catch.hpp"
@@ -101,5 +102,51 @@ SCENARIO("Channels can have data added, removed and closed", "[channel]")
                 REQUIRE(!int_chan.put(7, false));
             }
         }
+
+        WHEN("data is sent down and removed from the channel")
+        {
+            THEN("channel reports size and high watermark")
+            {
+                int i;
+
+                REQUIRE(int_chan.size() == 0);
+                REQUIRE(int_chan.high_watermark() == 0);
+                REQUIRE(int_chan.put(1, false));
+                REQUIRE(int_chan.put(2, false));
+                REQUIRE(int_chan.put(3, false));
+                REQUIRE(int_chan.get(i, false));
+                REQUIRE(int_chan.get(i, false));
+                REQUIRE(int_chan.size() == 1);
+                REQUIRE(int_chan.high_watermark() == 3);
+                REQUIRE(int_chan.put(4, false));
+                REQUIRE(int_chan.size() == 2);
+                REQUIRE(int_chan.high_watermark() == 3);
+            }
+        }
+    }
+}
+
+SCENARIO("Channels can carry move-only data", "[channel]")
+{
+    GIVEN("A channel of unique pointers")
+    {
+        Channel<std::unique_ptr<int>> chan(2);
+
+        WHEN("data is moved into the channel")
+        {
+            std::unique_ptr<int> p(new int(42));
+            int* raw = p.get();
+            REQUIRE(chan.put(std::move(p), false));
+
+            THEN("the same data is moved out")
+            {
+                std::unique_ptr<int> out;
+
+                REQUIRE(!p);
+                REQUIRE(chan.get(out, false));
+                REQUIRE(out.get() == raw);
+                REQUIRE(*out == 42);
+            }
+        }
     }
 }
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <string>
+
+#include "catch.hpp"
+
+#include "clientsampler.hpp"
+
+namespace {
+    IPAddress ipv4_client(unsigned i)
+    {
+        return IPAddress(std::to_string(10 + i / 65536) + "." +
+                         std::to_string(i / 256 % 256) + "." +
+                         std::to_string(i % 256) + ".1");
+    }
+
+    unsigned count_kept(const ClientSampler& sampler, unsigned clients)
+    {
+        unsigned res = 0;
+        for ( unsigned i = 0; i < clients; ++i )
+            if ( sampler.keep_client(ipv4_client(i)) )
+                ++res;
+        return res;
+    }
+}
+
+SCENARIO("ClientSampler keeps a fraction of clients", "[sampler]")
+{
+    GIVEN("A sampler keeping all clients")
+    {
+        ClientSampler sampler(1, 32, 128, "");
+
+        THEN("all clients are kept")
+        {
+            REQUIRE(!sampler.sampling());
+            REQUIRE(sampler.parts_per_million() == ClientSampler::PARTS);
+            REQUIRE(count_kept(sampler, 1000) == 1000);
+        }
+    }
+
+    GIVEN("A sampler keeping a tenth of clients")
+    {
+        ClientSampler sampler(0.1, 32, 128, "secret");
+
+        THEN("about a tenth of clients are kept")
+        {
+            REQUIRE(sampler.sampling());
+            REQUIRE(sampler.parts_per_million() == 100000);
+            unsigned kept = count_kept(sampler, 100000);
+            REQUIRE(kept > 9500);
+            REQUIRE(kept < 10500);
+        }
+
+        THEN("the decision is the same for the same client and key")
+        {
+            ClientSampler same(0.1, 32, 128, "secret");
+            for ( unsigned i = 0; i < 1000; ++i )
+                REQUIRE(sampler.keep_client(ipv4_client(i)) == same.keep_client(ipv4_client(i)));
+        }
+
+        THEN("a different key keeps different clients")
+        {
+            ClientSampler other(0.1, 32, 128, "other secret");
+            unsigned differ = 0;
+            for ( unsigned i = 0; i < 1000; ++i )
+                if ( sampler.keep_client(ipv4_client(i)) != other.keep_client(ipv4_client(i)) )
+                    ++differ;
+            REQUIRE(differ > 100);
+        }
+    }
+
+    GIVEN("A sampler keeping half of clients")
+    {
+        ClientSampler sampler(0.5, 32, 128, "secret");
+
+        THEN("keeping a percentage of sampled clients keeps nested sets")
+        {
+            unsigned kept50 = 0;
+            for ( unsigned i = 0; i < 10000; ++i )
+            {
+                IPAddress client = ipv4_client(i);
+                if ( sampler.keep_client(client, 10) )
+                    REQUIRE(sampler.keep_client(client, 50));
+                if ( sampler.keep_client(client, 50) )
+                {
+                    REQUIRE(sampler.keep_client(client));
+                    ++kept50;
+                }
+                REQUIRE(sampler.keep_client(client, 100) == sampler.keep_client(client));
+            }
+            REQUIRE(kept50 > 2300);
+            REQUIRE(kept50 < 2700);
+        }
+    }
+
+    GIVEN("A sampler grouping clients by network")
+    {
+        ClientSampler sampler(0.5, 24, 48, "");
+
+        THEN("clients in the same network are kept or dropped together")
+        {
+            for ( unsigned i = 0; i < 100; ++i )
+            {
+                std::string net = "10.1." + std::to_string(i) + ".";
+                bool keep = sampler.keep_client(IPAddress(net + "1"));
+                REQUIRE(sampler.keep_client(IPAddress(net + "200")) == keep);
+
+                std::string net6 = "2001:db8:" + std::to_string(i) + "::";
+                bool keep6 = sampler.keep_client(IPAddress(net6 + "1"));
+                REQUIRE(sampler.keep_client(IPAddress(net6 + "1:2:3:4")) == keep6);
+            }
+        }
+    }
+
+    GIVEN("Some sample fractions")
+    {
+        THEN("they convert to parts per million")
+        {
+            REQUIRE(ClientSampler::parts_per_million(0.25) == 250000);
+            REQUIRE(ClientSampler::parts_per_million(0.000001) == 1);
+            REQUIRE(ClientSampler::parts_per_million(0.0000001) == 0);
+            REQUIRE(ClientSampler::parts_per_million(2) == ClientSampler::PARTS);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "blockcbordata.hpp"
+#include "capturedns.hpp"
+
+#include "dnsname.hpp"
+
+SCENARIO("DNS names hold short and long names", "[dnsname]")
+{
+    GIVEN("A short name and a long name")
+    {
+        byte_string short_str = CaptureDNS::encode_domain_name("www.example.com");
+        byte_string long_str = CaptureDNS::encode_domain_name(
+            "a-rather-long-label-for-a-cdn-host.eu-west-1.example.cloudprovider.com");
+        REQUIRE(short_str.size() <= DNSName::INLINE_CAPACITY);
+        REQUIRE(long_str.size() > DNSName::INLINE_CAPACITY);
+
+        DNSName short_name(short_str);
+        DNSName long_name(long_str);
+
+        THEN("they hold the name data")
+        {
+            REQUIRE(short_name.as_byte_string() == short_str);
+            REQUIRE(long_name.as_byte_string() == long_str);
+            REQUIRE(short_name.size() == short_str.size());
+            REQUIRE(long_name[1] == 'a');
+            REQUIRE(CaptureDNS::decode_domain_name(short_name) == "www.example.com");
+        }
+
+        THEN("they compare correctly")
+        {
+            REQUIRE(short_name == DNSName(short_str));
+            REQUIRE(long_name == DNSName(long_str));
+            REQUIRE(short_name != long_name);
+            REQUIRE(hash_value(short_name) == hash_value(DNSName(short_str)));
+            REQUIRE(short_name < long_name);
+            REQUIRE(!(long_name < short_name));
+            REQUIRE(!(short_name < short_name));
+            REQUIRE(DNSName() < short_name);
+            REQUIRE(DNSName().empty());
+        }
+
+        WHEN("they are copied and assigned")
+        {
+            DNSName n1(short_name);
+            DNSName n2(long_name);
+            n1 = long_name;
+            n2 = short_name;
+
+            THEN("the values are exchanged")
+            {
+                REQUIRE(n1 == long_name);
+                REQUIRE(n2 == short_name);
+                REQUIRE(n1.as_byte_string() == long_str);
+                REQUIRE(n2.as_byte_string() == short_str);
+            }
+        }
+
+        WHEN("they are moved")
+        {
+            DNSName n1(std::move(short_name));
+            DNSName n2;
+            n2 = std::move(long_name);
+
+            THEN("the values move and the originals are empty")
+            {
+                REQUIRE(n1.as_byte_string() == short_str);
+                REQUIRE(n2.as_byte_string() == long_str);
+                REQUIRE(short_name.empty());
+                REQUIRE(long_name.empty());
+                REQUIRE(short_name == DNSName());
+            }
+        }
+    }
+}
+
+TEST_CASE("DNS name block table", "[.benchmark]")
+{
+    // Names with a typical spread of lengths.
+    const unsigned NNAMES = 100000;
+    const unsigned NREPS = 10;
+    const char* suffixes[] = {
+        ".example.com", ".a.example.net", ".cdn.example.org",
+        ".eu-west-1.compute.example-cloud.com",
+    };
+    std::vector<byte_string> names;
+    unsigned ninline = 0;
+    for ( unsigned i = 0; i < NNAMES; ++i )
+    {
+        names.push_back(CaptureDNS::encode_domain_name(
+                            "host" + std::to_string(i) + suffixes[i % 4]));
+        if ( names.back().size() <= DNSName::INLINE_CAPACITY )
+            ++ninline;
+    }
+
+    std::size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( unsigned rep = 0; rep < NREPS; ++rep )
+    {
+        block_cbor::BlockData cd;
+        for ( const auto& n : names )
+        {
+            // As captured: build the name, then add it to the
+            // block table as query and response.
+            DNSName name(n.data(), n.size());
+            found += cd.add_name_rdata(name);
+            found += cd.add_name_rdata(name);
+        }
+    }
+    auto finished = std::chrono::steady_clock::now();
+
+    REQUIRE(found > 0);
+    std::cout << "Tabulate " << NNAMES * NREPS << " names, "
+              << 100 * ninline / NNAMES << "% inline: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(finished - start).count() << "ms\n";
+}
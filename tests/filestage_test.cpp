@@ -0,0 +1,166 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "catch.hpp"
+
+#include "filestage.hpp"
+#include "streamwriter.hpp"
+
+namespace {
+    std::string temp_dir()
+    {
+        char name[] = "/tmp/filestage-test-XXXXXX";
+        REQUIRE(mkdtemp(name) != nullptr);
+        return name;
+    }
+
+    std::vector<uint8_t> read_file(const std::string& name)
+    {
+        std::ifstream ifs(name, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs),
+                                    std::istreambuf_iterator<char>());
+    }
+
+    unsigned count_files(const std::string& dir)
+    {
+        unsigned res = 0;
+        for ( boost::filesystem::directory_iterator i(dir), end; i != end; ++i )
+            ++res;
+        return res;
+    }
+
+    void write_file(const std::string& name, const std::vector<uint8_t>& data)
+    {
+        StreamWriter w(name, 0);
+        w.writeBytes(data.data(), static_cast<std::ptrdiff_t>(data.size()));
+    }
+}
+
+SCENARIO("FileStage prepares and finishes files", "[filestage]")
+{
+    GIVEN("A file stage and an empty directory")
+    {
+        std::string dir = temp_dir();
+
+        {
+            FileStage stage;
+
+            WHEN("a file is taken before any are prepared")
+            {
+                THEN("none is available")
+                {
+                    REQUIRE(stage.take(dir + "/a.tmp") == -1);
+                }
+            }
+
+            WHEN("a file is taken after one is prepared")
+            {
+                REQUIRE(stage.take(dir + "/a.tmp") == -1);
+
+                // Finishing a file happens after the preparation
+                // queued by the take.
+                int fd = open((dir + "/a.tmp").c_str(), O_WRONLY | O_CREAT, 0666);
+                REQUIRE(fd != -1);
+                stage.finish(fd, 0, dir + "/a.tmp", dir + "/a");
+                stage.wait_for(dir + "/a");
+                boost::filesystem::remove(dir + "/a");
+                fd = stage.take(dir + "/b.tmp");
+
+                THEN("a file is available, and finished under its final name")
+                {
+                    REQUIRE(fd != -1);
+                    REQUIRE(write(fd, "hello", 5) == 5);
+                    stage.finish(fd, 5, dir + "/b.tmp", dir + "/b");
+                    stage.wait_for(dir + "/b");
+                    REQUIRE(read_file(dir + "/b") == std::vector<uint8_t>({ 'h', 'e', 'l', 'l', 'o' }));
+                    REQUIRE(!boost::filesystem::exists(dir + "/b.tmp"));
+                }
+            }
+
+            WHEN("a taken file is removed")
+            {
+                REQUIRE(stage.take(dir + "/a.tmp") == -1);
+                int fd = open((dir + "/a.tmp").c_str(), O_WRONLY | O_CREAT, 0666);
+                REQUIRE(fd != -1);
+                stage.finish(fd, 0, dir + "/a.tmp", dir + "/a");
+                stage.wait_for(dir + "/a");
+                boost::filesystem::remove(dir + "/a");
+                fd = stage.take(dir + "/b.tmp");
+                REQUIRE(fd != -1);
+                close(fd);
+                stage.remove(dir + "/b.tmp");
+                stage.wait_for(dir + "/b.tmp");
+
+                THEN("the file is gone")
+                {
+                    REQUIRE(!boost::filesystem::exists(dir + "/b.tmp"));
+                }
+            }
+        }
+
+        THEN("no spare files are left behind")
+        {
+            REQUIRE(count_files(dir) <= 1);
+        }
+
+        boost::filesystem::remove_all(dir);
+    }
+}
+
+SCENARIO("StreamWriter uses a file stage", "[filestage]")
+{
+    GIVEN("A stream writer file stage")
+    {
+        std::string dir = temp_dir();
+        std::vector<uint8_t> data(100000);
+        for ( std::size_t i = 0; i < data.size(); ++i )
+            data[i] = static_cast<uint8_t>(i * 13);
+
+        StreamWriter::set_file_stage(std::make_shared<FileStage>());
+
+        WHEN("several files are written and renamed")
+        {
+            for ( unsigned i = 0; i < 5; ++i )
+            {
+                std::string name = dir + "/out" + std::to_string(i);
+                write_file(name + ".raw", data);
+                StreamWriter::rename_file(name + ".raw", name);
+            }
+            for ( unsigned i = 0; i < 5; ++i )
+                StreamWriter::wait_for_file(dir + "/out" + std::to_string(i));
+
+            THEN("each file holds the data under its final name")
+            {
+                for ( unsigned i = 0; i < 5; ++i )
+                    REQUIRE(read_file(dir + "/out" + std::to_string(i)) == data);
+                StreamWriter::set_file_stage(nullptr);
+                REQUIRE(count_files(dir) == 5);
+            }
+        }
+
+        StreamWriter::set_file_stage(nullptr);
+        boost::filesystem::remove_all(dir);
+    }
+}
@@ -146,3 +146,75 @@ SCENARIO("IPAddress string constructor does the right thing",
         }
     }
 }
+
+SCENARIO("IPAddress keeps IPv4 and IPv4-mapped IPv6 addresses apart",
+         "[ipaddress]")
+{
+    GIVEN("An IPv4 address and its IPv4-mapped IPv6 equivalent")
+    {
+        IPAddress a4("193.0.29.226");
+        IPAddress a4m("::ffff:193.0.29.226");
+        IPAddress a6("2001:67c:64:42:bdcd:34ce:2801:9686");
+
+        THEN("the IPv4-mapped address stays IPv6")
+        {
+            REQUIRE(!a4.is_ipv6());
+            REQUIRE(a4m.is_ipv6());
+            REQUIRE(a4 != a4m);
+            REQUIRE(hash_value(a4) != hash_value(a4m));
+            REQUIRE(a4.asNetworkBinary().size() == 4);
+            REQUIRE(a4m.asNetworkBinary().size() == 16);
+            REQUIRE(static_cast<Tins::IPv4Address>(a4) == Tins::IPv4Address("193.0.29.226"));
+            REQUIRE(static_cast<Tins::IPv6Address>(a4) == Tins::IPv6Address("::ffff:193.0.29.226"));
+            REQUIRE(static_cast<Tins::IPv6Address>(a4m) == Tins::IPv6Address("::ffff:193.0.29.226"));
+        }
+
+        THEN("both round-trip through network binary")
+        {
+            IPAddress r4(a4.asNetworkBinary());
+            IPAddress r4m(a4m.asNetworkBinary());
+            REQUIRE(r4 == a4);
+            REQUIRE(!r4.is_ipv6());
+            REQUIRE(r4m == a4m);
+            REQUIRE(r4m.is_ipv6());
+            REQUIRE(IPAddress(Tins::IPv6Address("::ffff:193.0.29.226")) == a4m);
+        }
+
+        THEN("addresses compare correctly")
+        {
+            IPAddress a4b("193.0.29.227");
+            IPAddress a6b("2001:67c:64:42:bdcd:34ce:2801:9687");
+
+            REQUIRE(a4 != a4b);
+            REQUIRE(a4 < a4b);
+            REQUIRE(!(a4b < a4));
+            REQUIRE(a6 < a6b);
+            REQUIRE(!(a6b < a6));
+            REQUIRE(a4 < a6);
+            REQUIRE(!(a6 < a4));
+            REQUIRE(!(a4 < a4));
+            REQUIRE(a4 < a4m);
+            REQUIRE(!(a4m < a4));
+            REQUIRE(!(a4m < a4m));
+            REQUIRE(a6 != IPAddress(Tins::IPv4Address("193.0.29.226")));
+        }
+
+        THEN("network addresses are found")
+        {
+            REQUIRE(a4.network(24) == IPAddress("193.0.29.0"));
+            REQUIRE(a4.network(32) == a4);
+            REQUIRE(a4.network(0) == IPAddress("0.0.0.0"));
+            REQUIRE(!a4.network(0).is_ipv6());
+            REQUIRE(a6.network(48) == IPAddress("2001:67c:64::"));
+            REQUIRE(a6.network(72) == IPAddress("2001:67c:64:42:bd00::"));
+            REQUIRE(a6.network(128) == a6);
+            REQUIRE(a6.network(0) == IPAddress("::"));
+        }
+
+        THEN("the default address is the unspecified IPv6 address")
+        {
+            REQUIRE(IPAddress().is_ipv6());
+            REQUIRE(IPAddress() == IPAddress("::"));
+        }
+    }
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "ipfragmentreassembler.hpp"
+
+namespace {
+    IPFragmentReassembler::DatagramKey make_key(uint32_t id)
+    {
+        return IPFragmentReassembler::DatagramKey{
+            IPAddress(Tins::IPv4Address("192.168.1.2")),
+            IPAddress(Tins::IPv4Address("192.168.1.1")),
+            id };
+    }
+
+    std::vector<uint8_t> make_payload(std::size_t len)
+    {
+        std::vector<uint8_t> res(len);
+        for ( std::size_t i = 0; i < len; ++i )
+            res[i] = static_cast<uint8_t>(i);
+        return res;
+    }
+}
+
+SCENARIO("IP fragment reassembler reassembles datagrams", "[fragment]")
+{
+    GIVEN("A reassembler and a datagram payload")
+    {
+        std::chrono::system_clock::time_point t;
+        IPFragmentReassembler r(10, 1024 * 1024, std::chrono::seconds(30));
+        IPFragmentReassembler::DatagramKey key = make_key(1);
+        std::vector<uint8_t> payload = make_payload(100);
+        std::vector<uint8_t> datagram;
+
+        WHEN("fragments arrive in order")
+        {
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(r.datagram_count() == 1);
+            REQUIRE(!r.process(key, 48, true, payload.data() + 48, 32, t, datagram));
+
+            THEN("the last fragment completes the datagram")
+            {
+                REQUIRE(r.process(key, 80, false, payload.data() + 80, 20, t, datagram));
+                REQUIRE(datagram == payload);
+                REQUIRE(r.datagram_count() == 0);
+                REQUIRE(r.memory_used() == 0);
+                REQUIRE(r.reassembled_count() == 1);
+            }
+        }
+
+        WHEN("fragments arrive out of order")
+        {
+            REQUIRE(!r.process(key, 80, false, payload.data() + 80, 20, t, datagram));
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+
+            THEN("the missing middle fragment completes the datagram")
+            {
+                REQUIRE(r.process(key, 48, true, payload.data() + 48, 32, t, datagram));
+                REQUIRE(datagram == payload);
+                REQUIRE(r.reassembled_count() == 1);
+            }
+        }
+
+        WHEN("fragments of different datagrams are interleaved")
+        {
+            IPFragmentReassembler::DatagramKey key2 = make_key(2);
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(key2, 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(r.datagram_count() == 2);
+
+            THEN("each datagram is reassembled")
+            {
+                REQUIRE(r.process(key2, 48, false, payload.data() + 48, 52, t, datagram));
+                REQUIRE(datagram == payload);
+                REQUIRE(r.process(key, 48, false, payload.data() + 48, 52, t, datagram));
+                REQUIRE(datagram == payload);
+                REQUIRE(r.datagram_count() == 0);
+            }
+        }
+
+        WHEN("a fragment is repeated")
+        {
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+
+            THEN("the repeat is ignored")
+            {
+                REQUIRE(r.process(key, 48, false, payload.data() + 48, 52, t, datagram));
+                REQUIRE(datagram == payload);
+                REQUIRE(r.dropped_count() == 0);
+            }
+        }
+
+        WHEN("a fragment overlaps earlier data")
+        {
+            REQUIRE(!r.process(key, 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(key, 40, false, payload.data() + 40, 60, t, datagram));
+
+            THEN("the datagram is dropped")
+            {
+                REQUIRE(r.dropped_count() == 1);
+                REQUIRE(r.datagram_count() == 0);
+                REQUIRE(r.memory_used() == 0);
+            }
+        }
+
+        WHEN("a non-final fragment is not a multiple of 8 bytes")
+        {
+            REQUIRE(!r.process(key, 0, true, payload.data(), 47, t, datagram));
+
+            THEN("the datagram is dropped")
+            {
+                REQUIRE(r.dropped_count() == 1);
+                REQUIRE(r.datagram_count() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("IP fragment reassembler stays within limits", "[fragment]")
+{
+    GIVEN("A datagram payload")
+    {
+        std::chrono::system_clock::time_point t;
+        std::vector<uint8_t> payload = make_payload(100);
+        std::vector<uint8_t> datagram;
+
+        WHEN("a datagram is not completed within the timeout")
+        {
+            IPFragmentReassembler r(10, 1024 * 1024, std::chrono::seconds(30));
+            REQUIRE(!r.process(make_key(1), 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(make_key(2), 0, true, payload.data(), 48,
+                               t + std::chrono::seconds(20), datagram));
+            REQUIRE(!r.process(make_key(1), 48, false, payload.data() + 48, 52,
+                               t + std::chrono::seconds(31), datagram));
+
+            THEN("it is timed out and later fragments start afresh")
+            {
+                REQUIRE(r.timeout_count() == 1);
+                REQUIRE(r.datagram_count() == 2);
+            }
+        }
+
+        WHEN("the datagram limit is reached")
+        {
+            IPFragmentReassembler r(2, 1024 * 1024, std::chrono::seconds(30));
+            REQUIRE(!r.process(make_key(1), 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(make_key(2), 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(make_key(3), 0, true, payload.data(), 48, t, datagram));
+
+            THEN("the oldest datagram is evicted")
+            {
+                REQUIRE(r.evicted_count() == 1);
+                REQUIRE(r.datagram_count() == 2);
+                REQUIRE(r.process(make_key(3), 48, false, payload.data() + 48, 52, t, datagram));
+                REQUIRE(r.process(make_key(2), 48, false, payload.data() + 48, 52, t, datagram));
+                REQUIRE(!r.process(make_key(1), 48, false, payload.data() + 48, 52, t, datagram));
+            }
+        }
+
+        WHEN("the memory budget is exceeded")
+        {
+            IPFragmentReassembler r(10, 2 * (IPFragmentReassembler::DATAGRAM_OVERHEAD + 48),
+                                    std::chrono::seconds(30));
+            REQUIRE(!r.process(make_key(1), 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(!r.process(make_key(2), 0, true, payload.data(), 48, t, datagram));
+            REQUIRE(r.evicted_count() == 0);
+            REQUIRE(!r.process(make_key(3), 0, true, payload.data(), 48, t, datagram));
+
+            THEN("the oldest datagram is evicted")
+            {
+                REQUIRE(r.evicted_count() == 1);
+                REQUIRE(r.datagram_count() == 2);
+                REQUIRE(r.memory_used() <= 2 * (IPFragmentReassembler::DATAGRAM_OVERHEAD + 48));
+            }
+        }
+    }
+}
+
+TEST_CASE("IP fragment reassembler under a fragment flood", "[.benchmark]")
+{
+    const uint32_t NDATAGRAMS = 1000000;
+    const std::size_t MAX_DATAGRAMS = 10000;
+    std::chrono::system_clock::time_point t;
+    IPFragmentReassembler r(MAX_DATAGRAMS, 16 * 1024 * 1024, std::chrono::seconds(30));
+    std::vector<uint8_t> payload = make_payload(1480);
+    std::vector<uint8_t> datagram;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // First fragments of datagrams that never complete.
+    for ( uint32_t i = 0; i < NDATAGRAMS; ++i )
+        r.process(make_key(i), 0, true, payload.data(), payload.size(), t, datagram);
+    std::size_t peak_memory = r.memory_used();
+    auto flooded = std::chrono::steady_clock::now();
+
+    // Complete datagrams arriving during the flood.
+    uint64_t reassembled = 0;
+    for ( uint32_t i = 0; i < NDATAGRAMS; ++i )
+    {
+        IPFragmentReassembler::DatagramKey key = make_key(NDATAGRAMS + i);
+        r.process(key, 0, true, payload.data(), payload.size(), t, datagram);
+        if ( r.process(key, payload.size(), false, payload.data(), 100, t, datagram) )
+            ++reassembled;
+    }
+    auto finished = std::chrono::steady_clock::now();
+
+    REQUIRE(r.datagram_count() <= MAX_DATAGRAMS);
+    REQUIRE(reassembled == NDATAGRAMS);
+
+    std::cout << "Flood of " << NDATAGRAMS << " first fragments: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(flooded - start).count() << "ms\n"
+              << "Reassemble " << NDATAGRAMS << " datagrams during flood: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(finished - flooded).count() << "ms\n"
+              << "Peak memory charged: " << peak_memory / (1024 * 1024) << "MB\n";
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <string>
+
+#include "catch.hpp"
+
+#include "clientsampler.hpp"
+#include "loadshedder.hpp"
+
+SCENARIO("Load is shed in tiers as the channel fills", "[loadshed]")
+{
+    GIVEN("A load shedder with shedding enabled")
+    {
+        LoadShedder shedder(50, 75, 10, ClientSampler(1, 32, 128, ""));
+
+        WHEN("the channel is below the sections fill level")
+        {
+            shedder.set_fill(49, 100);
+
+            THEN("nothing is shed")
+            {
+                REQUIRE(!shedder.shed_sections());
+                REQUIRE(!shedder.sampling());
+                REQUIRE(shedder.sample_percent() == 100);
+            }
+        }
+
+        WHEN("the channel is at the sections fill level")
+        {
+            shedder.set_fill(50, 100);
+
+            THEN("sections are shed but clients are not sampled")
+            {
+                REQUIRE(shedder.shed_sections());
+                REQUIRE(!shedder.sampling());
+            }
+        }
+
+        WHEN("the channel is between the sample fill level and full")
+        {
+            shedder.set_fill(800, 1000);
+
+            THEN("clients are sampled part way to the minimum")
+            {
+                REQUIRE(shedder.shed_sections());
+                REQUIRE(shedder.sampling());
+                REQUIRE(shedder.sample_percent() == 82);
+            }
+        }
+
+        WHEN("the channel is full")
+        {
+            shedder.set_fill(1000, 1000);
+
+            THEN("the minimum percentage of clients is kept")
+            {
+                REQUIRE(shedder.sample_percent() == 10);
+            }
+
+            AND_WHEN("the channel empties")
+            {
+                shedder.set_fill(0, 1000);
+
+                THEN("nothing is shed")
+                {
+                    REQUIRE(!shedder.shed_sections());
+                    REQUIRE(shedder.sample_percent() == 100);
+                }
+            }
+        }
+
+        WHEN("the channel has no maximum size")
+        {
+            shedder.set_fill(1000000, 0);
+
+            THEN("nothing is shed")
+            {
+                REQUIRE(!shedder.shed_sections());
+                REQUIRE(!shedder.sampling());
+            }
+        }
+    }
+}
+
+SCENARIO("Load is not shed with the default fill levels", "[loadshed]")
+{
+    GIVEN("A load shedder with shedding disabled")
+    {
+        LoadShedder shedder(100, 100, 10, ClientSampler(1, 32, 128, ""));
+
+        WHEN("the channel is full")
+        {
+            shedder.set_fill(1000, 1000);
+
+            THEN("nothing is shed")
+            {
+                REQUIRE(!shedder.shed_sections());
+                REQUIRE(!shedder.sampling());
+                REQUIRE(shedder.sample_percent() == 100);
+            }
+        }
+    }
+}
+
+SCENARIO("Client sampling is consistent", "[loadshed]")
+{
+    GIVEN("A load shedder with the channel full")
+    {
+        LoadShedder shedder(50, 75, 10, ClientSampler(1, 32, 128, ""));
+        shedder.set_fill(100, 100);
+
+        WHEN("the same client is checked repeatedly")
+        {
+            IPAddress client(std::string("192.0.2.1"));
+            bool keep = shedder.keep_client(client);
+
+            THEN("the decision does not change")
+            {
+                for ( int i = 0; i < 10; ++i )
+                    REQUIRE(shedder.keep_client(client) == keep);
+            }
+        }
+
+        WHEN("many clients are checked")
+        {
+            unsigned kept = 0;
+            for ( unsigned i = 0; i < 1000; ++i )
+            {
+                std::string addr = "10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256);
+                if ( shedder.keep_client(IPAddress(addr)) )
+                    ++kept;
+            }
+
+            THEN("some but not all are kept")
+            {
+                REQUIRE(kept > 0);
+                REQUIRE(kept < 1000);
+            }
+        }
+    }
+}
+
+SCENARIO("Load shedding samples within the client sample", "[loadshed]")
+{
+    GIVEN("A load shedder with a client sample and the channel full")
+    {
+        ClientSampler sampler(0.5, 32, 128, "secret");
+        LoadShedder shedder(50, 75, 10, sampler);
+        shedder.set_fill(100, 100);
+
+        WHEN("many clients are checked")
+        {
+            unsigned sampled = 0, kept = 0;
+            bool nested = true;
+            for ( unsigned i = 0; i < 100000; ++i )
+            {
+                std::string addr = "10." + std::to_string(i / 65536) + "." +
+                    std::to_string(i / 256 % 256) + "." + std::to_string(i % 256);
+                IPAddress client(addr);
+                if ( sampler.keep_client(client) )
+                    ++sampled;
+                if ( shedder.keep_client(client) )
+                {
+                    ++kept;
+                    if ( !sampler.keep_client(client) )
+                        nested = false;
+                }
+            }
+
+            THEN("the clients kept are the minimum percentage of the sampled clients")
+            {
+                REQUIRE(nested);
+                REQUIRE(kept > sampled / 10 - sampled / 100);
+                REQUIRE(kept < sampled / 10 + sampled / 100);
+            }
+        }
+    }
+}
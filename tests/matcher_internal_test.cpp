@@ -15,9 +15,11 @@
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <iostream>
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "catch.hpp"
 
@@ -228,3 +230,35 @@ SCENARIO("Matcher removes items from queue on posting to sink", "[matcher]")
 
     }
 }
+
+TEST_CASE("LiveQueries key hashing", "[.benchmark]")
+{
+    const unsigned NMSGS = 100000;
+    const unsigned NREPS = 100;
+    std::vector<DNSMessage> msgs(NMSGS);
+    for ( unsigned i = 0; i < NMSGS; ++i )
+    {
+        byte_string client(16, 0);
+        client[0] = 0x20;
+        client[1] = 0x01;
+        for ( unsigned j = 0; j < 4; ++j )
+            client[12 + j] = static_cast<uint8_t>(i >> (8 * j));
+        msgs[i].clientIP = IPAddress(i % 2 ? client : client.substr(12));
+        msgs[i].serverIP = IPAddress(Tins::IPv4Address("192.168.1.3"));
+        msgs[i].clientPort = 1024 + i % 60000;
+        msgs[i].serverPort = 53;
+        msgs[i].tcp = false;
+        msgs[i].dns.id(i);
+    }
+
+    std::size_t h = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( unsigned rep = 0; rep < NREPS; ++rep )
+        for ( const auto& m : msgs )
+            h += LiveQueries::makeKey(m);
+    auto finished = std::chrono::steady_clock::now();
+
+    REQUIRE(h != 0);
+    std::cout << "Make " << NMSGS * NREPS << " matcher keys: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(finished - start).count() << "ms\n";
+}
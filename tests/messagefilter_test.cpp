@@ -0,0 +1,224 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "catch.hpp"
+
+#include "configuration.hpp"
+#include "messagefilter.hpp"
+
+namespace {
+    /**
+     * \brief Make a raw DNS query with a single question.
+     */
+    byte_string make_query(const std::string& qname, unsigned qtype)
+    {
+        byte_string res{ 0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0, 0, 0, 0, 0, 0 };
+        std::string label;
+        for ( auto c : qname + "." )
+        {
+            if ( c == '.' )
+            {
+                if ( !label.empty() )
+                {
+                    res.push_back(static_cast<uint8_t>(label.size()));
+                    res.append(reinterpret_cast<const uint8_t*>(label.data()), label.size());
+                }
+                label.clear();
+            }
+            else
+                label.push_back(c);
+        }
+        res.push_back(0);
+        res.push_back(static_cast<uint8_t>(qtype >> 8));
+        res.push_back(static_cast<uint8_t>(qtype));
+        res.push_back(0);
+        res.push_back(1);
+        return res;
+    }
+
+    void parse_domain(const char* opt, const char* domain)
+    {
+        std::vector<const char*> args = { "compactor", "-c", "/dev/null", opt, domain };
+        Configuration config;
+        config.parse_command_line(static_cast<int>(args.size()), const_cast<char**>(args.data()));
+    }
+
+    bool keep(const MessageFilter& filter, const std::string& qname, unsigned qtype = 1,
+              const IPAddress& server = IPAddress("192.0.2.1"))
+    {
+        byte_string msg = make_query(qname, qtype);
+        return filter.keep(msg.data(), msg.size(), server);
+    }
+}
+
+SCENARIO("MessageFilter filters on query name", "[filter]")
+{
+    GIVEN("A configuration excluding some domains")
+    {
+        Configuration config;
+        config.exclude_qname_suffixes = { "monitor.example.com", "internal." };
+        MessageFilter filter(config);
+
+        THEN("names in the domains are dropped, case insensitively")
+        {
+            REQUIRE(filter.filtering());
+            REQUIRE(!keep(filter, "monitor.example.com"));
+            REQUIRE(!keep(filter, "a.b.MONITOR.Example.COM"));
+            REQUIRE(!keep(filter, "host.internal"));
+            REQUIRE(keep(filter, "example.com"));
+            REQUIRE(keep(filter, "xmonitor.example.com"));
+            REQUIRE(keep(filter, "internal.example.com"));
+            REQUIRE(keep(filter, ""));
+        }
+    }
+
+    GIVEN("A configuration including some domains")
+    {
+        Configuration config;
+        config.include_qname_suffixes = { "example.com", "example.net" };
+        config.exclude_qname_suffixes = { "www.example.com" };
+        MessageFilter filter(config);
+
+        THEN("only names in the included domains and not excluded are kept")
+        {
+            REQUIRE(keep(filter, "example.com"));
+            REQUIRE(keep(filter, "mail.example.net"));
+            REQUIRE(!keep(filter, "www.example.com"));
+            REQUIRE(!keep(filter, "example.org"));
+            REQUIRE(!keep(filter, "com"));
+        }
+
+        THEN("messages without a question are dropped")
+        {
+            byte_string msg{ 0x12, 0x34, 0x81, 0x01, 0, 0, 0, 0, 0, 0, 0, 0 };
+            REQUIRE(!filter.keep(msg.data(), msg.size(), IPAddress("192.0.2.1")));
+        }
+
+        THEN("truncated messages are left to the decoder")
+        {
+            byte_string msg = make_query("example.org", 1);
+            REQUIRE(filter.keep(msg.data(), 8, IPAddress("192.0.2.1")));
+            REQUIRE(filter.keep(msg.data(), 16, IPAddress("192.0.2.1")));
+        }
+    }
+
+    GIVEN("A configuration including the root")
+    {
+        Configuration config;
+        config.include_qname_suffixes = { "." };
+        MessageFilter filter(config);
+
+        THEN("all names are kept")
+        {
+            REQUIRE(keep(filter, "example.com"));
+            REQUIRE(keep(filter, ""));
+        }
+    }
+
+    GIVEN("A configuration excluding many domains")
+    {
+        Configuration config;
+        for ( unsigned i = 0; i < 5000; ++i )
+            config.exclude_qname_suffixes.push_back("zone" + std::to_string(i) + ".example");
+        MessageFilter filter(config);
+
+        THEN("each is matched")
+        {
+            for ( unsigned i = 0; i < 5000; ++i )
+                REQUIRE(!keep(filter, "www.zone" + std::to_string(i) + ".example"));
+            REQUIRE(keep(filter, "www.zone5000.example"));
+            REQUIRE(keep(filter, "example"));
+        }
+    }
+}
+
+SCENARIO("MessageFilter filters on server address and query type", "[filter]")
+{
+    GIVEN("A configuration with server address filters")
+    {
+        Configuration config;
+        config.include_server_addresses = { IPAddress("192.0.2.1"), IPAddress("2001:db8::1") };
+        config.exclude_server_addresses = { IPAddress("2001:db8::1") };
+        MessageFilter filter(config);
+
+        THEN("only included and not excluded servers are kept")
+        {
+            REQUIRE(keep(filter, "example.com", 1, IPAddress("192.0.2.1")));
+            REQUIRE(!keep(filter, "example.com", 1, IPAddress("192.0.2.2")));
+            REQUIRE(!keep(filter, "example.com", 1, IPAddress("2001:db8::1")));
+        }
+    }
+
+    GIVEN("A configuration with query type filters")
+    {
+        Configuration config;
+        config.exclude_qtypes = { 255 };
+        MessageFilter filter(config);
+
+        THEN("excluded types are dropped")
+        {
+            REQUIRE(keep(filter, "example.com", 1));
+            REQUIRE(!keep(filter, "example.com", 255));
+        }
+
+        WHEN("there is also an include list")
+        {
+            config.include_qtypes = { 1, 28 };
+            MessageFilter include_filter(config);
+
+            THEN("only included types are kept")
+            {
+                REQUIRE(keep(include_filter, "example.com", 28));
+                REQUIRE(!keep(include_filter, "example.com", 15));
+            }
+        }
+    }
+
+    GIVEN("A configuration without filters")
+    {
+        Configuration config;
+        MessageFilter filter(config);
+
+        THEN("everything is kept")
+        {
+            REQUIRE(!filter.filtering());
+            REQUIRE(keep(filter, "example.com", 255, IPAddress("192.0.2.9")));
+        }
+    }
+}
+
+SCENARIO("Query name filter domains are checked", "[filter]")
+{
+    GIVEN("Some domains")
+    {
+        THEN("valid domains are accepted")
+        {
+            REQUIRE_NOTHROW(parse_domain("--include-qname-suffix", "example.com"));
+            REQUIRE_NOTHROW(parse_domain("--include-qname-suffix", "example.com."));
+            REQUIRE_NOTHROW(parse_domain("--exclude-qname-suffix", "."));
+        }
+
+        THEN("empty, escaped and malformed domains are rejected")
+        {
+            REQUIRE_THROWS_AS(parse_domain("--exclude-qname-suffix", ""), boost::program_options::error);
+            REQUIRE_THROWS_AS(parse_domain("--include-qname-suffix", "a\\.b.example"), boost::program_options::error);
+            REQUIRE_THROWS_AS(parse_domain("--include-qname-suffix", "a..example"), boost::program_options::error);
+            REQUIRE_THROWS_AS(parse_domain("--include-qname-suffix", ".example"), boost::program_options::error);
+            REQUIRE_THROWS_AS(parse_domain("--include-qname-suffix", std::string(64, 'a').c_str()), boost::program_options::error);
+        }
+    }
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "catch.hpp"
+
+#include "aggregates.hpp"
+#include "blockcbordata.hpp"
+#include "metrics.hpp"
+
+SCENARIO("Latency histograms record values", "[metrics]")
+{
+    GIVEN("Histogram buckets")
+    {
+        WHEN("small values are indexed")
+        {
+            THEN("they get their own bucket")
+            {
+                for ( uint64_t v = 0; v < LatencyHistogram::SUB_BUCKETS; ++v )
+                {
+                    REQUIRE(LatencyHistogram::bucket_index(v) == v);
+                    REQUIRE(LatencyHistogram::bucket_upper_bound(v) == v + 1);
+                }
+            }
+        }
+
+        WHEN("larger values are indexed")
+        {
+            THEN("each value lies within its bucket, to within the precision")
+            {
+                for ( uint64_t v = 8; v < (1ULL << 40); v = v * 3 / 2 + 1 )
+                {
+                    std::size_t i = LatencyHistogram::bucket_index(v);
+                    REQUIRE(i < LatencyHistogram::BUCKETS);
+                    REQUIRE(v < LatencyHistogram::bucket_upper_bound(i));
+                    REQUIRE(v >= LatencyHistogram::bucket_upper_bound(i - 1));
+                    REQUIRE(LatencyHistogram::bucket_upper_bound(i) - v <= v / LatencyHistogram::SUB_BUCKETS + 1);
+                }
+            }
+        }
+
+        WHEN("a huge value is indexed")
+        {
+            THEN("it goes in the top bucket")
+            {
+                REQUIRE(LatencyHistogram::bucket_index(1ULL << 50) == LatencyHistogram::BUCKETS - 1);
+            }
+        }
+    }
+
+    GIVEN("A histogram with some values")
+    {
+        LatencyHistogram h;
+        REQUIRE(h.value_at_quantile(0.5) == 0);
+
+        for ( int i = 1; i <= 1000; ++i )
+            h.record(std::chrono::microseconds(i));
+        h.record(std::chrono::nanoseconds(-5));
+
+        WHEN("the histogram is examined")
+        {
+            THEN("count, sum and quantiles are as expected")
+            {
+                REQUIRE(h.count() == 1001);
+                REQUIRE(h.sum() == 500500000);
+                REQUIRE(h.value_at_quantile(0.0) == 1);
+                REQUIRE(h.value_at_quantile(0.5) >= 500000);
+                REQUIRE(h.value_at_quantile(0.5) <= 500000 * 9 / 8 + 1);
+                REQUIRE(h.value_at_quantile(1.0) >= 1000000);
+                REQUIRE(h.value_at_quantile(1.0) <= 1000000 * 9 / 8 + 1);
+            }
+        }
+
+        WHEN("the histogram is written")
+        {
+            std::ostringstream os;
+            h.write(os, "test_seconds", "stage=\"x\"");
+            std::string out = os.str();
+
+            THEN("cumulative buckets, sum and count are written")
+            {
+                REQUIRE(out.find("test_seconds_bucket{stage=\"x\",le=\"1e-09\"} 1\n") != std::string::npos);
+                REQUIRE(out.find("test_seconds_bucket{stage=\"x\",le=\"+Inf\"} 1001\n") != std::string::npos);
+                REQUIRE(out.find("test_seconds_sum{stage=\"x\"} 0.5005\n") != std::string::npos);
+                REQUIRE(out.find("test_seconds_count{stage=\"x\"} 1001\n") != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("Metrics can be written in Prometheus format", "[metrics]")
+{
+    GIVEN("Some metrics")
+    {
+        Metrics metrics;
+        PacketStatistics stats{};
+        stats.raw_packet_count = 42;
+        stats.output_cbor_drop_count = 3;
+        metrics.set_packet_statistics(stats);
+        metrics.set_matcher_counts(7, 2);
+        metrics.set_reorder_counts(4, 9);
+
+        block_cbor::BlockData bd;
+        bd.add_address(IPAddress(Tins::IPv4Address("192.168.1.1")));
+        bd.add_address(IPAddress(Tins::IPv4Address("192.168.1.2")));
+        metrics.set_block_table_sizes(bd);
+
+        metrics.add_gauge("test_gauge", "a=\"1\"", "A test gauge.", []() { return 5; });
+        metrics.add_gauge("test_gauge", "a=\"2\"", "A test gauge.", []() { return 6; });
+
+        WHEN("metrics are written")
+        {
+            std::ostringstream os;
+            metrics.write(os);
+            std::string out = os.str();
+
+            THEN("the values appear")
+            {
+                REQUIRE(out.find("# TYPE compactor_packets_total counter\ncompactor_packets_total 42\n") != std::string::npos);
+                REQUIRE(out.find("compactor_cbor_dropped_items_total 3\n") != std::string::npos);
+                REQUIRE(out.find("compactor_matcher_in_flight 7\n") != std::string::npos);
+                REQUIRE(out.find("compactor_matcher_unmatched_responses 2\n") != std::string::npos);
+                REQUIRE(out.find("compactor_reorder_held_packets 4\n") != std::string::npos);
+                REQUIRE(out.find("compactor_reorder_held_packets_high_watermark 9\n") != std::string::npos);
+                REQUIRE(out.find("compactor_blocks_written_total 1\n") != std::string::npos);
+                REQUIRE(out.find("compactor_block_table_items{table=\"ip_addresses\"} 2\n") != std::string::npos);
+                REQUIRE(out.find("compactor_stage_latency_seconds_count{stage=\"decode_to_match\"} 0\n") != std::string::npos);
+                REQUIRE(out.find("# TYPE test_gauge gauge\ntest_gauge{a=\"1\"} 5\ntest_gauge{a=\"2\"} 6\n") != std::string::npos);
+            }
+        }
+
+        WHEN("gauges are removed")
+        {
+            metrics.remove_gauges("a=\"1\"");
+            std::ostringstream os;
+            metrics.write(os);
+            std::string out = os.str();
+
+            THEN("only the remaining gauges appear")
+            {
+                REQUIRE(out.find("test_gauge{a=\"1\"}") == std::string::npos);
+                REQUIRE(out.find("test_gauge{a=\"2\"} 6\n") != std::string::npos);
+
+                metrics.remove_gauges("a=\"2\"");
+                std::ostringstream os2;
+                metrics.write(os2);
+                REQUIRE(os2.str().find("test_gauge") == std::string::npos);
+            }
+        }
+
+        WHEN("traffic aggregates are published")
+        {
+            std::ostringstream before;
+            metrics.write(before);
+            REQUIRE(before.str().find("compactor_aggregate_") == std::string::npos);
+
+            std::shared_ptr<Aggregates> agg = std::make_shared<Aggregates>(
+                5, std::chrono::system_clock::time_point(std::chrono::seconds(600)), std::chrono::seconds(60));
+            metrics.set_aggregates(agg);
+            std::ostringstream os;
+            metrics.write(os);
+            std::string out = os.str();
+
+            THEN("the aggregates appear")
+            {
+                REQUIRE(out.find("compactor_aggregate_period_start_seconds 600\n") != std::string::npos);
+                REQUIRE(out.find("compactor_aggregate_query_responses 0\n") != std::string::npos);
+                REQUIRE(out.find("compactor_aggregate_transport_query_responses{transport=\"tcp6\"} 0\n") != std::string::npos);
+                REQUIRE(out.find("compactor_aggregate_response_latency_seconds_count 0\n") != std::string::npos);
+            }
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "catch.hpp"
+
+#include "packetreorderer.hpp"
+
+namespace {
+    std::shared_ptr<PcapItem> make_pcap(unsigned usec, uint8_t id)
+    {
+        Tins::Packet pkt(Tins::RawPDU(&id, 1), std::chrono::microseconds(usec));
+        return std::make_shared<PcapItem>(pkt);
+    }
+
+    uint8_t id(const std::shared_ptr<PcapItem>& pcap)
+    {
+        return static_cast<Tins::RawPDU*>(pcap->pdu.get())->payload()[0];
+    }
+}
+
+SCENARIO("Packets are put in timestamp order", "[reorder]")
+{
+    GIVEN("A reorderer holding packets for 100us")
+    {
+        PacketReorderer reorderer(std::chrono::microseconds(100));
+
+        WHEN("packets from two sources are interleaved")
+        {
+            REQUIRE(reorderer.add(make_pcap(10, 1)));
+            REQUIRE(reorderer.add(make_pcap(30, 3)));
+            REQUIRE(reorderer.add(make_pcap(20, 2)));
+            REQUIRE(reorderer.add(make_pcap(40, 4)));
+
+            THEN("they are held until the hold time has passed")
+            {
+                REQUIRE(reorderer.size() == 4);
+                REQUIRE(!reorderer.next());
+
+                REQUIRE(reorderer.add(make_pcap(125, 5)));
+                std::shared_ptr<PcapItem> p = reorderer.next();
+                REQUIRE(p);
+                REQUIRE(id(p) == 1);
+                p = reorderer.next();
+                REQUIRE(p);
+                REQUIRE(id(p) == 2);
+                REQUIRE(!reorderer.next());
+                REQUIRE(reorderer.size() == 3);
+                REQUIRE(reorderer.high_watermark() == 5);
+            }
+
+            THEN("the current time releases them")
+            {
+                std::chrono::system_clock::time_point now(std::chrono::microseconds(135));
+                for ( uint8_t i = 1; i <= 3; ++i )
+                {
+                    std::shared_ptr<PcapItem> p = reorderer.next(now);
+                    REQUIRE(p);
+                    REQUIRE(id(p) == i);
+                }
+                REQUIRE(!reorderer.next(now));
+            }
+
+            THEN("flushing releases them all in order")
+            {
+                for ( uint8_t i = 1; i <= 4; ++i )
+                {
+                    std::shared_ptr<PcapItem> p = reorderer.flush_next();
+                    REQUIRE(p);
+                    REQUIRE(id(p) == i);
+                }
+                REQUIRE(!reorderer.flush_next());
+                REQUIRE(reorderer.size() == 0);
+            }
+
+            THEN("a packet earlier than one released is late")
+            {
+                reorderer.flush_next();
+                reorderer.flush_next();
+                REQUIRE(!reorderer.add(make_pcap(15, 6)));
+                REQUIRE(reorderer.add(make_pcap(20, 7)));
+                REQUIRE(reorderer.size() == 3);
+            }
+        }
+
+        WHEN("packets have the same timestamp")
+        {
+            REQUIRE(reorderer.add(make_pcap(10, 1)));
+            REQUIRE(reorderer.add(make_pcap(10, 2)));
+            REQUIRE(reorderer.add(make_pcap(10, 3)));
+
+            THEN("they keep their arrival order")
+            {
+                for ( uint8_t i = 1; i <= 3; ++i )
+                    REQUIRE(id(reorderer.flush_next()) == i);
+            }
+        }
+    }
+}
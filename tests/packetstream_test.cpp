@@ -12,6 +12,7 @@
 
 #include <chrono>
 #include <sstream>
+#include <string>
 #include <vector>
 
 #include "bytestring.hpp"
@@ -90,6 +91,114 @@ SCENARIO("PacketStream correctly parses packet", "[parse]")
             oss << *(dns_msgs[0]);
             REQUIRE(oss.str() == expected);
         }
+
+        WHEN("the client is not in the client sample")
+        {
+            Configuration sample_config;
+            sample_config.client_sample = 0;
+            PacketStream sample_stream(sample_config, dns_sink, address_event_sink);
+            std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+            sample_stream.process_packet(pcap);
+
+            THEN("the message is dropped and counted")
+            {
+                PacketStatistics stats{};
+                sample_stream.update_statistics(stats);
+                REQUIRE(dns_msgs.size() == 0);
+                REQUIRE(stats.client_sampled_out_message_count == 1);
+            }
+        }
+
+        WHEN("the packet stream is replaced mid-run")
+        {
+            Configuration sample_config;
+            sample_config.client_sample = 0;
+            PacketStatistics stats{};
+            uint64_t last_count = 0;
+            bool never_down = true;
+
+            for ( int run = 0; run < 3; ++run )
+            {
+                PacketStream sample_stream(sample_config, dns_sink, address_event_sink);
+                for ( int i = 0; i < 2; ++i )
+                {
+                    std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+                    sample_stream.process_packet(pcap);
+                    sample_stream.update_statistics(stats);
+                    sample_stream.update_statistics(stats);
+                    if ( stats.client_sampled_out_message_count < last_count )
+                        never_down = false;
+                    last_count = stats.client_sampled_out_message_count;
+                }
+            }
+
+            THEN("the totals carry on and never go down")
+            {
+                REQUIRE(never_down);
+                REQUIRE(stats.client_sampled_out_message_count == 6);
+            }
+        }
+
+        WHEN("the client sample is changed to keep all clients")
+        {
+            Configuration sample_config;
+            sample_config.client_sample = 0;
+            PacketStream sample_stream(sample_config, dns_sink, address_event_sink);
+            std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+            sample_stream.process_packet(pcap);
+
+            Configuration reload_config;
+            sample_stream.update_selection(reload_config);
+            pcap = std::make_shared<PcapItem>(pkt);
+            sample_stream.process_packet(pcap);
+
+            THEN("only the message after the change is kept")
+            {
+                PacketStatistics stats{};
+                sample_stream.update_statistics(stats);
+                REQUIRE(dns_msgs.size() == 1);
+                REQUIRE(stats.client_sampled_out_message_count == 1);
+            }
+        }
+
+        WHEN("the query name is excluded")
+        {
+            Configuration filter_config;
+            filter_config.exclude_qname_suffixes = { "WKGLOBAL.net" };
+            PacketStream filter_stream(filter_config, dns_sink, address_event_sink);
+            std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+            filter_stream.process_packet(pcap);
+
+            THEN("the message is dropped and counted")
+            {
+                PacketStatistics stats{};
+                filter_stream.update_statistics(stats);
+                REQUIRE(dns_msgs.size() == 0);
+                REQUIRE(stats.filtered_out_message_count == 1);
+            }
+        }
+
+        WHEN("the query name is excluded on reload")
+        {
+            Configuration filter_config;
+            PacketStream filter_stream(filter_config, dns_sink, address_event_sink);
+            std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+            filter_stream.process_packet(pcap);
+
+            Configuration reload_config;
+            reload_config.exclude_qname_suffixes = { "wkglobal.net" };
+            filter_stream.update_selection(reload_config);
+            pcap = std::make_shared<PcapItem>(pkt);
+            filter_stream.process_packet(pcap);
+
+            THEN("only the message before the change is kept")
+            {
+                PacketStatistics stats{};
+                filter_stream.update_statistics(stats);
+                REQUIRE(dns_msgs.size() == 1);
+                REQUIRE(stats.filtered_out_message_count == 1);
+            }
+        }
     }
 
     GIVEN("A fragmented IPv4 query")
@@ -157,6 +266,65 @@ SCENARIO("PacketStream correctly parses packet", "[parse]")
         }
     }
 
+    GIVEN("A fragmented IPv6 query")
+    {
+        const uint8_t msg_raw[] =
+            { 0x60,0xeb,0x69,0x8f,0x3c,0xb4,0x00,0x21,
+              0x59,0x00,0xcf,0xf0,0x86,0xdd,
+              // IPv6 header.
+              0x60,0x00,0x00,0x00,0x00,0x38,0x2c,0x3b,
+              0x20,0x01,0x05,0x78,0x00,0x03,0x11,0x01,
+              0x00,0x00,0x00,0x00,0x00,0xbf,0x00,0x02,
+              0x20,0x01,0x05,0x00,0x00,0x03,0x00,0x00,
+              0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x42,
+              // Fragment header.
+              0x11,0x00,0x00,0x01,0x00,0x00,0x12,0x34,
+              // Fragment body.
+              0xb5,0x2a,0x00,0x35,0x00,0x3a,0xe7,0xec,
+              0x0f,0x93,0x00,0x10,0x00,0x01,0x00,0x00,
+              0x00,0x00,0x00,0x01,0x08,0x72,0x69,0x39,
+              0x35,0x6e,0x73,0x30,0x31,0x08,0x77,0x6b,
+              0x67,0x6c,0x6f,0x62,0x61,0x6c,0x03,0x6e,
+              0x65,0x74,0x00,0x00,0x01,0x00,0x01,0x00 };
+        const uint8_t msg2_raw[] =
+            { 0x60,0xeb,0x69,0x8f,0x3c,0xb4,0x00,0x21,
+              0x59,0x00,0xcf,0xf0,0x86,0xdd,
+              // IPv6 header.
+              0x60,0x00,0x00,0x00,0x00,0x12,0x2c,0x3b,
+              0x20,0x01,0x05,0x78,0x00,0x03,0x11,0x01,
+              0x00,0x00,0x00,0x00,0x00,0xbf,0x00,0x02,
+              0x20,0x01,0x05,0x00,0x00,0x03,0x00,0x00,
+              0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x42,
+              // Fragment header.
+              0x11,0x00,0x00,0x30,0x00,0x00,0x12,0x34,
+              // Fragment body.
+              0x00,0x29,0x10,0x00,0x00,0x00,0x80,0x00,
+              0x00,0x00 };
+        Tins::Packet pkt(Tins::EthernetII(msg_raw, sizeof(msg_raw)),
+                         std::chrono::microseconds(2000000));
+        Tins::Packet pkt2(Tins::EthernetII(msg2_raw, sizeof(msg2_raw)),
+                         std::chrono::microseconds(2000020));
+
+        THEN("First packet is ignored, second generates output")
+        {
+            std::shared_ptr<PcapItem> pcap = std::make_shared<PcapItem>(pkt);
+            std::shared_ptr<PcapItem> pcap2 = std::make_shared<PcapItem>(pkt2);
+
+            pkt_stream.process_packet(pcap);
+            REQUIRE(dns_msgs.size() == 0);
+            pkt_stream.process_packet(pcap2);
+            REQUIRE(dns_msgs.size() == 1);
+            std::ostringstream oss;
+            oss << *(dns_msgs[0]);
+            REQUIRE(oss.str().find("\tTransport: UDP\n") != std::string::npos);
+            REQUIRE(oss.str().find("\tName: ri95ns01.wkglobal.net\n") != std::string::npos);
+
+            PacketStatistics stats{};
+            pkt_stream.update_statistics(stats);
+            REQUIRE(stats.ip_fragment_reassembled_count == 1);
+        }
+    }
+
     GIVEN("A TCP query")
     {
         const uint8_t syn_raw[] =
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "pcapreader.hpp"
+#include "streamwriter.hpp"
+
+namespace {
+    class TestFile
+    {
+    public:
+        TestFile()
+        {
+            char name[] = "/tmp/pcapreader-test-XXXXXX";
+            int fd = mkstemp(name);
+            REQUIRE(fd != -1);
+            close(fd);
+            name_ = name;
+        }
+
+        ~TestFile()
+        {
+            std::remove(name_.c_str());
+        }
+
+        template<typename Writer>
+        void write(const std::vector<uint8_t>& data)
+        {
+            Writer w(name_, 6);
+            w.writeBytes(data.data(), data.size());
+        }
+
+        const std::string& name() const
+        {
+            return name_;
+        }
+
+    private:
+        std::string name_;
+    };
+
+    void put16(std::vector<uint8_t>& v, uint16_t val, bool big_endian = false)
+    {
+        if ( big_endian )
+            v.insert(v.end(), { uint8_t(val >> 8), uint8_t(val) });
+        else
+            v.insert(v.end(), { uint8_t(val), uint8_t(val >> 8) });
+    }
+
+    void put32(std::vector<uint8_t>& v, uint32_t val, bool big_endian = false)
+    {
+        if ( big_endian )
+            v.insert(v.end(), { uint8_t(val >> 24), uint8_t(val >> 16), uint8_t(val >> 8), uint8_t(val) });
+        else
+            v.insert(v.end(), { uint8_t(val), uint8_t(val >> 8), uint8_t(val >> 16), uint8_t(val >> 24) });
+    }
+
+    std::vector<uint8_t> pcap_file(bool big_endian, bool nanosecond)
+    {
+        std::vector<uint8_t> res;
+        put32(res, nanosecond ? 0xa1b23c4d : 0xa1b2c3d4, big_endian);
+        put16(res, 2, big_endian);
+        put16(res, 4, big_endian);
+        put32(res, 0, big_endian);
+        put32(res, 0, big_endian);
+        put32(res, 65535, big_endian);
+        put32(res, DLT_EN10MB, big_endian);
+
+        for ( uint8_t i = 1; i <= 3; ++i )
+        {
+            put32(res, 1000 + i, big_endian);
+            put32(res, nanosecond ? 123456789 : 123456, big_endian);
+            put32(res, i, big_endian);
+            put32(res, 100, big_endian);
+            for ( uint8_t j = 0; j < i; ++j )
+                res.push_back(i);
+        }
+        return res;
+    }
+
+    std::vector<uint8_t> pcapng_file()
+    {
+        std::vector<uint8_t> res;
+
+        // Section header.
+        put32(res, 0x0a0d0d0a);
+        put32(res, 28);
+        put32(res, 0x1a2b3c4d);
+        put16(res, 1);
+        put16(res, 0);
+        put32(res, 0xffffffff);
+        put32(res, 0xffffffff);
+        put32(res, 28);
+
+        // Interface with nanosecond timestamps.
+        put32(res, 1);
+        put32(res, 32);
+        put16(res, DLT_EN10MB);
+        put16(res, 0);
+        put32(res, 0);
+        put16(res, 9);
+        put16(res, 1);
+        res.insert(res.end(), { 9, 0, 0, 0 });
+        put16(res, 0);
+        put16(res, 0);
+        put32(res, 32);
+
+        // Block to be skipped.
+        put32(res, 5);
+        put32(res, 16);
+        put32(res, 0);
+        put32(res, 16);
+
+        // Enhanced packet of 5 bytes, padded.
+        uint64_t ts = 1000 * 1000000000ULL + 123456789;
+        put32(res, 6);
+        put32(res, 40);
+        put32(res, 0);
+        put32(res, ts >> 32);
+        put32(res, ts & 0xffffffff);
+        put32(res, 5);
+        put32(res, 60);
+        res.insert(res.end(), { 1, 2, 3, 4, 5, 0, 0, 0 });
+        put32(res, 40);
+
+        // Simple packet of 4 bytes.
+        put32(res, 3);
+        put32(res, 20);
+        put32(res, 4);
+        res.insert(res.end(), { 6, 7, 8, 9 });
+        put32(res, 20);
+        return res;
+    }
+}
+
+SCENARIO("Classic PCAP files can be read", "[pcapreader]")
+{
+    GIVEN("PCAP files in each byte order and timestamp precision")
+    {
+        for ( bool big_endian : { false, true } )
+            for ( bool nanosecond : { false, true } )
+            {
+                TestFile f;
+                f.write<StreamWriter>(pcap_file(big_endian, nanosecond));
+                PcapReader reader(f.name());
+                PcapRecord rec;
+
+                for ( uint8_t i = 1; i <= 3; ++i )
+                {
+                    REQUIRE(reader.next(rec));
+                    REQUIRE(rec.linktype == DLT_EN10MB);
+                    REQUIRE(rec.hdr.ts.tv_sec == 1000 + i);
+                    REQUIRE(rec.hdr.ts.tv_usec == 123456);
+                    REQUIRE(rec.hdr.caplen == i);
+                    REQUIRE(rec.hdr.len == 100);
+                    REQUIRE(rec.data[0] == i);
+                }
+                REQUIRE(!reader.next(rec));
+            }
+    }
+}
+
+SCENARIO("Compressed PCAP files can be read", "[pcapreader]")
+{
+    GIVEN("PCAP files compressed with xz and gzip")
+    {
+        TestFile xz_file;
+        xz_file.write<XzStreamWriter>(pcap_file(false, false));
+        TestFile gz_file;
+        gz_file.write<GzipStreamWriter>(pcap_file(false, false));
+
+        THEN("the packets are read")
+        {
+            for ( const TestFile* f : { &xz_file, &gz_file } )
+            {
+                PcapReader reader(f->name());
+                PcapRecord rec;
+                for ( uint8_t i = 1; i <= 3; ++i )
+                {
+                    REQUIRE(reader.next(rec));
+                    REQUIRE(rec.hdr.caplen == i);
+                    REQUIRE(rec.data[i - 1] == i);
+                }
+                REQUIRE(!reader.next(rec));
+            }
+        }
+    }
+}
+
+SCENARIO("pcapng files can be read", "[pcapreader]")
+{
+    GIVEN("A pcapng file")
+    {
+        TestFile f;
+        f.write<StreamWriter>(pcapng_file());
+        PcapReader reader(f.name());
+        PcapRecord rec;
+
+        THEN("enhanced and simple packets are read")
+        {
+            REQUIRE(reader.next(rec));
+            REQUIRE(rec.linktype == DLT_EN10MB);
+            REQUIRE(rec.hdr.ts.tv_sec == 1000);
+            REQUIRE(rec.hdr.ts.tv_usec == 123456);
+            REQUIRE(rec.hdr.caplen == 5);
+            REQUIRE(rec.hdr.len == 60);
+            REQUIRE(rec.data[4] == 5);
+
+            REQUIRE(reader.next(rec));
+            REQUIRE(rec.hdr.caplen == 4);
+            REQUIRE(rec.hdr.len == 4);
+            REQUIRE(rec.data[0] == 6);
+
+            REQUIRE(!reader.next(rec));
+        }
+    }
+}
+
+SCENARIO("Bad capture files are reported", "[pcapreader]")
+{
+    GIVEN("A file that is not a capture")
+    {
+        TestFile f;
+        f.write<StreamWriter>({ 'n', 'o', 't', ' ', 'p', 'c', 'a', 'p' });
+
+        THEN("opening it fails")
+        {
+            REQUIRE_THROWS_AS(PcapReader(f.name()), pcap_reader_error);
+        }
+    }
+
+    GIVEN("A truncated PCAP file")
+    {
+        std::vector<uint8_t> data = pcap_file(false, false);
+        data.pop_back();
+        TestFile f;
+        f.write<StreamWriter>(data);
+        PcapReader reader(f.name());
+        PcapRecord rec;
+
+        THEN("reading the last packet fails")
+        {
+            REQUIRE(reader.next(rec));
+            REQUIRE(reader.next(rec));
+            REQUIRE_THROWS_AS(reader.next(rec), pcap_reader_error);
+        }
+    }
+
+    GIVEN("A file that does not exist")
+    {
+        THEN("opening it fails")
+        {
+            REQUIRE_THROWS_AS(PcapReader("/nonexistent/file.pcap"), pcap_reader_error);
+        }
+    }
+}
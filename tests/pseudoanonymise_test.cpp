@@ -110,6 +110,67 @@ SCENARIO("Pseudo-Anonymising IP addresses", "[pseudoanonymise]")
     }
 }
 
+SCENARIO("Pseudo-Anonymising with cache and batches", "[pseudoanonymise]")
+{
+    GIVEN("Pseudo-Anonymising engine with key")
+    {
+        PseudoAnonymise anon("some 16-byte key"_b);
+
+        WHEN("the same address is pseudo-anonymised twice")
+        {
+            IPAddress out1 = anon.address(IPAddress("8.8.8.8"));
+            IPAddress out2 = anon.address(IPAddress("8.8.8.8"));
+
+            THEN("the second lookup is a cache hit with the same result")
+            {
+                REQUIRE(out1 == IPAddress("38.134.79.111"));
+                REQUIRE(out1 == out2);
+                REQUIRE(anon.cache_misses() == 1);
+                REQUIRE(anon.cache_hits() == 1);
+                REQUIRE(anon.cache_hit_rate() == 0.5);
+            }
+        }
+
+        WHEN("a batch of addresses is pseudo-anonymised")
+        {
+            std::vector<IPAddress> addrs
+            {
+                IPAddress("127.0.0.1"),
+                IPAddress("::1"),
+                IPAddress("8.8.8.8"),
+                IPAddress("2001:503:ba3e::2:30"),
+                IPAddress("127.0.0.1"),
+            };
+            anon.addresses(addrs);
+
+            THEN("results match single address pseudo-anonymisation")
+            {
+                REQUIRE(addrs[0] == IPAddress("211.226.57.195"));
+                REQUIRE(addrs[1] == IPAddress("3718:8853:1723:6c88:7e5f:2e60:c79a:2bf"));
+                REQUIRE(addrs[2] == IPAddress("38.134.79.111"));
+                REQUIRE(addrs[3] == IPAddress("64d2:883d:ffb5:dd79:24b:943c:22aa:4ae7"));
+                REQUIRE(addrs[4] == addrs[0]);
+                REQUIRE(anon.cache_misses() == 4);
+                REQUIRE(anon.cache_hits() == 1);
+            }
+        }
+
+        WHEN("the cache is disabled")
+        {
+            anon.set_cache_size(0);
+            anon.address(IPAddress("8.8.8.8"));
+            IPAddress out = anon.address(IPAddress("8.8.8.8"));
+
+            THEN("every lookup is a miss")
+            {
+                REQUIRE(out == IPAddress("38.134.79.111"));
+                REQUIRE(anon.cache_misses() == 2);
+                REQUIRE(anon.cache_hits() == 0);
+            }
+        }
+    }
+}
+
 SCENARIO("Pseudo-Anonymising OPT RDATA", "[pseudoanonymise]")
 {
     GIVEN("OPT RDATA with ECS option")
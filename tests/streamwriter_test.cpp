@@ -0,0 +1,96 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "catch.hpp"
+
+#include "streamwriter.hpp"
+
+namespace {
+    std::string temp_name()
+    {
+        char name[] = "/tmp/streamwriter-test-XXXXXX";
+        int fd = mkstemp(name);
+        REQUIRE(fd != -1);
+        close(fd);
+        return name;
+    }
+
+    std::vector<uint8_t> read_file(const std::string& name)
+    {
+        std::ifstream ifs(name, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs),
+                                    std::istreambuf_iterator<char>());
+    }
+
+    std::vector<uint8_t> test_data()
+    {
+        // Several times the asynchronous buffer size, and not a
+        // multiple of it.
+        std::vector<uint8_t> res(1024 * 1024 + 12345);
+        for ( std::size_t i = 0; i < res.size(); ++i )
+            res[i] = static_cast<uint8_t>(i * 7 + i / 251);
+        return res;
+    }
+
+    void write_in_pieces(StreamWriter& w, const std::vector<uint8_t>& data)
+    {
+        // Mix tiny writes with writes larger than a buffer.
+        std::size_t sizes[] = { 1, 100, 4095, 300000, 17, 65536 };
+        std::size_t pos = 0;
+        for ( unsigned i = 0; pos < data.size(); ++i )
+        {
+            std::size_t n = std::min(sizes[i % 6], data.size() - pos);
+            w.writeBytes(data.data() + pos, static_cast<std::ptrdiff_t>(n));
+            pos += n;
+        }
+    }
+}
+
+SCENARIO("StreamWriter writes files synchronously and asynchronously", "[streamwriter]")
+{
+    std::vector<uint8_t> data = test_data();
+
+    for ( unsigned depth : { 0u, 1u, 4u } )
+    {
+        GIVEN("A write queue depth of " + std::to_string(depth))
+        {
+            StreamWriter::set_write_queue_depth(depth);
+            std::string name = temp_name();
+
+            WHEN("data is written in pieces and the writer closed")
+            {
+                {
+                    StreamWriter w(name, 0);
+                    write_in_pieces(w, data);
+                }
+
+                THEN("the file holds the data")
+                {
+                    REQUIRE(read_file(name) == data);
+                }
+            }
+
+            std::remove(name.c_str());
+            StreamWriter::set_write_queue_depth(0);
+        }
+    }
+}
@@ -0,0 +1,314 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+
+#include "tcpdnsreassembler.hpp"
+
+namespace {
+    TCPDNSReassembler::FlowKey make_key(uint32_t client)
+    {
+        return TCPDNSReassembler::FlowKey{
+            IPAddress(Tins::IPv4Address(client)),
+            IPAddress(Tins::IPv4Address("192.168.1.1")),
+            12345, 53 };
+    }
+}
+
+SCENARIO("TCP DNS reassembler finds messages", "[tcp]")
+{
+    GIVEN("A reassembler and a new flow")
+    {
+        std::vector<std::string> msgs;
+        TCPDNSReassembler::MessageSink sink =
+            [&](const uint8_t* msg, std::size_t len)
+            {
+                msgs.emplace_back(reinterpret_cast<const char*>(msg), len);
+            };
+        std::chrono::system_clock::time_point t;
+        TCPDNSReassembler r(10, 1024 * 1024, std::chrono::seconds(60));
+        TCPDNSReassembler::FlowKey key = make_key(1);
+        r.process(key, 999, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+        REQUIRE(r.flow_count() == 1);
+
+        WHEN("complete and partial messages are received")
+        {
+            const uint8_t seg1[] = { 0, 3, 'a', 'b', 'c', 0 };
+            const uint8_t seg2[] = { 4, 'd', 'e' };
+            const uint8_t seg3[] = { 'f', 'g', 0, 1, 'h' };
+            r.process(key, 1000, 0, seg1, sizeof(seg1), t, sink);
+            REQUIRE(msgs.size() == 1);
+            r.process(key, 1006, 0, seg2, sizeof(seg2), t, sink);
+            REQUIRE(msgs.size() == 1);
+            r.process(key, 1009, 0, seg3, sizeof(seg3), t, sink);
+
+            THEN("the messages are found")
+            {
+                REQUIRE(msgs.size() == 3);
+                REQUIRE(msgs[0] == "abc");
+                REQUIRE(msgs[1] == "defg");
+                REQUIRE(msgs[2] == "h");
+                REQUIRE(r.memory_used() == TCPDNSReassembler::FLOW_OVERHEAD);
+            }
+        }
+
+        WHEN("many messages are pipelined in a segment")
+        {
+            std::vector<uint8_t> seg;
+            for ( int i = 0; i < 100; ++i )
+            {
+                seg.push_back(0);
+                seg.push_back(2);
+                seg.push_back('a');
+                seg.push_back('0' + i % 10);
+            }
+            std::vector<const uint8_t*> ptrs;
+            TCPDNSReassembler::MessageSink ptr_sink =
+                [&](const uint8_t* msg, std::size_t)
+                {
+                    ptrs.push_back(msg);
+                };
+            r.process(key, 1000, 0, seg.data(), seg.size(), t, ptr_sink);
+
+            THEN("the messages are passed on in place")
+            {
+                REQUIRE(ptrs.size() == 100);
+                for ( std::size_t i = 0; i < ptrs.size(); ++i )
+                    REQUIRE(ptrs[i] == seg.data() + i * 4 + 2);
+                REQUIRE(r.memory_used() == TCPDNSReassembler::FLOW_OVERHEAD);
+            }
+        }
+
+        WHEN("data is retransmitted")
+        {
+            const uint8_t seg1[] = { 0, 2, 'a' };
+            const uint8_t seg2[] = { 0, 2, 'a', 'b' };
+            r.process(key, 1000, 0, seg1, sizeof(seg1), t, sink);
+            r.process(key, 1000, 0, seg2, sizeof(seg2), t, sink);
+            r.process(key, 1000, 0, seg2, sizeof(seg2), t, sink);
+
+            THEN("the message is found once")
+            {
+                REQUIRE(msgs.size() == 1);
+                REQUIRE(msgs[0] == "ab");
+            }
+        }
+
+        WHEN("data is missing")
+        {
+            const uint8_t seg[] = { 0, 2, 'a', 'b' };
+            r.process(key, 1010, 0, seg, sizeof(seg), t, sink);
+
+            THEN("the flow is abandoned")
+            {
+                REQUIRE(msgs.size() == 0);
+                REQUIRE(r.flow_count() == 0);
+                REQUIRE(r.desync_count() == 1);
+                REQUIRE(r.memory_used() == 0);
+            }
+        }
+
+        WHEN("the flow is finished or reset")
+        {
+            const uint8_t seg[] = { 0, 2, 'a', 'b' };
+            r.process(key, 1000, TCPDNSReassembler::FIN, seg, sizeof(seg), t, sink);
+            r.process(key.reverse(), 5000, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+            REQUIRE(r.flow_count() == 1);
+            r.process(key, 1005, TCPDNSReassembler::RST, nullptr, 0, t, sink);
+
+            THEN("the flows are removed")
+            {
+                REQUIRE(msgs.size() == 1);
+                REQUIRE(r.flow_count() == 0);
+            }
+        }
+
+        WHEN("data for an unknown flow is received")
+        {
+            const uint8_t seg[] = { 0, 2, 'a', 'b' };
+            r.process(make_key(2), 1000, 0, seg, sizeof(seg), t, sink);
+
+            THEN("it is ignored")
+            {
+                REQUIRE(msgs.size() == 0);
+                REQUIRE(r.flow_count() == 1);
+            }
+        }
+    }
+}
+
+SCENARIO("TCP DNS reassembler limits resources", "[tcp]")
+{
+    std::size_t nmsgs = 0;
+    TCPDNSReassembler::MessageSink sink =
+        [&](const uint8_t*, std::size_t)
+        {
+            ++nmsgs;
+        };
+    std::chrono::system_clock::time_point t;
+    const uint8_t partial[] = { 0x10, 0x00, 'a' };
+
+    GIVEN("A reassembler with a flow limit")
+    {
+        TCPDNSReassembler r(3, 1024 * 1024, std::chrono::seconds(60));
+
+        WHEN("more flows are opened")
+        {
+            for ( uint32_t i = 1; i <= 5; ++i )
+                r.process(make_key(i), 0, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+            const uint8_t seg[] = { 0, 1, 'a' };
+            r.process(make_key(1), 1, 0, seg, sizeof(seg), t, sink);
+            r.process(make_key(5), 1, 0, seg, sizeof(seg), t, sink);
+
+            THEN("the least recently used flows are evicted")
+            {
+                REQUIRE(r.flow_count() == 3);
+                REQUIRE(r.lru_evicted_count() == 2);
+                REQUIRE(nmsgs == 1);
+            }
+        }
+    }
+
+    GIVEN("A reassembler with a memory budget")
+    {
+        TCPDNSReassembler r(100, 4 * TCPDNSReassembler::FLOW_OVERHEAD + 0x1000 + 0x800,
+                            std::chrono::seconds(60));
+
+        WHEN("partial messages exceed the budget")
+        {
+            for ( uint32_t i = 1; i <= 3; ++i )
+            {
+                r.process(make_key(i), 0, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+                r.process(make_key(i), 1, 0, partial, sizeof(partial), t, sink);
+            }
+
+            THEN("the least recently used flows are evicted")
+            {
+                REQUIRE(r.flow_count() == 1);
+                REQUIRE(r.memory_evicted_count() == 2);
+                REQUIRE(r.memory_used() == TCPDNSReassembler::FLOW_OVERHEAD + 0x1000);
+            }
+        }
+    }
+
+    GIVEN("A reassembler with idle flows")
+    {
+        TCPDNSReassembler r(100, 1024 * 1024, std::chrono::seconds(60));
+        r.process(make_key(1), 0, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+        r.process(make_key(1), 1, 0, partial, sizeof(partial), t, sink);
+        r.process(make_key(2), 0, TCPDNSReassembler::SYN, nullptr, 0, t + std::chrono::seconds(30), sink);
+
+        WHEN("time passes")
+        {
+            r.process(make_key(3), 0, TCPDNSReassembler::SYN, nullptr, 0, t + std::chrono::seconds(61), sink);
+
+            THEN("idle flows are removed")
+            {
+                REQUIRE(r.flow_count() == 2);
+                REQUIRE(r.timeout_count() == 1);
+                REQUIRE(r.memory_used() == 2 * TCPDNSReassembler::FLOW_OVERHEAD);
+            }
+        }
+    }
+}
+
+TEST_CASE("TCP DNS reassembler with 1M concurrent flows", "[.benchmark]")
+{
+    const uint32_t NFLOWS = 1000000;
+    std::size_t nmsgs = 0;
+    TCPDNSReassembler::MessageSink sink =
+        [&](const uint8_t*, std::size_t)
+        {
+            ++nmsgs;
+        };
+    std::chrono::system_clock::time_point t;
+    TCPDNSReassembler r(NFLOWS, std::size_t(1) << 32, std::chrono::seconds(60));
+
+    uint8_t msg[2 + 64] = { 0, 64 };
+    auto start = std::chrono::steady_clock::now();
+
+    for ( uint32_t i = 0; i < NFLOWS; ++i )
+        r.process(make_key(i), 0, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+    auto opened = std::chrono::steady_clock::now();
+
+    // Every flow has a message split across two segments.
+    for ( uint32_t i = 0; i < NFLOWS; ++i )
+        r.process(make_key(i), 1, 0, msg, 34, t, sink);
+    std::size_t peak_memory = r.memory_used();
+    for ( uint32_t i = 0; i < NFLOWS; ++i )
+        r.process(make_key(i), 35, 0, msg + 34, sizeof(msg) - 34, t, sink);
+    auto finished = std::chrono::steady_clock::now();
+
+    REQUIRE(r.flow_count() == NFLOWS);
+    REQUIRE(nmsgs == NFLOWS);
+    REQUIRE(r.lru_evicted_count() == 0);
+    REQUIRE(r.memory_evicted_count() == 0);
+
+    std::cout << "Open " << NFLOWS << " flows: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(opened - start).count() << "ms\n"
+              << "Reassemble " << NFLOWS << " messages: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(finished - opened).count() << "ms\n"
+              << "Peak memory charged: " << peak_memory / (1024 * 1024) << "MB\n";
+}
+
+TEST_CASE("TCP DNS reassembler with 1000 pipelined queries per segment train", "[.benchmark]")
+{
+    const unsigned NQUERIES = 1000;
+    const unsigned NTRAINS = 1000;
+    const std::size_t MSS = 1460;
+    std::size_t nmsgs = 0;
+    TCPDNSReassembler::MessageSink sink =
+        [&](const uint8_t*, std::size_t)
+        {
+            ++nmsgs;
+        };
+    std::chrono::system_clock::time_point t;
+    TCPDNSReassembler r(10, 1024 * 1024, std::chrono::seconds(60));
+    TCPDNSReassembler::FlowKey key = make_key(1);
+
+    // A train of typical 40 byte queries, sent in MSS sized segments,
+    // so some queries are split between segments.
+    std::vector<uint8_t> train;
+    for ( unsigned i = 0; i < NQUERIES; ++i )
+    {
+        train.push_back(0);
+        train.push_back(40);
+        train.insert(train.end(), 40, static_cast<uint8_t>(i));
+    }
+
+    r.process(key, 0, TCPDNSReassembler::SYN, nullptr, 0, t, sink);
+    uint32_t seq = 1;
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < NTRAINS; ++i )
+        for ( std::size_t pos = 0; pos < train.size(); pos += MSS )
+        {
+            std::size_t len = std::min(MSS, train.size() - pos);
+            r.process(key, seq, 0, train.data() + pos, len, t, sink);
+            seq += len;
+        }
+    auto finished = std::chrono::steady_clock::now();
+
+    REQUIRE(nmsgs == NQUERIES * NTRAINS);
+    REQUIRE(r.flow_count() == 1);
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - start).count();
+    std::cout << "Reassemble " << NTRAINS << " trains of " << NQUERIES << " pipelined queries: "
+              << ns / 1000000 << "ms, "
+              << ns / (NQUERIES * NTRAINS) << "ns per query\n";
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018 Internet Corporation for Assigned Names and Numbers.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/*
+ * Developed by Sinodun IT (www.sinodun.com)
+ */
+
+#include <vector>
+
+#include "catch.hpp"
+
+#include "threadplacement.hpp"
+
+SCENARIO("CPU lists can be parsed", "[threadplacement]")
+{
+    GIVEN("A list of single CPUs")
+    {
+        THEN("the CPUs are returned")
+        {
+            REQUIRE(parse_cpu_list("2") == std::vector<unsigned>({ 2 }));
+            REQUIRE(parse_cpu_list("0,4,8") == std::vector<unsigned>({ 0, 4, 8 }));
+        }
+    }
+
+    GIVEN("A list with ranges")
+    {
+        THEN("the ranges are expanded")
+        {
+            REQUIRE(parse_cpu_list("0-3,8,10-11") == std::vector<unsigned>({ 0, 1, 2, 3, 8, 10, 11 }));
+        }
+    }
+
+    GIVEN("A list out of order and with duplicates")
+    {
+        THEN("the CPUs are sorted and duplicates removed")
+        {
+            REQUIRE(parse_cpu_list("8,2-4,3") == std::vector<unsigned>({ 2, 3, 4, 8 }));
+        }
+    }
+
+    GIVEN("Invalid lists")
+    {
+        THEN("an error is thrown")
+        {
+            REQUIRE_THROWS_AS(parse_cpu_list(""), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("a"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("1,"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list(",1"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("1x"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("3-1"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("1-"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("1 ,2"), cpu_list_error);
+            REQUIRE_THROWS_AS(parse_cpu_list("100000"), cpu_list_error);
+        }
+    }
+}